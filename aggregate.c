@@ -0,0 +1,1163 @@
+#include "tinydb.h"
+#include <math.h>
+
+// Aggregation operators. Without grouping, each batch is folded into the
+// accumulators by a loop specialised for the function and column type, so
+// the per-row work is a load, a compare or add, and a null check. Batches
+// without gaps in their selection take branch-free loops over the whole
+// vectors, which the compiler turns into SIMD code.
+//
+// With GROUP BY, groups live in an open-addressing hash table. When the
+// table reaches its memory budget, rows of groups not already in it are
+// written to spill partitions on temporary pages and aggregated in later
+// passes, one partition at a time.
+//
+// Parallel aggregates run a copy of the input plan per worker thread. Each
+// worker folds its rows into accumulators or a hash table of its own, and
+// the caller's thread merges those partial results when the workers are
+// done.
+
+typedef struct {
+    long long count;
+    long long int_sum;
+    double float_sum;
+    int has_value;
+    value_t best;              // Current MIN or MAX
+} accumulator_t;
+
+typedef struct {
+    aggregate_spec_t specs[MAX_OUTPUT_COLUMNS];
+    accumulator_t accumulators[MAX_OUTPUT_COLUMNS];
+    int done;
+    batch_t batch;
+    operator_t *workers[MAX_PARALLELISM];   // Inputs of a parallel aggregate, one per thread
+    int worker_count;
+    accumulator_t partials[MAX_PARALLELISM][MAX_OUTPUT_COLUMNS];   // Accumulators of each worker
+    parallel_t parallel;
+} aggregate_state_t;
+
+static int aggregate_string_compare(database_t *db, const value_t *a, const value_t *b) {
+    char *a_text = a->is_external ? overflow_read(db, a) : NULL;
+    char *b_text = b->is_external ? overflow_read(db, b) : NULL;
+    int result = strcmp(a_text ? a_text : a->data.str_val, b_text ? b_text : b->data.str_val);
+    free(a_text);
+    free(b_text);
+    return result;
+}
+
+// Folds the selected rows of `vec` into a MIN (cmp <) or MAX (cmp >)
+#define EXTREME_LOOP(values, field, cmp)                                    \
+    for (int k = 0; k < count; k++) {                                       \
+        int row = sel[k];                                                   \
+        if (vec->nulls[row]) continue;                                      \
+        if (!acc->has_value || values[row] cmp acc->best.data.field) {      \
+            acc->best.data.field = values[row];                             \
+            acc->has_value = 1;                                             \
+        }                                                                   \
+    }
+
+// Folds rows 0..count-1 of `vec` into a MIN (cmp <) or MAX (cmp >).
+// `pick` replaces NULLs by the identity so the loop has no branches; for
+// INT it is a bit mask, which the compiler can vectorize.
+#define DENSE_EXTREME_LOOP(type, values, field, identity, cmp, pick)       \
+    {                                                                       \
+        const type *in = values;                                            \
+        type best = identity;                                               \
+        int seen = 0;                                                       \
+        for (int row = 0; row < count; row++) {                             \
+            int keep = nulls[row] == 0;                                     \
+            type v = pick;                                                  \
+            best = v cmp best ? v : best;                                   \
+            seen |= keep;                                                   \
+        }                                                                   \
+        if (seen && (!acc->has_value || best cmp acc->best.data.field)) {   \
+            acc->best.data.field = best;                                    \
+            acc->has_value = 1;                                             \
+        }                                                                   \
+    }
+
+// Kernels for a batch whose selection covers every row, over INT or FLOAT
+static void aggregate_fold_dense(const aggregate_spec_t *spec, accumulator_t *acc, const vector_t *vec,
+                                 int count) {
+    const uint8_t *nulls = vec->nulls;
+    long long valid = 0;
+    
+    switch (spec->fn) {
+        case AGG_SUM:
+        case AGG_AVG:
+            if (vec->type == DATA_TYPE_INT) {
+                const int *ints = vec->ints;
+                long long sum = 0;
+                for (int row = 0; row < count; row++) {
+                    int keep = nulls[row] == 0;
+                    sum += ints[row] & -keep;
+                    valid += keep;
+                }
+                acc->int_sum += sum;
+            } else {
+                const float *floats = vec->floats;
+                double sum = 0;
+                for (int row = 0; row < count; row++) {
+                    int keep = nulls[row] == 0;
+                    sum += keep ? floats[row] : 0.0f;
+                    valid += keep;
+                }
+                acc->float_sum += sum;
+            }
+            acc->count += valid;
+            break;
+        case AGG_MIN:
+            if (vec->type == DATA_TYPE_INT) {
+                DENSE_EXTREME_LOOP(int, vec->ints, int_val, INT32_MAX, <,
+                                   (in[row] & -keep) | (INT32_MAX & (keep - 1)));
+            } else {
+                DENSE_EXTREME_LOOP(float, vec->floats, float_val, INFINITY, <, keep ? in[row] : INFINITY);
+            }
+            break;
+        case AGG_MAX:
+            if (vec->type == DATA_TYPE_INT) {
+                DENSE_EXTREME_LOOP(int, vec->ints, int_val, INT32_MIN, >,
+                                   (in[row] & -keep) | (INT32_MIN & (keep - 1)));
+            } else {
+                DENSE_EXTREME_LOOP(float, vec->floats, float_val, -INFINITY, >, keep ? in[row] : -INFINITY);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void aggregate_fold(operator_t *op, const aggregate_spec_t *spec, accumulator_t *acc,
+                           const batch_t *batch) {
+    const uint16_t *sel = batch->selection;
+    int count = batch->selected_count;
+    
+    if (spec->fn == AGG_COUNT_STAR) {
+        acc->count += count;
+        return;
+    }
+    
+    const vector_t *vec = &batch->columns[spec->column];
+    int sign = spec->fn == AGG_MAX ? -1 : 1;
+    
+    if (count == batch->row_count && vec->type != DATA_TYPE_VARCHAR && spec->fn != AGG_COUNT) {
+        aggregate_fold_dense(spec, acc, vec, count);
+        return;
+    }
+    
+    switch (spec->fn) {
+        case AGG_COUNT:
+            for (int k = 0; k < count; k++) {
+                acc->count += !vec->nulls[sel[k]];
+            }
+            break;
+        case AGG_SUM:
+        case AGG_AVG:
+            if (vec->type == DATA_TYPE_INT) {
+                for (int k = 0; k < count; k++) {
+                    int row = sel[k];
+                    if (vec->nulls[row]) continue;
+                    acc->int_sum += vec->ints[row];
+                    acc->count++;
+                }
+            } else {
+                for (int k = 0; k < count; k++) {
+                    int row = sel[k];
+                    if (vec->nulls[row]) continue;
+                    acc->float_sum += vec->floats[row];
+                    acc->count++;
+                }
+            }
+            break;
+        case AGG_MIN:
+        case AGG_MAX:
+            if (vec->type == DATA_TYPE_INT && spec->fn == AGG_MIN) {
+                EXTREME_LOOP(vec->ints, int_val, <);
+            } else if (vec->type == DATA_TYPE_INT) {
+                EXTREME_LOOP(vec->ints, int_val, >);
+            } else if (vec->type == DATA_TYPE_FLOAT && spec->fn == AGG_MIN) {
+                EXTREME_LOOP(vec->floats, float_val, <);
+            } else if (vec->type == DATA_TYPE_FLOAT) {
+                EXTREME_LOOP(vec->floats, float_val, >);
+            } else {
+                for (int k = 0; k < count; k++) {
+                    int row = sel[k];
+                    if (vec->nulls[row]) continue;
+                    if (!acc->has_value ||
+                        sign * aggregate_string_compare(op->db, &vec->strings[row], &acc->best) < 0) {
+                        acc->best = vec->strings[row];
+                        acc->has_value = 1;
+                    }
+                }
+            }
+            break;
+        case AGG_COUNT_STAR:
+            break;
+    }
+}
+
+// Adds the partial result of a parallel worker to `acc`. `type` is the
+// type of the aggregated column.
+static void aggregate_merge(database_t *db, const aggregate_spec_t *spec, data_type_t type, accumulator_t *acc,
+                            const accumulator_t *partial) {
+    acc->count += partial->count;
+    acc->int_sum += partial->int_sum;
+    acc->float_sum += partial->float_sum;
+    if (!partial->has_value) return;
+    
+    int cmp = 0;
+    if (acc->has_value) {
+        switch (type) {
+            case DATA_TYPE_INT:
+                cmp = (partial->best.data.int_val > acc->best.data.int_val) -
+                      (partial->best.data.int_val < acc->best.data.int_val);
+                break;
+            case DATA_TYPE_FLOAT:
+                cmp = (partial->best.data.float_val > acc->best.data.float_val) -
+                      (partial->best.data.float_val < acc->best.data.float_val);
+                break;
+            case DATA_TYPE_VARCHAR:
+                cmp = aggregate_string_compare(db, &partial->best, &acc->best);
+                break;
+        }
+    }
+    if (!acc->has_value || (spec->fn == AGG_MIN && cmp < 0) || (spec->fn == AGG_MAX && cmp > 0)) {
+        acc->best = partial->best;
+        acc->has_value = 1;
+    }
+}
+
+static void aggregate_result(const aggregate_spec_t *spec, const accumulator_t *acc, data_type_t type,
+                             value_t *value) {
+    memset(value, 0, sizeof(value_t));
+    value->type = type;
+    
+    switch (spec->fn) {
+        case AGG_COUNT_STAR:
+        case AGG_COUNT:
+            value->data.int_val = (int)acc->count;
+            return;
+        case AGG_SUM:
+            if (acc->count == 0) {
+                value->is_null = 1;
+            } else if (type == DATA_TYPE_INT) {
+                value->data.int_val = (int)acc->int_sum;
+            } else {
+                value->data.float_val = (float)acc->float_sum;
+            }
+            return;
+        case AGG_AVG:
+            if (acc->count == 0) {
+                value->is_null = 1;
+            } else {
+                double sum = acc->int_sum + acc->float_sum;
+                value->data.float_val = (float)(sum / acc->count);
+            }
+            return;
+        case AGG_MIN:
+        case AGG_MAX:
+            if (!acc->has_value) {
+                value->is_null = 1;
+            } else {
+                *value = acc->best;
+                value->type = type;
+            }
+            return;
+    }
+}
+
+// Workers are opened in order, so a scan leader in the first one sets up
+// the page source before the others use it
+static int aggregate_open_workers(operator_t **workers, int worker_count) {
+    for (int i = 0; i < worker_count; i++) {
+        if (exec_open(workers[i]) != 0) return -1;
+    }
+    return 0;
+}
+
+static void aggregate_close_workers(operator_t **workers, int worker_count) {
+    for (int i = 0; i < worker_count; i++) {
+        exec_close(workers[i]);
+    }
+}
+
+static int aggregate_open(operator_t *op) {
+    aggregate_state_t *state = op->state;
+    memset(state->accumulators, 0, sizeof(state->accumulators));
+    state->done = 0;
+    if (aggregate_open_workers(state->workers, state->worker_count) != 0) return -1;
+    return batch_init(&state->batch, op->column_count, op->column_types);
+}
+
+// Folds the rows of one worker into its own accumulators
+static int aggregate_run(parallel_t *par, int worker, void *arg) {
+    operator_t *op = arg;
+    aggregate_state_t *state = op->state;
+    batch_t *input;
+    int result;
+    (void)par;
+    
+    while ((result = exec_next(state->workers[worker], &input)) > 0) {
+        for (int i = 0; i < op->column_count; i++) {
+            aggregate_fold(op, &state->specs[i], &state->partials[worker][i], input);
+        }
+    }
+    return result;
+}
+
+// Folds the whole input into the accumulators
+static int aggregate_consume(operator_t *op) {
+    aggregate_state_t *state = op->state;
+    batch_t *input;
+    int result;
+    
+    if (state->worker_count == 0) {
+        while ((result = exec_next(op->child, &input)) > 0) {
+            for (int i = 0; i < op->column_count; i++) {
+                aggregate_fold(op, &state->specs[i], &state->accumulators[i], input);
+            }
+        }
+        return result;
+    }
+    
+    // The workers hand over no batches, so this just waits for them
+    memset(state->partials, 0, sizeof(state->partials));
+    if (parallel_start(&state->parallel, state->worker_count, aggregate_run, op) != 0) return -1;
+    result = parallel_next(&state->parallel, &input);
+    parallel_stop(&state->parallel);
+    if (result < 0) return -1;
+    
+    for (int w = 0; w < state->worker_count; w++) {
+        for (int i = 0; i < op->column_count; i++) {
+            aggregate_merge(op->db, &state->specs[i], op->column_types[i], &state->accumulators[i],
+                            &state->partials[w][i]);
+        }
+    }
+    return 0;
+}
+
+static int aggregate_next(operator_t *op, batch_t **batch) {
+    aggregate_state_t *state = op->state;
+    if (state->done) return 0;
+    
+    if (aggregate_consume(op) < 0) return -1;
+    
+    for (int i = 0; i < op->column_count; i++) {
+        value_t value;
+        aggregate_result(&state->specs[i], &state->accumulators[i], op->column_types[i], &value);
+        batch_set_value(&state->batch, i, 0, &value);
+    }
+    state->batch.row_count = 1;
+    batch_select_all(&state->batch);
+    state->done = 1;
+    
+    *batch = &state->batch;
+    return 1;
+}
+
+static void aggregate_close(operator_t *op) {
+    aggregate_state_t *state = op->state;
+    aggregate_close_workers(state->workers, state->worker_count);
+    batch_free(&state->batch);
+}
+
+static void aggregate_destroy(operator_t *op) {
+    aggregate_state_t *state = op->state;
+    for (int i = 0; i < state->worker_count; i++) {
+        exec_destroy(state->workers[i]);
+    }
+}
+
+static const char *aggregate_names[] = {"COUNT", "COUNT", "SUM", "MIN", "MAX", "AVG"};
+
+// Sets the type and name of output columns first..first+spec_count-1.
+// COUNT is INT, SUM keeps the column type, AVG is FLOAT, and MIN/MAX keep
+// the column type.
+static int aggregate_describe(operator_t *op, const operator_t *child, const aggregate_spec_t *specs,
+                              int spec_count, int first) {
+    for (int i = 0; i < spec_count; i++) {
+        const aggregate_spec_t *spec = &specs[i];
+        int out = first + i;
+        
+        if (spec->fn == AGG_COUNT_STAR) {
+            op->column_types[out] = DATA_TYPE_INT;
+            strcpy(op->column_names[out], "COUNT(*)");
+            continue;
+        }
+        if (spec->column < 0 || spec->column >= child->column_count) return -1;
+        
+        data_type_t type = child->column_types[spec->column];
+        if ((spec->fn == AGG_SUM || spec->fn == AGG_AVG) && type == DATA_TYPE_VARCHAR) {
+            printf("Cannot compute %s of VARCHAR column %s\n", aggregate_names[spec->fn],
+                   child->column_names[spec->column]);
+            return -1;
+        }
+        
+        switch (spec->fn) {
+            case AGG_COUNT:
+                op->column_types[out] = DATA_TYPE_INT;
+                break;
+            case AGG_AVG:
+                op->column_types[out] = DATA_TYPE_FLOAT;
+                break;
+            default:
+                op->column_types[out] = type;
+                break;
+        }
+        snprintf(op->column_names[out], MAX_COLUMN_NAME, "%s(%.*s)", aggregate_names[spec->fn],
+                 MAX_COLUMN_NAME - 8, child->column_names[spec->column]);
+    }
+    return 0;
+}
+
+// Produces a single row with one column per aggregate. Over an empty input
+// COUNT is 0 and the others are NULL.
+operator_t* exec_aggregate_create(operator_t *child, const aggregate_spec_t *specs, int spec_count) {
+    if (!child || spec_count <= 0 || spec_count > MAX_OUTPUT_COLUMNS) return NULL;
+    
+    operator_t *op = exec_operator_create("Aggregate", child->db, child, sizeof(aggregate_state_t));
+    if (!op) return NULL;
+    
+    if (aggregate_describe(op, child, specs, spec_count, 0) != 0) {
+        free(op->state);
+        free(op);
+        return NULL;
+    }
+    
+    aggregate_state_t *state = op->state;
+    memcpy(state->specs, specs, spec_count * sizeof(aggregate_spec_t));
+    op->column_count = spec_count;
+    
+    op->open = aggregate_open;
+    op->next = aggregate_next;
+    op->close = aggregate_close;
+    return op;
+}
+
+// --- Grouped aggregation -------------------------------------------------
+
+#define AGG_SPILL_PARTITIONS 16
+#define AGG_SPILL_BITS 4
+
+typedef struct {
+    page_id_t head;
+    int level;                // Partitioning depth of the rows in the run
+} spill_run_t;
+
+typedef struct {
+    uint64_t hash;
+    int group;                // -1 when the slot is empty
+} group_slot_t;
+
+typedef struct {
+    int group_columns[MAX_OUTPUT_COLUMNS];
+    int group_count;
+    aggregate_spec_t specs[MAX_OUTPUT_COLUMNS];
+    int spec_count;
+    size_t memory_budget;
+    
+    group_slot_t *slots;
+    int slot_capacity;                // Power of two
+    value_t *keys;                    // group_count values per group; codes in int_val where dictionaries[] is set
+    const dictionary_t *dictionaries[MAX_OUTPUT_COLUMNS];   // Per group column whose keys are codes
+    int keyed;                        // dictionaries[] has been chosen
+    const dict_code_t *row_codes[MAX_OUTPUT_COLUMNS];       // Codes of the current batch, by row
+    dict_code_t *codes;               // BATCH_SIZE per group column, for batches holding strings
+    accumulator_t *accumulators;      // spec_count per group
+    int groups;
+    int group_capacity;
+    int emitted;
+    
+    int level;
+    int input_done;
+    spill_partition_t partitions[AGG_SPILL_PARTITIONS];
+    spill_run_t *runs;                // Spilled partitions still to aggregate
+    int run_count;
+    int run_capacity;
+    
+    batch_t input;                    // Rows read back from a spill run
+    batch_t batch;
+    
+    operator_t *workers[MAX_PARALLELISM];   // Per-thread aggregates of a parallel aggregate
+    int worker_count;
+    parallel_t parallel;
+    spill_partition_t overflow;       // Rows the workers' tables had no room for
+} group_state_t;
+
+static size_t group_bytes(const group_state_t *state) {
+    return state->group_count * sizeof(value_t) + state->spec_count * sizeof(accumulator_t) +
+           2 * sizeof(group_slot_t);
+}
+
+static int group_grow_slots(group_state_t *state) {
+    int capacity = state->slot_capacity ? state->slot_capacity * 2 : 64;
+    group_slot_t *slots = malloc(capacity * sizeof(group_slot_t));
+    if (!slots) return -1;
+    
+    for (int i = 0; i < capacity; i++) {
+        slots[i].group = -1;
+    }
+    for (int i = 0; i < state->slot_capacity; i++) {
+        if (state->slots[i].group < 0) continue;
+        int index = (int)(state->slots[i].hash & (capacity - 1));
+        while (slots[index].group >= 0) {
+            index = (index + 1) & (capacity - 1);
+        }
+        slots[index] = state->slots[i];
+    }
+    
+    free(state->slots);
+    state->slots = slots;
+    state->slot_capacity = capacity;
+    return 0;
+}
+
+static int group_grow_groups(group_state_t *state) {
+    int capacity = state->group_capacity ? state->group_capacity * 2 : 64;
+    
+    value_t *keys = realloc(state->keys, (size_t)capacity * (state->group_count ? state->group_count : 1) *
+                                         sizeof(value_t));
+    if (!keys) return -1;
+    state->keys = keys;
+    
+    accumulator_t *accumulators = realloc(state->accumulators,
+                                          (size_t)capacity * state->spec_count * sizeof(accumulator_t));
+    if (!accumulators) return -1;
+    state->accumulators = accumulators;
+    
+    state->group_capacity = capacity;
+    return 0;
+}
+
+// Hashes the group columns of the selected rows into hashes[row]. A group
+// column that the first batch delivers as dictionary codes keeps codes as
+// its keys, which hash and compare as 2-byte integers. Later batches that
+// hold the strings of such a column, like rows read back from a spill, are
+// encoded with the same dictionary, so a group is found whichever way its
+// rows arrive.
+static void group_hash(operator_t *op, const batch_t *batch, uint64_t *hashes) {
+    group_state_t *state = op->state;
+    int plain[MAX_OUTPUT_COLUMNS];
+    int plain_count = 0;
+    
+    if (!state->keyed) {
+        for (int i = 0; i < state->group_count; i++) {
+            state->dictionaries[i] = batch->columns[state->group_columns[i]].dictionary;
+        }
+        state->keyed = 1;
+    }
+    for (int i = 0; i < state->group_count; i++) {
+        if (!state->dictionaries[i]) plain[plain_count++] = state->group_columns[i];
+    }
+    batch_hash(op->db, batch, plain, plain_count, hashes);
+    
+    for (int i = 0; i < state->group_count; i++) {
+        if (!state->dictionaries[i]) continue;
+        
+        const vector_t *vec = &batch->columns[state->group_columns[i]];
+        if (vec->dictionary == state->dictionaries[i]) {
+            state->row_codes[i] = vec->codes;
+        } else {
+            dict_code_t *codes = &state->codes[i * BATCH_SIZE];
+            for (int k = 0; k < batch->selected_count; k++) {
+                int row = batch->selection[k];
+                if (vec->nulls[row]) continue;
+                value_t value;
+                vector_get_value(vec, row, &value);
+                codes[row] = (dict_code_t)dictionary_find(state->dictionaries[i], value.data.str_val);
+            }
+            state->row_codes[i] = codes;
+        }
+        batch_hash_codes(batch, state->row_codes[i], vec->nulls, hashes);
+    }
+}
+
+// The value of key column i of a group. Codes are decoded here, once per
+// group rather than once per row.
+static void group_key(const group_state_t *state, int group, int i, value_t *value) {
+    const value_t *key = &state->keys[group * state->group_count + i];
+    if (!state->dictionaries[i] || key->is_null) {
+        *value = *key;
+        return;
+    }
+    
+    const char *text = dictionary_value(state->dictionaries[i], (dict_code_t)key->data.int_val);
+    memset(value, 0, sizeof(value_t));
+    value->type = DATA_TYPE_VARCHAR;
+    if (text) strcpy(value->data.str_val, text);
+}
+
+// Compares key column i of a group with a row of the batch group_hash()
+// last saw
+static int group_key_equal(operator_t *op, const batch_t *batch, int row, const value_t *keys, int i) {
+    group_state_t *state = op->state;
+    int column = state->group_columns[i];
+    if (!state->dictionaries[i]) return batch_value_equal(op->db, batch, column, row, &keys[i]);
+    
+    int is_null = batch->columns[column].nulls[row];
+    if (keys[i].is_null || is_null) return keys[i].is_null && is_null;
+    return keys[i].data.int_val == state->row_codes[i][row];
+}
+
+// Returns the group of the row, adding it if the memory budget allows.
+// Returns -1 if the row has to be spilled and -2 on error.
+static int group_find(operator_t *op, const batch_t *batch, int row, uint64_t hash) {
+    group_state_t *state = op->state;
+    int mask = state->slot_capacity - 1;
+    int index = (int)(hash & mask);
+    
+    for (; state->slots[index].group >= 0; index = (index + 1) & mask) {
+        if (state->slots[index].hash != hash) continue;
+        
+        int group = state->slots[index].group;
+        const value_t *keys = &state->keys[group * state->group_count];
+        int equal = 1;
+        for (int i = 0; i < state->group_count && equal; i++) {
+            equal = group_key_equal(op, batch, row, keys, i);
+        }
+        if (equal) return group;
+    }
+    
+    // The budget always admits one group, so every pass makes progress
+    if (state->groups > 0 && (state->groups + 1) * group_bytes(state) > state->memory_budget) return -1;
+    
+    if (state->groups == state->group_capacity && group_grow_groups(state) != 0) return -2;
+    if ((state->groups + 1) * 2 > state->slot_capacity) {
+        if (group_grow_slots(state) != 0) return -2;
+        mask = state->slot_capacity - 1;
+        index = (int)(hash & mask);
+        while (state->slots[index].group >= 0) {
+            index = (index + 1) & mask;
+        }
+    }
+    
+    int group = state->groups++;
+    state->slots[index].hash = hash;
+    state->slots[index].group = group;
+    for (int i = 0; i < state->group_count; i++) {
+        value_t *key = &state->keys[group * state->group_count + i];
+        if (!state->dictionaries[i]) {
+            batch_get_value(batch, state->group_columns[i], row, key);
+            continue;
+        }
+        memset(key, 0, sizeof(value_t));
+        key->type = DATA_TYPE_VARCHAR;
+        key->is_null = batch->columns[state->group_columns[i]].nulls[row];
+        if (!key->is_null) key->data.int_val = state->row_codes[i][row];
+    }
+    memset(&state->accumulators[group * state->spec_count], 0, state->spec_count * sizeof(accumulator_t));
+    return group;
+}
+
+static int spill_row(operator_t *op, const batch_t *batch, int row, uint64_t hash) {
+    group_state_t *state = op->state;
+    
+    // Each level partitions on the next bits from the top of the hash; the
+    // table itself uses the low bits
+    int shift = 64 - AGG_SPILL_BITS * (state->level + 1);
+    if (shift < 32) shift = 32;
+    spill_partition_t *partition = &state->partitions[(hash >> shift) & (AGG_SPILL_PARTITIONS - 1)];
+    return spill_append(op->db, partition, batch, row);
+}
+
+// Updates the accumulators of one aggregate for the rows of the batch
+// whose group is known; the function and type dispatch stay outside the
+// row loop
+#define GROUP_LOOP(body)                                                    \
+    for (int k = 0; k < count; k++) {                                       \
+        if (groups[k] < 0) continue;                                        \
+        int row = sel[k];                                                   \
+        accumulator_t *acc = &accumulators[groups[k] * spec_count];         \
+        body;                                                               \
+    }
+
+#define GROUP_EXTREME(values, field, cmp)                                   \
+    GROUP_LOOP(if (!vec->nulls[row] &&                                      \
+                   (!acc->has_value || values[row] cmp acc->best.data.field)) { \
+                   acc->best.data.field = values[row];                      \
+                   acc->has_value = 1;                                      \
+               })
+
+static void group_update(operator_t *op, int spec_index, const batch_t *batch, const int *groups) {
+    group_state_t *state = op->state;
+    const aggregate_spec_t *spec = &state->specs[spec_index];
+    const uint16_t *sel = batch->selection;
+    int count = batch->selected_count;
+    int spec_count = state->spec_count;
+    accumulator_t *accumulators = state->accumulators + spec_index;
+    
+    if (spec->fn == AGG_COUNT_STAR) {
+        GROUP_LOOP((void)row; acc->count++);
+        return;
+    }
+    
+    const vector_t *vec = &batch->columns[spec->column];
+    int sign = spec->fn == AGG_MAX ? -1 : 1;
+    
+    switch (spec->fn) {
+        case AGG_COUNT:
+            GROUP_LOOP(acc->count += !vec->nulls[row]);
+            break;
+        case AGG_SUM:
+        case AGG_AVG:
+            if (vec->type == DATA_TYPE_INT) {
+                GROUP_LOOP(if (!vec->nulls[row]) { acc->int_sum += vec->ints[row]; acc->count++; });
+            } else {
+                GROUP_LOOP(if (!vec->nulls[row]) { acc->float_sum += vec->floats[row]; acc->count++; });
+            }
+            break;
+        case AGG_MIN:
+        case AGG_MAX:
+            if (vec->type == DATA_TYPE_INT && spec->fn == AGG_MIN) {
+                GROUP_EXTREME(vec->ints, int_val, <);
+            } else if (vec->type == DATA_TYPE_INT) {
+                GROUP_EXTREME(vec->ints, int_val, >);
+            } else if (vec->type == DATA_TYPE_FLOAT && spec->fn == AGG_MIN) {
+                GROUP_EXTREME(vec->floats, float_val, <);
+            } else if (vec->type == DATA_TYPE_FLOAT) {
+                GROUP_EXTREME(vec->floats, float_val, >);
+            } else {
+                // Strings of dictionary columns may still be codes
+                GROUP_LOOP(if (!vec->nulls[row]) {
+                               value_t value;
+                               vector_get_value(vec, row, &value);
+                               if (!acc->has_value ||
+                                   sign * aggregate_string_compare(op->db, &value, &acc->best) < 0) {
+                                   acc->best = value;
+                                   acc->has_value = 1;
+                               }
+                           });
+            }
+            break;
+        case AGG_COUNT_STAR:
+            break;
+    }
+}
+
+// Adds the selected rows of a batch to their groups. groups[k] is set to
+// the group of the k-th selected row, or -1 if it did not fit.
+static int group_add(operator_t *op, const batch_t *batch, const uint64_t *hashes, int *groups) {
+    group_state_t *state = op->state;
+    
+    for (int k = 0; k < batch->selected_count; k++) {
+        int row = batch->selection[k];
+        groups[k] = group_find(op, batch, row, hashes[row]);
+        if (groups[k] == -2) return -1;
+    }
+    
+    for (int i = 0; i < state->spec_count; i++) {
+        group_update(op, i, batch, groups);
+    }
+    return 0;
+}
+
+// Adds the selected rows of a batch to their groups, spilling the rows of
+// groups that no longer fit
+static int group_consume(operator_t *op, const batch_t *batch) {
+    uint64_t hashes[BATCH_SIZE];
+    int groups[BATCH_SIZE];
+    
+    group_hash(op, batch, hashes);
+    if (group_add(op, batch, hashes, groups) != 0) return -1;
+    
+    for (int k = 0; k < batch->selected_count; k++) {
+        int row = batch->selection[k];
+        if (groups[k] == -1 && spill_row(op, batch, row, hashes[row]) != 0) return -1;
+    }
+    return 0;
+}
+
+// Aggregates the rows of one worker into the table of its own aggregate.
+// Rows of groups that do not fit there are handed to the caller's thread,
+// so workers never write pages.
+static int group_run_input(parallel_t *par, int worker, operator_t *local) {
+    uint64_t hashes[BATCH_SIZE];
+    int groups[BATCH_SIZE];
+    batch_t *input;
+    int result;
+    
+    while ((result = exec_next(local->child, &input)) > 0) {
+        group_hash(local, input, hashes);
+        if (group_add(local, input, hashes, groups) != 0) return -1;
+        
+        int count = 0;
+        for (int k = 0; k < input->selected_count; k++) {
+            if (groups[k] == -1) input->selection[count++] = input->selection[k];
+        }
+        if (count == 0) continue;
+        
+        input->selected_count = count;
+        if (local->analyze) {
+            local->stats.batches++;
+            local->stats.rows += count;
+        }
+        if (parallel_emit(par, worker, input) != 0) return 0;
+    }
+    return result;
+}
+
+// The worker's aggregate is never called through exec_next(), so under
+// EXPLAIN ANALYZE its run counts as one loop, whose rows are the groups of
+// its table and the rows it handed on
+static int group_run(parallel_t *par, int worker, void *arg) {
+    group_state_t *state = ((operator_t*)arg)->state;
+    operator_t *local = state->workers[worker];
+    
+    exec_measure_t measure;
+    if (local->analyze) exec_measure_start(&measure);
+    int result = group_run_input(par, worker, local);
+    if (local->analyze) {
+        exec_measure_end(local, &measure);
+        local->stats.loops++;
+        local->stats.rows += ((group_state_t*)local->state)->groups;
+    }
+    return result;
+}
+
+// Adds the groups of a worker's table to this one. Their keys are loaded
+// into the input batch, where group_find() expects them. The worker tables
+// share the memory budget, so together they fit and the merge ignores it.
+static int group_merge(operator_t *op, const group_state_t *from) {
+    group_state_t *state = op->state;
+    uint64_t hashes[BATCH_SIZE];
+    size_t memory_budget = state->memory_budget;
+    state->memory_budget = SIZE_MAX;
+    
+    for (int first = 0; first < from->groups; first += BATCH_SIZE) {
+        int count = from->groups - first;
+        if (count > BATCH_SIZE) count = BATCH_SIZE;
+        
+        for (int k = 0; k < count; k++) {
+            for (int i = 0; i < state->group_count; i++) {
+                value_t key;
+                group_key(from, first + k, i, &key);
+                batch_set_value(&state->input, state->group_columns[i], k, &key);
+            }
+        }
+        state->input.row_count = count;
+        batch_select_all(&state->input);
+        group_hash(op, &state->input, hashes);
+        
+        for (int k = 0; k < count; k++) {
+            int group = group_find(op, &state->input, k, hashes[k]);
+            if (group < 0) {
+                state->memory_budget = memory_budget;
+                return -1;
+            }
+            for (int i = 0; i < state->spec_count; i++) {
+                aggregate_merge(op->db, &state->specs[i], op->column_types[state->group_count + i],
+                                &state->accumulators[group * state->spec_count + i],
+                                &from->accumulators[(first + k) * state->spec_count + i]);
+            }
+        }
+    }
+    
+    state->memory_budget = memory_budget;
+    return 0;
+}
+
+// Reads the whole input, aggregating the rows of the groups that fit in
+// the table. A parallel aggregate merges the workers' tables once they are
+// done and then adds the rows they passed on, which wait in a spill chain
+// meanwhile.
+static int group_read_input(operator_t *op) {
+    group_state_t *state = op->state;
+    batch_t *input;
+    int result;
+    
+    if (state->worker_count == 0) {
+        while ((result = exec_next(op->child, &input)) > 0) {
+            if (group_consume(op, input) != 0) return -1;
+        }
+        return result;
+    }
+    
+    if (parallel_start(&state->parallel, state->worker_count, group_run, op) != 0) return -1;
+    while ((result = parallel_next(&state->parallel, &input)) > 0) {
+        for (int k = 0; k < input->selected_count && result > 0; k++) {
+            if (spill_append(op->db, &state->overflow, input, input->selection[k]) != 0) result = -1;
+        }
+        if (result < 0) break;
+    }
+    parallel_stop(&state->parallel);
+    if (result < 0) return -1;
+    
+    for (int i = 0; i < state->worker_count; i++) {
+        if (group_merge(op, state->workers[i]->state) != 0) return -1;
+    }
+    
+    page_id_t page_id;
+    if (spill_finish(op->db, &state->overflow, &page_id) != 0) return -1;
+    
+    int rows;
+    while ((rows = spill_read(op->db, &page_id, &state->input)) > 0) {
+        if (group_consume(op, &state->input) != 0) break;
+    }
+    if (rows != 0) {
+        spill_free(op->db, page_id);
+        return -1;
+    }
+    return 0;
+}
+
+// Queues the partitions filled during this pass for later passes
+static int group_finish_pass(operator_t *op) {
+    group_state_t *state = op->state;
+    
+    for (int i = 0; i < AGG_SPILL_PARTITIONS; i++) {
+        page_id_t head;
+        if (spill_finish(op->db, &state->partitions[i], &head) != 0) return -1;
+        if (head == 0) continue;
+        
+        if (state->run_count == state->run_capacity) {
+            int capacity = state->run_capacity ? state->run_capacity * 2 : AGG_SPILL_PARTITIONS;
+            spill_run_t *runs = realloc(state->runs, capacity * sizeof(spill_run_t));
+            if (!runs) return -1;
+            state->runs = runs;
+            state->run_capacity = capacity;
+        }
+        state->runs[state->run_count].head = head;
+        state->runs[state->run_count].level = state->level + 1;
+        state->run_count++;
+    }
+    return 0;
+}
+
+static void group_reset(group_state_t *state) {
+    for (int i = 0; i < state->slot_capacity; i++) {
+        state->slots[i].group = -1;
+    }
+    state->groups = 0;
+    state->emitted = 0;
+}
+
+// Aggregates one spilled partition, freeing its pages as they are read
+static int group_load_run(operator_t *op) {
+    group_state_t *state = op->state;
+    spill_run_t run = state->runs[--state->run_count];
+    
+    group_reset(state);
+    state->level = run.level;
+    
+    page_id_t page_id = run.head;
+    int rows;
+    while ((rows = spill_read(op->db, &page_id, &state->input)) > 0) {
+        if (group_consume(op, &state->input) != 0) break;
+    }
+    if (rows != 0) {
+        spill_free(op->db, page_id);
+        return -1;
+    }
+    return group_finish_pass(op);
+}
+
+static int group_open(operator_t *op) {
+    group_state_t *state = op->state;
+    state->level = 0;
+    state->input_done = 0;
+    state->run_count = 0;
+    state->keyed = 0;
+    
+    // A parallel aggregate reads the columns of its workers' inputs
+    const operator_t *child = state->worker_count ? state->workers[0]->child : op->child;
+    if (aggregate_open_workers(state->workers, state->worker_count) != 0) return -1;
+    if (batch_init(&state->batch, op->column_count, op->column_types) != 0) return -1;
+    if (batch_init(&state->input, child->column_count, child->column_types) != 0) return -1;
+    state->codes = malloc(state->group_count * BATCH_SIZE * sizeof(dict_code_t));
+    if (!state->codes || group_grow_slots(state) != 0) return -1;
+    group_reset(state);
+    return 0;
+}
+
+static int group_next(operator_t *op, batch_t **batch) {
+    group_state_t *state = op->state;
+    
+    while (state->emitted == state->groups) {
+        if (!state->input_done) {
+            if (group_read_input(op) != 0 || group_finish_pass(op) != 0) return -1;
+            state->input_done = 1;
+        } else if (state->run_count > 0) {
+            if (group_load_run(op) != 0) return -1;
+        } else {
+            return 0;
+        }
+    }
+    
+    batch_t *out = &state->batch;
+    int count = state->groups - state->emitted;
+    if (count > BATCH_SIZE) count = BATCH_SIZE;
+    
+    for (int k = 0; k < count; k++) {
+        int group = state->emitted + k;
+        for (int i = 0; i < state->group_count; i++) {
+            value_t key;
+            group_key(state, group, i, &key);
+            batch_set_value(out, i, k, &key);
+        }
+        for (int i = 0; i < state->spec_count; i++) {
+            int column = state->group_count + i;
+            value_t value;
+            aggregate_result(&state->specs[i], &state->accumulators[group * state->spec_count + i],
+                             op->column_types[column], &value);
+            batch_set_value(out, column, k, &value);
+        }
+    }
+    
+    state->emitted += count;
+    out->row_count = count;
+    batch_select_all(out);
+    *batch = out;
+    return 1;
+}
+
+static void group_close(operator_t *op) {
+    group_state_t *state = op->state;
+    
+    // Spill pages of an unfinished query go back to the free list
+    for (int i = 0; i < state->run_count; i++) {
+        spill_free(op->db, state->runs[i].head);
+    }
+    for (int i = 0; i < AGG_SPILL_PARTITIONS; i++) {
+        spill_release(op->db, &state->partitions[i]);
+    }
+    spill_release(op->db, &state->overflow);
+    aggregate_close_workers(state->workers, state->worker_count);
+    
+    free(state->runs);
+    free(state->slots);
+    free(state->keys);
+    free(state->accumulators);
+    free(state->codes);
+    state->runs = NULL;
+    state->slots = NULL;
+    state->keys = NULL;
+    state->accumulators = NULL;
+    state->codes = NULL;
+    state->run_count = 0;
+    state->run_capacity = 0;
+    state->slot_capacity = 0;
+    state->group_capacity = 0;
+    state->groups = 0;
+    state->emitted = 0;
+    batch_free(&state->input);
+    batch_free(&state->batch);
+}
+
+static void group_destroy(operator_t *op) {
+    group_state_t *state = op->state;
+    for (int i = 0; i < state->worker_count; i++) {
+        exec_destroy(state->workers[i]);
+    }
+}
+
+// Produces one row per distinct combination of the group columns: the
+// group columns first, then one column per aggregate. NULL group values
+// form a group of their own. The hash table is kept within memory_budget
+// bytes (0 selects AGG_MEMORY_BUDGET) by spilling to temporary pages.
+// Groups come out in no particular order.
+operator_t* exec_group_aggregate_create(operator_t *child, const int *group_columns, int group_count,
+                                        const aggregate_spec_t *specs, int spec_count, size_t memory_budget) {
+    if (!child || group_count <= 0 || spec_count < 0 || group_count + spec_count > MAX_OUTPUT_COLUMNS) {
+        return NULL;
+    }
+    
+    operator_t *op = exec_operator_create("Hash Aggregate", child->db, child, sizeof(group_state_t));
+    if (!op) return NULL;
+    
+    group_state_t *state = op->state;
+    for (int i = 0; i < group_count; i++) {
+        int column = group_columns[i];
+        if (column < 0 || column >= child->column_count) {
+            free(op->state);
+            free(op);
+            return NULL;
+        }
+        state->group_columns[i] = column;
+        op->column_types[i] = child->column_types[column];
+        strcpy(op->column_names[i], child->column_names[column]);
+    }
+    if (aggregate_describe(op, child, specs, spec_count, group_count) != 0) {
+        free(op->state);
+        free(op);
+        return NULL;
+    }
+    
+    state->group_count = group_count;
+    memcpy(state->specs, specs, spec_count * sizeof(aggregate_spec_t));
+    state->spec_count = spec_count;
+    state->memory_budget = memory_budget ? memory_budget : AGG_MEMORY_BUDGET;
+    op->column_count = group_count + spec_count;
+    
+    op->open = group_open;
+    op->next = group_next;
+    op->close = group_close;
+    exec_keep_codes(child);
+    return op;
+}
+
+// Computes the aggregates of exec_aggregate_create (group_count 0) or
+// exec_group_aggregate_create over the rows of all the worker plans, which
+// must produce the same columns and normally share their scan. Each worker
+// runs on a thread of its own and aggregates its rows into accumulators or
+// a hash table of its own, which the caller's thread merges at the end.
+// The worker tables split the memory budget between them; rows of groups
+// that do not fit are passed to the caller's thread and aggregated after
+// the merge, spilling as usual. Takes over the workers, except when the
+// operator cannot be created.
+operator_t* exec_parallel_aggregate_create(operator_t **workers, int worker_count, const int *group_columns,
+                                           int group_count, const aggregate_spec_t *specs, int spec_count,
+                                           size_t memory_budget) {
+    if (worker_count <= 0 || worker_count > MAX_PARALLELISM) return NULL;
+    for (int i = 1; i < worker_count; i++) {
+        if (workers[i]->column_count != workers[0]->column_count ||
+            memcmp(workers[i]->column_types, workers[0]->column_types,
+                   workers[0]->column_count * sizeof(data_type_t)) != 0) {
+            return NULL;
+        }
+    }
+    
+    // The operator is built over the first worker for its output columns,
+    // then detached from it
+    if (group_count == 0) {
+        operator_t *op = exec_aggregate_create(workers[0], specs, spec_count);
+        if (!op) return NULL;
+        
+        aggregate_state_t *state = op->state;
+        memcpy(state->workers, workers, worker_count * sizeof(operator_t*));
+        state->worker_count = worker_count;
+        op->workers = state->workers;
+        op->worker_count = worker_count;
+        op->name = "Parallel Aggregate";
+        op->child = NULL;
+        op->destroy = aggregate_destroy;
+        return op;
+    }
+    
+    if (memory_budget == 0) memory_budget = AGG_MEMORY_BUDGET;
+    size_t share = memory_budget / worker_count;
+    if (share == 0) share = 1;
+    
+    operator_t *op = exec_group_aggregate_create(workers[0], group_columns, group_count, specs, spec_count,
+                                                 memory_budget);
+    if (!op) return NULL;
+    op->name = "Parallel Hash Aggregate";
+    op->child = NULL;
+    op->destroy = group_destroy;
+    
+    group_state_t *state = op->state;
+    for (int i = 0; i < worker_count; i++) {
+        operator_t *local = exec_group_aggregate_create(workers[i], group_columns, group_count, specs, spec_count,
+                                                        share);
+        if (!local) {
+            for (int j = 0; j < state->worker_count; j++) {
+                state->workers[j]->child = NULL;
+            }
+            exec_destroy(op);
+            return NULL;
+        }
+        state->workers[state->worker_count++] = local;
+    }
+    op->workers = state->workers;
+    op->worker_count = state->worker_count;
+    return op;
+}
@@ -19,7 +19,7 @@ static int value_compare(const value_t *a, const value_t *b) {
     }
 }
 
-btree_node_t* btree_create_node(database_t *db, int is_leaf) {
+btree_node_t* btree_create_node(database_t *db, int is_leaf, page_t **page_handle) {
     page_t *page = storage_allocate_page(db);
     if (!page) return NULL;
     
@@ -30,22 +30,11 @@ btree_node_t* btree_create_node(database_t *db, int is_leaf) {
     node->is_leaf = is_leaf;
     node->key_count = 0;
     
-    // Initialize all pointers to 0
-    if (is_leaf) {
-        for (int i = 0; i < BTREE_ORDER - 1; i++) {
-            node->pointers.leaf.tuple_page_ids[i] = 0;
-            node->pointers.leaf.tuple_slots[i] = 0;
-        }
-    } else {
-        for (int i = 0; i < BTREE_ORDER; i++) {
-            node->pointers.children[i] = 0;
-        }
-    }
-    
     pthread_mutex_lock(&page->page_mutex);
     page->is_dirty = 1;
     pthread_mutex_unlock(&page->page_mutex);
     
+    *page_handle = page;
     return node;
 }
 
@@ -69,47 +58,10 @@ static btree_node_t* btree_load_node(database_t *db, page_id_t page_id, page_t *
     return node;
 }
 
-static void btree_save_node(database_t *db, page_id_t page_id, btree_node_t *node) {
-    printf("btree_save_node: Saving page %llu, key_count: %d\n", page_id, node->key_count);
-    
-    // Debug: print keys being saved
-    printf("btree_save_node: Node pointer: %p\n", (void*)node);
-    for (int i = 0; i < node->key_count; i++) {
-        printf("btree_save_node: Saving key[%d] = %d (addr: %p)\n", 
-               i, node->keys[i].data.int_val, (void*)&node->keys[i]);
-    }
-    
-    page_t *page = buffer_get_page(db->buffer_pool, page_id);
-    if (!page) return;
-    
-    // Always copy data to ensure page data is updated
-    printf("btree_save_node: Copying %zu bytes to page data at %p (node at %p)\n", 
-           sizeof(btree_node_t), (void*)page->data, (void*)node);
-    
-    // Debug: check key values before copy
-    btree_node_t *debug_node = (btree_node_t*)node;
-    printf("btree_save_node: Before copy - key_count: %d\n", debug_node->key_count);
-    for (int i = 0; i < debug_node->key_count; i++) {
-        printf("btree_save_node: Before copy - key[%d] = %d at %p\n", 
-               i, debug_node->keys[i].data.int_val, (void*)&debug_node->keys[i]);
-    }
-    
-    memcpy(page->data, node, sizeof(btree_node_t));
-    
-    // Debug: check key values after copy
-    btree_node_t *debug_page_node = (btree_node_t*)page->data;
-    printf("btree_save_node: After copy - key_count: %d\n", debug_page_node->key_count);
-    for (int i = 0; i < debug_page_node->key_count; i++) {
-        printf("btree_save_node: After copy - key[%d] = %d at %p\n", 
-               i, debug_page_node->keys[i].data.int_val, (void*)&debug_page_node->keys[i]);
-    }
-    
+static void btree_mark_dirty(page_t *page) {
     pthread_mutex_lock(&page->page_mutex);
     page->is_dirty = 1;
     pthread_mutex_unlock(&page->page_mutex);
-    
-    buffer_release_page(db->buffer_pool, page);
-    printf("btree_save_node: Page %llu marked as dirty\n", page_id);
 }
 
 static int btree_find_key_position(btree_node_t *node, const value_t *key) {
@@ -134,186 +86,316 @@ static int btree_find_key_position(btree_node_t *node, const value_t *key) {
     return pos;
 }
 
-static void btree_insert_key_at_position(btree_node_t *node, int pos, const value_t *key, 
-                                        page_id_t tuple_page_id, slot_id_t tuple_slot) {
-    printf("btree_insert_key_at_position: Inserting key at pos %d, current key_count: %d\n", pos, node->key_count);
+// Index of the child subtree that may contain `key`: keys equal to a
+// separator live in the right-hand subtree.
+static int btree_child_index(btree_node_t *node, const value_t *key) {
+    int left = 0, right = node->key_count;
     
-    for (int i = node->key_count; i > pos; i--) {
-        node->keys[i] = node->keys[i-1];
-        if (node->is_leaf) {
-            node->pointers.leaf.tuple_page_ids[i] = node->pointers.leaf.tuple_page_ids[i-1];
-            node->pointers.leaf.tuple_slots[i] = node->pointers.leaf.tuple_slots[i-1];
+    while (left < right) {
+        int mid = (left + right) / 2;
+        if (value_compare(key, &node->keys[mid]) < 0) {
+            right = mid;
         } else {
-            node->pointers.children[i+1] = node->pointers.children[i];
+            left = mid + 1;
         }
     }
     
+    return left;
+}
+
+// Scratch copy of a node holding one entry more than fits in a page, used
+// to insert into a full node before splitting it in two.
+typedef struct {
+    int key_count;
+    value_t keys[BTREE_ORDER];
+    page_id_t children[BTREE_ORDER + 1];
+    page_id_t tuple_page_ids[BTREE_ORDER];
+    slot_id_t tuple_slots[BTREE_ORDER];
+} btree_overflow_node_t;
+
+static void btree_leaf_insert_at(btree_node_t *node, int pos, const value_t *key,
+                                 page_id_t tuple_page_id, slot_id_t tuple_slot) {
+    for (int i = node->key_count; i > pos; i--) {
+        node->keys[i] = node->keys[i-1];
+        node->pointers.leaf.tuple_page_ids[i] = node->pointers.leaf.tuple_page_ids[i-1];
+        node->pointers.leaf.tuple_slots[i] = node->pointers.leaf.tuple_slots[i-1];
+    }
     node->keys[pos] = *key;
-    if (node->is_leaf) {
-        node->pointers.leaf.tuple_page_ids[pos] = tuple_page_id;
-        node->pointers.leaf.tuple_slots[pos] = tuple_slot;
-        printf("btree_insert_key_at_position: Inserted key %d -> page %llu, slot %d\n", 
-               key->data.int_val, tuple_page_id, tuple_slot);
+    node->pointers.leaf.tuple_page_ids[pos] = tuple_page_id;
+    node->pointers.leaf.tuple_slots[pos] = tuple_slot;
+    node->key_count++;
+}
+
+static void btree_internal_insert_at(btree_node_t *node, int pos, const value_t *key,
+                                     page_id_t right_child) {
+    for (int i = node->key_count; i > pos; i--) {
+        node->keys[i] = node->keys[i-1];
+        node->pointers.children[i+1] = node->pointers.children[i];
     }
+    node->keys[pos] = *key;
+    node->pointers.children[pos + 1] = right_child;
     node->key_count++;
+}
+
+// Split a full leaf while inserting one more entry. The right half moves to
+// a new page and its first key is copied up as the separator.
+static int btree_split_leaf(database_t *db, btree_node_t *node, int pos, const value_t *key,
+                            page_id_t tuple_page_id, slot_id_t tuple_slot,
+                            value_t *promoted_key, page_id_t *new_page_id) {
+    btree_overflow_node_t tmp;
+    tmp.key_count = 0;
+    for (int i = 0; i <= node->key_count; i++) {
+        if (i == pos) {
+            tmp.keys[tmp.key_count] = *key;
+            tmp.tuple_page_ids[tmp.key_count] = tuple_page_id;
+            tmp.tuple_slots[tmp.key_count] = tuple_slot;
+            tmp.key_count++;
+        }
+        if (i < node->key_count) {
+            tmp.keys[tmp.key_count] = node->keys[i];
+            tmp.tuple_page_ids[tmp.key_count] = node->pointers.leaf.tuple_page_ids[i];
+            tmp.tuple_slots[tmp.key_count] = node->pointers.leaf.tuple_slots[i];
+            tmp.key_count++;
+        }
+    }
+    
+    page_t *new_page = NULL;
+    btree_node_t *new_node = btree_create_node(db, 1, &new_page);
+    if (!new_node) return -1;
+    
+    int mid = tmp.key_count / 2;
+    node->key_count = 0;
+    for (int i = 0; i < mid; i++) {
+        btree_leaf_insert_at(node, i, &tmp.keys[i], tmp.tuple_page_ids[i], tmp.tuple_slots[i]);
+    }
+    for (int i = mid; i < tmp.key_count; i++) {
+        btree_leaf_insert_at(new_node, i - mid, &tmp.keys[i], tmp.tuple_page_ids[i], tmp.tuple_slots[i]);
+    }
+    
+    *promoted_key = new_node->keys[0];
+    *new_page_id = new_page->page_id;
     
-    // Debug: verify key was actually stored
-    printf("btree_insert_key_at_position: Verified key[%d] = %d at %p\n", 
-           pos, node->keys[pos].data.int_val, (void*)&node->keys[pos]);
-    printf("btree_insert_key_at_position: New key_count: %d\n", node->key_count);
+    buffer_release_page(db->buffer_pool, new_page);
+    return 0;
 }
 
-static btree_node_t* btree_split_node(database_t *db, btree_node_t *full_node, 
-                                     value_t *promoted_key, page_id_t *new_page_id) {
-    btree_node_t *new_node = btree_create_node(db, full_node->is_leaf);
-    if (!new_node) return NULL;
+// Split a full internal node while inserting one more separator. The middle
+// separator moves up to the parent.
+static int btree_split_internal(database_t *db, btree_node_t *node, int pos, const value_t *key,
+                                page_id_t right_child, value_t *promoted_key, page_id_t *new_page_id) {
+    btree_overflow_node_t tmp;
+    tmp.key_count = node->key_count + 1;
+    tmp.children[0] = node->pointers.children[0];
+    for (int i = 0, j = 0; i < tmp.key_count; i++) {
+        if (i == pos) {
+            tmp.keys[i] = *key;
+            tmp.children[i + 1] = right_child;
+        } else {
+            tmp.keys[i] = node->keys[j];
+            tmp.children[i + 1] = node->pointers.children[j + 1];
+            j++;
+        }
+    }
+    
+    page_t *new_page = NULL;
+    btree_node_t *new_node = btree_create_node(db, 0, &new_page);
+    if (!new_node) return -1;
     
-    int mid = BTREE_ORDER / 2;
+    int mid = tmp.key_count / 2;
+    
+    node->key_count = mid;
+    for (int i = 0; i < mid; i++) {
+        node->keys[i] = tmp.keys[i];
+        node->pointers.children[i] = tmp.children[i];
+    }
+    node->pointers.children[mid] = tmp.children[mid];
     
-    *promoted_key = full_node->keys[mid];
+    *promoted_key = tmp.keys[mid];
     
-    new_node->key_count = full_node->key_count - mid - 1;
+    new_node->key_count = tmp.key_count - mid - 1;
     for (int i = 0; i < new_node->key_count; i++) {
-        new_node->keys[i] = full_node->keys[mid + 1 + i];
-        if (full_node->is_leaf) {
-            new_node->pointers.leaf.tuple_page_ids[i] = full_node->pointers.leaf.tuple_page_ids[mid + 1 + i];
-            new_node->pointers.leaf.tuple_slots[i] = full_node->pointers.leaf.tuple_slots[mid + 1 + i];
+        new_node->keys[i] = tmp.keys[mid + 1 + i];
+        new_node->pointers.children[i] = tmp.children[mid + 1 + i];
+    }
+    new_node->pointers.children[new_node->key_count] = tmp.children[tmp.key_count];
+    
+    *new_page_id = new_page->page_id;
+    
+    buffer_release_page(db->buffer_pool, new_page);
+    return 0;
+}
+
+// One entry to insert: either a (key -> tuple location) pair, or a whole
+// row for the leaves of an index-organized table.
+typedef struct {
+    const value_t *key;
+    page_id_t tuple_page_id;
+    slot_id_t tuple_slot;
+    const tuple_t *row;
+    int key_column;
+} btree_entry_t;
+
+static int btree_row_find_position(btree_row_leaf_t *leaf, int key_column, const value_t *key) {
+    int left = 0, right = leaf->key_count;
+    
+    while (left < right) {
+        int mid = (left + right) / 2;
+        if (value_compare(&leaf->rows[mid].values[key_column], key) < 0) {
+            left = mid + 1;
         } else {
-            new_node->pointers.children[i] = full_node->pointers.children[mid + 1 + i];
+            right = mid;
         }
     }
     
-    if (!full_node->is_leaf) {
-        new_node->pointers.children[new_node->key_count] = full_node->pointers.children[full_node->key_count];
-    }
+    return left;
+}
+
+static int btree_row_leaf_insert(database_t *db, btree_row_leaf_t *leaf, const btree_entry_t *entry,
+                                 value_t *promoted_key, page_id_t *new_page_id) {
+    int pos = btree_row_find_position(leaf, entry->key_column, entry->key);
     
-    full_node->key_count = mid;
+    if (pos < leaf->key_count &&
+        value_compare(&leaf->rows[pos].values[entry->key_column], entry->key) == 0) {
+        printf("btree_row_leaf_insert: Key already exists\n");
+        return -1;
+    }
     
-    page_t *new_page = storage_allocate_page(db);
-    if (new_page) {
-        *new_page_id = new_page->page_id;
-        buffer_release_page(db->buffer_pool, new_page);
+    if (leaf->key_count < BTREE_ROW_LEAF_CAPACITY) {
+        memmove(&leaf->rows[pos + 1], &leaf->rows[pos], (leaf->key_count - pos) * sizeof(tuple_t));
+        leaf->rows[pos] = *entry->row;
+        leaf->key_count++;
+        return 0;
     }
     
-    return new_node;
+    tuple_t tmp[BTREE_ROW_LEAF_CAPACITY + 1];
+    int total = leaf->key_count + 1;
+    memcpy(tmp, leaf->rows, pos * sizeof(tuple_t));
+    tmp[pos] = *entry->row;
+    memcpy(&tmp[pos + 1], &leaf->rows[pos], (leaf->key_count - pos) * sizeof(tuple_t));
+    
+    page_t *new_page = NULL;
+    btree_row_leaf_t *new_leaf = (btree_row_leaf_t*)btree_create_node(db, BTREE_ROW_LEAF, &new_page);
+    if (!new_leaf) return -1;
+    
+    // Appending past the end of the rightmost leaf (ascending keys) leaves
+    // the old leaf full instead of half empty.
+    int mid = (pos == leaf->key_count && leaf->next_leaf == 0) ? leaf->key_count : total / 2;
+    
+    memcpy(leaf->rows, tmp, mid * sizeof(tuple_t));
+    memset(&leaf->rows[mid], 0, (BTREE_ROW_LEAF_CAPACITY - mid) * sizeof(tuple_t));
+    leaf->key_count = mid;
+    
+    memcpy(new_leaf->rows, &tmp[mid], (total - mid) * sizeof(tuple_t));
+    new_leaf->key_count = total - mid;
+    
+    new_leaf->next_leaf = leaf->next_leaf;
+    leaf->next_leaf = new_page->page_id;
+    
+    *promoted_key = new_leaf->rows[0].values[entry->key_column];
+    *new_page_id = new_page->page_id;
+    
+    buffer_release_page(db->buffer_pool, new_page);
+    return 1;
 }
 
-static int btree_insert_recursive(database_t *db, page_id_t page_id, const value_t *key,
-                                 page_id_t tuple_page_id, slot_id_t tuple_slot,
+// Returns 0 when the key was inserted, 1 when the node split (the caller
+// must insert promoted_key/new_page_id into the parent) and -1 on error or
+// duplicate key.
+static int btree_insert_recursive(database_t *db, page_id_t page_id, const btree_entry_t *entry,
                                  value_t *promoted_key, page_id_t *new_page_id) {
-    printf("btree_insert_recursive: Inserting into page %llu\n", page_id);
     page_t *page_handle = NULL;
     btree_node_t *node = btree_load_node(db, page_id, &page_handle);
     if (!node) return -1;
     
-    if (node->is_leaf) {
-        printf("btree_insert_recursive: Page %llu is leaf, key_count: %d\n", page_id, node->key_count);
-        
-        // Debug: print all keys before insertion
-        printf("btree_insert_recursive: Page pointer: %p\n", (void*)node);
-        for (int i = 0; i < node->key_count; i++) {
-            printf("btree_insert_recursive: Before insert - Key[%d] = %d\n", i, node->keys[i].data.int_val);
-        }
-        
+    const value_t *key = entry->key;
+    int result;
+    
+    if (node->is_leaf == BTREE_ROW_LEAF) {
+        result = btree_row_leaf_insert(db, (btree_row_leaf_t*)node, entry, promoted_key, new_page_id);
+    } else if (node->is_leaf) {
         int pos = btree_find_key_position(node, key);
-        printf("btree_insert_recursive: Key position: %d, inserting key: %d\n", pos, key->data.int_val);
         
         if (pos < node->key_count && value_compare(key, &node->keys[pos]) == 0) {
             printf("btree_insert_recursive: Key already exists\n");
-            btree_save_node(db, page_id, node);
             buffer_release_page(db->buffer_pool, page_handle);
             return -1;
         }
         
         if (node->key_count < BTREE_ORDER - 1) {
-            printf("btree_insert_recursive: Node has space, inserting key\n");
-            btree_insert_key_at_position(node, pos, key, tuple_page_id, tuple_slot);
-            btree_save_node(db, page_id, node);
-            buffer_release_page(db->buffer_pool, page_handle);
-            return 0;
+            btree_leaf_insert_at(node, pos, key, entry->tuple_page_id, entry->tuple_slot);
+            result = 0;
         } else {
-            btree_insert_key_at_position(node, pos, key, tuple_page_id, tuple_slot);
-            btree_node_t *new_node = btree_split_node(db, node, promoted_key, new_page_id);
-            if (!new_node) {
-                buffer_release_page(db->buffer_pool, page_handle);
-                return -1;
-            }
-            
-            btree_save_node(db, page_id, node);
-            btree_save_node(db, *new_page_id, new_node);
-            buffer_release_page(db->buffer_pool, page_handle);
-            return 1;
+            result = btree_split_leaf(db, node, pos, key, entry->tuple_page_id, entry->tuple_slot,
+                                      promoted_key, new_page_id) == 0 ? 1 : -1;
         }
     } else {
-        int pos = btree_find_key_position(node, key);
-        page_id_t child_page_id = node->pointers.children[pos];
-        
+        int pos = btree_child_index(node, key);
         value_t child_promoted_key;
         page_id_t child_new_page_id;
         
-        int result = btree_insert_recursive(db, child_page_id, key, tuple_page_id, tuple_slot,
-                                          &child_promoted_key, &child_new_page_id);
+        result = btree_insert_recursive(db, node->pointers.children[pos], entry,
+                                        &child_promoted_key, &child_new_page_id);
         
-        if (result == 0) {
-            btree_save_node(db, page_id, node);
-            buffer_release_page(db->buffer_pool, page_handle);
-            return 0;
-        } else if (result == 1) {
+        if (result == 1) {
             if (node->key_count < BTREE_ORDER - 1) {
-                btree_insert_key_at_position(node, pos, &child_promoted_key, 0, 0);
-                node->pointers.children[pos + 1] = child_new_page_id;
-                btree_save_node(db, page_id, node);
-                buffer_release_page(db->buffer_pool, page_handle);
-                return 0;
+                btree_internal_insert_at(node, pos, &child_promoted_key, child_new_page_id);
+                result = 0;
             } else {
-                btree_insert_key_at_position(node, pos, &child_promoted_key, 0, 0);
-                node->pointers.children[pos + 1] = child_new_page_id;
-                
-                btree_node_t *new_node = btree_split_node(db, node, promoted_key, new_page_id);
-                if (!new_node) {
-                    buffer_release_page(db->buffer_pool, page_handle);
-                    return -1;
-                }
-                
-                btree_save_node(db, page_id, node);
-                btree_save_node(db, *new_page_id, new_node);
-                buffer_release_page(db->buffer_pool, page_handle);
-                return 1;
+                result = btree_split_internal(db, node, pos, &child_promoted_key, child_new_page_id,
+                                              promoted_key, new_page_id) == 0 ? 1 : -1;
             }
         }
-        buffer_release_page(db->buffer_pool, page_handle);
     }
     
-    return -1;
+    if (result >= 0) {
+        btree_mark_dirty(page_handle);
+    }
+    buffer_release_page(db->buffer_pool, page_handle);
+    return result;
 }
 
-int btree_insert(database_t *db, page_id_t root_page_id, const value_t *key, 
-                page_id_t tuple_page_id, slot_id_t tuple_slot) {
+static int btree_insert_entry(database_t *db, page_id_t root_page_id, const btree_entry_t *entry) {
     value_t promoted_key;
     page_id_t new_page_id;
     
-    int result = btree_insert_recursive(db, root_page_id, key, tuple_page_id, tuple_slot,
-                                       &promoted_key, &new_page_id);
+    int result = btree_insert_recursive(db, root_page_id, entry, &promoted_key, &new_page_id);
     
     if (result == 1) {
-        btree_node_t *new_root = btree_create_node(db, 0);
-        if (!new_root) return -1;
-        
-        new_root->key_count = 1;
-        new_root->keys[0] = promoted_key;
-        new_root->pointers.children[0] = root_page_id;
-        new_root->pointers.children[1] = new_page_id;
+        // The root keeps its page id (the schema points at it): move its
+        // current contents to a fresh page and turn it into the new parent.
+        page_t *root_page = buffer_get_page(db->buffer_pool, root_page_id);
+        if (!root_page) return -1;
         
-        page_t *root_page = storage_allocate_page(db);
-        if (root_page) {
-            btree_save_node(db, root_page->page_id, new_root);
+        page_t *left_page = NULL;
+        btree_node_t *left = btree_create_node(db, 0, &left_page);
+        if (!left) {
             buffer_release_page(db->buffer_pool, root_page);
+            return -1;
         }
+        memcpy(left, root_page->data, PAGE_SIZE);
+        
+        btree_node_t *root = (btree_node_t*)root_page->data;
+        memset(root_page->data, 0, PAGE_SIZE);
+        root->is_leaf = 0;
+        root->key_count = 1;
+        root->keys[0] = promoted_key;
+        root->pointers.children[0] = left_page->page_id;
+        root->pointers.children[1] = new_page_id;
+        
+        btree_mark_dirty(root_page);
+        buffer_release_page(db->buffer_pool, left_page);
+        buffer_release_page(db->buffer_pool, root_page);
     }
     
     return (result >= 0) ? 0 : -1;
 }
 
+int btree_insert(database_t *db, page_id_t root_page_id, const value_t *key, 
+                page_id_t tuple_page_id, slot_id_t tuple_slot) {
+    btree_entry_t entry = { key, tuple_page_id, tuple_slot, NULL, -1 };
+    return btree_insert_entry(db, root_page_id, &entry);
+}
+
 int btree_search(database_t *db, page_id_t root_page_id, const value_t *key,
                 page_id_t *tuple_page_id, slot_id_t *tuple_slot) {
     page_id_t current_page_id = root_page_id;
@@ -351,7 +433,7 @@ int btree_search(database_t *db, page_id_t root_page_id, const value_t *key,
             return -1;
         } else {
             printf("btree_search: Page %llu is internal, key_count: %d\n", current_page_id, node->key_count);
-            int pos = btree_find_key_position(node, key);
+            int pos = btree_child_index(node, key);
             page_id_t next_page_id = node->pointers.children[pos];
             buffer_release_page(db->buffer_pool, page_handle);
             current_page_id = next_page_id;
@@ -363,9 +445,501 @@ int btree_search(database_t *db, page_id_t root_page_id, const value_t *key,
     return -1;
 }
 
+// Descend to the leaf that would hold `key`. The leaf stays pinned and is
+// returned through page_handle.
+static btree_node_t* btree_find_leaf(database_t *db, page_id_t root_page_id, const value_t *key,
+                                     page_t **page_handle) {
+    page_id_t current_page_id = root_page_id;
+    
+    while (current_page_id != 0) {
+        btree_node_t *node = btree_load_node(db, current_page_id, page_handle);
+        if (!node) return NULL;
+        
+        if (node->is_leaf) {
+            return node;
+        }
+        
+        page_id_t next_page_id = node->pointers.children[btree_child_index(node, key)];
+        buffer_release_page(db->buffer_pool, *page_handle);
+        current_page_id = next_page_id;
+    }
+    
+    return NULL;
+}
+
+// btree_find_leaf() that also sets *upper to the lowest separator above
+// the key met on the way down, so every key from `key` up to *upper
+// (exclusive) belongs to the returned leaf. *has_upper is 0 for the
+// rightmost leaf.
+static btree_node_t* btree_find_leaf_range(database_t *db, page_id_t root_page_id, const value_t *key,
+                                           page_t **page_handle, value_t *upper, int *has_upper) {
+    page_id_t current_page_id = root_page_id;
+    *has_upper = 0;
+    
+    while (current_page_id != 0) {
+        btree_node_t *node = btree_load_node(db, current_page_id, page_handle);
+        if (!node) return NULL;
+        
+        if (node->is_leaf) {
+            return node;
+        }
+        
+        int pos = btree_child_index(node, key);
+        if (pos < node->key_count) {
+            *upper = node->keys[pos];
+            *has_upper = 1;
+        }
+        page_id_t next_page_id = node->pointers.children[pos];
+        buffer_release_page(db->buffer_pool, *page_handle);
+        current_page_id = next_page_id;
+    }
+    
+    return NULL;
+}
+
+// Inserts `count` keys given in ascending order. The keys that fall in the
+// same leaf are added during a single visit to it; when the leaf fills up,
+// the next key goes through btree_insert() to split it. Returns -1 on error
+// or if a key exists already, after inserting the keys before it.
+int btree_insert_sorted(database_t *db, page_id_t root_page_id, const value_t *keys,
+                        const page_id_t *tuple_page_ids, const slot_id_t *tuple_slots, int count) {
+    int i = 0;
+    
+    while (i < count) {
+        page_t *page_handle = NULL;
+        value_t upper;
+        int has_upper;
+        btree_node_t *node = btree_find_leaf_range(db, root_page_id, &keys[i], &page_handle, &upper, &has_upper);
+        if (!node) return -1;
+        if (node->is_leaf != BTREE_LEAF) {
+            buffer_release_page(db->buffer_pool, page_handle);
+            return -1;
+        }
+        
+        int start = i;
+        int result = 0;
+        while (i < count && node->key_count < BTREE_ORDER - 1 &&
+               (!has_upper || value_compare(&keys[i], &upper) < 0)) {
+            int pos = btree_find_key_position(node, &keys[i]);
+            if (pos < node->key_count && value_compare(&keys[i], &node->keys[pos]) == 0) {
+                printf("btree_insert_sorted: Key already exists\n");
+                result = -1;
+                break;
+            }
+            btree_leaf_insert_at(node, pos, &keys[i], tuple_page_ids[i], tuple_slots[i]);
+            i++;
+        }
+        int full = node->key_count == BTREE_ORDER - 1;
+        
+        if (i > start) btree_mark_dirty(page_handle);
+        buffer_release_page(db->buffer_pool, page_handle);
+        if (result != 0) return -1;
+        
+        if (i < count && full) {
+            if (btree_insert(db, root_page_id, &keys[i], tuple_page_ids[i], tuple_slots[i]) != 0) return -1;
+            i++;
+        }
+    }
+    
+    return 0;
+}
+
+// Looks up `count` keys given in ascending order, visiting each leaf once.
+// Returns the index of the first key that is in the index, `count` if none
+// is, or -1 on error.
+int btree_search_sorted(database_t *db, page_id_t root_page_id, const value_t *keys, int count) {
+    int i = 0;
+    
+    while (i < count) {
+        page_t *page_handle = NULL;
+        value_t upper;
+        int has_upper;
+        btree_node_t *node = btree_find_leaf_range(db, root_page_id, &keys[i], &page_handle, &upper, &has_upper);
+        if (!node) return -1;
+        if (node->is_leaf != BTREE_LEAF) {
+            buffer_release_page(db->buffer_pool, page_handle);
+            return -1;
+        }
+        
+        do {
+            int pos = btree_find_key_position(node, &keys[i]);
+            if (pos < node->key_count && value_compare(&keys[i], &node->keys[pos]) == 0) {
+                buffer_release_page(db->buffer_pool, page_handle);
+                return i;
+            }
+            i++;
+        } while (i < count && (!has_upper || value_compare(&keys[i], &upper) < 0));
+        
+        buffer_release_page(db->buffer_pool, page_handle);
+    }
+    
+    return count;
+}
+
+// Removes the key from its leaf. Leaves are not merged: an underfull leaf
+// still routes correctly and is refilled by later inserts.
 int btree_delete(database_t *db, page_id_t root_page_id, const value_t *key) {
-    (void)db; // Suppress unused parameter warning
-    (void)root_page_id; // Suppress unused parameter warning
-    (void)key; // Suppress unused parameter warning
+    page_t *page_handle = NULL;
+    btree_node_t *node = btree_find_leaf(db, root_page_id, key, &page_handle);
+    if (!node) return -1;
+    
+    int pos = btree_find_key_position(node, key);
+    if (pos >= node->key_count || value_compare(key, &node->keys[pos]) != 0) {
+        buffer_release_page(db->buffer_pool, page_handle);
+        return -1;
+    }
+    
+    for (int i = pos; i < node->key_count - 1; i++) {
+        node->keys[i] = node->keys[i + 1];
+        node->pointers.leaf.tuple_page_ids[i] = node->pointers.leaf.tuple_page_ids[i + 1];
+        node->pointers.leaf.tuple_slots[i] = node->pointers.leaf.tuple_slots[i + 1];
+    }
+    node->key_count--;
+    
+    btree_mark_dirty(page_handle);
+    buffer_release_page(db->buffer_pool, page_handle);
+    return 0;
+}
+
+int btree_update(database_t *db, page_id_t root_page_id, const value_t *key,
+                 page_id_t tuple_page_id, slot_id_t tuple_slot) {
+    page_t *page_handle = NULL;
+    btree_node_t *node = btree_find_leaf(db, root_page_id, key, &page_handle);
+    if (!node) return -1;
+    
+    int pos = btree_find_key_position(node, key);
+    if (pos >= node->key_count || value_compare(key, &node->keys[pos]) != 0) {
+        buffer_release_page(db->buffer_pool, page_handle);
+        return -1;
+    }
+    
+    node->pointers.leaf.tuple_page_ids[pos] = tuple_page_id;
+    node->pointers.leaf.tuple_slots[pos] = tuple_slot;
+    
+    btree_mark_dirty(page_handle);
+    buffer_release_page(db->buffer_pool, page_handle);
+    return 0;
+}
+
+void key_bounds_init(key_bounds_t *bounds) {
+    memset(bounds, 0, sizeof(key_bounds_t));
+}
+
+// Narrows the bounds to also satisfy `key <op> bound`. CMP_NE does not
+// describe a range and leaves the bounds unchanged.
+void key_bounds_tighten(key_bounds_t *bounds, compare_op_t op, const value_t *key) {
+    if (op == CMP_EQ || op == CMP_GT || op == CMP_GE) {
+        int inclusive = op != CMP_GT;
+        int cmp = bounds->has_low ? value_compare(key, &bounds->low) : 1;
+        if (cmp > 0 || (cmp == 0 && !inclusive)) {
+            bounds->low = *key;
+            bounds->low_inclusive = inclusive;
+        }
+        bounds->has_low = 1;
+    }
+    if (op == CMP_EQ || op == CMP_LT || op == CMP_LE) {
+        int inclusive = op != CMP_LT;
+        int cmp = bounds->has_high ? value_compare(key, &bounds->high) : -1;
+        if (cmp < 0 || (cmp == 0 && !inclusive)) {
+            bounds->high = *key;
+            bounds->high_inclusive = inclusive;
+        }
+        bounds->has_high = 1;
+    }
+}
+
+// Returns -1 if the key is below the bounds, 1 if it is above them and 0
+// if it is within.
+int key_bounds_check(const key_bounds_t *bounds, const value_t *key) {
+    if (bounds->has_low) {
+        int cmp = value_compare(key, &bounds->low);
+        if (cmp < 0 || (cmp == 0 && !bounds->low_inclusive)) return -1;
+    }
+    if (bounds->has_high) {
+        int cmp = value_compare(key, &bounds->high);
+        if (cmp > 0 || (cmp == 0 && !bounds->high_inclusive)) return 1;
+    }
+    return 0;
+}
+
+void btree_range_open(btree_range_t *range, const key_bounds_t *bounds) {
+    memset(range, 0, sizeof(btree_range_t));
+    if (bounds->has_low) {
+        range->next_key = bounds->low;
+        range->has_next_key = 1;
+        range->next_inclusive = bounds->low_inclusive;
+    }
+}
+
+// Collects the index entries within the bounds from the next leaf of the
+// range, at most max_entries of them, and returns how many were found (0
+// once the range is exhausted). Leaves are not linked, so every call
+// descends from the root; the smallest separator to the right of the path
+// is where the following leaf starts.
+int btree_range_next(database_t *db, page_id_t root_page_id, const key_bounds_t *bounds, btree_range_t *range,
+                     page_id_t *page_ids, slot_id_t *slots, int max_entries) {
+    while (!range->done) {
+        page_t *page_handle = NULL;
+        page_id_t page_id = root_page_id;
+        value_t fence;
+        int has_fence = 0;
+        btree_node_t *node;
+        
+        while (1) {
+            node = btree_load_node(db, page_id, &page_handle);
+            if (!node) return -1;
+            if (node->is_leaf) break;
+            
+            int child = range->has_next_key ? btree_child_index(node, &range->next_key) : 0;
+            if (child < node->key_count) {
+                fence = node->keys[child];
+                has_fence = 1;
+            }
+            page_id = node->pointers.children[child];
+            buffer_release_page(db->buffer_pool, page_handle);
+        }
+        
+        int pos = 0;
+        if (range->has_next_key) {
+            pos = btree_find_key_position(node, &range->next_key);
+            if (pos < node->key_count && !range->next_inclusive &&
+                value_compare(&node->keys[pos], &range->next_key) == 0) {
+                pos++;
+            }
+        }
+        
+        int count = 0;
+        for (; pos < node->key_count; pos++) {
+            int where = key_bounds_check(bounds, &node->keys[pos]);
+            if (where > 0) {
+                range->done = 1;
+                break;
+            }
+            if (where < 0) continue;
+            
+            if (count == max_entries) {
+                range->next_key = node->keys[pos];
+                range->has_next_key = 1;
+                range->next_inclusive = 1;
+                break;
+            }
+            page_ids[count] = node->pointers.leaf.tuple_page_ids[pos];
+            slots[count] = node->pointers.leaf.tuple_slots[pos];
+            count++;
+        }
+        
+        if (pos == node->key_count) {
+            if (has_fence) {
+                range->next_key = fence;
+                range->has_next_key = 1;
+                range->next_inclusive = 1;
+            } else {
+                range->done = 1;
+            }
+        }
+        
+        buffer_release_page(db->buffer_pool, page_handle);
+        if (count > 0) return count;
+    }
+    
+    return 0;
+}
+
+static int btree_key_column(table_schema_t *schema) {
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_primary_key) return i;
+    }
+    return -1;
+}
+
+int btree_row_insert(database_t *db, table_schema_t *schema, const tuple_t *tuple) {
+    int key_column = btree_key_column(schema);
+    if (key_column < 0) return -1;
+    
+    btree_entry_t entry = { &tuple->values[key_column], 0, 0, tuple, key_column };
+    return btree_insert_entry(db, schema->root_page_id, &entry);
+}
+
+// Finds the row stored under `key` in an index-organized table and copies it
+// into `row`. Visibility is left to the caller.
+int btree_row_search(database_t *db, table_schema_t *schema, const value_t *key, tuple_t *row) {
+    int key_column = btree_key_column(schema);
+    if (key_column < 0) return -1;
+    
+    page_t *page_handle = NULL;
+    btree_row_leaf_t *leaf = (btree_row_leaf_t*)btree_find_leaf(db, schema->root_page_id, key, &page_handle);
+    if (!leaf) return -1;
+    
+    int pos = btree_row_find_position(leaf, key_column, key);
+    int found = pos < leaf->key_count && value_compare(&leaf->rows[pos].values[key_column], key) == 0;
+    if (found) {
+        *row = leaf->rows[pos];
+    }
+    
+    buffer_release_page(db->buffer_pool, page_handle);
+    return found ? 0 : -1;
+}
+
+int btree_row_mark_deleted(database_t *db, table_schema_t *schema, const value_t *key,
+                           transaction_id_t txn_id) {
+    int key_column = btree_key_column(schema);
+    if (key_column < 0) return -1;
+    
+    page_t *page_handle = NULL;
+    btree_row_leaf_t *leaf = (btree_row_leaf_t*)btree_find_leaf(db, schema->root_page_id, key, &page_handle);
+    if (!leaf) return -1;
+    
+    int pos = btree_row_find_position(leaf, key_column, key);
+    if (pos >= leaf->key_count || value_compare(&leaf->rows[pos].values[key_column], key) != 0) {
+        buffer_release_page(db->buffer_pool, page_handle);
+        return -1;
+    }
+    
+    mvcc_mark_deleted(&leaf->rows[pos].header, txn_id);
+    
+    btree_mark_dirty(page_handle);
+    storage_write_page(db, page_handle->page_id, page_handle->data);
+    buffer_release_page(db->buffer_pool, page_handle);
+    return 0;
+}
+
+static btree_node_t* btree_leftmost_leaf(database_t *db, page_id_t root_page_id, page_t **page_handle) {
+    page_id_t current_page_id = root_page_id;
+    
+    while (current_page_id != 0) {
+        btree_node_t *node = btree_load_node(db, current_page_id, page_handle);
+        if (!node) return NULL;
+        
+        if (node->is_leaf) {
+            return node;
+        }
+        
+        page_id_t next_page_id = node->pointers.children[0];
+        buffer_release_page(db->buffer_pool, *page_handle);
+        current_page_id = next_page_id;
+    }
+    
+    return NULL;
+}
+
+// Page id of the leftmost row leaf, where a full scan of an index-organized
+// table starts.
+page_id_t btree_row_first_leaf(database_t *db, table_schema_t *schema) {
+    page_t *page_handle = NULL;
+    btree_node_t *leaf = btree_leftmost_leaf(db, schema->root_page_id, &page_handle);
+    if (!leaf) return 0;
+    
+    page_id_t page_id = page_handle->page_id;
+    buffer_release_page(db->buffer_pool, page_handle);
+    return page_id;
+}
+
+// Page id of the row leaf that holds `key` or would hold it, where a range
+// scan of an index-organized table starts.
+page_id_t btree_row_find_leaf(database_t *db, table_schema_t *schema, const value_t *key) {
+    page_t *page_handle = NULL;
+    btree_node_t *leaf = btree_find_leaf(db, schema->root_page_id, key, &page_handle);
+    if (!leaf) return 0;
+    
+    page_id_t page_id = page_handle->page_id;
+    buffer_release_page(db->buffer_pool, page_handle);
+    return page_id;
+}
+
+// Visits the visible rows with low <= key <= high in key order by walking
+// the leaf chain. NULL bounds are open. Rows passed to the callback point
+// into the pinned leaf and are only valid during the call.
+int btree_row_scan(database_t *db, table_schema_t *schema, const value_t *low, const value_t *high,
+                   transaction_id_t txn_id, row_scan_fn callback, void *arg) {
+    int key_column = btree_key_column(schema);
+    if (key_column < 0) return -1;
+    
+    snapshot_t snapshot;
+    txn_snapshot(db, txn_id, &snapshot);
+    
+    page_t *page_handle = NULL;
+    btree_row_leaf_t *leaf;
+    int pos = 0;
+    
+    if (low) {
+        leaf = (btree_row_leaf_t*)btree_find_leaf(db, schema->root_page_id, low, &page_handle);
+        if (leaf) pos = btree_row_find_position(leaf, key_column, low);
+    } else {
+        leaf = (btree_row_leaf_t*)btree_leftmost_leaf(db, schema->root_page_id, &page_handle);
+    }
+    if (!leaf) return -1;
+    
+    while (1) {
+        for (; pos < leaf->key_count; pos++) {
+            tuple_t *row = &leaf->rows[pos];
+            
+            if (high && value_compare(&row->values[key_column], high) > 0) {
+                buffer_release_page(db->buffer_pool, page_handle);
+                return 0;
+            }
+            
+            tuple_header_t header = row->header;
+            if (mvcc_is_visible(&header, &snapshot) && callback(row, arg)) {
+                buffer_release_page(db->buffer_pool, page_handle);
+                return 0;
+            }
+        }
+        
+        page_id_t next_leaf = leaf->next_leaf;
+        buffer_release_page(db->buffer_pool, page_handle);
+        if (next_leaf == 0) break;
+        
+        leaf = (btree_row_leaf_t*)btree_load_node(db, next_leaf, &page_handle);
+        if (!leaf) return -1;
+        pos = 0;
+    }
+    
     return 0;
-}
\ No newline at end of file
+}
+
+// Removes dead row versions from every leaf of an index-organized table.
+// Leaves are compacted in place; separators in the parents stay valid.
+int btree_row_vacuum(database_t *db, table_schema_t *schema, vacuum_stats_t *stats) {
+    page_t *page_handle = NULL;
+    btree_row_leaf_t *leaf = (btree_row_leaf_t*)btree_leftmost_leaf(db, schema->root_page_id, &page_handle);
+    if (!leaf) return -1;
+    
+    while (1) {
+        int kept = 0;
+        int changed = 0;
+        
+        for (int i = 0; i < leaf->key_count; i++) {
+            transaction_id_t xmax = leaf->rows[i].header.xmax;
+            
+            if (vacuum_tuple_is_dead(db, &leaf->rows[i].header, stats->horizon)) {
+                overflow_free_tuple(db, &leaf->rows[i]);
+                stats->tuples_removed++;
+                changed = 1;
+                continue;
+            }
+            if (leaf->rows[i].header.xmax != xmax) changed = 1;
+            if (kept != i) {
+                leaf->rows[kept] = leaf->rows[i];
+                changed = 1;
+            }
+            kept++;
+        }
+        stats->pages_scanned++;
+        
+        if (changed) {
+            memset(&leaf->rows[kept], 0, (leaf->key_count - kept) * sizeof(tuple_t));
+            leaf->key_count = kept;
+            btree_mark_dirty(page_handle);
+            storage_write_page(db, page_handle->page_id, page_handle->data);
+        }
+        
+        page_id_t next_leaf = leaf->next_leaf;
+        buffer_release_page(db->buffer_pool, page_handle);
+        if (next_leaf == 0) break;
+        
+        leaf = (btree_row_leaf_t*)btree_load_node(db, next_leaf, &page_handle);
+        if (!leaf) return -1;
+    }
+    
+    return 0;
+}
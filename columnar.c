@@ -0,0 +1,518 @@
+#include "tinydb.h"
+
+// Columnar tables use PAX pages: every page holds a group of rows, but the
+// values of each column are stored together in their own minipage so a scan
+// touching one column only reads that column's bytes.
+//
+//   [header][xmin x N][xmax x N][col0 nulls][col0 values]...[colK nulls][colK values]
+
+typedef struct {
+    int capacity;
+    int xmin_offset;
+    int xmax_offset;
+    int null_offsets[MAX_COLUMNS];
+    int column_offsets[MAX_COLUMNS];
+    int widths[MAX_COLUMNS];
+} pax_layout_t;
+
+#define PAX_ALIGN(x) (((x) + 7) & ~7)
+
+static int pax_column_width(const column_def_t *col) {
+    if (col->is_dictionary) return sizeof(dict_code_t);
+    
+    switch (col->type) {
+        case DATA_TYPE_INT:
+            return sizeof(int);
+        case DATA_TYPE_FLOAT:
+            return sizeof(float);
+        case DATA_TYPE_VARCHAR: {
+            int size = col->size;
+            if (size <= 0 || size > MAX_VALUE_SIZE - 1) size = MAX_VALUE_SIZE - 1;
+            return size + 1;
+        }
+    }
+    return 0;
+}
+
+static int pax_layout_size(const table_schema_t *schema, int capacity, pax_layout_t *layout) {
+    int offset = PAX_ALIGN((int)sizeof(heap_page_header_t));
+    
+    layout->capacity = capacity;
+    layout->xmin_offset = offset;
+    offset += capacity * sizeof(transaction_id_t);
+    layout->xmax_offset = offset;
+    offset += capacity * sizeof(transaction_id_t);
+    
+    for (int i = 0; i < schema->column_count; i++) {
+        layout->widths[i] = pax_column_width(&schema->columns[i]);
+        layout->null_offsets[i] = offset;
+        offset = PAX_ALIGN(offset + (capacity + 7) / 8);
+        layout->column_offsets[i] = offset;
+        offset = PAX_ALIGN(offset + capacity * layout->widths[i]);
+    }
+    
+    return offset;
+}
+
+// The layout only depends on the schema, so it is recomputed rather than
+// stored in every page.
+static void pax_compute_layout(const table_schema_t *schema, pax_layout_t *layout) {
+    int row_bytes = 2 * sizeof(transaction_id_t);
+    for (int i = 0; i < schema->column_count; i++) {
+        row_bytes += pax_column_width(&schema->columns[i]);
+    }
+    
+    int capacity = PAGE_SIZE / row_bytes;
+    while (capacity > 1 && pax_layout_size(schema, capacity, layout) > PAGE_SIZE) {
+        capacity--;
+    }
+    pax_layout_size(schema, capacity, layout);
+}
+
+static void pax_mark_dirty(page_t *page) {
+    pthread_mutex_lock(&page->page_mutex);
+    page->is_dirty = 1;
+    pthread_mutex_unlock(&page->page_mutex);
+}
+
+static page_t* pax_allocate_page(database_t *db, table_schema_t *schema, const pax_layout_t *layout) {
+    return table_append_page(db, schema, layout->capacity);
+}
+
+static void pax_read_value(database_t *db, const char *data, const pax_layout_t *layout,
+                           table_schema_t *schema, int col, int slot, value_t *val) {
+    const uint8_t *nulls = (const uint8_t*)(data + layout->null_offsets[col]);
+    const char *src = data + layout->column_offsets[col] + slot * layout->widths[col];
+    
+    memset(val, 0, sizeof(value_t));
+    val->type = schema->columns[col].type;
+    val->is_null = (nulls[slot / 8] >> (slot % 8)) & 1;
+    if (val->is_null) return;
+    
+    switch (val->type) {
+        case DATA_TYPE_INT:
+            memcpy(&val->data.int_val, src, sizeof(int));
+            break;
+        case DATA_TYPE_FLOAT:
+            memcpy(&val->data.float_val, src, sizeof(float));
+            break;
+        case DATA_TYPE_VARCHAR:
+            if (schema->columns[col].is_dictionary) {
+                dict_code_t code;
+                memcpy(&code, src, sizeof(dict_code_t));
+                dictionary_t *dict = dictionary_get(db, schema, col);
+                const char *text = dict ? dictionary_value(dict, code) : NULL;
+                if (text) strcpy(val->data.str_val, text);
+            } else {
+                strncpy(val->data.str_val, src, MAX_VALUE_SIZE - 1);
+            }
+            break;
+    }
+}
+
+int columnar_insert(database_t *db, table_schema_t *schema, const tuple_t *tuple,
+                    page_id_t *page_id, slot_id_t *slot) {
+    pax_layout_t layout;
+    pax_compute_layout(schema, &layout);
+    
+    for (int i = 0; i < schema->column_count; i++) {
+        const value_t *val = &tuple->values[i];
+        if (!val->is_null && val->type == DATA_TYPE_VARCHAR && !schema->columns[i].is_dictionary &&
+            (val->is_external || (int)strlen(val->data.str_val) >= layout.widths[i])) {
+            printf("Value too long for column %s\n", schema->columns[i].name);
+            return -1;
+        }
+    }
+    
+    // Encode before touching the page so a full dictionary leaves it unchanged
+    dict_code_t codes[MAX_COLUMNS];
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_dictionary && !tuple->values[i].is_null &&
+            dictionary_encode(db, schema, i, tuple->values[i].data.str_val, &codes[i]) != 0) {
+            return -1;
+        }
+    }
+    
+    page_t *page = NULL;
+    if (schema->last_page_id != 0) {
+        page = buffer_get_page(db->buffer_pool, schema->last_page_id);
+        if (!page) return -1;
+        
+        heap_page_header_t *header = (heap_page_header_t*)page->data;
+        if (header->tuple_count >= header->capacity) {
+            buffer_release_page(db->buffer_pool, page);
+            page = NULL;
+        }
+    }
+    
+    if (!page) {
+        page = pax_allocate_page(db, schema, &layout);
+        if (!page) return -1;
+    }
+    
+    char *data = page->data;
+    heap_page_header_t *header = (heap_page_header_t*)data;
+    int row = header->tuple_count;
+    
+    ((transaction_id_t*)(data + layout.xmin_offset))[row] = tuple->header.xmin;
+    ((transaction_id_t*)(data + layout.xmax_offset))[row] = tuple->header.xmax;
+    
+    for (int i = 0; i < schema->column_count; i++) {
+        const value_t *val = &tuple->values[i];
+        uint8_t *nulls = (uint8_t*)(data + layout.null_offsets[i]);
+        char *dest = data + layout.column_offsets[i] + row * layout.widths[i];
+        
+        if (val->is_null) {
+            nulls[row / 8] |= (uint8_t)(1 << (row % 8));
+            continue;
+        }
+        
+        switch (schema->columns[i].type) {
+            case DATA_TYPE_INT:
+                memcpy(dest, &val->data.int_val, sizeof(int));
+                break;
+            case DATA_TYPE_FLOAT:
+                memcpy(dest, &val->data.float_val, sizeof(float));
+                break;
+            case DATA_TYPE_VARCHAR:
+                if (schema->columns[i].is_dictionary) {
+                    memcpy(dest, &codes[i], sizeof(dict_code_t));
+                } else {
+                    strncpy(dest, val->data.str_val, layout.widths[i] - 1);
+                    dest[layout.widths[i] - 1] = '\0';
+                }
+                break;
+        }
+    }
+    
+    header->tuple_count++;
+    *page_id = page->page_id;
+    *slot = row;
+    
+    pax_mark_dirty(page);
+    storage_write_page(db, page->page_id, page->data);
+    buffer_release_page(db->buffer_pool, page);
+    
+    return 0;
+}
+
+int columnar_load_tuple(database_t *db, table_schema_t *schema, page_id_t page_id,
+                        slot_id_t slot, tuple_t *tuple) {
+    page_t *page = buffer_get_page(db->buffer_pool, page_id);
+    if (!page) return -1;
+    
+    int result = columnar_read_tuple(db, schema, page->data, slot, tuple);
+    
+    buffer_release_page(db->buffer_pool, page);
+    return result;
+}
+
+// Reads the MVCC header of one row of a PAX page image
+int columnar_read_header(const table_schema_t *schema, const char *page_data, int slot, tuple_header_t *header) {
+    const heap_page_header_t *page_header = (const heap_page_header_t*)page_data;
+    if (slot < 0 || slot >= page_header->tuple_count) return -1;
+    
+    pax_layout_t layout;
+    pax_compute_layout(schema, &layout);
+    
+    memset(header, 0, sizeof(tuple_header_t));
+    header->xmin = ((const transaction_id_t*)(page_data + layout.xmin_offset))[slot];
+    header->xmax = ((const transaction_id_t*)(page_data + layout.xmax_offset))[slot];
+    return 0;
+}
+
+// Materializes one row of a PAX page image
+int columnar_read_tuple(database_t *db, table_schema_t *schema, const char *page_data,
+                        int slot, tuple_t *tuple) {
+    const heap_page_header_t *header = (const heap_page_header_t*)page_data;
+    if (slot < 0 || slot >= header->tuple_count) return -1;
+    
+    pax_layout_t layout;
+    pax_compute_layout(schema, &layout);
+    
+    tuple->header.xmin = ((const transaction_id_t*)(page_data + layout.xmin_offset))[slot];
+    tuple->header.xmax = ((const transaction_id_t*)(page_data + layout.xmax_offset))[slot];
+    tuple->header.is_deleted = 0;
+    tuple->column_count = schema->column_count;
+    
+    for (int i = 0; i < schema->column_count; i++) {
+        pax_read_value(db, page_data, &layout, schema, i, slot, &tuple->values[i]);
+    }
+    return 0;
+}
+
+int columnar_mark_deleted(database_t *db, table_schema_t *schema, page_id_t page_id,
+                          slot_id_t slot, transaction_id_t txn_id) {
+    pax_layout_t layout;
+    pax_compute_layout(schema, &layout);
+    
+    page_t *page = buffer_get_page(db->buffer_pool, page_id);
+    if (!page) return -1;
+    
+    heap_page_header_t *header = (heap_page_header_t*)page->data;
+    if ((int)slot >= header->tuple_count) {
+        buffer_release_page(db->buffer_pool, page);
+        return -1;
+    }
+    
+    ((transaction_id_t*)(page->data + layout.xmax_offset))[slot] = txn_id;
+    
+    pax_mark_dirty(page);
+    storage_write_page(db, page_id, page->data);
+    buffer_release_page(db->buffer_pool, page);
+    return 0;
+}
+
+int columnar_scan(database_t *db, const char *table_name, const int *column_ids, int column_count,
+                  transaction_id_t txn_id, column_scan_fn callback, void *arg) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema || schema->storage_type != STORAGE_COLUMN) return -1;
+    if (column_count < 0 || column_count > MAX_COLUMNS) return -1;
+    
+    for (int i = 0; i < column_count; i++) {
+        if (column_ids[i] < 0 || column_ids[i] >= schema->column_count) return -1;
+    }
+    
+    pax_layout_t layout;
+    pax_compute_layout(schema, &layout);
+    
+    snapshot_t snapshot;
+    txn_snapshot(db, txn_id, &snapshot);
+    
+    uint8_t visible[PAGE_SIZE];
+    column_vector_t columns[MAX_COLUMNS];
+    page_id_t page_id = schema->first_page_id;
+    
+    while (page_id != 0) {
+        page_t *page = buffer_get_page(db->buffer_pool, page_id);
+        if (!page) return -1;
+        
+        const char *data = page->data;
+        const heap_page_header_t *header = (const heap_page_header_t*)data;
+        const transaction_id_t *xmins = (const transaction_id_t*)(data + layout.xmin_offset);
+        const transaction_id_t *xmaxs = (const transaction_id_t*)(data + layout.xmax_offset);
+        
+        for (int row = 0; row < header->tuple_count; row++) {
+            tuple_header_t tuple_header = { xmins[row], xmaxs[row], 0, 0, 0, 0 };
+            visible[row] = (uint8_t)mvcc_is_visible(&tuple_header, &snapshot);
+        }
+        
+        for (int i = 0; i < column_count; i++) {
+            int col = column_ids[i];
+            columns[i].type = schema->columns[col].type;
+            columns[i].width = layout.widths[col];
+            columns[i].data = data + layout.column_offsets[col];
+            columns[i].null_bitmap = (const uint8_t*)(data + layout.null_offsets[col]);
+            columns[i].dictionary = dictionary_get(db, schema, col);
+        }
+        
+        int stop = callback(columns, header->tuple_count, visible, arg);
+        page_id_t next_page_id = header->next_page_id;
+        buffer_release_page(db->buffer_pool, page);
+        
+        if (stop) break;
+        page_id = next_page_id;
+    }
+    
+    return 0;
+}
+
+// Appends the rows in [first, first + count) of a PAX page image that are
+// visible in the snapshot to the batch, with their locations. Only the listed
+// columns are read, each with a loop specialized for its type, and
+// dictionary columns are copied as codes; batch columns whose id is
+// negative are left for later. Returns the number of rows added.
+int columnar_read_batch(database_t *db, table_schema_t *schema, page_id_t page_id, const char *page_data,
+                        int first, int count, const snapshot_t *snapshot, const int *column_ids, int column_count,
+                        batch_t *batch) {
+    pax_layout_t layout;
+    pax_compute_layout(schema, &layout);
+    
+    const transaction_id_t *xmins = (const transaction_id_t*)(page_data + layout.xmin_offset);
+    const transaction_id_t *xmaxs = (const transaction_id_t*)(page_data + layout.xmax_offset);
+    uint16_t rows[BATCH_SIZE];
+    int visible = 0;
+    
+    for (int row = first; row < first + count; row++) {
+        tuple_header_t header = { xmins[row], xmaxs[row], 0, 0, 0, 0 };
+        if (mvcc_is_visible(&header, snapshot)) {
+            rows[visible++] = (uint16_t)row;
+        }
+    }
+    
+    int dest = batch->row_count;
+    for (int k = 0; k < visible; k++) {
+        batch->row_pages[dest + k] = page_id;
+        batch->row_slots[dest + k] = rows[k];
+    }
+    
+    for (int i = 0; i < column_count; i++) {
+        int col = column_ids[i];
+        if (col < 0) continue;
+        
+        vector_t *vec = &batch->columns[i];
+        const uint8_t *nulls = (const uint8_t*)(page_data + layout.null_offsets[col]);
+        const char *src = page_data + layout.column_offsets[col];
+        int width = layout.widths[col];
+        
+        for (int k = 0; k < visible; k++) {
+            vec->nulls[dest + k] = (nulls[rows[k] / 8] >> (rows[k] % 8)) & 1;
+        }
+        
+        switch (schema->columns[col].type) {
+            case DATA_TYPE_INT:
+                for (int k = 0; k < visible; k++) {
+                    memcpy(&vec->ints[dest + k], src + rows[k] * width, sizeof(int));
+                }
+                break;
+            case DATA_TYPE_FLOAT:
+                for (int k = 0; k < visible; k++) {
+                    memcpy(&vec->floats[dest + k], src + rows[k] * width, sizeof(float));
+                }
+                break;
+            case DATA_TYPE_VARCHAR:
+                if (schema->columns[col].is_dictionary) {
+                    for (int k = 0; k < visible; k++) {
+                        memcpy(&vec->codes[dest + k], src + rows[k] * width, sizeof(dict_code_t));
+                    }
+                    break;
+                }
+                for (int k = 0; k < visible; k++) {
+                    pax_read_value(db, page_data, &layout, schema, col, rows[k], &vec->strings[dest + k]);
+                }
+                break;
+        }
+    }
+    
+    batch->row_count += visible;
+    return visible;
+}
+
+// Reads the listed columns of the given batch rows, which are all stored
+// on this PAX page image, into the batch. Negative column ids are skipped;
+// dictionary columns are read as codes.
+void columnar_fetch_rows(database_t *db, table_schema_t *schema, const char *page_data,
+                         const int *column_ids, int column_count, batch_t *batch, const uint16_t *rows, int count) {
+    pax_layout_t layout;
+    pax_compute_layout(schema, &layout);
+    
+    for (int i = 0; i < column_count; i++) {
+        int col = column_ids[i];
+        if (col < 0) continue;
+        
+        if (schema->columns[col].is_dictionary) {
+            vector_t *vec = &batch->columns[i];
+            const uint8_t *nulls = (const uint8_t*)(page_data + layout.null_offsets[col]);
+            const char *src = page_data + layout.column_offsets[col];
+            for (int k = 0; k < count; k++) {
+                int slot = batch->row_slots[rows[k]];
+                vec->nulls[rows[k]] = (nulls[slot / 8] >> (slot % 8)) & 1;
+                memcpy(&vec->codes[rows[k]], src + slot * layout.widths[col], sizeof(dict_code_t));
+            }
+            continue;
+        }
+        
+        for (int k = 0; k < count; k++) {
+            value_t value;
+            pax_read_value(db, page_data, &layout, schema, column_ids[i], batch->row_slots[rows[k]], &value);
+            batch_set_value(batch, i, rows[k], &value);
+        }
+    }
+}
+
+// Moves row `from` to row `to` within a PAX page, column by column.
+static void pax_move_row(char *data, const pax_layout_t *layout, const table_schema_t *schema,
+                         int from, int to) {
+    transaction_id_t *xmins = (transaction_id_t*)(data + layout->xmin_offset);
+    transaction_id_t *xmaxs = (transaction_id_t*)(data + layout->xmax_offset);
+    xmins[to] = xmins[from];
+    xmaxs[to] = xmaxs[from];
+    
+    for (int i = 0; i < schema->column_count; i++) {
+        uint8_t *nulls = (uint8_t*)(data + layout->null_offsets[i]);
+        char *values = data + layout->column_offsets[i];
+        int is_null = (nulls[from / 8] >> (from % 8)) & 1;
+        
+        memcpy(values + to * layout->widths[i], values + from * layout->widths[i], layout->widths[i]);
+        if (is_null) {
+            nulls[to / 8] |= (uint8_t)(1 << (to % 8));
+        } else {
+            nulls[to / 8] &= (uint8_t)~(1 << (to % 8));
+        }
+    }
+}
+
+static void pax_clear_rows(char *data, const pax_layout_t *layout, const table_schema_t *schema,
+                           int from, int to) {
+    for (int row = from; row < to; row++) {
+        ((transaction_id_t*)(data + layout->xmin_offset))[row] = 0;
+        ((transaction_id_t*)(data + layout->xmax_offset))[row] = 0;
+        for (int i = 0; i < schema->column_count; i++) {
+            uint8_t *nulls = (uint8_t*)(data + layout->null_offsets[i]);
+            nulls[row / 8] &= (uint8_t)~(1 << (row % 8));
+            memset(data + layout->column_offsets[i] + row * layout->widths[i], 0, layout->widths[i]);
+        }
+    }
+}
+
+// Compacts one PAX page the same way heap_vacuum_page compacts a row page.
+// Returns the number of rows left on the page.
+int columnar_vacuum_page(database_t *db, table_schema_t *schema, page_id_t page_id,
+                         vacuum_stats_t *stats) {
+    pax_layout_t layout;
+    pax_compute_layout(schema, &layout);
+    
+    page_t *page = buffer_get_page(db->buffer_pool, page_id);
+    if (!page) return -1;
+    
+    char *data = page->data;
+    heap_page_header_t *header = (heap_page_header_t*)data;
+    transaction_id_t *xmins = (transaction_id_t*)(data + layout.xmin_offset);
+    transaction_id_t *xmaxs = (transaction_id_t*)(data + layout.xmax_offset);
+    int pk = -1;
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_primary_key) pk = i;
+    }
+    
+    int kept = 0;
+    int changed = 0;
+    value_t key;
+    for (int row = 0; row < header->tuple_count; row++) {
+        tuple_header_t tuple_header = { xmins[row], xmaxs[row], 0, 0, 0, 0 };
+        
+        if (vacuum_tuple_is_dead(db, &tuple_header, stats->horizon)) {
+            if (pk >= 0) {
+                pax_read_value(db, data, &layout, schema, pk, row, &key);
+                vacuum_index_relocate(db, schema, &key, page_id, row, -1);
+            }
+            stats->tuples_removed++;
+            changed = 1;
+            continue;
+        }
+        
+        if (tuple_header.xmax != xmaxs[row]) {
+            xmaxs[row] = tuple_header.xmax;
+            changed = 1;
+        }
+        
+        if (kept != row) {
+            pax_move_row(data, &layout, schema, row, kept);
+            if (pk >= 0) {
+                pax_read_value(db, data, &layout, schema, pk, kept, &key);
+                vacuum_index_relocate(db, schema, &key, page_id, row, kept);
+            }
+            changed = 1;
+        }
+        kept++;
+    }
+    
+    if (changed) {
+        pax_clear_rows(data, &layout, schema, kept, header->tuple_count);
+        header->tuple_count = kept;
+        pax_mark_dirty(page);
+        storage_write_page(db, page_id, page->data);
+    }
+    
+    buffer_release_page(db->buffer_pool, page);
+    return kept;
+}
@@ -0,0 +1,734 @@
+#include "tinydb.h"
+#include <errno.h>
+#include <limits.h>
+
+// Bulk loading with COPY. A load runs as a pipeline:
+//
+//   read chunk -> parse rows -> sort by key, fill pages, insert keys in order
+//   (shared)      (workers)     (caller's thread)
+//
+// Worker threads take turns reading the next chunk of the file, each cut at
+// a row boundary, and parse it into batches of typed columns. The caller
+// collects their batches into runs of COPY_RUN_ROWS rows and stores each run
+// with tuple_insert_batch_into(), so pages are allocated and written by one
+// thread only and the index receives long sorted runs of keys.
+//
+// The binary format is the file header followed by one record per row:
+//
+//   header: "TINYCPY1", uint32 column count, one uint8 type per column
+//   record: uint32 payload length, then per column a uint8 null flag and,
+//           unless NULL, an int32, a float or a uint32 length and the bytes
+//
+// Numbers are in the byte order of the machine that wrote the file.
+
+#define COPY_CHUNK_SIZE (256 * 1024)
+#define COPY_RUN_ROWS (8 * BATCH_SIZE)
+#define COPY_MAX_RECORD (MAX_COLUMNS * (1 + sizeof(uint32_t) + MAX_VARCHAR_SIZE))
+
+static const char copy_magic[8] = { 'T', 'I', 'N', 'Y', 'C', 'P', 'Y', '1' };
+
+// Whole rows of the file, and the line (CSV) or row (binary) they start at
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    long long first_row;
+} copy_chunk_t;
+
+// Strings too long for str_val, owned by the batch being filled
+typedef struct {
+    char **texts;
+    int count;
+    int capacity;
+} copy_texts_t;
+
+typedef struct {
+    table_schema_t *schema;
+    copy_format_t format;
+    
+    // Input, shared by the workers
+    pthread_mutex_t input_mutex;
+    FILE *file;
+    int at_end;
+    int input_failed;
+    char *pending;                // Read past the end of the last chunk
+    size_t pending_length;
+    size_t pending_capacity;
+    long long next_row;
+    
+    parallel_t parallel;
+    batch_t batches[MAX_PARALLELISM];
+    copy_texts_t texts[MAX_PARALLELISM];
+    char *fields[MAX_PARALLELISM];   // Unquoted CSV field of each worker
+} copy_state_t;
+
+static int copy_chunk_reserve(copy_chunk_t *chunk, size_t capacity) {
+    if (chunk->capacity >= capacity) return 0;
+    char *data = realloc(chunk->data, capacity);
+    if (!data) return -1;
+    chunk->data = data;
+    chunk->capacity = capacity;
+    return 0;
+}
+
+// Length of the complete CSV rows at the start of data, and the lines they
+// span. Newlines inside quoted fields do not end a row.
+static size_t copy_csv_split(const char *data, size_t length, long long *lines) {
+    size_t end = 0;
+    long long newlines = 0;
+    int quoted = 0;
+    
+    *lines = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == '"') {
+            quoted = !quoted;
+        } else if (data[i] == '\n') {
+            newlines++;
+            if (!quoted) {
+                end = i + 1;
+                *lines = newlines;
+            }
+        }
+    }
+    return end;
+}
+
+// Length of the complete binary records at the start of data, and their
+// count. Returns -1 for a record longer than any row can be.
+static long long copy_binary_split(const char *data, size_t length, long long *rows) {
+    size_t end = 0;
+    
+    *rows = 0;
+    while (length - end >= sizeof(uint32_t)) {
+        uint32_t record_length;
+        memcpy(&record_length, data + end, sizeof(record_length));
+        if (record_length > COPY_MAX_RECORD) return -1;
+        if (length - end - sizeof(uint32_t) < record_length) break;
+        end += sizeof(uint32_t) + record_length;
+        (*rows)++;
+    }
+    return (long long)end;
+}
+
+// Fills the chunk with the next whole rows of the file. Returns 1 with
+// rows, 0 at the end of the file and -1 on error.
+static int copy_read_chunk(copy_state_t *state, copy_chunk_t *chunk) {
+    int result = 1;
+    pthread_mutex_lock(&state->input_mutex);
+    
+    chunk->length = 0;
+    size_t length = state->pending_length;
+    if (state->input_failed ||
+        copy_chunk_reserve(chunk, state->pending_length + COPY_CHUNK_SIZE) != 0) {
+        state->input_failed = 1;
+        pthread_mutex_unlock(&state->input_mutex);
+        return -1;
+    }
+    if (length > 0) memcpy(chunk->data, state->pending, length);
+    state->pending_length = 0;
+    
+    long long rows = 0;
+    long long end = 0;
+    while (1) {
+        if (!state->at_end) {
+            size_t wanted = chunk->capacity - length;
+            size_t got = fread(chunk->data + length, 1, wanted, state->file);
+            length += got;
+            if (got < wanted) {
+                if (ferror(state->file)) {
+                    printf("COPY: cannot read the file\n");
+                    result = -1;
+                    break;
+                }
+                state->at_end = 1;
+            }
+        }
+        
+        if (state->format == COPY_FORMAT_CSV) {
+            end = (long long)copy_csv_split(chunk->data, length, &rows);
+            if (state->at_end && (size_t)end < length) {
+                // The last line need not end with a newline
+                end = (long long)length;
+                rows++;
+            }
+        } else {
+            end = copy_binary_split(chunk->data, length, &rows);
+            if (end < 0 || (state->at_end && (size_t)end < length)) {
+                printf("COPY: row %lld: damaged or truncated record\n", state->next_row + rows);
+                result = -1;
+                break;
+            }
+        }
+        if (end > 0 || state->at_end) break;
+        
+        // Not one whole row yet
+        if (copy_chunk_reserve(chunk, chunk->capacity * 2) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    
+    // Keep what follows the last whole row for the next chunk
+    size_t rest = result > 0 ? length - (size_t)end : 0;
+    if (rest > state->pending_capacity) {
+        char *pending = realloc(state->pending, rest);
+        if (pending) {
+            state->pending = pending;
+            state->pending_capacity = rest;
+        } else {
+            result = -1;
+        }
+    }
+    if (result > 0) {
+        if (rest > 0) memcpy(state->pending, chunk->data + end, rest);
+        state->pending_length = rest;
+        chunk->length = (size_t)end;
+        chunk->first_row = state->next_row;
+        state->next_row += rows;
+        if (end == 0) result = 0;
+    } else {
+        state->input_failed = 1;
+    }
+    
+    pthread_mutex_unlock(&state->input_mutex);
+    return result;
+}
+
+static void copy_texts_clear(copy_texts_t *texts) {
+    for (int i = 0; i < texts->count; i++) {
+        free(texts->texts[i]);
+    }
+    texts->count = 0;
+}
+
+// Keeps a copy of a long string until the batch holding it is consumed
+static int copy_texts_add(copy_texts_t *texts, const char *text, size_t length, value_t *value) {
+    if (texts->count == texts->capacity) {
+        int capacity = texts->capacity ? texts->capacity * 2 : 64;
+        char **grown = realloc(texts->texts, capacity * sizeof(char*));
+        if (!grown) return -1;
+        texts->texts = grown;
+        texts->capacity = capacity;
+    }
+    
+    char *copy = malloc(length + 1);
+    if (!copy) return -1;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    texts->texts[texts->count++] = copy;
+    
+    value->is_external = 1;
+    value->data.ext.page_id = 0;
+    value->data.ext.length = length;
+    value->data.ext.data = copy;
+    return 0;
+}
+
+// Makes a value of the column's type from its text, which is NUL-terminated
+static int copy_convert(copy_state_t *state, int worker, int column, const char *text, size_t length,
+                        value_t *value) {
+    const column_def_t *def = &state->schema->columns[column];
+    char *end;
+    
+    memset(value, 0, sizeof(value_t));
+    value->type = def->type;
+    errno = 0;
+    
+    switch (def->type) {
+        case DATA_TYPE_INT: {
+            long number = strtol(text, &end, 10);
+            if (length == 0 || *end != '\0' || errno != 0 || number < INT_MIN || number > INT_MAX) break;
+            value->data.int_val = (int)number;
+            return 0;
+        }
+        case DATA_TYPE_FLOAT:
+            value->data.float_val = strtof(text, &end);
+            if (length == 0 || *end != '\0') break;
+            return 0;
+        case DATA_TYPE_VARCHAR:
+            if (length < MAX_VALUE_SIZE) {
+                memcpy(value->data.str_val, text, length + 1);
+                return 0;
+            }
+            return copy_texts_add(&state->texts[worker], text, length, value);
+    }
+    
+    printf("Invalid value for column %s: %s\n", def->name, text);
+    return -1;
+}
+
+// Hands the worker's batch to the caller and waits until it is stored.
+// Returns -1 if the load is being stopped.
+static int copy_emit(copy_state_t *state, int worker) {
+    batch_t *batch = &state->batches[worker];
+    if (batch->row_count == 0) return 0;
+    
+    batch_select_all(batch);
+    int result = parallel_emit(&state->parallel, worker, batch);
+    batch->row_count = 0;
+    copy_texts_clear(&state->texts[worker]);
+    return result;
+}
+
+static int copy_add_row(copy_state_t *state, int worker, const value_t *values) {
+    batch_t *batch = &state->batches[worker];
+    for (int i = 0; i < batch->column_count; i++) {
+        batch_set_value(batch, i, batch->row_count, &values[i]);
+    }
+    batch->row_count++;
+    
+    return batch->row_count == BATCH_SIZE ? copy_emit(state, worker) : 0;
+}
+
+// Parses the CSV rows of a chunk. A field may be quoted, with "" standing
+// for a quote inside it; an unquoted empty field is NULL. Empty lines are
+// skipped.
+static int copy_parse_csv(copy_state_t *state, int worker, const copy_chunk_t *chunk) {
+    const char *p = chunk->data;
+    const char *end = chunk->data + chunk->length;
+    char *field = state->fields[worker];
+    int column_count = state->schema->column_count;
+    long long line = chunk->first_row;
+    
+    while (p < end) {
+        long long row_line = line;
+        if (*p == '\n' || (*p == '\r' && p + 1 < end && p[1] == '\n')) {
+            p += *p == '\r' ? 2 : 1;
+            line++;
+            continue;
+        }
+        
+        value_t values[MAX_COLUMNS];
+        int count = 0;
+        while (1) {
+            size_t length = 0;
+            int quoted = p < end && *p == '"';
+            int too_long = 0;
+            
+            if (quoted) {
+                p++;
+                while (p < end && (*p != '"' || (p + 1 < end && p[1] == '"'))) {
+                    if (*p == '"') p++;
+                    if (*p == '\n') line++;
+                    if (length < MAX_VARCHAR_SIZE) {
+                        field[length++] = *p;
+                    } else {
+                        too_long = 1;
+                    }
+                    p++;
+                }
+                if (p == end) {
+                    printf("COPY: line %lld: unterminated quoted field\n", row_line);
+                    return -1;
+                }
+                p++;
+            } else {
+                while (p < end && *p != ',' && *p != '\n') {
+                    if (length < MAX_VARCHAR_SIZE) {
+                        field[length++] = *p;
+                    } else {
+                        too_long = 1;
+                    }
+                    p++;
+                }
+                if (length > 0 && field[length - 1] == '\r' && (p == end || *p == '\n')) length--;
+            }
+            field[length] = '\0';
+            
+            if (count == column_count) {
+                printf("COPY: line %lld: more than %d values\n", row_line, column_count);
+                return -1;
+            }
+            if (too_long) {
+                printf("COPY: line %lld: value too long\n", row_line);
+                return -1;
+            }
+            if (!quoted && length == 0) {
+                memset(&values[count], 0, sizeof(value_t));
+                values[count].type = state->schema->columns[count].type;
+                values[count].is_null = 1;
+            } else if (copy_convert(state, worker, count, field, length, &values[count]) != 0) {
+                printf("COPY: line %lld: cannot load the row\n", row_line);
+                return -1;
+            }
+            count++;
+            
+            if (p < end && *p == '\r' && p + 1 < end && p[1] == '\n') p++;
+            if (p == end || *p == '\n') break;
+            if (*p != ',') {
+                printf("COPY: line %lld: expected a comma after a quoted field\n", row_line);
+                return -1;
+            }
+            p++;
+        }
+        if (p < end) {
+            p++;
+            line++;
+        }
+        
+        if (count != column_count) {
+            printf("COPY: line %lld: %d values for %d columns\n", row_line, count, column_count);
+            return -1;
+        }
+        if (copy_add_row(state, worker, values) != 0) return -1;
+    }
+    return 0;
+}
+
+// Parses the binary records of a chunk
+static int copy_parse_binary(copy_state_t *state, int worker, const copy_chunk_t *chunk) {
+    const char *p = chunk->data;
+    const char *end = chunk->data + chunk->length;
+    long long row = chunk->first_row;
+    
+    for (; p < end; row++) {
+        uint32_t record_length;
+        memcpy(&record_length, p, sizeof(record_length));
+        p += sizeof(record_length);
+        const char *record_end = p + record_length;
+        
+        value_t values[MAX_COLUMNS];
+        for (int i = 0; i < state->schema->column_count; i++) {
+            value_t *value = &values[i];
+            memset(value, 0, sizeof(value_t));
+            value->type = state->schema->columns[i].type;
+            if (p >= record_end) goto damaged;
+            value->is_null = *p++;
+            if (value->is_null) continue;
+            
+            switch (value->type) {
+                case DATA_TYPE_INT:
+                    if (record_end - p < (long)sizeof(int32_t)) goto damaged;
+                    memcpy(&value->data.int_val, p, sizeof(int32_t));
+                    p += sizeof(int32_t);
+                    break;
+                case DATA_TYPE_FLOAT:
+                    if (record_end - p < (long)sizeof(float)) goto damaged;
+                    memcpy(&value->data.float_val, p, sizeof(float));
+                    p += sizeof(float);
+                    break;
+                case DATA_TYPE_VARCHAR: {
+                    uint32_t length;
+                    if (record_end - p < (long)sizeof(length)) goto damaged;
+                    memcpy(&length, p, sizeof(length));
+                    p += sizeof(length);
+                    if (length > MAX_VARCHAR_SIZE || (uint32_t)(record_end - p) < length) goto damaged;
+                    if (length < MAX_VALUE_SIZE) {
+                        memcpy(value->data.str_val, p, length);
+                        value->data.str_val[length] = '\0';
+                    } else if (copy_texts_add(&state->texts[worker], p, length, value) != 0) {
+                        return -1;
+                    }
+                    p += length;
+                    break;
+                }
+            }
+        }
+        if (p != record_end) goto damaged;
+        
+        if (copy_add_row(state, worker, values) != 0) return -1;
+    }
+    return 0;
+
+damaged:
+    printf("COPY: row %lld: damaged record\n", row);
+    return -1;
+}
+
+static int copy_worker(parallel_t *par, int worker, void *arg) {
+    (void)par;
+    copy_state_t *state = arg;
+    copy_chunk_t chunk = { 0 };
+    int result;
+    
+    while ((result = copy_read_chunk(state, &chunk)) > 0) {
+        if (state->format == COPY_FORMAT_CSV) {
+            result = copy_parse_csv(state, worker, &chunk);
+        } else {
+            result = copy_parse_binary(state, worker, &chunk);
+        }
+        if (result != 0) break;
+    }
+    if (result == 0) result = copy_emit(state, worker);
+    
+    free(chunk.data);
+    return result;
+}
+
+// Rows collected from the workers' batches, with their own copies of long
+// strings since a batch is reused as soon as it has been read
+typedef struct {
+    tuple_t *tuples;
+    int count;
+    copy_texts_t texts;
+} copy_run_t;
+
+static int copy_run_flush(database_t *db, table_schema_t *schema, copy_run_t *run, transaction_id_t txn_id,
+                          long long *row_count) {
+    int result = 0;
+    if (run->count > 0) {
+        result = tuple_insert_batch_into(db, schema, run->tuples, run->count, txn_id);
+        if (result == 0) *row_count += run->count;
+    }
+    run->count = 0;
+    copy_texts_clear(&run->texts);
+    return result;
+}
+
+static int copy_check_header(FILE *file, table_schema_t *schema) {
+    char magic[sizeof(copy_magic)];
+    uint32_t column_count;
+    uint8_t types[MAX_COLUMNS];
+    
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, copy_magic, sizeof(magic)) != 0 ||
+        fread(&column_count, sizeof(column_count), 1, file) != 1) {
+        printf("COPY: not a binary COPY file\n");
+        return -1;
+    }
+    if (column_count != (uint32_t)schema->column_count ||
+        fread(types, 1, column_count, file) != column_count) {
+        printf("COPY: the file has %u columns, the table %d\n", column_count, schema->column_count);
+        return -1;
+    }
+    for (int i = 0; i < schema->column_count; i++) {
+        if (types[i] != (uint8_t)schema->columns[i].type) {
+            printf("COPY: column %s has another type in the file\n", schema->columns[i].name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Loads the rows of a CSV or binary file into the table, in transaction
+// txn_id. With `header`, the first line of a CSV file is skipped. The file
+// is parsed by up to max_parallelism worker threads. Rows are stored in
+// runs; if a run fails, for a bad value or a duplicate key, the runs before
+// it stay inserted in the transaction. Sets *row_count to the rows loaded.
+int copy_from_file(database_t *db, const char *table_name, const char *path, copy_format_t format, int header,
+                   transaction_id_t txn_id, long long *row_count) {
+    *row_count = 0;
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) {
+        printf("Unknown table %s\n", table_name);
+        return -1;
+    }
+    
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("COPY: cannot open %s\n", path);
+        return -1;
+    }
+    
+    copy_state_t *state = calloc(1, sizeof(copy_state_t));
+    copy_run_t run = { 0 };
+    run.tuples = malloc(COPY_RUN_ROWS * sizeof(tuple_t));
+    if (!state || !run.tuples) {
+        free(state);
+        free(run.tuples);
+        fclose(file);
+        return -1;
+    }
+    state->schema = schema;
+    state->format = format;
+    state->file = file;
+    state->next_row = 1;
+    pthread_mutex_init(&state->input_mutex, NULL);
+    
+    int result = 0;
+    if (format == COPY_FORMAT_BINARY) {
+        result = copy_check_header(file, schema);
+    } else if (header) {
+        int c;
+        while ((c = getc(file)) != EOF && c != '\n') {}
+        state->next_row = 2;
+    }
+    
+    data_type_t types[MAX_COLUMNS];
+    for (int i = 0; i < schema->column_count; i++) {
+        types[i] = schema->columns[i].type;
+    }
+    int worker_count = db->max_parallelism > 0 ? db->max_parallelism : 1;
+    int workers_ready = 0;
+    for (; result == 0 && workers_ready < worker_count; workers_ready++) {
+        state->fields[workers_ready] = malloc(MAX_VARCHAR_SIZE + 1);
+        if (!state->fields[workers_ready] ||
+            batch_init(&state->batches[workers_ready], schema->column_count, types) != 0) {
+            free(state->fields[workers_ready]);
+            result = -1;
+            break;
+        }
+    }
+    if (result == 0) result = parallel_start(&state->parallel, worker_count, copy_worker, state);
+    
+    batch_t *batch;
+    int next;
+    while (result == 0 && (next = parallel_next(&state->parallel, &batch)) != 0) {
+        if (next < 0) {
+            result = -1;
+            break;
+        }
+        for (int r = 0; result == 0 && r < batch->row_count; r++) {
+            tuple_t *tuple = &run.tuples[run.count++];
+            tuple->column_count = schema->column_count;
+            for (int i = 0; i < schema->column_count; i++) {
+                value_t *value = &tuple->values[i];
+                batch_get_value(batch, i, r, value);
+                if (value->is_external && !value->is_null &&
+                    copy_texts_add(&run.texts, value->data.ext.data, value->data.ext.length, value) != 0) {
+                    result = -1;
+                }
+            }
+            if (result == 0 && run.count == COPY_RUN_ROWS) {
+                result = copy_run_flush(db, schema, &run, txn_id, row_count);
+            }
+        }
+    }
+    if (result == 0) result = copy_run_flush(db, schema, &run, txn_id, row_count);
+    
+    parallel_stop(&state->parallel);
+    for (int i = 0; i < workers_ready; i++) {
+        batch_free(&state->batches[i]);
+        copy_texts_clear(&state->texts[i]);
+        free(state->texts[i].texts);
+        free(state->fields[i]);
+    }
+    copy_texts_clear(&run.texts);
+    free(run.texts.texts);
+    free(run.tuples);
+    pthread_mutex_destroy(&state->input_mutex);
+    free(state->pending);
+    free(state);
+    fclose(file);
+    return result;
+}
+
+// Writes a CSV field, quoted if it could otherwise be read back differently
+static void copy_write_csv_text(FILE *file, const char *text) {
+    if (text[0] != '\0' && !strpbrk(text, ",\"\r\n")) {
+        fputs(text, file);
+        return;
+    }
+    
+    putc('"', file);
+    for (const char *p = text; *p; p++) {
+        if (*p == '"') putc('"', file);
+        putc(*p, file);
+    }
+    putc('"', file);
+}
+
+static int copy_write_row(database_t *db, table_schema_t *schema, FILE *file, copy_format_t format,
+                          const tuple_t *tuple, char *record) {
+    size_t length = 0;
+    
+    for (int i = 0; i < schema->column_count; i++) {
+        const value_t *value = &tuple->values[i];
+        char *text = NULL;
+        if (!value->is_null && value->type == DATA_TYPE_VARCHAR && value->is_external) {
+            text = overflow_read(db, value);
+            if (!text) return -1;
+        }
+        
+        if (format == COPY_FORMAT_CSV) {
+            if (i > 0) putc(',', file);
+            if (value->is_null) {
+                // Written as an empty field
+            } else if (value->type == DATA_TYPE_INT) {
+                fprintf(file, "%d", value->data.int_val);
+            } else if (value->type == DATA_TYPE_FLOAT) {
+                fprintf(file, "%.9g", value->data.float_val);
+            } else {
+                copy_write_csv_text(file, text ? text : value->data.str_val);
+            }
+        } else {
+            char *out = record + sizeof(uint32_t) + length;
+            *out++ = (char)value->is_null;
+            length++;
+            if (!value->is_null && value->type == DATA_TYPE_INT) {
+                int32_t number = value->data.int_val;
+                memcpy(out, &number, sizeof(number));
+                length += sizeof(number);
+            } else if (!value->is_null && value->type == DATA_TYPE_FLOAT) {
+                memcpy(out, &value->data.float_val, sizeof(float));
+                length += sizeof(float);
+            } else if (!value->is_null) {
+                const char *s = text ? text : value->data.str_val;
+                uint32_t s_length = (uint32_t)strlen(s);
+                memcpy(out, &s_length, sizeof(s_length));
+                memcpy(out + sizeof(s_length), s, s_length);
+                length += sizeof(s_length) + s_length;
+            }
+        }
+        free(text);
+    }
+    
+    if (format == COPY_FORMAT_CSV) {
+        putc('\n', file);
+    } else {
+        uint32_t record_length = (uint32_t)length;
+        memcpy(record, &record_length, sizeof(record_length));
+        fwrite(record, 1, sizeof(record_length) + length, file);
+    }
+    return 0;
+}
+
+// Writes the rows of the table visible to txn_id to a CSV or binary file.
+// With `header`, a CSV file starts with the column names.
+int copy_to_file(database_t *db, const char *table_name, const char *path, copy_format_t format, int header,
+                 transaction_id_t txn_id, long long *row_count) {
+    *row_count = 0;
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) {
+        printf("Unknown table %s\n", table_name);
+        return -1;
+    }
+    
+    table_cursor_t *cursor = malloc(sizeof(table_cursor_t));
+    char *record = malloc(sizeof(uint32_t) + COPY_MAX_RECORD);
+    FILE *file = fopen(path, "wb");
+    if (!cursor || !record || !file) {
+        if (!file) printf("COPY: cannot create %s\n", path);
+        if (file) fclose(file);
+        free(cursor);
+        free(record);
+        return -1;
+    }
+    
+    if (format == COPY_FORMAT_BINARY) {
+        uint32_t column_count = (uint32_t)schema->column_count;
+        fwrite(copy_magic, 1, sizeof(copy_magic), file);
+        fwrite(&column_count, sizeof(column_count), 1, file);
+        for (int i = 0; i < schema->column_count; i++) {
+            putc((uint8_t)schema->columns[i].type, file);
+        }
+    } else if (header) {
+        for (int i = 0; i < schema->column_count; i++) {
+            if (i > 0) putc(',', file);
+            copy_write_csv_text(file, schema->columns[i].name);
+        }
+        putc('\n', file);
+    }
+    
+    int result = table_scan_open(db, table_name, txn_id, cursor);
+    if (result == 0) {
+        tuple_t tuple;
+        int next;
+        while ((next = table_scan_next(cursor, &tuple)) > 0) {
+            if (copy_write_row(db, schema, file, format, &tuple, record) != 0) {
+                result = -1;
+                break;
+            }
+            (*row_count)++;
+        }
+        if (next < 0) result = -1;
+        table_scan_close(cursor);
+    }
+    
+    if (fclose(file) != 0 || result != 0) {
+        if (result == 0) printf("COPY: cannot write %s\n", path);
+        result = -1;
+    }
+    free(cursor);
+    free(record);
+    return result;
+}
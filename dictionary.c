@@ -0,0 +1,238 @@
+#include "tinydb.h"
+
+// Every table with dictionary-encoded columns owns one chain of dictionary
+// pages, referenced from its schema. Entries of all such columns share the
+// chain and are only ever appended:
+//
+//   [dictionary_page_header_t][entry]...[entry] -> next page
+//
+// The entries of a column are loaded into memory on first use and kept in
+// db->dictionaries until the database is closed.
+
+#define DICTIONARY_ENTRIES_PER_PAGE \
+    ((int)((PAGE_SIZE - sizeof(dictionary_page_header_t)) / sizeof(dictionary_entry_t)))
+
+struct dictionary_s {
+    page_id_t page_id;             // First page of the owning table's chain
+    int column;
+    int count;
+    int capacity;
+    char (*values)[MAX_VALUE_SIZE];    // Indexed by code
+    int *slots;                    // Open addressing, code + 1 or 0 when empty
+    int slot_count;
+    struct dictionary_s *next;
+};
+
+static dictionary_entry_t* dictionary_page_entries(char *page_data) {
+    return (dictionary_entry_t*)(page_data + sizeof(dictionary_page_header_t));
+}
+
+static void dictionary_write_page(database_t *db, page_t *page) {
+    pthread_mutex_lock(&page->page_mutex);
+    page->is_dirty = 1;
+    pthread_mutex_unlock(&page->page_mutex);
+    
+    storage_write_page(db, page->page_id, page->data);
+}
+
+static uint32_t dictionary_hash(const char *value) {
+    uint32_t hash = 2166136261u;
+    while (*value) {
+        hash ^= (uint8_t)*value++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int dictionary_rehash(dictionary_t *dict, int slot_count) {
+    int *slots = calloc(slot_count, sizeof(int));
+    if (!slots) return -1;
+    
+    for (int code = 0; code < dict->count; code++) {
+        uint32_t slot = dictionary_hash(dict->values[code]) & (slot_count - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = code + 1;
+    }
+    
+    free(dict->slots);
+    dict->slots = slots;
+    dict->slot_count = slot_count;
+    return 0;
+}
+
+// Adds the next code to the in-memory dictionary
+static int dictionary_append(dictionary_t *dict, const char *value) {
+    if (dict->count == dict->capacity) {
+        int capacity = dict->capacity ? dict->capacity * 2 : 16;
+        char (*values)[MAX_VALUE_SIZE] = realloc(dict->values, capacity * sizeof(*values));
+        if (!values) return -1;
+        dict->values = values;
+        dict->capacity = capacity;
+    }
+    if ((dict->count + 1) * 2 > dict->slot_count &&
+        dictionary_rehash(dict, dict->slot_count ? dict->slot_count * 2 : 32) != 0) {
+        return -1;
+    }
+    
+    strncpy(dict->values[dict->count], value, MAX_VALUE_SIZE - 1);
+    dict->values[dict->count][MAX_VALUE_SIZE - 1] = '\0';
+    
+    uint32_t slot = dictionary_hash(dict->values[dict->count]) & (dict->slot_count - 1);
+    while (dict->slots[slot] != 0) {
+        slot = (slot + 1) & (dict->slot_count - 1);
+    }
+    dict->slots[slot] = dict->count + 1;
+    dict->count++;
+    return 0;
+}
+
+static void dictionary_destroy(dictionary_t *dict) {
+    free(dict->values);
+    free(dict->slots);
+    free(dict);
+}
+
+page_id_t dictionary_create(database_t *db) {
+    page_t *page = storage_allocate_page(db);
+    if (!page) return 0;
+    
+    memset(page->data, 0, PAGE_SIZE);
+    dictionary_write_page(db, page);
+    
+    page_id_t page_id = page->page_id;
+    buffer_release_page(db->buffer_pool, page);
+    return page_id;
+}
+
+dictionary_t* dictionary_get(database_t *db, table_schema_t *schema, int column) {
+    if (schema->dictionary_page_id == 0 || !schema->columns[column].is_dictionary) return NULL;
+    
+    for (dictionary_t *dict = db->dictionaries; dict; dict = dict->next) {
+        if (dict->page_id == schema->dictionary_page_id && dict->column == column) {
+            return dict;
+        }
+    }
+    
+    dictionary_t *dict = calloc(1, sizeof(dictionary_t));
+    if (!dict) return NULL;
+    dict->page_id = schema->dictionary_page_id;
+    dict->column = column;
+    
+    page_id_t page_id = schema->dictionary_page_id;
+    while (page_id != 0) {
+        page_t *page = buffer_get_page(db->buffer_pool, page_id);
+        if (!page) {
+            dictionary_destroy(dict);
+            return NULL;
+        }
+        
+        dictionary_page_header_t *header = (dictionary_page_header_t*)page->data;
+        dictionary_entry_t *entries = dictionary_page_entries(page->data);
+        for (int i = 0; i < header->entry_count; i++) {
+            if (entries[i].column != column) continue;
+            if (entries[i].code != dict->count || dictionary_append(dict, entries[i].value) != 0) {
+                printf("dictionary: Corrupt dictionary for column %s\n", schema->columns[column].name);
+                buffer_release_page(db->buffer_pool, page);
+                dictionary_destroy(dict);
+                return NULL;
+            }
+        }
+        
+        page_id = header->next_page_id;
+        buffer_release_page(db->buffer_pool, page);
+    }
+    
+    dict->next = db->dictionaries;
+    db->dictionaries = dict;
+    return dict;
+}
+
+int dictionary_find(const dictionary_t *dict, const char *value) {
+    if (dict->slot_count == 0) return -1;
+    
+    uint32_t slot = dictionary_hash(value) & (dict->slot_count - 1);
+    while (dict->slots[slot] != 0) {
+        int code = dict->slots[slot] - 1;
+        if (strcmp(dict->values[code], value) == 0) {
+            return code;
+        }
+        slot = (slot + 1) & (dict->slot_count - 1);
+    }
+    return -1;
+}
+
+const char* dictionary_value(const dictionary_t *dict, dict_code_t code) {
+    if (code >= dict->count) return NULL;
+    return dict->values[code];
+}
+
+int dictionary_size(const dictionary_t *dict) {
+    return dict->count;
+}
+
+// Returns the code of `value`, adding it to the dictionary first if needed.
+// New entries go to the last page of the chain, which grows when full.
+int dictionary_encode(database_t *db, table_schema_t *schema, int column, const char *value,
+                      dict_code_t *code) {
+    dictionary_t *dict = dictionary_get(db, schema, column);
+    if (!dict) return -1;
+    
+    int existing = dictionary_find(dict, value);
+    if (existing >= 0) {
+        *code = (dict_code_t)existing;
+        return 0;
+    }
+    
+    if (dict->count >= DICTIONARY_MAX_CODES) {
+        printf("Dictionary for column %s is full\n", schema->columns[column].name);
+        return -1;
+    }
+    
+    page_t *page = buffer_get_page(db->buffer_pool, schema->dictionary_page_id);
+    if (!page) return -1;
+    
+    while (((dictionary_page_header_t*)page->data)->next_page_id != 0) {
+        page_id_t next_page_id = ((dictionary_page_header_t*)page->data)->next_page_id;
+        buffer_release_page(db->buffer_pool, page);
+        page = buffer_get_page(db->buffer_pool, next_page_id);
+        if (!page) return -1;
+    }
+    
+    if (((dictionary_page_header_t*)page->data)->entry_count >= DICTIONARY_ENTRIES_PER_PAGE) {
+        page_t *new_page = storage_allocate_page(db);
+        if (!new_page) {
+            buffer_release_page(db->buffer_pool, page);
+            return -1;
+        }
+        memset(new_page->data, 0, PAGE_SIZE);
+        
+        ((dictionary_page_header_t*)page->data)->next_page_id = new_page->page_id;
+        dictionary_write_page(db, page);
+        buffer_release_page(db->buffer_pool, page);
+        page = new_page;
+    }
+    
+    dictionary_page_header_t *header = (dictionary_page_header_t*)page->data;
+    dictionary_entry_t *entry = &dictionary_page_entries(page->data)[header->entry_count];
+    entry->column = (uint16_t)column;
+    entry->code = (dict_code_t)dict->count;
+    strncpy(entry->value, value, MAX_VALUE_SIZE - 1);
+    entry->value[MAX_VALUE_SIZE - 1] = '\0';
+    header->entry_count++;
+    
+    dictionary_write_page(db, page);
+    buffer_release_page(db->buffer_pool, page);
+    
+    *code = (dict_code_t)dict->count;
+    return dictionary_append(dict, value);
+}
+
+void dictionary_release_all(database_t *db) {
+    while (db->dictionaries) {
+        dictionary_t *next = db->dictionaries->next;
+        dictionary_destroy(db->dictionaries);
+        db->dictionaries = next;
+    }
+}
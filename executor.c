@@ -0,0 +1,1161 @@
+#include "tinydb.h"
+
+// Batch-at-a-time executor. A query is a tree of operators; each call to
+// next() moves one batch of up to BATCH_SIZE rows from a child to its
+// parent. Per-row work happens in loops over typed vectors, with the type
+// and operator dispatch hoisted out of the loop.
+
+int batch_init(batch_t *batch, int column_count, const data_type_t *types) {
+    memset(batch, 0, sizeof(batch_t));
+    batch->column_count = column_count;
+    
+    for (int i = 0; i < column_count; i++) {
+        vector_t *vec = &batch->columns[i];
+        vec->type = types[i];
+        vec->nulls = calloc(BATCH_SIZE, sizeof(uint8_t));
+        
+        switch (types[i]) {
+            case DATA_TYPE_INT:
+                vec->ints = calloc(BATCH_SIZE, sizeof(int));
+                break;
+            case DATA_TYPE_FLOAT:
+                vec->floats = calloc(BATCH_SIZE, sizeof(float));
+                break;
+            case DATA_TYPE_VARCHAR:
+                vec->strings = calloc(BATCH_SIZE, sizeof(value_t));
+                vec->codes = calloc(BATCH_SIZE, sizeof(dict_code_t));
+                break;
+        }
+        
+        if (!vec->nulls || (!vec->ints && !vec->floats && !vec->strings) ||
+            (types[i] == DATA_TYPE_VARCHAR && !vec->codes)) {
+            batch_free(batch);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void batch_free(batch_t *batch) {
+    for (int i = 0; i < batch->column_count; i++) {
+        free(batch->columns[i].ints);
+        free(batch->columns[i].floats);
+        free(batch->columns[i].strings);
+        free(batch->columns[i].codes);
+        free(batch->columns[i].nulls);
+    }
+    memset(batch, 0, sizeof(batch_t));
+}
+
+void batch_select_all(batch_t *batch) {
+    for (int i = 0; i < batch->row_count; i++) {
+        batch->selection[i] = (uint16_t)i;
+    }
+    batch->selected_count = batch->row_count;
+}
+
+void batch_get_value(const batch_t *batch, int column, int row, value_t *value) {
+    vector_get_value(&batch->columns[column], row, value);
+}
+
+// Dictionary-encoded values are looked up by their code, so this works
+// on vectors whose strings were never decoded
+void vector_get_value(const vector_t *vec, int row, value_t *value) {
+    if (vec->type == DATA_TYPE_VARCHAR && vec->dictionary) {
+        const char *text = vec->nulls[row] ? NULL : dictionary_value(vec->dictionary, vec->codes[row]);
+        memset(value, 0, sizeof(value_t));
+        value->type = DATA_TYPE_VARCHAR;
+        value->is_null = vec->nulls[row];
+        if (text) strcpy(value->data.str_val, text);
+        return;
+    }
+    if (vec->type == DATA_TYPE_VARCHAR) {
+        *value = vec->strings[row];
+        value->is_null = vec->nulls[row];
+        return;
+    }
+    
+    memset(value, 0, sizeof(value_t));
+    value->type = vec->type;
+    value->is_null = vec->nulls[row];
+    if (vec->type == DATA_TYPE_INT) {
+        value->data.int_val = vec->ints[row];
+    } else {
+        value->data.float_val = vec->floats[row];
+    }
+}
+
+void batch_set_value(batch_t *batch, int column, int row, const value_t *value) {
+    vector_t *vec = &batch->columns[column];
+    vec->nulls[row] = value->is_null;
+    
+    switch (vec->type) {
+        case DATA_TYPE_INT:
+            vec->ints[row] = value->data.int_val;
+            break;
+        case DATA_TYPE_FLOAT:
+            vec->floats[row] = value->type == DATA_TYPE_INT ? (float)value->data.int_val
+                                                            : value->data.float_val;
+            break;
+        case DATA_TYPE_VARCHAR:
+            vec->strings[row] = *value;
+            break;
+    }
+}
+
+operator_t* exec_operator_create(const char *name, database_t *db, operator_t *child, size_t state_size) {
+    operator_t *op = calloc(1, sizeof(operator_t));
+    if (!op) return NULL;
+    
+    op->state = calloc(1, state_size);
+    if (!op->state) {
+        free(op);
+        return NULL;
+    }
+    
+    op->name = name;
+    op->db = db;
+    op->child = child;
+    return op;
+}
+
+// Copies the output schema of the child, for operators that keep it
+static void exec_inherit_columns(operator_t *op) {
+    op->column_count = op->child->column_count;
+    memcpy(op->column_types, op->child->column_types, sizeof(op->column_types));
+    memcpy(op->column_names, op->child->column_names, sizeof(op->column_names));
+}
+
+// Starts measuring the calling thread for an operator. Operators whose
+// work is driven by someone else than exec_next(), such as the worker
+// copies of a parallel operator, charge it with exec_measure_end().
+void exec_measure_start(exec_measure_t *measure) {
+    clock_gettime(CLOCK_MONOTONIC, &measure->start);
+    io_stats_get(&measure->io);
+}
+
+void exec_measure_end(operator_t *op, const exec_measure_t *measure) {
+    struct timespec end;
+    io_stats_t io;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    io_stats_get(&io);
+    
+    op->stats.seconds += (double)(end.tv_sec - measure->start.tv_sec) +
+                         (double)(end.tv_nsec - measure->start.tv_nsec) / 1e9;
+    op->stats.io.pages_pinned += io.pages_pinned - measure->io.pages_pinned;
+    op->stats.io.buffer_hits += io.buffer_hits - measure->io.buffer_hits;
+    op->stats.io.buffer_misses += io.buffer_misses - measure->io.buffer_misses;
+    op->stats.io.bytes_read += io.bytes_read - measure->io.bytes_read;
+    op->stats.io.bytes_written += io.bytes_written - measure->io.bytes_written;
+}
+
+static int exec_open_tree(operator_t *op) {
+    if (op->child && exec_open(op->child) != 0) return -1;
+    if (op->inner && exec_open(op->inner) != 0) return -1;
+    op->is_open = 1;
+    if (op->open && op->open(op) != 0) return -1;
+    return 0;
+}
+
+// Opens the children first. An operator counts as open as soon as its
+// open() runs, so exec_close() also releases a partially opened tree.
+int exec_open(operator_t *op) {
+    if (!op->analyze) return exec_open_tree(op);
+    
+    exec_measure_t measure;
+    exec_measure_start(&measure);
+    int result = exec_open_tree(op);
+    exec_measure_end(op, &measure);
+    return result;
+}
+
+int exec_next(operator_t *op, batch_t **batch) {
+    if (!op->analyze) return op->next(op, batch);
+    
+    exec_measure_t measure;
+    exec_measure_start(&measure);
+    int result = op->next(op, batch);
+    exec_measure_end(op, &measure);
+    
+    op->stats.loops++;
+    if (result > 0) {
+        op->stats.batches++;
+        op->stats.rows += (*batch)->selected_count;
+    }
+    return result;
+}
+
+static void exec_close_tree(operator_t *op) {
+    if (op->is_open && op->close) op->close(op);
+    op->is_open = 0;
+    if (op->child) exec_close(op->child);
+    if (op->inner) exec_close(op->inner);
+}
+
+void exec_close(operator_t *op) {
+    if (!op->analyze || !op->is_open) {
+        exec_close_tree(op);
+        return;
+    }
+    
+    exec_measure_t measure;
+    exec_measure_start(&measure);
+    exec_close_tree(op);
+    exec_measure_end(op, &measure);
+}
+
+void exec_destroy(operator_t *op) {
+    if (!op) return;
+    
+    exec_close(op);
+    if (op->destroy) op->destroy(op);
+    exec_destroy(op->child);
+    exec_destroy(op->inner);
+    free(op->state);
+    free(op);
+}
+
+// Makes the operators of the plan, worker copies included, gather stats
+// as they run. Call before exec_open().
+void exec_analyze(operator_t *op) {
+    op->analyze = 1;
+    memset(&op->stats, 0, sizeof(operator_stats_t));
+    if (op->child) exec_analyze(op->child);
+    if (op->inner) exec_analyze(op->inner);
+    for (int i = 0; i < op->worker_count; i++) {
+        exec_analyze(op->workers[i]);
+    }
+}
+
+static void exec_explain_operator(const operator_t *op, int depth, const char *label, int analyze) {
+    char detail[128] = "";
+    if (op->explain) op->explain(op, detail, sizeof(detail));
+    
+    printf("%*s%s%s%s%s\n", depth * 2, "", depth > 0 ? "-> " : "", label, op->name, detail);
+    if (analyze) {
+        printf("%*s   rows=%lld batches=%lld loops=%lld time=%.3f ms\n", depth * 2, "",
+               op->stats.rows, op->stats.batches, op->stats.loops, op->stats.seconds * 1000.0);
+        printf("%*s   pages pinned=%lld, buffer hits=%lld misses=%lld, bytes read=%lld written=%lld\n",
+               depth * 2, "", op->stats.io.pages_pinned, op->stats.io.buffer_hits, op->stats.io.buffer_misses,
+               op->stats.io.bytes_read, op->stats.io.bytes_written);
+    }
+    
+    for (int i = 0; i < op->worker_count; i++) {
+        char worker[32];
+        snprintf(worker, sizeof(worker), "Worker %d: ", i);
+        exec_explain_operator(op->workers[i], depth + 1, worker, analyze);
+    }
+    if (op->child) exec_explain_operator(op->child, depth + 1, "", analyze);
+    if (op->inner) exec_explain_operator(op->inner, depth + 1, "Inner: ", analyze);
+}
+
+// Prints the plan, one operator per line under the operator that reads
+// from it. With `analyze`, each line is followed by the stats the plan
+// gathered after exec_analyze(). Time and I/O of an operator include its
+// children on the same thread; the workers of a parallel operator run on
+// threads of their own and report theirs separately.
+void exec_explain(const operator_t *op, int analyze) {
+    exec_explain_operator(op, 0, "", analyze);
+}
+
+// --- Scan ---------------------------------------------------------------
+
+// Narrows the selection to the rows of the column that satisfy one
+// comparison, and returns how many are left, or -1 if a value could not
+// be read
+typedef int (*filter_kernel_t)(database_t *db, const vector_t *vec, const value_t *constant,
+                               uint16_t *sel, int count);
+
+// A filter expression with the kernel of each comparison chosen up front
+// for its column type, operator and constant
+typedef struct {
+    expr_t expr;
+    filter_kernel_t kernels[MAX_EXPR_NODES];
+} filter_program_t;
+
+typedef struct {
+    table_schema_t *schema;
+    transaction_id_t txn_id;
+    int column_ids[MAX_COLUMNS];
+    int column_count;
+    int ranged;
+    key_bounds_t bounds;
+    filter_program_t filter;        // Pushed-down predicate, root -1 if none
+    int early_ids[MAX_COLUMNS];     // Columns the filter reads, -1 elsewhere
+    int late_ids[MAX_COLUMNS];      // The others, read after filtering
+    int late_count;
+    int keep_codes;                 // Leave dictionary columns undecoded (exec_keep_codes)
+    operator_t *leader;             // Scan whose page source this one shares, NULL if none
+    scan_morsels_t morsels;         // The shared source, when this scan is the leader
+    table_cursor_t cursor;
+    batch_t batch;
+} scan_state_t;
+
+static int filter_eval(operator_t *op, const filter_program_t *program, int index, const batch_t *batch,
+                       uint16_t *sel, int count);
+
+static int scan_open(operator_t *op) {
+    scan_state_t *state = op->state;
+    
+    if (batch_init(&state->batch, op->column_count, op->column_types) != 0) return -1;
+    if (state->ranged) {
+        return table_scan_open_range(op->db, state->schema->name, &state->bounds, state->txn_id, &state->cursor);
+    }
+    if (table_scan_open(op->db, state->schema->name, state->txn_id, &state->cursor) != 0) return -1;
+    
+    if (state->leader) {
+        scan_state_t *leader = state->leader->state;
+        table_scan_share(&state->cursor, &leader->morsels, state->leader == op);
+    }
+    return 0;
+}
+
+// Text of a row of a dictionary-encoded vector
+static const char* code_text(const vector_t *vec, int row) {
+    const char *text = dictionary_value(vec->dictionary, vec->codes[row]);
+    return text ? text : "";
+}
+
+// Looks up the text of the selected rows of the dictionary-encoded
+// vectors of a batch
+static void scan_decode(batch_t *batch) {
+    for (int i = 0; i < batch->column_count; i++) {
+        vector_t *vec = &batch->columns[i];
+        if (!vec->dictionary) continue;
+        
+        for (int k = 0; k < batch->selected_count; k++) {
+            int row = batch->selection[k];
+            value_t *value = &vec->strings[row];
+            value->type = DATA_TYPE_VARCHAR;
+            value->is_null = vec->nulls[row];
+            value->is_external = 0;
+            strcpy(value->data.str_val, value->is_null ? "" : code_text(vec, row));
+        }
+    }
+}
+
+// With a pushed-down filter, only the columns it reads are decoded for
+// every row; the rest are fetched for the rows that pass. Dictionary
+// columns are filtered on their codes and decoded for those rows only.
+static int scan_next(operator_t *op, batch_t **batch) {
+    scan_state_t *state = op->state;
+    batch_t *out = &state->batch;
+    
+    if (state->filter.expr.root < 0) {
+        int rows = table_scan_next_batch(&state->cursor, state->column_ids, state->column_count, out);
+        if (rows <= 0) return rows;
+        if (!state->keep_codes) scan_decode(out);
+        *batch = out;
+        return 1;
+    }
+    
+    while (1) {
+        int rows = table_scan_next_batch(&state->cursor, state->early_ids, state->column_count, out);
+        if (rows <= 0) return rows;
+        
+        int kept = filter_eval(op, &state->filter, state->filter.expr.root, out, out->selection,
+                               out->selected_count);
+        if (kept < 0) return -1;
+        out->selected_count = kept;
+        if (out->selected_count == 0) continue;
+        
+        if (state->late_count > 0 &&
+            table_scan_fetch(&state->cursor, state->late_ids, state->column_count, out) != 0) {
+            return -1;
+        }
+        if (!state->keep_codes) scan_decode(out);
+        *batch = out;
+        return 1;
+    }
+}
+
+static void scan_close(operator_t *op) {
+    scan_state_t *state = op->state;
+    table_scan_close(&state->cursor);
+    batch_free(&state->batch);
+}
+
+static void scan_explain(const operator_t *op, char *detail, size_t size) {
+    const scan_state_t *state = op->state;
+    snprintf(detail, size, " on %s%s%s", state->schema->name, state->ranged ? " using primary key" : "",
+             state->filter.expr.root >= 0 ? " with filter" : "");
+}
+
+static void scan_destroy(operator_t *op) {
+    scan_state_t *state = op->state;
+    pthread_mutex_destroy(&state->morsels.mutex);
+}
+
+static operator_t* scan_create(database_t *db, const char *name, const char *table_name,
+                               const key_bounds_t *bounds, const int *column_ids, int column_count,
+                               transaction_id_t txn_id) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) return NULL;
+    if (!column_ids) column_count = schema->column_count;
+    if (column_count < 0 || column_count > MAX_COLUMNS) return NULL;
+    
+    operator_t *op = exec_operator_create(name, db, NULL, sizeof(scan_state_t));
+    if (!op) return NULL;
+    
+    scan_state_t *state = op->state;
+    state->schema = schema;
+    state->txn_id = txn_id;
+    state->column_count = column_count;
+    expr_init(&state->filter.expr);
+    pthread_mutex_init(&state->morsels.mutex, NULL);
+    op->destroy = scan_destroy;
+    if (bounds) {
+        state->ranged = 1;
+        state->bounds = *bounds;
+    }
+    
+    for (int i = 0; i < column_count; i++) {
+        int col = column_ids ? column_ids[i] : i;
+        if (col < 0 || col >= schema->column_count) {
+            exec_destroy(op);
+            return NULL;
+        }
+        state->column_ids[i] = col;
+        op->column_types[i] = schema->columns[col].type;
+        strcpy(op->column_names[i], schema->columns[col].name);
+    }
+    op->column_count = column_count;
+    
+    op->open = scan_open;
+    op->next = scan_next;
+    op->close = scan_close;
+    op->explain = scan_explain;
+    return op;
+}
+
+// Reads the listed columns of every row visible to txn_id. A NULL
+// column list reads all columns.
+operator_t* exec_scan_create(database_t *db, const char *table_name, const int *column_ids, int column_count,
+                             transaction_id_t txn_id) {
+    return scan_create(db, "Scan", table_name, NULL, column_ids, column_count, txn_id);
+}
+
+// Like exec_scan_create, but only visits rows whose primary key is within
+// the bounds, in key order, using the primary index.
+operator_t* exec_range_scan_create(database_t *db, const char *table_name, const key_bounds_t *bounds,
+                                   const int *column_ids, int column_count, transaction_id_t txn_id) {
+    return scan_create(db, "Range Scan", table_name, bounds, column_ids, column_count, txn_id);
+}
+
+// --- Filter -------------------------------------------------------------
+
+typedef struct {
+    filter_program_t program;
+} filter_state_t;
+
+void expr_init(expr_t *expr) {
+    expr->node_count = 0;
+    expr->root = -1;
+}
+
+// Adds a node and returns its index, or -1 when the expression is full.
+// The caller sets expr->root once the tree is complete.
+int expr_add_compare(expr_t *expr, int column, compare_op_t op, const value_t *constant) {
+    if (expr->node_count >= MAX_EXPR_NODES) return -1;
+    
+    expr_node_t *node = &expr->nodes[expr->node_count];
+    memset(node, 0, sizeof(expr_node_t));
+    node->kind = EXPR_COMPARE;
+    node->predicate.column = column;
+    node->predicate.op = op;
+    node->predicate.constant = *constant;
+    node->left = -1;
+    node->right = -1;
+    return expr->node_count++;
+}
+
+int expr_add_logical(expr_t *expr, expr_kind_t kind, int left, int right) {
+    if (expr->node_count >= MAX_EXPR_NODES || left < 0 || right < 0) return -1;
+    
+    expr_node_t *node = &expr->nodes[expr->node_count];
+    memset(node, 0, sizeof(expr_node_t));
+    node->kind = kind;
+    node->left = left;
+    node->right = right;
+    return expr->node_count++;
+}
+
+// Comparison kernels, one per column type, constant type and operator.
+// Each loop tests a plain typed array against a constant converted once,
+// and keeps the row branch-free by always writing it and advancing only
+// when it matches. NULL never matches.
+#define FILTER_KERNEL(name, type, array, constant_type, constant_value, op)                   \
+    static int name(database_t *db, const vector_t *vec, const value_t *constant,            \
+                    uint16_t *sel, int count) {                                               \
+        const type *values = vec->array;                                                      \
+        const uint8_t *nulls = vec->nulls;                                                    \
+        const constant_type c = constant_value;                                               \
+        int kept = 0;                                                                         \
+        (void)db;                                                                             \
+        for (int k = 0; k < count; k++) {                                                     \
+            int row = sel[k];                                                                 \
+            sel[kept] = (uint16_t)row;                                                        \
+            kept += !nulls[row] & ((constant_type)values[row] op c);                          \
+        }                                                                                     \
+        return kept;                                                                          \
+    }
+
+// Strings held in overflow pages are read only when compared, and one
+// that cannot be read fails the filter. Dictionary codes are compared
+// through the dictionary's copy of the text.
+#define STRING_KERNEL(name, op)                                                               \
+    static int name(database_t *db, const vector_t *vec, const value_t *constant,            \
+                    uint16_t *sel, int count) {                                               \
+        const value_t *values = vec->strings;                                                 \
+        const uint8_t *nulls = vec->nulls;                                                    \
+        const char *c = constant->data.str_val;                                               \
+        int kept = 0;                                                                         \
+        for (int k = 0; k < count; k++) {                                                     \
+            int row = sel[k];                                                                 \
+            if (nulls[row]) continue;                                                         \
+            int cmp;                                                                          \
+            if (vec->dictionary) {                                                            \
+                cmp = strcmp(code_text(vec, row), c);                                         \
+            } else if (!values[row].is_external) {                                            \
+                cmp = strcmp(values[row].data.str_val, c);                                    \
+            } else if (string_compare(db, &values[row], c, &cmp) != 0) {                      \
+                return -1;                                                                    \
+            }                                                                                 \
+            if (cmp op 0) sel[kept++] = (uint16_t)row;                                        \
+        }                                                                                     \
+        return kept;                                                                          \
+    }
+
+// Equality on a dictionary column compares codes: the constant is looked
+// up once per batch, and one the dictionary lacks has no code, so it
+// equals no row. Vectors without a dictionary take the string kernel.
+#define CODE_KERNEL(name, op, string_kernel)                                                  \
+    static int name(database_t *db, const vector_t *vec, const value_t *constant,            \
+                    uint16_t *sel, int count) {                                               \
+        if (!vec->dictionary) return string_kernel(db, vec, constant, sel, count);            \
+        const dict_code_t *codes = vec->codes;                                                \
+        const uint8_t *nulls = vec->nulls;                                                    \
+        const int c = dictionary_find(vec->dictionary, constant->data.str_val);               \
+        int kept = 0;                                                                         \
+        for (int k = 0; k < count; k++) {                                                     \
+            int row = sel[k];                                                                 \
+            sel[kept] = (uint16_t)row;                                                        \
+            kept += !nulls[row] & ((int)codes[row] op c);                                     \
+        }                                                                                     \
+        return kept;                                                                          \
+    }
+
+// The six operators, in compare_op_t order
+#define FILTER_KERNELS(prefix, type, array, constant_type, constant_value)        \
+    FILTER_KERNEL(prefix##_eq, type, array, constant_type, constant_value, ==)   \
+    FILTER_KERNEL(prefix##_ne, type, array, constant_type, constant_value, !=)   \
+    FILTER_KERNEL(prefix##_lt, type, array, constant_type, constant_value, <)    \
+    FILTER_KERNEL(prefix##_le, type, array, constant_type, constant_value, <=)   \
+    FILTER_KERNEL(prefix##_gt, type, array, constant_type, constant_value, >)    \
+    FILTER_KERNEL(prefix##_ge, type, array, constant_type, constant_value, >=)
+
+#define KERNEL_ROW(prefix) { prefix##_eq, prefix##_ne, prefix##_lt, prefix##_le, prefix##_gt, prefix##_ge }
+
+// Compares a string held in overflow pages with the constant into *cmp.
+// Returns -1 if the value cannot be read.
+static int string_compare(database_t *db, const value_t *value, const char *constant, int *cmp) {
+    char *text = overflow_read(db, value);
+    if (!text) return -1;
+    *cmp = strcmp(text, constant);
+    free(text);
+    return 0;
+}
+
+FILTER_KERNELS(filter_int_int, int, ints, int, constant->data.int_val)
+FILTER_KERNELS(filter_int_float, int, ints, float, constant->data.float_val)
+FILTER_KERNELS(filter_float_float, float, floats, float, constant->data.float_val)
+FILTER_KERNELS(filter_float_int, float, floats, float, (float)constant->data.int_val)
+STRING_KERNEL(filter_string_eq, ==)
+STRING_KERNEL(filter_string_ne, !=)
+STRING_KERNEL(filter_string_lt, <)
+STRING_KERNEL(filter_string_le, <=)
+STRING_KERNEL(filter_string_gt, >)
+STRING_KERNEL(filter_string_ge, >=)
+CODE_KERNEL(filter_code_eq, ==, filter_string_eq)
+CODE_KERNEL(filter_code_ne, !=, filter_string_ne)
+
+static int filter_none(database_t *db, const vector_t *vec, const value_t *constant, uint16_t *sel, int count) {
+    (void)db;
+    (void)vec;
+    (void)constant;
+    (void)sel;
+    (void)count;
+    return 0;
+}
+
+static const filter_kernel_t int_kernels[][6] = { KERNEL_ROW(filter_int_int), KERNEL_ROW(filter_int_float) };
+static const filter_kernel_t float_kernels[][6] = { KERNEL_ROW(filter_float_int),
+                                                    KERNEL_ROW(filter_float_float) };
+static const filter_kernel_t string_kernels[6] = { filter_code_eq, filter_code_ne, filter_string_lt,
+                                                   filter_string_le, filter_string_gt, filter_string_ge };
+
+// Chooses the kernel of a comparison on a column of `type`. A NULL
+// constant matches nothing; other constants have been checked against the
+// column type by expr_check().
+static filter_kernel_t filter_kernel(data_type_t type, const predicate_t *pred) {
+    if (pred->constant.is_null) return filter_none;
+    
+    int is_float = pred->constant.type == DATA_TYPE_FLOAT;
+    switch (type) {
+        case DATA_TYPE_INT:
+            return int_kernels[is_float][pred->op];
+        case DATA_TYPE_FLOAT:
+            return float_kernels[is_float][pred->op];
+        case DATA_TYPE_VARCHAR:
+            return string_kernels[pred->op];
+    }
+    return filter_none;
+}
+
+// Prepares an expression over the output of `input` for evaluation
+static void filter_compile(const operator_t *input, const expr_t *expr, filter_program_t *program) {
+    program->expr = *expr;
+    for (int i = 0; i < expr->node_count; i++) {
+        const expr_node_t *node = &expr->nodes[i];
+        program->kernels[i] = node->kind == EXPR_COMPARE
+                                  ? filter_kernel(input->column_types[node->predicate.column], &node->predicate)
+                                  : NULL;
+    }
+}
+
+// Narrows `sel` to the rows for which the expression node holds. AND
+// applies its operands one after the other; OR tests its right operand
+// only on the rows the left one rejected and merges the two results, which
+// keeps the selection in ascending order. Returns -1 if a kernel failed.
+static int filter_eval(operator_t *op, const filter_program_t *program, int index, const batch_t *batch,
+                       uint16_t *sel, int count) {
+    const expr_node_t *node = &program->expr.nodes[index];
+    
+    switch (node->kind) {
+        case EXPR_COMPARE:
+            return program->kernels[index](op->db, &batch->columns[node->predicate.column],
+                                           &node->predicate.constant, sel, count);
+        case EXPR_AND:
+            count = filter_eval(op, program, node->left, batch, sel, count);
+            if (count <= 0) return count;
+            return filter_eval(op, program, node->right, batch, sel, count);
+        case EXPR_OR: {
+            uint16_t left[BATCH_SIZE];
+            uint16_t rest[BATCH_SIZE];
+            memcpy(left, sel, count * sizeof(uint16_t));
+            int left_count = filter_eval(op, program, node->left, batch, left, count);
+            if (left_count < 0) return -1;
+            
+            int rest_count = 0;
+            for (int k = 0, j = 0; k < count; k++) {
+                if (j < left_count && left[j] == sel[k]) {
+                    j++;
+                } else {
+                    rest[rest_count++] = sel[k];
+                }
+            }
+            rest_count = filter_eval(op, program, node->right, batch, rest, rest_count);
+            if (rest_count < 0) return -1;
+            
+            int i = 0, j = 0, out = 0;
+            while (i < left_count || j < rest_count) {
+                if (j == rest_count || (i < left_count && left[i] < rest[j])) {
+                    sel[out++] = left[i++];
+                } else {
+                    sel[out++] = rest[j++];
+                }
+            }
+            return out;
+        }
+    }
+    return 0;
+}
+
+static int filter_next(operator_t *op, batch_t **batch) {
+    filter_state_t *state = op->state;
+    
+    // Batches that lose every row are skipped rather than passed on empty
+    while (1) {
+        int result = exec_next(op->child, batch);
+        if (result <= 0) return result;
+        
+        if (state->program.expr.root >= 0 && (*batch)->selected_count > 0) {
+            int kept = filter_eval(op, &state->program, state->program.expr.root, *batch,
+                                   (*batch)->selection, (*batch)->selected_count);
+            if (kept < 0) return -1;
+            (*batch)->selected_count = kept;
+        }
+        if ((*batch)->selected_count > 0) return 1;
+    }
+}
+
+// Checks that an expression can be evaluated over the output of `input`
+static int expr_check(const operator_t *input, const expr_t *expr) {
+    if (expr->root >= expr->node_count) return -1;
+    
+    for (int i = 0; i < expr->node_count; i++) {
+        const expr_node_t *node = &expr->nodes[i];
+        if (node->kind != EXPR_COMPARE) {
+            // Operands come before the node that uses them, so there are no cycles
+            if (node->left < 0 || node->left >= i || node->right < 0 || node->right >= i) return -1;
+            continue;
+        }
+        
+        const predicate_t *pred = &node->predicate;
+        if (pred->column < 0 || pred->column >= input->column_count) return -1;
+        if (!pred->constant.is_null &&
+            (input->column_types[pred->column] == DATA_TYPE_VARCHAR) !=
+            (pred->constant.type == DATA_TYPE_VARCHAR)) {
+            printf("Type mismatch in predicate on column %s\n", input->column_names[pred->column]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Keeps the rows for which the expression holds. Works in place on the
+// child's batch by narrowing its selection vector.
+operator_t* exec_filter_expr_create(operator_t *child, const expr_t *expr) {
+    if (!child || expr_check(child, expr) != 0) return NULL;
+    
+    operator_t *op = exec_operator_create("Filter", child->db, child, sizeof(filter_state_t));
+    if (!op) return NULL;
+    
+    filter_state_t *state = op->state;
+    filter_compile(child, expr, &state->program);
+    
+    exec_inherit_columns(op);
+    op->next = filter_next;
+    return op;
+}
+
+// Moves a filter into a scan created by exec_scan_create or
+// exec_range_scan_create, before the scan is opened. The scan then decodes
+// the columns the filter reads, evaluates it, and reads the remaining
+// columns only for the rows that matched (late materialization).
+int exec_scan_push_filter(operator_t *scan, const expr_t *expr) {
+    if (!scan || scan->next != scan_next || scan->is_open) return -1;
+    if (expr->root < 0) return 0;
+    if (expr_check(scan, expr) != 0) return -1;
+    
+    scan_state_t *state = scan->state;
+    filter_compile(scan, expr, &state->filter);
+    
+    uint8_t used[MAX_COLUMNS] = {0};
+    for (int i = 0; i < expr->node_count; i++) {
+        if (expr->nodes[i].kind == EXPR_COMPARE) used[expr->nodes[i].predicate.column] = 1;
+    }
+    
+    state->late_count = 0;
+    for (int i = 0; i < state->column_count; i++) {
+        state->early_ids[i] = used[i] ? state->column_ids[i] : -1;
+        state->late_ids[i] = used[i] ? -1 : state->column_ids[i];
+        state->late_count += !used[i];
+    }
+    return 0;
+}
+
+// Makes a scan created by exec_scan_create divide the table with `leader`,
+// another such scan of the same table, before either is opened. Every scan
+// sharing a leader takes the next unread page whenever it needs one, so
+// scans run on different threads read each page exactly once between them.
+// The leader must be opened first.
+int exec_scan_share(operator_t *scan, operator_t *leader) {
+    if (!scan || !leader || scan->next != scan_next || leader->next != scan_next) return -1;
+    if (scan->is_open || leader->is_open) return -1;
+    
+    scan_state_t *state = scan->state;
+    scan_state_t *leader_state = leader->state;
+    if (state->ranged || leader_state->ranged || state->schema != leader_state->schema) return -1;
+    
+    leader_state->leader = leader;
+    state->leader = leader;
+    return 0;
+}
+
+// Keeps the rows matching all predicates
+operator_t* exec_filter_create(operator_t *child, const predicate_t *predicates, int predicate_count) {
+    if (!child || predicate_count < 0 || predicate_count > MAX_OUTPUT_COLUMNS) return NULL;
+    
+    expr_t expr;
+    expr_init(&expr);
+    for (int i = 0; i < predicate_count; i++) {
+        int node = expr_add_compare(&expr, predicates[i].column, predicates[i].op, &predicates[i].constant);
+        expr.root = expr.root < 0 ? node : expr_add_logical(&expr, EXPR_AND, expr.root, node);
+    }
+    return exec_filter_expr_create(child, &expr);
+}
+
+// --- Project ------------------------------------------------------------
+
+// Values of one expression node for the current batch, at the positions
+// of the selected rows
+typedef struct {
+    data_type_t type;
+    int ints[BATCH_SIZE];
+    float floats[BATCH_SIZE];
+    uint8_t nulls[BATCH_SIZE];
+} scalar_result_t;
+
+typedef struct {
+    scalar_expr_t exprs[MAX_OUTPUT_COLUMNS];
+    data_type_t node_types[MAX_OUTPUT_COLUMNS][MAX_SCALAR_NODES];
+    scalar_result_t *results[MAX_OUTPUT_COLUMNS];   // NULL for plain columns
+    batch_t batch;
+} project_state_t;
+
+void scalar_init(scalar_expr_t *expr) {
+    memset(expr, 0, sizeof(scalar_expr_t));
+    expr->root = -1;
+}
+
+static int scalar_add_node(scalar_expr_t *expr, scalar_kind_t kind) {
+    if (expr->node_count >= MAX_SCALAR_NODES) return -1;
+    
+    scalar_node_t *node = &expr->nodes[expr->node_count];
+    memset(node, 0, sizeof(scalar_node_t));
+    node->kind = kind;
+    node->left = -1;
+    node->right = -1;
+    return expr->node_count++;
+}
+
+// Adds a node and returns its index, or -1 when the expression is full.
+// The caller sets expr->root once the tree is complete.
+int scalar_add_column(scalar_expr_t *expr, int column) {
+    int index = scalar_add_node(expr, SCALAR_COLUMN);
+    if (index >= 0) expr->nodes[index].column = column;
+    return index;
+}
+
+int scalar_add_constant(scalar_expr_t *expr, const value_t *constant) {
+    int index = scalar_add_node(expr, SCALAR_CONSTANT);
+    if (index >= 0) expr->nodes[index].constant = *constant;
+    return index;
+}
+
+int scalar_add_arith(scalar_expr_t *expr, scalar_kind_t kind, int left, int right) {
+    if (left < 0 || right < 0) return -1;
+    
+    int index = scalar_add_node(expr, kind);
+    if (index >= 0) {
+        expr->nodes[index].left = left;
+        expr->nodes[index].right = right;
+    }
+    return index;
+}
+
+// Operand value as FLOAT, whichever type the operand has
+#define SCALAR_FLOAT(r, row) ((r)->type == DATA_TYPE_INT ? (float)(r)->ints[row] : (r)->floats[row])
+
+#define SCALAR_LOOP(compute)                                \
+    for (int k = 0; k < count; k++) {                       \
+        int row = sel[k];                                   \
+        out->nulls[row] = l->nulls[row] | r->nulls[row];    \
+        if (!out->nulls[row]) { compute; }                  \
+    }
+
+// Evaluates an arithmetic node from its operands. INT results are computed
+// in 64 bits and truncated, so overflow wraps instead of being undefined.
+static void scalar_arith(scalar_kind_t kind, const scalar_result_t *l, const scalar_result_t *r,
+                         scalar_result_t *out, const uint16_t *sel, int count) {
+    if (out->type == DATA_TYPE_INT) {
+        switch (kind) {
+            case SCALAR_ADD:
+                SCALAR_LOOP(out->ints[row] = (int)((long long)l->ints[row] + r->ints[row]));
+                break;
+            case SCALAR_SUB:
+                SCALAR_LOOP(out->ints[row] = (int)((long long)l->ints[row] - r->ints[row]));
+                break;
+            case SCALAR_MUL:
+                SCALAR_LOOP(out->ints[row] = (int)((long long)l->ints[row] * r->ints[row]));
+                break;
+            case SCALAR_DIV:
+                SCALAR_LOOP(
+                    if (r->ints[row] == 0) out->nulls[row] = 1;
+                    else out->ints[row] = (int)((long long)l->ints[row] / r->ints[row]));
+                break;
+            default:
+                break;
+        }
+        return;
+    }
+    
+    switch (kind) {
+        case SCALAR_ADD:
+            SCALAR_LOOP(out->floats[row] = SCALAR_FLOAT(l, row) + SCALAR_FLOAT(r, row));
+            break;
+        case SCALAR_SUB:
+            SCALAR_LOOP(out->floats[row] = SCALAR_FLOAT(l, row) - SCALAR_FLOAT(r, row));
+            break;
+        case SCALAR_MUL:
+            SCALAR_LOOP(out->floats[row] = SCALAR_FLOAT(l, row) * SCALAR_FLOAT(r, row));
+            break;
+        case SCALAR_DIV:
+            SCALAR_LOOP(
+                if (SCALAR_FLOAT(r, row) == 0.0f) out->nulls[row] = 1;
+                else out->floats[row] = SCALAR_FLOAT(l, row) / SCALAR_FLOAT(r, row));
+            break;
+        default:
+            break;
+    }
+}
+
+// Evaluates every node of an expression over the selected rows. Operands
+// come before the nodes that use them, so one pass in node order suffices.
+static void scalar_eval(const scalar_expr_t *expr, const data_type_t *types, const batch_t *input,
+                        scalar_result_t *results) {
+    const uint16_t *sel = input->selection;
+    int count = input->selected_count;
+    
+    for (int i = 0; i < expr->node_count; i++) {
+        const scalar_node_t *node = &expr->nodes[i];
+        scalar_result_t *out = &results[i];
+        out->type = types[i];
+        
+        switch (node->kind) {
+            case SCALAR_COLUMN: {
+                const vector_t *vec = &input->columns[node->column];
+                for (int k = 0; k < count; k++) {
+                    out->nulls[sel[k]] = vec->nulls[sel[k]];
+                }
+                if (vec->type == DATA_TYPE_INT) {
+                    memcpy(out->ints, vec->ints, sizeof(out->ints));
+                } else {
+                    memcpy(out->floats, vec->floats, sizeof(out->floats));
+                }
+                break;
+            }
+            case SCALAR_CONSTANT:
+                for (int k = 0; k < count; k++) {
+                    int row = sel[k];
+                    out->nulls[row] = node->constant.is_null;
+                    out->ints[row] = node->constant.data.int_val;
+                    out->floats[row] = node->constant.data.float_val;
+                }
+                break;
+            default:
+                scalar_arith(node->kind, &results[node->left], &results[node->right], out, sel, count);
+                break;
+        }
+    }
+}
+
+static int project_open(operator_t *op) {
+    project_state_t *state = op->state;
+    
+    for (int i = 0; i < op->column_count; i++) {
+        if (state->exprs[i].nodes[state->exprs[i].root].kind == SCALAR_COLUMN) continue;
+        state->results[i] = calloc(state->exprs[i].node_count, sizeof(scalar_result_t));
+        if (!state->results[i]) return -1;
+    }
+    return 0;
+}
+
+static int project_next(operator_t *op, batch_t **batch) {
+    project_state_t *state = op->state;
+    batch_t *input;
+    
+    int result = exec_next(op->child, &input);
+    if (result <= 0) return result;
+    
+    // Plain columns share the child's vectors; computed ones point into the
+    // result of the expression's root node
+    batch_t *output = &state->batch;
+    output->column_count = op->column_count;
+    output->row_count = input->row_count;
+    output->selected_count = input->selected_count;
+    memcpy(output->selection, input->selection, input->selected_count * sizeof(uint16_t));
+    
+    for (int i = 0; i < op->column_count; i++) {
+        const scalar_expr_t *expr = &state->exprs[i];
+        if (!state->results[i]) {
+            output->columns[i] = input->columns[expr->nodes[expr->root].column];
+            continue;
+        }
+        
+        scalar_eval(expr, state->node_types[i], input, state->results[i]);
+        scalar_result_t *root = &state->results[i][expr->root];
+        vector_t *vec = &output->columns[i];
+        memset(vec, 0, sizeof(vector_t));
+        vec->type = op->column_types[i];
+        vec->nulls = root->nulls;
+        if (vec->type == DATA_TYPE_INT) {
+            vec->ints = root->ints;
+        } else {
+            vec->floats = root->floats;
+        }
+    }
+    
+    *batch = output;
+    return 1;
+}
+
+static void project_close(operator_t *op) {
+    project_state_t *state = op->state;
+    for (int i = 0; i < op->column_count; i++) {
+        free(state->results[i]);
+        state->results[i] = NULL;
+    }
+}
+
+// Types the nodes of an expression over the columns of `child`. A VARCHAR
+// column may only be selected on its own. Returns -1 if the expression is
+// malformed.
+static int scalar_check(const operator_t *child, const scalar_expr_t *expr, data_type_t *types) {
+    if (expr->root < 0 || expr->root >= expr->node_count) return -1;
+    
+    for (int i = 0; i < expr->node_count; i++) {
+        const scalar_node_t *node = &expr->nodes[i];
+        switch (node->kind) {
+            case SCALAR_COLUMN:
+                if (node->column < 0 || node->column >= child->column_count) return -1;
+                types[i] = child->column_types[node->column];
+                if (types[i] == DATA_TYPE_VARCHAR && expr->node_count > 1) {
+                    printf("Cannot use VARCHAR column %s in arithmetic\n", child->column_names[node->column]);
+                    return -1;
+                }
+                break;
+            case SCALAR_CONSTANT:
+                if (node->constant.type == DATA_TYPE_VARCHAR) return -1;
+                types[i] = node->constant.type;
+                break;
+            default:
+                if (node->left < 0 || node->left >= i || node->right < 0 || node->right >= i) return -1;
+                types[i] = types[node->left] == DATA_TYPE_INT && types[node->right] == DATA_TYPE_INT
+                               ? DATA_TYPE_INT : DATA_TYPE_FLOAT;
+                break;
+        }
+    }
+    return 0;
+}
+
+// Produces one column per expression. A column reference passes the
+// child's vector through untouched; arithmetic is evaluated a whole batch
+// at a time, one node after another.
+operator_t* exec_project_expr_create(operator_t *child, const scalar_expr_t *exprs, int expr_count) {
+    if (!child || expr_count <= 0 || expr_count > MAX_OUTPUT_COLUMNS) return NULL;
+    
+    operator_t *op = exec_operator_create("Project", child->db, child, sizeof(project_state_t));
+    if (!op) return NULL;
+    
+    project_state_t *state = op->state;
+    for (int i = 0; i < expr_count; i++) {
+        const scalar_expr_t *expr = &exprs[i];
+        if (scalar_check(child, expr, state->node_types[i]) != 0) {
+            free(op->state);
+            free(op);
+            return NULL;
+        }
+        
+        state->exprs[i] = *expr;
+        op->column_types[i] = state->node_types[i][expr->root];
+        if (expr->name[0]) {
+            strcpy(op->column_names[i], expr->name);
+        } else if (expr->nodes[expr->root].kind == SCALAR_COLUMN) {
+            strcpy(op->column_names[i], child->column_names[expr->nodes[expr->root].column]);
+        } else {
+            snprintf(op->column_names[i], MAX_COLUMN_NAME, "expr%d", i + 1);
+        }
+    }
+    op->column_count = expr_count;
+    
+    op->open = project_open;
+    op->next = project_next;
+    op->close = project_close;
+    return op;
+}
+
+// Reorders or drops columns of the child
+operator_t* exec_project_create(operator_t *child, const int *columns, int column_count) {
+    if (!child || column_count <= 0 || column_count > MAX_OUTPUT_COLUMNS) return NULL;
+    
+    scalar_expr_t exprs[MAX_OUTPUT_COLUMNS];
+    for (int i = 0; i < column_count; i++) {
+        scalar_init(&exprs[i]);
+        exprs[i].root = scalar_add_column(&exprs[i], columns[i]);
+    }
+    return exec_project_expr_create(child, exprs, column_count);
+}
+
+// Lets the dictionary-encoded columns that reach `op` from its scan stay
+// codes, for a parent that reads them by code or through
+// vector_get_value(). Filters and plain columns of projects hand their
+// child's vectors on, so the request passes through them; other
+// operators make vectors of their own and ignore it.
+void exec_keep_codes(operator_t *op) {
+    while (op && (op->next == filter_next || op->next == project_next)) {
+        op = op->child;
+    }
+    if (op && op->next == scan_next) ((scan_state_t*)op->state)->keep_codes = 1;
+}
+
+// --- Limit --------------------------------------------------------------
+
+typedef struct {
+    long long limit;
+    long long offset;
+    long long skipped;
+    long long produced;
+} limit_state_t;
+
+static int limit_next(operator_t *op, batch_t **batch) {
+    limit_state_t *state = op->state;
+    
+    while (state->produced < state->limit) {
+        int result = exec_next(op->child, batch);
+        if (result <= 0) return result;
+        
+        batch_t *input = *batch;
+        int start = 0;
+        if (state->skipped < state->offset) {
+            long long skip = state->offset - state->skipped;
+            start = skip < input->selected_count ? (int)skip : input->selected_count;
+            state->skipped += start;
+        }
+        
+        int available = input->selected_count - start;
+        if (available > state->limit - state->produced) {
+            available = (int)(state->limit - state->produced);
+        }
+        if (available <= 0) continue;
+        
+        memmove(input->selection, input->selection + start, available * sizeof(uint16_t));
+        input->selected_count = available;
+        state->produced += available;
+        return 1;
+    }
+    
+    return 0;
+}
+
+static int limit_open(operator_t *op) {
+    limit_state_t *state = op->state;
+    state->skipped = 0;
+    state->produced = 0;
+    return 0;
+}
+
+static void limit_explain(const operator_t *op, char *detail, size_t size) {
+    const limit_state_t *state = op->state;
+    snprintf(detail, size, " (limit %lld offset %lld)", state->limit, state->offset);
+}
+
+// Passes on at most `limit` rows after skipping `offset` rows, and stops
+// pulling from the child once the limit is reached.
+operator_t* exec_limit_create(operator_t *child, long long limit, long long offset) {
+    if (!child || limit < 0 || offset < 0) return NULL;
+    
+    operator_t *op = exec_operator_create("Limit", child->db, child, sizeof(limit_state_t));
+    if (!op) return NULL;
+    
+    limit_state_t *state = op->state;
+    state->limit = limit;
+    state->offset = offset;
+    
+    exec_inherit_columns(op);
+    op->open = limit_open;
+    op->next = limit_next;
+    op->explain = limit_explain;
+    return op;
+}
@@ -0,0 +1,619 @@
+#include "tinydb.h"
+
+// Equi-joins. Both operators output the left columns followed by the right
+// columns, and a LEFT join keeps every left row, with NULL right columns
+// when nothing matches. NULL keys never match.
+//
+// The hash join builds a table on the right input and streams the left
+// input through it. Build rows are split on the low bits of their hash
+// into JOIN_RADIX_PARTITIONS small open-addressing tables, so each probe
+// touches the slots and rows of one partition only. When the build side
+// exceeds the memory budget, both inputs are partitioned to temporary pages
+// on the high bits of the hash (a Grace hash join) and each pair of
+// partitions is joined in turn.
+//
+// The index join looks each left row up in the right table's primary index
+// and suits a small, filtered left input.
+
+#define JOIN_RADIX_BITS 6
+#define JOIN_RADIX_PARTITIONS (1 << JOIN_RADIX_BITS)
+#define JOIN_SPILL_BITS 4
+#define JOIN_SPILL_PARTITIONS (1 << JOIN_SPILL_BITS)
+
+typedef struct {
+    value_t *rows;            // Build rows, one value_t per column
+    uint64_t *hashes;
+    int row_count;
+    int row_capacity;
+    int *slots;               // Row numbers, -1 when empty
+    int slot_capacity;        // Power of two
+} join_partition_t;
+
+typedef struct {
+    join_type_t type;
+    int left_keys[MAX_COLUMNS];
+    int right_keys[MAX_COLUMNS];
+    int key_count;
+    size_t memory_budget;
+    size_t build_bytes;
+    join_partition_t partitions[JOIN_RADIX_PARTITIONS];
+    
+    int built;
+    int spilling;
+    spill_partition_t right_spill[JOIN_SPILL_PARTITIONS];
+    spill_partition_t left_spill[JOIN_SPILL_PARTITIONS];
+    page_id_t right_runs[JOIN_SPILL_PARTITIONS];
+    page_id_t left_runs[JOIN_SPILL_PARTITIONS];
+    int run;                  // Partition pair being joined, in Grace mode
+    
+    // Probe progress, kept across output batches
+    batch_t *probe;
+    uint64_t hashes[BATCH_SIZE];
+    int position;             // Index into the probe selection
+    int slot;                 // Next slot for the current row, -1 to start
+    int matched;
+    
+    batch_t left_input;       // Spilled rows read back
+    batch_t right_input;
+    batch_t batch;
+} hash_join_state_t;
+
+static size_t join_row_bytes(const operator_t *right) {
+    return right->column_count * sizeof(value_t) + sizeof(uint64_t) + 2 * sizeof(int);
+}
+
+static int join_has_null_key(const batch_t *batch, const int *keys, int key_count, int row) {
+    for (int i = 0; i < key_count; i++) {
+        if (batch->columns[keys[i]].nulls[row]) return 1;
+    }
+    return 0;
+}
+
+static int join_grow_slots(join_partition_t *part) {
+    int capacity = part->slot_capacity ? part->slot_capacity * 2 : 16;
+    int *slots = malloc(capacity * sizeof(int));
+    if (!slots) return -1;
+    
+    for (int i = 0; i < capacity; i++) {
+        slots[i] = -1;
+    }
+    for (int r = 0; r < part->row_count; r++) {
+        int index = (int)((part->hashes[r] >> JOIN_RADIX_BITS) & (capacity - 1));
+        while (slots[index] >= 0) {
+            index = (index + 1) & (capacity - 1);
+        }
+        slots[index] = r;
+    }
+    
+    free(part->slots);
+    part->slots = slots;
+    part->slot_capacity = capacity;
+    return 0;
+}
+
+// Adds a build row to the in-memory partition its hash selects
+static int join_insert(operator_t *op, const value_t *values, uint64_t hash) {
+    hash_join_state_t *state = op->state;
+    join_partition_t *part = &state->partitions[hash & (JOIN_RADIX_PARTITIONS - 1)];
+    int column_count = op->inner->column_count;
+    
+    if (part->row_count == part->row_capacity) {
+        int capacity = part->row_capacity ? part->row_capacity * 2 : 16;
+        value_t *rows = realloc(part->rows, (size_t)capacity * column_count * sizeof(value_t));
+        if (!rows) return -1;
+        part->rows = rows;
+        
+        uint64_t *hashes = realloc(part->hashes, capacity * sizeof(uint64_t));
+        if (!hashes) return -1;
+        part->hashes = hashes;
+        part->row_capacity = capacity;
+    }
+    if ((part->row_count + 1) * 2 > part->slot_capacity && join_grow_slots(part) != 0) return -1;
+    
+    int row = part->row_count++;
+    memcpy(&part->rows[(size_t)row * column_count], values, column_count * sizeof(value_t));
+    part->hashes[row] = hash;
+    
+    int mask = part->slot_capacity - 1;
+    int index = (int)((hash >> JOIN_RADIX_BITS) & mask);
+    while (part->slots[index] >= 0) {
+        index = (index + 1) & mask;
+    }
+    part->slots[index] = row;
+    
+    state->build_bytes += join_row_bytes(op->inner);
+    return 0;
+}
+
+static void join_reset(hash_join_state_t *state) {
+    for (int p = 0; p < JOIN_RADIX_PARTITIONS; p++) {
+        join_partition_t *part = &state->partitions[p];
+        for (int i = 0; i < part->slot_capacity; i++) {
+            part->slots[i] = -1;
+        }
+        part->row_count = 0;
+    }
+    state->build_bytes = 0;
+}
+
+static spill_partition_t* join_spill_partition(spill_partition_t *partitions, uint64_t hash) {
+    return &partitions[hash >> (64 - JOIN_SPILL_BITS)];
+}
+
+// Moves the build rows gathered so far to the right spill partitions;
+// the rest of the build input follows them there
+static int join_start_spilling(operator_t *op) {
+    hash_join_state_t *state = op->state;
+    int column_count = op->inner->column_count;
+    
+    for (int p = 0; p < JOIN_RADIX_PARTITIONS; p++) {
+        const join_partition_t *part = &state->partitions[p];
+        for (int r = 0; r < part->row_count; r++) {
+            spill_partition_t *spill = join_spill_partition(state->right_spill, part->hashes[r]);
+            if (spill_append_values(op->db, spill, &part->rows[(size_t)r * column_count], column_count) != 0) {
+                return -1;
+            }
+        }
+    }
+    join_reset(state);
+    state->spilling = 1;
+    return 0;
+}
+
+// Adds the build rows of a batch to the table, or to the spill partitions
+// once the table is over budget
+static int join_build_batch(operator_t *op, const batch_t *batch) {
+    hash_join_state_t *state = op->state;
+    uint64_t hashes[BATCH_SIZE];
+    value_t values[MAX_OUTPUT_COLUMNS];
+    
+    batch_hash(op->db, batch, state->right_keys, state->key_count, hashes);
+    
+    for (int k = 0; k < batch->selected_count; k++) {
+        int row = batch->selection[k];
+        if (join_has_null_key(batch, state->right_keys, state->key_count, row)) continue;
+        
+        if (state->spilling) {
+            if (spill_append(op->db, join_spill_partition(state->right_spill, hashes[row]), batch, row) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        
+        for (int i = 0; i < batch->column_count; i++) {
+            batch_get_value(batch, i, row, &values[i]);
+        }
+        if (join_insert(op, values, hashes[row]) != 0) return -1;
+        if (state->build_bytes > state->memory_budget && join_start_spilling(op) != 0) return -1;
+    }
+    return 0;
+}
+
+// Reads the build input. In Grace mode the left input is partitioned as
+// well, before any output is produced.
+static int join_build(operator_t *op) {
+    hash_join_state_t *state = op->state;
+    batch_t *input;
+    int result;
+    
+    while ((result = exec_next(op->inner, &input)) > 0) {
+        if (join_build_batch(op, input) != 0) return -1;
+    }
+    if (result < 0) return -1;
+    state->built = 1;
+    if (!state->spilling) return 0;
+    
+    uint64_t hashes[BATCH_SIZE];
+    while ((result = exec_next(op->child, &input)) > 0) {
+        batch_hash(op->db, input, state->left_keys, state->key_count, hashes);
+        for (int k = 0; k < input->selected_count; k++) {
+            int row = input->selection[k];
+            // Rows with a NULL key cannot match, but a LEFT join still
+            // outputs them; any partition will do
+            if (state->type == JOIN_INNER && join_has_null_key(input, state->left_keys, state->key_count, row)) {
+                continue;
+            }
+            if (spill_append(op->db, join_spill_partition(state->left_spill, hashes[row]), input, row) != 0) {
+                return -1;
+            }
+        }
+    }
+    if (result < 0) return -1;
+    
+    for (int i = 0; i < JOIN_SPILL_PARTITIONS; i++) {
+        if (spill_finish(op->db, &state->right_spill[i], &state->right_runs[i]) != 0) return -1;
+        if (spill_finish(op->db, &state->left_spill[i], &state->left_runs[i]) != 0) return -1;
+    }
+    state->run = -1;
+    return 0;
+}
+
+// Loads the build rows of the next partition pair into the table. A
+// partition that is still over budget is loaded anyway.
+static int join_load_run(operator_t *op) {
+    hash_join_state_t *state = op->state;
+    join_reset(state);
+    
+    page_id_t page_id = state->right_runs[state->run];
+    state->right_runs[state->run] = 0;
+    
+    int rows;
+    value_t values[MAX_OUTPUT_COLUMNS];
+    uint64_t hashes[BATCH_SIZE];
+    while ((rows = spill_read(op->db, &page_id, &state->right_input)) > 0) {
+        batch_t *batch = &state->right_input;
+        batch_hash(op->db, batch, state->right_keys, state->key_count, hashes);
+        for (int r = 0; r < rows; r++) {
+            for (int i = 0; i < batch->column_count; i++) {
+                batch_get_value(batch, i, r, &values[i]);
+            }
+            if (join_insert(op, values, hashes[r]) != 0) {
+                spill_free(op->db, page_id);
+                return -1;
+            }
+        }
+    }
+    if (rows < 0) {
+        spill_free(op->db, page_id);
+        return -1;
+    }
+    return 0;
+}
+
+// Points state->probe at the next batch of left rows and hashes it.
+// Returns 0 when the left input is exhausted.
+static int join_next_probe(operator_t *op) {
+    hash_join_state_t *state = op->state;
+    int result;
+    
+    if (!state->spilling) {
+        result = exec_next(op->child, &state->probe);
+    } else {
+        result = 0;
+        while (state->run < JOIN_SPILL_PARTITIONS) {
+            if (state->run >= 0) {
+                result = spill_read(op->db, &state->left_runs[state->run], &state->left_input);
+                if (result != 0) break;
+            }
+            if (++state->run == JOIN_SPILL_PARTITIONS) break;
+            if (join_load_run(op) != 0) return -1;
+        }
+        state->probe = &state->left_input;
+    }
+    if (result <= 0) {
+        state->probe = NULL;
+        return result;
+    }
+    
+    batch_hash(op->db, state->probe, state->left_keys, state->key_count, state->hashes);
+    state->position = 0;
+    state->slot = -1;
+    state->matched = 0;
+    return 1;
+}
+
+// Writes a left row, and the build row `row` of `part` or NULLs, to the
+// output
+static void join_emit(operator_t *op, const batch_t *probe, int probe_row, const join_partition_t *part,
+                      int row) {
+    hash_join_state_t *state = op->state;
+    batch_t *out = &state->batch;
+    int out_row = out->row_count++;
+    int left_count = probe->column_count;
+    int right_count = op->column_count - left_count;
+    value_t value;
+    
+    for (int i = 0; i < left_count; i++) {
+        batch_get_value(probe, i, probe_row, &value);
+        batch_set_value(out, i, out_row, &value);
+    }
+    for (int i = 0; i < right_count; i++) {
+        if (part) {
+            batch_set_value(out, left_count + i, out_row, &part->rows[(size_t)row * right_count + i]);
+        } else {
+            out->columns[left_count + i].nulls[out_row] = 1;
+        }
+    }
+}
+
+// Emits the matches of the current probe row, and a NULL-extended row for
+// an unmatched row of a LEFT join. Returns 1 if the output filled up
+// first, in which case state->slot says where to resume.
+static int join_probe_row(operator_t *op, const batch_t *probe, int row) {
+    hash_join_state_t *state = op->state;
+    batch_t *out = &state->batch;
+    uint64_t hash = state->hashes[row];
+    const join_partition_t *part = &state->partitions[hash & (JOIN_RADIX_PARTITIONS - 1)];
+    int right_count = op->column_count - probe->column_count;
+    
+    if (part->row_count > 0 && !join_has_null_key(probe, state->left_keys, state->key_count, row)) {
+        int mask = part->slot_capacity - 1;
+        int index = state->slot >= 0 ? state->slot : (int)((hash >> JOIN_RADIX_BITS) & mask);
+        
+        for (; part->slots[index] >= 0; index = (index + 1) & mask) {
+            int build_row = part->slots[index];
+            if (part->hashes[build_row] != hash) continue;
+            
+            const value_t *values = &part->rows[(size_t)build_row * right_count];
+            int equal = 1;
+            for (int i = 0; i < state->key_count && equal; i++) {
+                equal = batch_value_equal(op->db, probe, state->left_keys[i], row, &values[state->right_keys[i]]);
+            }
+            if (!equal) continue;
+            
+            join_emit(op, probe, row, part, build_row);
+            state->matched = 1;
+            if (out->row_count == BATCH_SIZE) {
+                state->slot = (index + 1) & mask;
+                return 1;
+            }
+        }
+    }
+    
+    if (!state->matched && state->type == JOIN_LEFT) {
+        join_emit(op, probe, row, NULL, 0);
+    }
+    return 0;
+}
+
+static int hash_join_next(operator_t *op, batch_t **batch) {
+    hash_join_state_t *state = op->state;
+    batch_t *out = &state->batch;
+    if (!state->built && join_build(op) != 0) return -1;
+    
+    out->row_count = 0;
+    while (out->row_count < BATCH_SIZE) {
+        if (!state->probe) {
+            int result = join_next_probe(op);
+            if (result < 0) return -1;
+            if (result == 0) break;
+        }
+        
+        if (state->position == state->probe->selected_count) {
+            state->probe = NULL;
+            continue;
+        }
+        if (join_probe_row(op, state->probe, state->probe->selection[state->position])) break;
+        
+        state->position++;
+        state->slot = -1;
+        state->matched = 0;
+    }
+    
+    if (out->row_count == 0) return 0;
+    batch_select_all(out);
+    *batch = out;
+    return 1;
+}
+
+static int hash_join_open(operator_t *op) {
+    hash_join_state_t *state = op->state;
+    state->built = 0;
+    state->spilling = 0;
+    state->probe = NULL;
+    
+    if (batch_init(&state->batch, op->column_count, op->column_types) != 0) return -1;
+    if (batch_init(&state->left_input, op->child->column_count, op->child->column_types) != 0) return -1;
+    if (batch_init(&state->right_input, op->inner->column_count, op->inner->column_types) != 0) return -1;
+    return 0;
+}
+
+static void hash_join_close(operator_t *op) {
+    hash_join_state_t *state = op->state;
+    
+    for (int p = 0; p < JOIN_RADIX_PARTITIONS; p++) {
+        free(state->partitions[p].rows);
+        free(state->partitions[p].hashes);
+        free(state->partitions[p].slots);
+        memset(&state->partitions[p], 0, sizeof(join_partition_t));
+    }
+    // Spill pages of an unfinished query go back to the free list
+    for (int i = 0; i < JOIN_SPILL_PARTITIONS; i++) {
+        spill_release(op->db, &state->right_spill[i]);
+        spill_release(op->db, &state->left_spill[i]);
+        spill_free(op->db, state->right_runs[i]);
+        spill_free(op->db, state->left_runs[i]);
+        state->right_runs[i] = 0;
+        state->left_runs[i] = 0;
+    }
+    state->build_bytes = 0;
+    state->probe = NULL;
+    batch_free(&state->left_input);
+    batch_free(&state->right_input);
+    batch_free(&state->batch);
+}
+
+static void hash_join_explain(const operator_t *op, char *detail, size_t size) {
+    const hash_join_state_t *state = op->state;
+    snprintf(detail, size, "%s%s", state->type == JOIN_LEFT ? " (left outer)" : "",
+             state->spilling ? " spilled to disk" : "");
+}
+
+// Output columns are the left columns followed by the right columns
+static int join_describe(operator_t *op, const operator_t *left, const operator_t *right) {
+    if (left->column_count + right->column_count > MAX_OUTPUT_COLUMNS) return -1;
+    
+    op->column_count = 0;
+    for (int side = 0; side < 2; side++) {
+        const operator_t *input = side == 0 ? left : right;
+        for (int i = 0; i < input->column_count; i++) {
+            op->column_types[op->column_count] = input->column_types[i];
+            strcpy(op->column_names[op->column_count], input->column_names[i]);
+            op->column_count++;
+        }
+    }
+    return 0;
+}
+
+// Joins rows whose left_keys equal their right_keys, building the hash
+// table on the right input. The table is kept within memory_budget bytes
+// (0 selects JOIN_MEMORY_BUDGET) by partitioning both inputs to temporary
+// pages. Key columns must have the same types on both sides. Output order
+// follows the left input except in Grace mode.
+operator_t* exec_hash_join_create(operator_t *left, operator_t *right, const int *left_keys, const int *right_keys,
+                                  int key_count, join_type_t type, size_t memory_budget) {
+    if (!left || !right || key_count <= 0 || key_count > MAX_COLUMNS) return NULL;
+    
+    for (int i = 0; i < key_count; i++) {
+        if (left_keys[i] < 0 || left_keys[i] >= left->column_count) return NULL;
+        if (right_keys[i] < 0 || right_keys[i] >= right->column_count) return NULL;
+        if (left->column_types[left_keys[i]] != right->column_types[right_keys[i]]) return NULL;
+    }
+    
+    operator_t *op = exec_operator_create("Hash Join", left->db, left, sizeof(hash_join_state_t));
+    if (!op) return NULL;
+    
+    if (join_describe(op, left, right) != 0) {
+        free(op->state);
+        free(op);
+        return NULL;
+    }
+    op->inner = right;
+    
+    hash_join_state_t *state = op->state;
+    state->type = type;
+    memcpy(state->left_keys, left_keys, key_count * sizeof(int));
+    memcpy(state->right_keys, right_keys, key_count * sizeof(int));
+    state->key_count = key_count;
+    state->memory_budget = memory_budget ? memory_budget : JOIN_MEMORY_BUDGET;
+    
+    op->open = hash_join_open;
+    op->next = hash_join_next;
+    op->close = hash_join_close;
+    op->explain = hash_join_explain;
+    return op;
+}
+
+typedef struct {
+    join_type_t type;
+    int left_key;
+    table_schema_t *schema;
+    int column_ids[MAX_COLUMNS];
+    transaction_id_t txn_id;
+    batch_t right;            // Right columns for the rows of the current left batch
+    batch_t batch;            // Left vectors followed by `right`'s
+} index_join_state_t;
+
+static int index_join_open(operator_t *op) {
+    index_join_state_t *state = op->state;
+    int left_count = op->child->column_count;
+    
+    if (batch_init(&state->right, op->column_count - left_count, op->column_types + left_count) != 0) return -1;
+    
+    // The output batch only points at other batches' vectors
+    memset(&state->batch, 0, sizeof(batch_t));
+    state->batch.column_count = op->column_count;
+    for (int i = 0; i < state->right.column_count; i++) {
+        state->batch.columns[left_count + i] = state->right.columns[i];
+    }
+    return 0;
+}
+
+static int index_join_next(operator_t *op, batch_t **batch) {
+    index_join_state_t *state = op->state;
+    batch_t *out = &state->batch;
+    batch_t *right = &state->right;
+    int left_count = op->child->column_count;
+    
+    for (;;) {
+        batch_t *input;
+        int result = exec_next(op->child, &input);
+        if (result <= 0) return result;
+        
+        int count = 0;
+        for (int k = 0; k < input->selected_count; k++) {
+            int row = input->selection[k];
+            value_t key;
+            batch_get_value(input, state->left_key, row, &key);
+            
+            // Only the right columns are read, straight from the pinned page
+            tuple_t fetched;
+            int found = 0;
+            if (!key.is_null) {
+                found = tuple_fetch(op->db, state->schema, &key, state->column_ids, right->column_count,
+                                    &fetched, state->txn_id);
+                if (found < 0) return -1;
+            }
+            
+            if (found) {
+                for (int i = 0; i < right->column_count; i++) {
+                    batch_set_value(right, i, row, &fetched.values[i]);
+                }
+            } else if (state->type == JOIN_LEFT) {
+                for (int i = 0; i < right->column_count; i++) {
+                    right->columns[i].nulls[row] = 1;
+                }
+            } else {
+                continue;
+            }
+            out->selection[count++] = (uint16_t)row;
+        }
+        if (count == 0) continue;
+        
+        for (int i = 0; i < left_count; i++) {
+            out->columns[i] = input->columns[i];
+        }
+        out->row_count = input->row_count;
+        out->selected_count = count;
+        *batch = out;
+        return 1;
+    }
+}
+
+static void index_join_close(operator_t *op) {
+    index_join_state_t *state = op->state;
+    batch_free(&state->right);
+}
+
+static void index_join_explain(const operator_t *op, char *detail, size_t size) {
+    const index_join_state_t *state = op->state;
+    snprintf(detail, size, "%s on %s using primary key", state->type == JOIN_LEFT ? " (left outer)" : "",
+             state->schema->name);
+}
+
+// Joins each left row to the row of table_name whose primary key equals
+// the left_key column, by an index lookup. The right columns are the
+// listed table columns.
+operator_t* exec_index_join_create(operator_t *left, int left_key, const char *table_name, const int *column_ids,
+                                   int column_count, join_type_t type, transaction_id_t txn_id) {
+    if (!left) return NULL;
+    table_schema_t *schema = find_table_schema(left->db, table_name);
+    if (!schema || left_key < 0 || left_key >= left->column_count) return NULL;
+    if (column_count <= 0 || column_count > MAX_COLUMNS) return NULL;
+    if (left->column_count + column_count > MAX_OUTPUT_COLUMNS) return NULL;
+    
+    int key_column = -1;
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_primary_key) key_column = i;
+    }
+    if (key_column < 0 || schema->columns[key_column].type != left->column_types[left_key]) return NULL;
+    for (int i = 0; i < column_count; i++) {
+        if (column_ids[i] < 0 || column_ids[i] >= schema->column_count) return NULL;
+    }
+    
+    operator_t *op = exec_operator_create("Index Join", left->db, left, sizeof(index_join_state_t));
+    if (!op) return NULL;
+    
+    index_join_state_t *state = op->state;
+    state->type = type;
+    state->left_key = left_key;
+    state->schema = schema;
+    memcpy(state->column_ids, column_ids, column_count * sizeof(int));
+    state->txn_id = txn_id;
+    
+    op->column_count = left->column_count;
+    memcpy(op->column_types, left->column_types, sizeof(op->column_types));
+    memcpy(op->column_names, left->column_names, sizeof(op->column_names));
+    for (int i = 0; i < column_count; i++) {
+        const column_def_t *column = &schema->columns[column_ids[i]];
+        op->column_types[op->column_count] = column->type;
+        strcpy(op->column_names[op->column_count], column->name);
+        op->column_count++;
+    }
+    
+    op->open = index_join_open;
+    op->next = index_join_next;
+    op->close = index_join_close;
+    op->explain = index_join_explain;
+    return op;
+}
@@ -8,18 +8,31 @@ extern void db_periodic_checkpoint(database_t *db);
 void print_help() {
     printf("TinyDB - A simple relational database with MVCC support\n");
     printf("Commands:\n");
-    printf("  CREATE TABLE table_name (col1 type, col2 type PRIMARY KEY, ...);\n");
+    printf("  CREATE TABLE table_name (col1 type, col2 type PRIMARY KEY, ...) [STORAGE = ROW|COLUMN|INDEX];\n");
     printf("  BEGIN;\n");
-    printf("  INSERT INTO table_name VALUES (val1, val2, ...);\n");
-    printf("  SELECT * FROM table_name [WHERE col = value];\n");
-    printf("  DELETE FROM table_name WHERE col = value;\n");
+    printf("  INSERT INTO table_name VALUES (val1, val2, ...), (...);\n");
+    printf("  SELECT *|expr [AS name], ... FROM table_name [WHERE condition] [GROUP BY col, ...]\n");
+    printf("         [ORDER BY col [ASC|DESC], ...] [LIMIT n [OFFSET m]];\n");
+    printf("  SELECT *|expr, ... FROM t1 [INNER|LEFT [OUTER]] JOIN t2 ON t1.col = t2.col [WHERE condition];\n");
+    printf("  EXPLAIN [ANALYZE] SELECT ...;   (show the plan, with per-operator rows, time and I/O)\n");
+    printf("  DELETE FROM table_name WHERE condition;\n");
+    printf("  UPDATE table_name SET col = expr|'string', ... [WHERE condition];\n");
+    printf("  COPY table_name FROM|TO 'file' [CSV [HEADER] | BINARY];\n");
+    printf("    expr: col or table.col, integer, + - * /, ( ), COUNT(*), COUNT|SUM|AVG|MIN|MAX(col)\n");
+    printf("    condition: col =|<>|<|<=|>|>= value, col BETWEEN a AND b, AND, OR, ( )\n");
     printf("  COMMIT;\n");
     printf("  ROLLBACK;\n");
+    printf("  VACUUM [table_name];\n");
+    printf("  ANALYZE [table_name];   (gather the statistics the planner costs plans with)\n");
+    printf("  SET MAX_PARALLELISM [=|TO] n;   (worker threads per scan, 0 = all cores)\n");
+    printf("  SET OUTPUT [=|TO] TEXT|BINARY;   (format of SELECT results)\n");
     printf("  .help - Show this help\n");
     printf("  .checkpoint - Force checkpoint\n");
     printf("  .tables - List all tables\n");
+    printf("  .cache - Show statement cache statistics\n");
+    printf("  .autovacuum <seconds>|off - Start or stop background vacuum\n");
     printf("  .exit - Exit the database\n");
-    printf("\nSupported data types: INT, VARCHAR(size), FLOAT\n");
+    printf("\nSupported data types: INT, VARCHAR(size) [DICTIONARY], FLOAT\n");
 }
 
 void list_tables(database_t *db) {
@@ -43,6 +56,7 @@ void list_tables(database_t *db) {
                     break;
                 case DATA_TYPE_VARCHAR:
                     printf("VARCHAR(%d)", schema->columns[j].size);
+                    if (schema->columns[j].is_dictionary) printf(" DICTIONARY");
                     break;
                 case DATA_TYPE_FLOAT:
                     printf("FLOAT");
@@ -53,7 +67,13 @@ void list_tables(database_t *db) {
                 printf(" PRIMARY KEY");
             }
         }
-        printf(")\n");
+        printf(")");
+        if (schema->storage_type == STORAGE_COLUMN) {
+            printf(" STORAGE = COLUMN");
+        } else if (schema->storage_type == STORAGE_INDEX) {
+            printf(" STORAGE = INDEX");
+        }
+        printf("\n");
     }
 }
 
@@ -130,6 +150,29 @@ int main(int argc, char *argv[]) {
             continue;
         }
         
+        if (strcmp(trimmed, ".cache") == 0) {
+            sql_cache_stats_t stats;
+            sql_cache_get_stats(db, &stats);
+            long long lookups = stats.hits + stats.misses;
+            printf("Statement cache: %d/%d entries, %lld hits, %lld misses (%.1f%% hit rate), "
+                   "%lld evictions, %lld invalidations\n",
+                   stats.entries, SQL_CACHE_SIZE, stats.hits, stats.misses,
+                   lookups > 0 ? 100.0 * stats.hits / lookups : 0.0, stats.evictions, stats.invalidations);
+            continue;
+        }
+        
+        if (strncmp(trimmed, ".autovacuum", 11) == 0) {
+            const char *arg = trimmed + 11;
+            while (*arg == ' ') arg++;
+            
+            if (strcmp(arg, "off") == 0) {
+                vacuum_stop_worker(db);
+            } else if (vacuum_start_worker(db, atoi(arg)) != 0) {
+                printf("Usage: .autovacuum <seconds>|off\n");
+            }
+            continue;
+        }
+        
         int result = sql_execute(db, trimmed, &current_txn);
         
         if (result == 0) {
@@ -0,0 +1,149 @@
+#include "tinydb.h"
+
+// Strings longer than MAX_VALUE_SIZE - 1 are kept out of the row in a chain
+// of overflow pages. The row only holds the first page id and the length,
+// so the chain is read when the value is actually needed.
+//
+//   [overflow_page_header_t][up to OVERFLOW_PAGE_CAPACITY bytes] -> next page
+
+#define OVERFLOW_PAGE_CAPACITY ((uint32_t)(PAGE_SIZE - sizeof(overflow_page_header_t)))
+
+static void write_overflow_page(database_t *db, page_t *page) {
+    pthread_mutex_lock(&page->page_mutex);
+    page->is_dirty = 1;
+    pthread_mutex_unlock(&page->page_mutex);
+    
+    storage_write_page(db, page->page_id, page->data);
+    buffer_release_page(db->buffer_pool, page);
+}
+
+int overflow_write(database_t *db, const char *data, uint32_t length, page_id_t *first_page_id) {
+    page_t *prev_page = NULL;
+    uint32_t written = 0;
+    
+    *first_page_id = 0;
+    
+    while (written < length) {
+        page_t *page = storage_allocate_page(db);
+        if (!page) {
+            if (prev_page) write_overflow_page(db, prev_page);
+            overflow_free(db, *first_page_id);
+            *first_page_id = 0;
+            return -1;
+        }
+        
+        uint32_t chunk = length - written;
+        if (chunk > OVERFLOW_PAGE_CAPACITY) chunk = OVERFLOW_PAGE_CAPACITY;
+        
+        memset(page->data, 0, PAGE_SIZE);
+        overflow_page_header_t *header = (overflow_page_header_t*)page->data;
+        header->next_page_id = 0;
+        header->length = chunk;
+        memcpy(page->data + sizeof(overflow_page_header_t), data + written, chunk);
+        written += chunk;
+        
+        if (prev_page) {
+            ((overflow_page_header_t*)prev_page->data)->next_page_id = page->page_id;
+            write_overflow_page(db, prev_page);
+        } else {
+            *first_page_id = page->page_id;
+        }
+        prev_page = page;
+    }
+    
+    if (prev_page) write_overflow_page(db, prev_page);
+    return 0;
+}
+
+// Returns the full string of an external value as a NUL-terminated copy
+// that the caller frees, or NULL if the chain cannot be read.
+char* overflow_read(database_t *db, const value_t *value) {
+    if (!value->is_external) return NULL;
+    
+    const external_value_t *ext = &value->data.ext;
+    char *result = malloc(ext->length + 1);
+    if (!result) return NULL;
+    
+    if (ext->page_id == 0) {
+        // Not stored yet: the value still lives in the caller's buffer
+        memcpy(result, ext->data, ext->length);
+        result[ext->length] = '\0';
+        return result;
+    }
+    
+    uint32_t read = 0;
+    page_id_t page_id = ext->page_id;
+    
+    while (page_id != 0 && read < ext->length) {
+        page_t *page = buffer_get_page(db->buffer_pool, page_id);
+        if (!page) {
+            free(result);
+            return NULL;
+        }
+        
+        overflow_page_header_t *header = (overflow_page_header_t*)page->data;
+        uint32_t chunk = header->length;
+        if (chunk > ext->length - read) chunk = ext->length - read;
+        
+        memcpy(result + read, page->data + sizeof(overflow_page_header_t), chunk);
+        read += chunk;
+        page_id = header->next_page_id;
+        buffer_release_page(db->buffer_pool, page);
+    }
+    
+    if (read != ext->length) {
+        free(result);
+        return NULL;
+    }
+    
+    result[read] = '\0';
+    return result;
+}
+
+void overflow_free(database_t *db, page_id_t first_page_id) {
+    page_id_t page_id = first_page_id;
+    
+    while (page_id != 0) {
+        page_t *page = buffer_get_page(db->buffer_pool, page_id);
+        if (!page) return;
+        
+        page_id_t next_page_id = ((overflow_page_header_t*)page->data)->next_page_id;
+        buffer_release_page(db->buffer_pool, page);
+        
+        storage_free_page(db, page_id);
+        page_id = next_page_id;
+    }
+}
+
+// Moves every pending external value of the tuple into its own overflow
+// chain, leaving only the chain reference in the tuple.
+int overflow_store_tuple(database_t *db, tuple_t *tuple) {
+    for (int i = 0; i < tuple->column_count; i++) {
+        value_t *val = &tuple->values[i];
+        if (val->is_null || !val->is_external || val->data.ext.page_id != 0) continue;
+        
+        page_id_t first_page_id;
+        if (overflow_write(db, val->data.ext.data, val->data.ext.length, &first_page_id) != 0) {
+            for (int j = 0; j < i; j++) {
+                if (tuple->values[j].is_external) {
+                    overflow_free(db, tuple->values[j].data.ext.page_id);
+                    tuple->values[j].data.ext.page_id = 0;
+                }
+            }
+            return -1;
+        }
+        
+        val->data.ext.page_id = first_page_id;
+        val->data.ext.data = NULL;
+    }
+    return 0;
+}
+
+void overflow_free_tuple(database_t *db, const tuple_t *tuple) {
+    for (int i = 0; i < tuple->column_count; i++) {
+        const value_t *val = &tuple->values[i];
+        if (!val->is_null && val->is_external) {
+            overflow_free(db, val->data.ext.page_id);
+        }
+    }
+}
@@ -0,0 +1,227 @@
+#include "tinydb.h"
+
+// Intra-query parallelism. A parallel plan runs one copy of its lower
+// operators per worker thread, each copy rooted at a scan that shares its
+// page source with the others (exec_scan_share), so the table is divided
+// page by page among the workers as they ask for more. The consuming
+// operator stays on the caller's thread and receives the workers' batches
+// one at a time, or merges the partial results they built on their own.
+
+static void* parallel_main(void *arg) {
+    parallel_worker_t *worker = arg;
+    parallel_t *par = worker->par;
+    
+    int result = par->fn(par, worker->index, par->arg);
+    
+    pthread_mutex_lock(&par->mutex);
+    par->running--;
+    if (result < 0) par->failed = 1;
+    pthread_cond_broadcast(&par->ready);
+    pthread_mutex_unlock(&par->mutex);
+    return NULL;
+}
+
+// Starts worker_count threads, each calling fn(par, index, arg). Returns -1
+// if a thread cannot be started, after stopping those that were.
+int parallel_start(parallel_t *par, int worker_count, parallel_fn_t fn, void *arg) {
+    if (worker_count <= 0 || worker_count > MAX_PARALLELISM) return -1;
+    
+    pthread_mutex_init(&par->mutex, NULL);
+    pthread_cond_init(&par->ready, NULL);
+    pthread_cond_init(&par->consumed, NULL);
+    par->fn = fn;
+    par->arg = arg;
+    par->current = -1;
+    par->failed = 0;
+    par->stopping = 0;
+    par->running = worker_count;
+    par->worker_count = 0;
+    
+    for (int i = 0; i < worker_count; i++) {
+        par->batches[i] = NULL;
+        par->workers[i].par = par;
+        par->workers[i].index = i;
+    }
+    
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&par->threads[i], NULL, parallel_main, &par->workers[i]) != 0) {
+            printf("Cannot start worker thread\n");
+            pthread_mutex_lock(&par->mutex);
+            par->running -= worker_count - i;
+            pthread_mutex_unlock(&par->mutex);
+            parallel_stop(par);
+            return -1;
+        }
+        par->worker_count = i + 1;
+    }
+    return 0;
+}
+
+// Hands a batch of the worker to the consumer and waits until it is done
+// with it. Returns -1 if the consumer is stopping, in which case the
+// worker should return.
+int parallel_emit(parallel_t *par, int worker, batch_t *batch) {
+    pthread_mutex_lock(&par->mutex);
+    if (!par->stopping) {
+        par->batches[worker] = batch;
+        pthread_cond_broadcast(&par->ready);
+        while (par->batches[worker] && !par->stopping) {
+            pthread_cond_wait(&par->consumed, &par->mutex);
+        }
+    }
+    int stopping = par->stopping;
+    pthread_mutex_unlock(&par->mutex);
+    return stopping ? -1 : 0;
+}
+
+// Gives the batch returned by the previous call back to its worker and
+// waits for the next one. Workers are served in turn so none of them is
+// left waiting behind the others. Returns 1 with a batch, 0 once every
+// worker has returned and -1 if one of them failed.
+int parallel_next(parallel_t *par, batch_t **batch) {
+    pthread_mutex_lock(&par->mutex);
+    int start = 0;
+    if (par->current >= 0) {
+        par->batches[par->current] = NULL;
+        start = par->current + 1;
+        par->current = -1;
+        pthread_cond_broadcast(&par->consumed);
+    }
+    
+    while (1) {
+        if (par->failed) {
+            pthread_mutex_unlock(&par->mutex);
+            return -1;
+        }
+        for (int k = 0; k < par->worker_count; k++) {
+            int worker = (start + k) % par->worker_count;
+            if (!par->batches[worker]) continue;
+            
+            par->current = worker;
+            *batch = par->batches[worker];
+            pthread_mutex_unlock(&par->mutex);
+            return 1;
+        }
+        if (par->running == 0) {
+            pthread_mutex_unlock(&par->mutex);
+            return 0;
+        }
+        pthread_cond_wait(&par->ready, &par->mutex);
+    }
+}
+
+// Tells the workers to stop, waits for them and releases the threads. A
+// worker stops at its next parallel_emit(); one that never emits runs to
+// its end. Does nothing if no threads were started.
+void parallel_stop(parallel_t *par) {
+    if (!par->fn) return;
+    
+    pthread_mutex_lock(&par->mutex);
+    par->stopping = 1;
+    pthread_cond_broadcast(&par->consumed);
+    pthread_mutex_unlock(&par->mutex);
+    
+    for (int i = 0; i < par->worker_count; i++) {
+        pthread_join(par->threads[i], NULL);
+    }
+    
+    pthread_cond_destroy(&par->consumed);
+    pthread_cond_destroy(&par->ready);
+    pthread_mutex_destroy(&par->mutex);
+    par->worker_count = 0;
+    par->fn = NULL;
+}
+
+// --- Gather ---------------------------------------------------------------
+
+typedef struct {
+    operator_t *workers[MAX_PARALLELISM];
+    int worker_count;
+    int started;
+    parallel_t parallel;
+} gather_state_t;
+
+static int gather_run(parallel_t *par, int worker, void *arg) {
+    gather_state_t *state = ((operator_t*)arg)->state;
+    batch_t *batch;
+    int result;
+    
+    while ((result = exec_next(state->workers[worker], &batch)) > 0) {
+        if (parallel_emit(par, worker, batch) != 0) return 0;
+    }
+    return result;
+}
+
+// Workers are opened in order, so a scan leader in the first one sets up
+// the page source before the others use it
+static int gather_open(operator_t *op) {
+    gather_state_t *state = op->state;
+    state->started = 0;
+    
+    for (int i = 0; i < state->worker_count; i++) {
+        if (exec_open(state->workers[i]) != 0) return -1;
+    }
+    return 0;
+}
+
+static int gather_next(operator_t *op, batch_t **batch) {
+    gather_state_t *state = op->state;
+    
+    if (!state->started) {
+        if (parallel_start(&state->parallel, state->worker_count, gather_run, op) != 0) return -1;
+        state->started = 1;
+    }
+    return parallel_next(&state->parallel, batch);
+}
+
+static void gather_close(operator_t *op) {
+    gather_state_t *state = op->state;
+    
+    if (state->started) parallel_stop(&state->parallel);
+    state->started = 0;
+    for (int i = 0; i < state->worker_count; i++) {
+        exec_close(state->workers[i]);
+    }
+}
+
+static void gather_destroy(operator_t *op) {
+    gather_state_t *state = op->state;
+    for (int i = 0; i < state->worker_count; i++) {
+        exec_destroy(state->workers[i]);
+    }
+}
+
+// Runs each worker plan on a thread of its own and passes on their batches
+// as they come, in no particular order. The workers must produce the same
+// columns. The operator takes over the workers, except when it cannot be
+// created.
+operator_t* exec_gather_create(operator_t **workers, int worker_count) {
+    if (worker_count <= 0 || worker_count > MAX_PARALLELISM) return NULL;
+    
+    for (int i = 1; i < worker_count; i++) {
+        if (workers[i]->column_count != workers[0]->column_count ||
+            memcmp(workers[i]->column_types, workers[0]->column_types,
+                   workers[0]->column_count * sizeof(data_type_t)) != 0) {
+            return NULL;
+        }
+    }
+    
+    operator_t *op = exec_operator_create("Gather", workers[0]->db, NULL, sizeof(gather_state_t));
+    if (!op) return NULL;
+    
+    gather_state_t *state = op->state;
+    memcpy(state->workers, workers, worker_count * sizeof(operator_t*));
+    state->worker_count = worker_count;
+    op->workers = state->workers;
+    op->worker_count = worker_count;
+    
+    op->column_count = workers[0]->column_count;
+    memcpy(op->column_types, workers[0]->column_types, sizeof(op->column_types));
+    memcpy(op->column_names, workers[0]->column_names, sizeof(op->column_names));
+    
+    op->open = gather_open;
+    op->next = gather_next;
+    op->close = gather_close;
+    op->destroy = gather_destroy;
+    return op;
+}
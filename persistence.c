@@ -25,6 +25,9 @@ int db_save_metadata(database_t *db) {
     metadata_t *page_metadata = (metadata_t*)metadata_page->data;
     page_metadata->schema_count = metadata.schema_count;
     page_metadata->next_page_id = metadata.next_page_id;
+    if (db->txn_manager) {
+        page_metadata->next_txn_id = db->txn_manager->next_txn_id;
+    }
     
     char *schema_data = metadata_page->data + sizeof(metadata_t);
     int remaining_space = PAGE_SIZE - sizeof(metadata_t);
@@ -63,6 +66,8 @@ int db_load_metadata(database_t *db) {
         metadata_t *metadata = (metadata_t*)metadata_page->data;
         metadata->schema_count = 0;
         metadata->next_page_id = 2; // Start from page 2 (page 1 is metadata)
+        metadata->next_txn_id = 1;
+        metadata->free_page_id = 0;
         
         pthread_mutex_lock(&metadata_page->page_mutex);
         metadata_page->is_dirty = 1;
@@ -75,8 +80,18 @@ int db_load_metadata(database_t *db) {
     
     metadata_t *metadata = (metadata_t*)metadata_page->data;
     db->schema_count = metadata->schema_count;
+    db->schema_version++;
     printf("Loaded metadata: schema_count=%d\n", db->schema_count);
     
+    // Transaction ids keep increasing across restarts so tuple versions
+    // written by earlier sessions stay ordered before new transactions.
+    if (!db->txn_manager) {
+        db->txn_manager = txn_manager_create();
+    }
+    if (db->txn_manager) {
+        txn_manager_resume(db->txn_manager, metadata->next_txn_id);
+    }
+    
     if (db->schema_count > 0) {
         char *schema_data = metadata_page->data + sizeof(metadata_t);
         int schema_data_size = db->schema_count * sizeof(table_schema_t);
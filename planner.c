@@ -0,0 +1,843 @@
+#include "tinydb.h"
+
+// Turns a select list and WHERE expression into an operator tree.
+// Comparisons on the primary key that every matching row must satisfy
+// (those reachable from the root through AND only) become the bounds of a
+// range scan over the primary index. The scan reads only the columns the
+// query refers to, and the rest of the expression is pushed into it, so
+// columns used only by the select list are decoded just for matching rows.
+//
+// Tables analyzed by ANALYZE are planned by cost: the planner estimates
+// how many rows each choice reads and what reading them costs, and takes
+// the cheaper of a range scan or a full scan, of reading in key order or
+// sorting, and of the join methods and sides. Costs are in units of one
+// sequential page read. Tables without statistics follow the fixed rules
+// given with each choice.
+
+#define COST_SEQ_PAGE 1.0
+#define COST_RANDOM_PAGE 4.0     // A page read out of order
+#define COST_ROW 0.01            // Passing one row through an operator
+#define COST_HASH_ROW 0.02       // Adding one row to a hash table
+
+static int plan_key_column(const table_schema_t *schema) {
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_primary_key) return i;
+    }
+    return -1;
+}
+
+// Folds the key comparisons of the top-level conjunction into `bounds`
+// and marks the nodes that the bounds fully replace.
+static void plan_collect_bounds(const expr_t *expr, int index, int key_column, data_type_t key_type,
+                                key_bounds_t *bounds, uint8_t *consumed) {
+    const expr_node_t *node = &expr->nodes[index];
+    
+    if (node->kind == EXPR_AND) {
+        plan_collect_bounds(expr, node->left, key_column, key_type, bounds, consumed);
+        plan_collect_bounds(expr, node->right, key_column, key_type, bounds, consumed);
+        return;
+    }
+    if (node->kind != EXPR_COMPARE) return;
+    
+    const predicate_t *pred = &node->predicate;
+    if (pred->column != key_column || pred->op == CMP_NE || pred->constant.is_null) return;
+    
+    value_t key = pred->constant;
+    if (key.type == DATA_TYPE_INT && key_type == DATA_TYPE_FLOAT) {
+        key.data.float_val = (float)key.data.int_val;
+        key.type = DATA_TYPE_FLOAT;
+    }
+    if (key.type != key_type || key.is_external) return;
+    
+    key_bounds_tighten(bounds, pred->op, &key);
+    consumed[index] = 1;
+}
+
+// Estimated fraction of the rows for which the subtree holds, taking the
+// comparisons as independent
+static double plan_selectivity(const table_stats_t *stats, const expr_t *expr, int index) {
+    const expr_node_t *node = &expr->nodes[index];
+    if (node->kind == EXPR_COMPARE) {
+        return stats_selectivity(stats, node->predicate.column, node->predicate.op, &node->predicate.constant);
+    }
+    
+    double left = plan_selectivity(stats, expr, node->left);
+    double right = plan_selectivity(stats, expr, node->right);
+    if (node->kind == EXPR_AND) return left * right;
+    return left + right - left * right;
+}
+
+static double plan_full_scan_cost(const table_stats_t *stats) {
+    return stats->page_count * COST_SEQ_PAGE + stats->row_count * COST_ROW;
+}
+
+// Cost of reading a fraction of the rows of a table in key order. The
+// rows of an index-organized table are stored that way. Other tables are
+// read through their primary index: rows stored in key order come from a
+// run of pages, while rows stored at random can cost a page read each.
+// The correlation between key and storage order weighs the two.
+static double plan_key_order_cost(const table_schema_t *schema, const table_stats_t *stats, double selectivity) {
+    double rows = selectivity * stats->row_count;
+    double in_order = selectivity * stats->page_count * COST_SEQ_PAGE;
+    if (schema->storage_type == STORAGE_INDEX) return in_order + rows * COST_ROW;
+    
+    double scattered = rows * COST_RANDOM_PAGE;
+    double correlation = stats->key_correlation;
+    double index = rows / BTREE_ORDER * COST_RANDOM_PAGE;
+    return index + scattered + correlation * correlation * (in_order - scattered) + rows * COST_ROW;
+}
+
+// Key bounds that the expression gives a scan of the table
+static void plan_where_bounds(const table_schema_t *schema, const expr_t *where, key_bounds_t *bounds) {
+    key_bounds_init(bounds);
+    int key_column = plan_key_column(schema);
+    if (!where || where->root < 0 || key_column < 0) return;
+    
+    uint8_t consumed[MAX_EXPR_NODES] = {0};
+    plan_collect_bounds(where, where->root, key_column, schema->columns[key_column].type, bounds, consumed);
+}
+
+// Whether a scan within the bounds should read through the primary index
+// rather than scan the whole table. Always without statistics.
+static int plan_use_bounds(database_t *db, const table_schema_t *schema, const key_bounds_t *bounds) {
+    table_stats_t stats;
+    if (schema->storage_type == STORAGE_INDEX || stats_load(db, schema, &stats) != 1) return 1;
+    
+    double selectivity = stats_bounds_selectivity(&stats, plan_key_column(schema), bounds);
+    return plan_key_order_cost(schema, &stats, selectivity) <= plan_full_scan_cost(&stats);
+}
+
+// Estimated cost of plan_select over the table, and in *rows the number
+// of rows it returns
+static double plan_scan_cost(const table_schema_t *schema, const table_stats_t *stats, const expr_t *where,
+                             double *rows) {
+    *rows = stats->row_count;
+    if (where->root >= 0) *rows *= plan_selectivity(stats, where, where->root);
+    
+    double cost = plan_full_scan_cost(stats);
+    key_bounds_t bounds;
+    plan_where_bounds(schema, where, &bounds);
+    if (bounds.has_low || bounds.has_high) {
+        double selectivity = stats_bounds_selectivity(stats, plan_key_column(schema), &bounds);
+        double ranged = plan_key_order_cost(schema, stats, selectivity);
+        if (ranged < cost) cost = ranged;
+    }
+    return cost;
+}
+
+// Copies the part of the expression not covered by the bounds and returns
+// the index of its root in `residual`, or -1 if nothing is left.
+static int plan_copy_residual(const expr_t *expr, int index, const uint8_t *consumed, expr_t *residual) {
+    const expr_node_t *node = &expr->nodes[index];
+    if (consumed[index]) return -1;
+    
+    if (node->kind == EXPR_COMPARE) {
+        return expr_add_compare(residual, node->predicate.column, node->predicate.op, &node->predicate.constant);
+    }
+    
+    int left = plan_copy_residual(expr, node->left, consumed, residual);
+    int right = plan_copy_residual(expr, node->right, consumed, residual);
+    if (left < 0) return right;
+    if (right < 0) return left;
+    return expr_add_logical(residual, node->kind, left, right);
+}
+
+// Marks the table columns an expression or select list refers to.
+// Returns -1 if one of them does not exist.
+static int plan_mark_where(const table_schema_t *schema, const expr_t *where, uint8_t *used) {
+    for (int i = 0; i < where->node_count; i++) {
+        if (where->nodes[i].kind != EXPR_COMPARE) continue;
+        int col = where->nodes[i].predicate.column;
+        if (col < 0 || col >= schema->column_count) return -1;
+        used[col] = 1;
+    }
+    return 0;
+}
+
+static int plan_mark_items(const table_schema_t *schema, const scalar_expr_t *items, int item_count,
+                           uint8_t *used) {
+    for (int i = 0; i < item_count; i++) {
+        for (int j = 0; j < items[i].node_count; j++) {
+            if (items[i].nodes[j].kind != SCALAR_COLUMN) continue;
+            int col = items[i].nodes[j].column;
+            if (col < 0 || col >= schema->column_count) return -1;
+            used[col] = 1;
+        }
+    }
+    return 0;
+}
+
+// True if the select list just repeats the scan's columns in order
+static int plan_is_identity(const operator_t *scan, const scalar_expr_t *items, int item_count) {
+    if (item_count != scan->column_count) return 0;
+    
+    for (int i = 0; i < item_count; i++) {
+        if (items[i].node_count != 1 || items[i].root != 0) return 0;
+        if (items[i].nodes[0].kind != SCALAR_COLUMN || items[i].nodes[0].column != i) return 0;
+        if (items[i].name[0] && strcmp(items[i].name, scan->column_names[i]) != 0) return 0;
+    }
+    return 1;
+}
+
+// Plans a single-table select and points *scan at the scan it reads. With
+// `ordered` set, rows come out in primary key order, read through the
+// primary index even without bounds.
+static operator_t* plan_scan_pipeline(database_t *db, const char *table_name, const scalar_expr_t *items,
+                                      int item_count, const expr_t *where, int ordered, transaction_id_t txn_id,
+                                      operator_t **scan) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) return NULL;
+    if (items && (item_count <= 0 || item_count > MAX_OUTPUT_COLUMNS)) return NULL;
+    
+    uint8_t used[MAX_COLUMNS] = {0};
+    if (!items) {
+        memset(used, 1, sizeof(used));
+    } else if (plan_mark_items(schema, items, item_count, used) != 0) {
+        return NULL;
+    }
+    
+    key_bounds_t bounds;
+    uint8_t consumed[MAX_EXPR_NODES] = {0};
+    expr_t residual;
+    key_bounds_init(&bounds);
+    expr_init(&residual);
+    
+    if (where && where->root >= 0) {
+        // Validates every column, even those the bounds replace
+        uint8_t where_used[MAX_COLUMNS] = {0};
+        if (plan_mark_where(schema, where, where_used) != 0) return NULL;
+        
+        int key_column = plan_key_column(schema);
+        if (key_column >= 0) {
+            plan_collect_bounds(where, where->root, key_column, schema->columns[key_column].type, &bounds,
+                                consumed);
+        }
+        // A full scan evaluates the key comparisons with the rest
+        if (!ordered && (bounds.has_low || bounds.has_high) && !plan_use_bounds(db, schema, &bounds)) {
+            key_bounds_init(&bounds);
+            memset(consumed, 0, sizeof(consumed));
+        }
+        residual.root = plan_copy_residual(where, where->root, consumed, &residual);
+        plan_mark_where(schema, &residual, used);
+    }
+    
+    // The scan outputs the referenced columns in table order
+    int column_ids[MAX_COLUMNS];
+    int position[MAX_COLUMNS];
+    int column_count = 0;
+    for (int i = 0; i < schema->column_count; i++) {
+        if (!used[i]) continue;
+        position[i] = column_count;
+        column_ids[column_count++] = i;
+    }
+    
+    operator_t *plan;
+    if (ordered || bounds.has_low || bounds.has_high) {
+        plan = exec_range_scan_create(db, table_name, &bounds, column_ids, column_count, txn_id);
+    } else {
+        plan = exec_scan_create(db, table_name, column_ids, column_count, txn_id);
+    }
+    if (!plan) return NULL;
+    
+    for (int i = 0; i < residual.node_count; i++) {
+        if (residual.nodes[i].kind == EXPR_COMPARE) {
+            residual.nodes[i].predicate.column = position[residual.nodes[i].predicate.column];
+        }
+    }
+    if (exec_scan_push_filter(plan, &residual) != 0) {
+        exec_destroy(plan);
+        return NULL;
+    }
+    
+    *scan = plan;
+    if (!items) return plan;
+    
+    scalar_expr_t exprs[MAX_OUTPUT_COLUMNS];
+    for (int i = 0; i < item_count; i++) {
+        exprs[i] = items[i];
+        for (int j = 0; j < exprs[i].node_count; j++) {
+            if (exprs[i].nodes[j].kind == SCALAR_COLUMN) {
+                exprs[i].nodes[j].column = position[exprs[i].nodes[j].column];
+            }
+        }
+    }
+    if (plan_is_identity(plan, exprs, item_count)) return plan;
+    
+    operator_t *project = exec_project_expr_create(plan, exprs, item_count);
+    if (!project) {
+        exec_destroy(plan);
+        return NULL;
+    }
+    return project;
+}
+
+// Workers for a scan of the table: up to max_parallelism, but a table
+// stored on a single page is read by one
+static int plan_parallelism(database_t *db, const table_schema_t *schema) {
+    if (schema->storage_type != STORAGE_INDEX && schema->first_page_id == schema->last_page_id) return 1;
+    return db->max_parallelism;
+}
+
+// Plans one copy of the select per worker into workers[] and returns how
+// many there are, or -1 on error. Copies after the first share the first
+// one's scan, so each reads part of the table. Scans using the primary
+// index, for bounds or order, are not divided and get a single copy.
+static int plan_scan_workers(database_t *db, const char *table_name, const scalar_expr_t *items, int item_count,
+                             const expr_t *where, int ordered, transaction_id_t txn_id, operator_t **workers) {
+    operator_t *leader;
+    workers[0] = plan_scan_pipeline(db, table_name, items, item_count, where, ordered, txn_id, &leader);
+    if (!workers[0]) return -1;
+    
+    int count = plan_parallelism(db, find_table_schema(db, table_name));
+    if (count <= 1 || exec_scan_share(leader, leader) != 0) return 1;
+    
+    for (int i = 1; i < count; i++) {
+        operator_t *scan;
+        workers[i] = plan_scan_pipeline(db, table_name, items, item_count, where, ordered, txn_id, &scan);
+        if (!workers[i] || exec_scan_share(scan, leader) != 0) {
+            for (int j = 0; j <= i; j++) {
+                exec_destroy(workers[j]);
+            }
+            return -1;
+        }
+    }
+    return count;
+}
+
+// Plans a single-table select, run by several workers under a Gather when
+// the database allows parallelism
+static operator_t* plan_scan_select(database_t *db, const char *table_name, const scalar_expr_t *items,
+                                    int item_count, const expr_t *where, int ordered, transaction_id_t txn_id) {
+    operator_t *workers[MAX_PARALLELISM];
+    int count = plan_scan_workers(db, table_name, items, item_count, where, ordered, txn_id, workers);
+    if (count <= 0) return NULL;
+    if (count == 1) return workers[0];
+    
+    operator_t *gather = exec_gather_create(workers, count);
+    if (!gather) {
+        for (int i = 0; i < count; i++) {
+            exec_destroy(workers[i]);
+        }
+    }
+    return gather;
+}
+
+// Builds a plan producing the select list over the rows visible to txn_id
+// that match `where`. NULL items select all columns, and a NULL or empty
+// expression matches every row. Column numbers in both refer to the table.
+operator_t* plan_select(database_t *db, const char *table_name, const scalar_expr_t *items, int item_count,
+                        const expr_t *where, transaction_id_t txn_id) {
+    return plan_scan_select(db, table_name, items, item_count, where, 0, txn_id);
+}
+
+// Orders the output of a plan by the keys, which refer to its columns, and
+// applies LIMIT and OFFSET (a negative limit means none). Only the first
+// output_count columns are kept (all of them for 0), so sort keys can be
+// carried as trailing columns. When limit + offset rows fit in the sort
+// memory budget, a top-N heap replaces the sort. Takes over `plan`, which
+// is destroyed on failure.
+operator_t* plan_sort(operator_t *plan, const sort_key_t *keys, int key_count, long long limit, long long offset,
+                      int output_count) {
+    if (!plan || output_count < 0 || output_count > plan->column_count) {
+        exec_destroy(plan);
+        return NULL;
+    }
+    
+    operator_t *top = plan;
+    if (key_count > 0) {
+        size_t row_bytes = plan->column_count * sizeof(value_t) + sizeof(long long) + sizeof(int);
+        if (limit >= 0 && (size_t)(limit + offset) <= SORT_MEMORY_BUDGET / row_bytes) {
+            top = exec_top_n_create(plan, keys, key_count, limit, offset);
+            limit = -1;
+        } else {
+            top = exec_sort_create(plan, keys, key_count, 0);
+        }
+    }
+    if (top && limit >= 0) {
+        operator_t *limited = exec_limit_create(top, limit, offset);
+        if (!limited) exec_destroy(top);
+        top = limited;
+    } else if (!top) {
+        exec_destroy(plan);
+    }
+    if (!top || output_count == 0 || output_count == top->column_count) return top;
+    
+    int columns[MAX_OUTPUT_COLUMNS];
+    for (int i = 0; i < output_count; i++) {
+        columns[i] = i;
+    }
+    operator_t *project = exec_project_create(top, columns, output_count);
+    if (!project) exec_destroy(top);
+    return project;
+}
+
+// Whether reading the rows in key order is cheaper than scanning and
+// sorting them. Reading in key order stops after the rows a LIMIT needs.
+static int plan_order_by_key(const table_schema_t *schema, const table_stats_t *stats, const expr_t *where,
+                             long long limit, long long offset) {
+    if (schema->storage_type == STORAGE_INDEX) return 1;
+    
+    expr_t none;
+    expr_init(&none);
+    double rows;
+    double sorted = plan_scan_cost(schema, stats, where ? where : &none, &rows);
+    // A sort compares each row about log2(rows) times
+    for (double n = 1.0; n < rows; n *= 2.0) {
+        sorted += rows * COST_ROW;
+    }
+    
+    key_bounds_t bounds;
+    plan_where_bounds(schema, where, &bounds);
+    double selectivity = stats_bounds_selectivity(stats, plan_key_column(schema), &bounds);
+    double ordered = plan_key_order_cost(schema, stats, selectivity);
+    if (limit >= 0 && rows > 0.0 && limit + offset < rows) ordered *= (limit + offset) / rows;
+    return ordered <= sorted;
+}
+
+// plan_select followed by plan_sort. Sort keys refer to the select list,
+// or to table columns when items is NULL. Ordering on the primary key
+// alone, ascending, reads the table through its primary index instead of
+// sorting, unless statistics show the sort to be cheaper.
+operator_t* plan_select_sorted(database_t *db, const char *table_name, const scalar_expr_t *items, int item_count,
+                               int output_count, const expr_t *where, const sort_key_t *keys, int key_count,
+                               long long limit, long long offset, transaction_id_t txn_id) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) return NULL;
+    
+    int ordered = 0;
+    int key_column = plan_key_column(schema);
+    if (key_column >= 0 && key_count == 1 && !keys[0].descending) {
+        if (!items) {
+            ordered = keys[0].column == key_column;
+        } else if (keys[0].column >= 0 && keys[0].column < item_count) {
+            const scalar_expr_t *item = &items[keys[0].column];
+            ordered = item->node_count == 1 && item->nodes[0].kind == SCALAR_COLUMN &&
+                      item->nodes[0].column == key_column;
+        }
+    }
+    
+    table_stats_t stats;
+    if (ordered && stats_load(db, schema, &stats) == 1) {
+        ordered = plan_order_by_key(schema, &stats, where, limit, offset);
+    }
+    
+    operator_t *plan = plan_scan_select(db, table_name, items, item_count, where, ordered, txn_id);
+    if (!plan) return NULL;
+    return plan_sort(plan, keys, ordered ? 0 : key_count, limit, offset, output_count);
+}
+
+// Builds a plan computing the aggregates over the rows visible to txn_id
+// that match `where`, with one row per group when group_count > 0 and a
+// single row otherwise. The output holds the group columns followed by the
+// aggregates. Column numbers refer to the table.
+operator_t* plan_aggregate(database_t *db, const char *table_name, const int *group_columns, int group_count,
+                           const aggregate_spec_t *specs, int spec_count, const expr_t *where,
+                           transaction_id_t txn_id) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) return NULL;
+    if (group_count < 0 || spec_count < 0 || group_count + spec_count > MAX_OUTPUT_COLUMNS) return NULL;
+    if (group_count == 0 && spec_count == 0) return NULL;
+    
+    // The scan provides each referenced column once; COUNT(*) alone still
+    // needs one column to count rows by
+    scalar_expr_t items[MAX_OUTPUT_COLUMNS];
+    int position[MAX_COLUMNS];
+    int item_count = 0;
+    for (int i = 0; i < schema->column_count; i++) {
+        position[i] = -1;
+    }
+    
+    int inputs[2 * MAX_OUTPUT_COLUMNS];
+    int input_count = 0;
+    for (int i = 0; i < group_count; i++) {
+        inputs[input_count++] = group_columns[i];
+    }
+    for (int i = 0; i < spec_count; i++) {
+        inputs[input_count++] = specs[i].fn == AGG_COUNT_STAR ? 0 : specs[i].column;
+    }
+    
+    for (int i = 0; i < input_count; i++) {
+        int col = inputs[i];
+        if (col < 0 || col >= schema->column_count) return NULL;
+        if (position[col] >= 0) continue;
+        
+        position[col] = item_count;
+        scalar_init(&items[item_count]);
+        items[item_count].root = scalar_add_column(&items[item_count], col);
+        item_count++;
+    }
+    
+    operator_t *workers[MAX_PARALLELISM];
+    int worker_count = plan_scan_workers(db, table_name, items, item_count, where, 0, txn_id, workers);
+    if (worker_count <= 0) return NULL;
+    
+    int groups[MAX_OUTPUT_COLUMNS];
+    aggregate_spec_t aggregates[MAX_OUTPUT_COLUMNS];
+    for (int i = 0; i < group_count; i++) {
+        groups[i] = position[group_columns[i]];
+    }
+    for (int i = 0; i < spec_count; i++) {
+        aggregates[i] = specs[i];
+        aggregates[i].column = specs[i].fn == AGG_COUNT_STAR ? 0 : position[specs[i].column];
+    }
+    
+    // Parallel workers aggregate their share of the rows before the merge
+    operator_t *aggregate;
+    if (worker_count > 1) {
+        aggregate = exec_parallel_aggregate_create(workers, worker_count, groups, group_count, aggregates,
+                                                   spec_count, 0);
+    } else if (group_count > 0) {
+        aggregate = exec_group_aggregate_create(workers[0], groups, group_count, aggregates, spec_count, 0);
+    } else {
+        aggregate = exec_aggregate_create(workers[0], aggregates, spec_count);
+    }
+    if (!aggregate) {
+        for (int i = 0; i < worker_count; i++) {
+            exec_destroy(workers[i]);
+        }
+        return NULL;
+    }
+    return aggregate;
+}
+
+// Side of a join a WHERE subtree refers to: 1 for the left table only, 2
+// for the right table only, 3 for both
+static int plan_expr_sides(const expr_t *expr, int index, int left_count) {
+    const expr_node_t *node = &expr->nodes[index];
+    if (node->kind == EXPR_COMPARE) return node->predicate.column < left_count ? 1 : 2;
+    return plan_expr_sides(expr, node->left, left_count) | plan_expr_sides(expr, node->right, left_count);
+}
+
+// Copies a subtree into `out`, shifting its columns by `shift`
+static int plan_copy_expr(const expr_t *expr, int index, int shift, expr_t *out) {
+    const expr_node_t *node = &expr->nodes[index];
+    if (node->kind == EXPR_COMPARE) {
+        return expr_add_compare(out, node->predicate.column + shift, node->predicate.op, &node->predicate.constant);
+    }
+    
+    int left = plan_copy_expr(expr, node->left, shift, out);
+    int right = plan_copy_expr(expr, node->right, shift, out);
+    if (left < 0 || right < 0) return -1;
+    return expr_add_logical(out, node->kind, left, right);
+}
+
+// ANDs a copy of the subtree into `out`
+static void plan_add_conjunct(const expr_t *expr, int index, int shift, expr_t *out) {
+    int root = plan_copy_expr(expr, index, shift, out);
+    out->root = out->root < 0 ? root : expr_add_logical(out, EXPR_AND, out->root, root);
+}
+
+// Splits the top-level conjunction of a join's WHERE expression. Terms on
+// one table are evaluated by its scan, before the join; the right table's
+// terms must stay above a LEFT join, where they also reject the rows
+// padded with NULLs.
+static void plan_split_where(const expr_t *where, int index, int left_count, join_type_t type,
+                             expr_t *left, expr_t *right, expr_t *residual) {
+    const expr_node_t *node = &where->nodes[index];
+    if (node->kind == EXPR_AND) {
+        plan_split_where(where, node->left, left_count, type, left, right, residual);
+        plan_split_where(where, node->right, left_count, type, left, right, residual);
+        return;
+    }
+    
+    int sides = plan_expr_sides(where, index, left_count);
+    if (sides == 1) {
+        plan_add_conjunct(where, index, 0, left);
+    } else if (sides == 2 && type == JOIN_INNER) {
+        plan_add_conjunct(where, index, -left_count, right);
+    } else {
+        plan_add_conjunct(where, index, 0, residual);
+    }
+}
+
+// Scan items for the used columns of one table, in table order.
+// position[] maps each used column to its place in the scan output.
+static int plan_side_items(const uint8_t *used, int column_count, scalar_expr_t *items, int *position) {
+    int item_count = 0;
+    for (int i = 0; i < column_count; i++) {
+        if (!used[i]) continue;
+        position[i] = item_count;
+        scalar_init(&items[item_count]);
+        items[item_count].root = scalar_add_column(&items[item_count], i);
+        item_count++;
+    }
+    return item_count;
+}
+
+// Checks the join keys and the columns the select list and expression
+// refer to
+static int plan_join_check(const table_schema_t *left_schema, const table_schema_t *right_schema,
+                           const join_spec_t *join, const scalar_expr_t *items, int item_count, const expr_t *where) {
+    if (items && (item_count <= 0 || item_count > MAX_OUTPUT_COLUMNS)) return -1;
+    
+    int left_count = left_schema->column_count;
+    int total = left_count + right_schema->column_count;
+    if (join->left_key < 0 || join->left_key >= left_count) return -1;
+    if (join->right_key < 0 || join->right_key >= right_schema->column_count) return -1;
+    if (left_schema->columns[join->left_key].type != right_schema->columns[join->right_key].type) return -1;
+    
+    for (int i = 0; items && i < item_count; i++) {
+        for (int j = 0; j < items[i].node_count; j++) {
+            int col = items[i].nodes[j].column;
+            if (items[i].nodes[j].kind == SCALAR_COLUMN && (col < 0 || col >= total)) return -1;
+        }
+    }
+    for (int i = 0; where && i < where->node_count; i++) {
+        int col = where->nodes[i].predicate.column;
+        if (where->nodes[i].kind == EXPR_COMPARE && (col < 0 || col >= total)) return -1;
+    }
+    return 0;
+}
+
+// Plans the join with the given method: lookups in the right table's
+// primary index for each left row, or a hash join built on the right table.
+// The arguments are those of plan_join, already checked.
+static operator_t* plan_join_method(database_t *db, const join_spec_t *join, const table_schema_t *left_schema,
+                                    const table_schema_t *right_schema, const scalar_expr_t *items, int item_count,
+                                    const expr_t *where, int use_index, transaction_id_t txn_id) {
+    int left_count = left_schema->column_count;
+    int total = left_count + right_schema->column_count;
+    
+    uint8_t used[2 * MAX_COLUMNS] = {0};
+    if (!items) {
+        memset(used, 1, total);
+    } else {
+        for (int i = 0; i < item_count; i++) {
+            for (int j = 0; j < items[i].node_count; j++) {
+                if (items[i].nodes[j].kind == SCALAR_COLUMN) used[items[i].nodes[j].column] = 1;
+            }
+        }
+    }
+    used[join->left_key] = 1;
+    used[left_count + join->right_key] = 1;
+    
+    expr_t left_where, right_where, residual;
+    expr_init(&left_where);
+    expr_init(&right_where);
+    expr_init(&residual);
+    if (where && where->root >= 0) {
+        plan_split_where(where, where->root, left_count, join->type, &left_where, &right_where, &residual);
+    }
+    
+    if (use_index && right_where.root >= 0) {
+        plan_add_conjunct(&right_where, right_where.root, left_count, &residual);
+    }
+    for (int i = 0; i < residual.node_count; i++) {
+        if (residual.nodes[i].kind == EXPR_COMPARE) used[residual.nodes[i].predicate.column] = 1;
+    }
+    
+    // Each side provides its used columns in table order
+    scalar_expr_t left_items[MAX_COLUMNS], right_items[MAX_COLUMNS];
+    int left_position[MAX_COLUMNS], right_position[MAX_COLUMNS];
+    int left_items_count = plan_side_items(used, left_count, left_items, left_position);
+    int right_items_count = plan_side_items(used + left_count, right_schema->column_count, right_items,
+                                            right_position);
+    
+    operator_t *left = plan_select(db, join->left_table, left_items, left_items_count, &left_where, txn_id);
+    if (!left) return NULL;
+    
+    operator_t *plan;
+    if (use_index) {
+        int column_ids[MAX_COLUMNS];
+        for (int i = 0; i < right_items_count; i++) {
+            column_ids[i] = right_items[i].nodes[0].column;
+        }
+        plan = exec_index_join_create(left, left_position[join->left_key], join->right_table, column_ids,
+                                      right_items_count, join->type, txn_id);
+    } else {
+        operator_t *right = plan_select(db, join->right_table, right_items, right_items_count, &right_where,
+                                        txn_id);
+        if (!right) {
+            exec_destroy(left);
+            return NULL;
+        }
+        int left_key = left_position[join->left_key];
+        int right_key = right_position[join->right_key];
+        plan = exec_hash_join_create(left, right, &left_key, &right_key, 1, join->type, 0);
+        if (!plan) exec_destroy(right);
+    }
+    if (!plan) {
+        exec_destroy(left);
+        return NULL;
+    }
+    
+    // Join output columns: the used left columns, then the used right ones
+    int position[2 * MAX_COLUMNS];
+    for (int i = 0; i < total; i++) {
+        position[i] = i < left_count ? left_position[i] : left_items_count + right_position[i - left_count];
+    }
+    
+    if (residual.root >= 0) {
+        for (int i = 0; i < residual.node_count; i++) {
+            if (residual.nodes[i].kind == EXPR_COMPARE) {
+                residual.nodes[i].predicate.column = position[residual.nodes[i].predicate.column];
+            }
+        }
+        operator_t *filter = exec_filter_expr_create(plan, &residual);
+        if (!filter) {
+            exec_destroy(plan);
+            return NULL;
+        }
+        plan = filter;
+    }
+    
+    if (!items) return plan;
+    
+    scalar_expr_t exprs[MAX_OUTPUT_COLUMNS];
+    for (int i = 0; i < item_count; i++) {
+        exprs[i] = items[i];
+        for (int j = 0; j < exprs[i].node_count; j++) {
+            if (exprs[i].nodes[j].kind == SCALAR_COLUMN) {
+                exprs[i].nodes[j].column = position[exprs[i].nodes[j].column];
+            }
+        }
+    }
+    if (plan_is_identity(plan, exprs, item_count)) return plan;
+    
+    operator_t *project = exec_project_expr_create(plan, exprs, item_count);
+    if (!project) {
+        exec_destroy(plan);
+        return NULL;
+    }
+    return project;
+}
+
+// Plans the join with its tables swapped, for an INNER join that is
+// cheaper the other way round. Column numbers are mirrored to count the
+// right table's columns first, and the select list puts the columns back
+// in the order of the statement.
+static operator_t* plan_join_swapped(database_t *db, const join_spec_t *join, const table_schema_t *left_schema,
+                                     const table_schema_t *right_schema, const scalar_expr_t *items,
+                                     int item_count, const expr_t *where, int use_index, transaction_id_t txn_id) {
+    int left_count = left_schema->column_count;
+    int right_count = right_schema->column_count;
+    
+    join_spec_t swapped = *join;
+    strcpy(swapped.left_table, join->right_table);
+    strcpy(swapped.right_table, join->left_table);
+    swapped.left_key = join->right_key;
+    swapped.right_key = join->left_key;
+    
+    scalar_expr_t swapped_items[MAX_OUTPUT_COLUMNS];
+    if (items) {
+        for (int i = 0; i < item_count; i++) {
+            swapped_items[i] = items[i];
+            for (int j = 0; j < items[i].node_count; j++) {
+                scalar_node_t *node = &swapped_items[i].nodes[j];
+                if (node->kind == SCALAR_COLUMN) {
+                    node->column = node->column < left_count ? node->column + right_count : node->column - left_count;
+                }
+            }
+        }
+    } else {
+        item_count = left_count + right_count;
+        for (int i = 0; i < item_count; i++) {
+            scalar_init(&swapped_items[i]);
+            int col = i < left_count ? i + right_count : i - left_count;
+            swapped_items[i].root = scalar_add_column(&swapped_items[i], col);
+        }
+    }
+    
+    expr_t swapped_where;
+    expr_init(&swapped_where);
+    if (where) {
+        swapped_where = *where;
+        for (int i = 0; i < where->node_count; i++) {
+            expr_node_t *node = &swapped_where.nodes[i];
+            if (node->kind == EXPR_COMPARE) {
+                int col = node->predicate.column;
+                node->predicate.column = col < left_count ? col + right_count : col - left_count;
+            }
+        }
+    }
+    
+    return plan_join_method(db, &swapped, right_schema, left_schema, swapped_items, item_count, &swapped_where,
+                            use_index, txn_id);
+}
+
+// Picks the cheapest of the join methods for the estimated sizes of both
+// sides: a hash join built on either side, or lookups in the primary index
+// of either table. Only INNER joins can swap their sides.
+static void plan_join_choose(const join_spec_t *join, const table_schema_t *left_schema,
+                             const table_schema_t *right_schema, const table_stats_t *left_stats,
+                             const table_stats_t *right_stats, const expr_t *where, int *use_index, int *swap) {
+    int left_count = left_schema->column_count;
+    expr_t left_where, right_where, residual;
+    expr_init(&left_where);
+    expr_init(&right_where);
+    expr_init(&residual);
+    if (where && where->root >= 0) {
+        plan_split_where(where, where->root, left_count, join->type, &left_where, &right_where, &residual);
+    }
+    
+    double left_rows, right_rows;
+    double left_cost = plan_scan_cost(left_schema, left_stats, &left_where, &left_rows);
+    double right_cost = plan_scan_cost(right_schema, right_stats, &right_where, &right_rows);
+    double lookup = COST_RANDOM_PAGE + COST_ROW;
+    int inner = join->type == JOIN_INNER;
+    
+    double best = left_cost + right_cost + right_rows * COST_HASH_ROW + left_rows * COST_ROW;
+    *use_index = 0;
+    *swap = 0;
+    
+    double cost = left_cost + right_cost + left_rows * COST_HASH_ROW + right_rows * COST_ROW;
+    if (inner && cost < best) {
+        best = cost;
+        *swap = 1;
+    }
+    // The right table's terms of a LEFT join stay above it, so its index
+    // join reads those too
+    cost = left_cost + left_rows * lookup;
+    if (right_schema->columns[join->right_key].is_primary_key && cost < best) {
+        best = cost;
+        *use_index = 1;
+        *swap = 0;
+    }
+    cost = right_cost + right_rows * lookup;
+    if (inner && left_schema->columns[join->left_key].is_primary_key && cost < best) {
+        *use_index = 1;
+        *swap = 1;
+    }
+}
+
+// Builds a plan for `left JOIN right ON left_key = right_key` producing
+// the select list over the rows that match `where`. Column numbers in the
+// items and the expression count the left table's columns first, then the
+// right table's; NULL items select all of them.
+//
+// With statistics on both tables the join method and sides are costed.
+// Otherwise the right table is reached through its primary index when the
+// join key is that index and the left table is filtered, so the lookups are
+// few, and the scans feed a hash join built on the right table when not.
+operator_t* plan_join(database_t *db, const join_spec_t *join, const scalar_expr_t *items, int item_count,
+                      const expr_t *where, transaction_id_t txn_id) {
+    table_schema_t *left_schema = find_table_schema(db, join->left_table);
+    table_schema_t *right_schema = find_table_schema(db, join->right_table);
+    if (!left_schema || !right_schema) return NULL;
+    if (plan_join_check(left_schema, right_schema, join, items, item_count, where) != 0) return NULL;
+    
+    int use_index = 0;
+    int swap = 0;
+    table_stats_t *stats = malloc(2 * sizeof(table_stats_t));
+    if (!stats) return NULL;
+    if (stats_load(db, left_schema, &stats[0]) == 1 && stats_load(db, right_schema, &stats[1]) == 1) {
+        plan_join_choose(join, left_schema, right_schema, &stats[0], &stats[1], where, &use_index, &swap);
+    } else if (right_schema->columns[join->right_key].is_primary_key) {
+        // Whether any term of the top-level conjunction is on the left table
+        expr_t left_where, right_where, residual;
+        expr_init(&left_where);
+        expr_init(&right_where);
+        expr_init(&residual);
+        if (where && where->root >= 0) {
+            plan_split_where(where, where->root, left_schema->column_count, join->type, &left_where,
+                             &right_where, &residual);
+        }
+        use_index = left_where.root >= 0;
+    }
+    free(stats);
+    
+    if (swap) {
+        return plan_join_swapped(db, join, left_schema, right_schema, items, item_count, where, use_index, txn_id);
+    }
+    return plan_join_method(db, join, left_schema, right_schema, items, item_count, where, use_index, txn_id);
+}
@@ -0,0 +1,249 @@
+#include "tinydb.h"
+
+// Output of query results. A sink formats the batches of a plan into a
+// buffer of its own and writes the buffer to its file once it holds
+// RESULT_BUFFER_SIZE bytes, so a large result costs a few large writes
+// rather than a formatted print per value.
+//
+// The text format is a line per row with each value followed by a tab.
+// Floats are printed with as few digits as read back to the same value.
+//
+// The binary format is for programs reading results. It is a header, a
+// frame per batch and an empty frame at the end, so a stream cut short by
+// an error is recognized by its missing end:
+//
+//   header: "TINYRES1", uint32 column count, then per column a uint8 type,
+//           a uint8 name length and the name
+//   frame:  uint32 payload length, uint32 row count, then per column one
+//           uint8 null flag per row followed by the values of the rows that
+//           are not NULL: int32, float, or uint32 length and the bytes
+//   end:    uint32 0
+//
+// Numbers are in the byte order of the machine that wrote the stream.
+
+#define RESULT_BUFFER_SIZE (64 * 1024)
+
+static const char result_magic[8] = { 'T', 'I', 'N', 'Y', 'R', 'E', 'S', '1' };
+
+static int result_flush(result_sink_t *sink) {
+    if (sink->length > 0 && fwrite(sink->buffer, 1, sink->length, sink->file) != sink->length) {
+        sink->failed = 1;
+    }
+    sink->length = 0;
+    return sink->failed ? -1 : 0;
+}
+
+// Makes room for `size` more bytes. The buffer grows rather than being
+// written out, as a binary frame is only complete once its length is set.
+static int result_reserve(result_sink_t *sink, size_t size) {
+    if (sink->length + size <= sink->capacity) return 0;
+    
+    size_t capacity = sink->capacity;
+    while (capacity < sink->length + size) capacity *= 2;
+    char *grown = realloc(sink->buffer, capacity);
+    if (!grown) {
+        sink->failed = 1;
+        return -1;
+    }
+    sink->buffer = grown;
+    sink->capacity = capacity;
+    return 0;
+}
+
+static void result_put(result_sink_t *sink, const void *data, size_t size) {
+    memcpy(sink->buffer + sink->length, data, size);
+    sink->length += size;
+}
+
+// Text of a VARCHAR value, read from its overflow pages if it is stored
+// there; *text is then the copy to free.
+static const char* result_string(result_sink_t *sink, const value_t *value, char **text) {
+    *text = NULL;
+    if (!value->is_external) return value->data.str_val;
+    
+    *text = overflow_read(sink->db, value);
+    if (!*text) sink->failed = 1;
+    return *text;
+}
+
+static int result_format_int(char *out, int value) {
+    char digits[16];
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    
+    int length = 0;
+    if (value < 0) out[length++] = '-';
+    while (count > 0) out[length++] = digits[--count];
+    return length;
+}
+
+// Shortest of 6 to 9 significant digits that reads back as the same float
+static int result_format_float(char *out, float value) {
+    int length = 0;
+    for (int precision = 6; precision <= 9; precision++) {
+        length = snprintf(out, 32, "%.*g", precision, value);
+        if (strtof(out, NULL) == value) break;
+    }
+    return length;
+}
+
+static int result_write_text(result_sink_t *sink, const batch_t *batch) {
+    for (int k = 0; k < batch->selected_count; k++) {
+        int row = batch->selection[k];
+        for (int i = 0; i < batch->column_count; i++) {
+            const vector_t *vec = &batch->columns[i];
+            if (result_reserve(sink, 48) != 0) return -1;
+            
+            char *out = sink->buffer + sink->length;
+            if (vec->nulls[row]) {
+                memcpy(out, "NULL", 4);
+                sink->length += 4;
+            } else if (vec->type == DATA_TYPE_INT) {
+                sink->length += result_format_int(out, vec->ints[row]);
+            } else if (vec->type == DATA_TYPE_FLOAT) {
+                sink->length += result_format_float(out, vec->floats[row]);
+            } else {
+                char *text;
+                const char *s = result_string(sink, &vec->strings[row], &text);
+                if (!s) return -1;
+                size_t length = strlen(s);
+                if (result_reserve(sink, length + 1) != 0) {
+                    free(text);
+                    return -1;
+                }
+                result_put(sink, s, length);
+                free(text);
+            }
+            sink->buffer[sink->length++] = '\t';
+        }
+        if (result_reserve(sink, 1) != 0) return -1;
+        sink->buffer[sink->length++] = '\n';
+        
+        if (sink->length >= RESULT_BUFFER_SIZE && result_flush(sink) != 0) return -1;
+    }
+    return 0;
+}
+
+static int result_write_binary(result_sink_t *sink, const batch_t *batch) {
+    int count = batch->selected_count;
+    const uint16_t *sel = batch->selection;
+    if (count == 0) return 0;
+    
+    size_t start = sink->length;
+    uint32_t row_count = (uint32_t)count;
+    if (result_reserve(sink, 2 * sizeof(uint32_t)) != 0) return -1;
+    sink->length += sizeof(uint32_t);
+    result_put(sink, &row_count, sizeof(row_count));
+    
+    for (int i = 0; i < batch->column_count; i++) {
+        const vector_t *vec = &batch->columns[i];
+        if (result_reserve(sink, count * (1 + sizeof(int32_t))) != 0) return -1;
+        
+        for (int k = 0; k < count; k++) {
+            sink->buffer[sink->length++] = (char)vec->nulls[sel[k]];
+        }
+        
+        if (vec->type == DATA_TYPE_INT) {
+            for (int k = 0; k < count; k++) {
+                if (vec->nulls[sel[k]]) continue;
+                int32_t number = vec->ints[sel[k]];
+                result_put(sink, &number, sizeof(number));
+            }
+        } else if (vec->type == DATA_TYPE_FLOAT) {
+            for (int k = 0; k < count; k++) {
+                if (!vec->nulls[sel[k]]) result_put(sink, &vec->floats[sel[k]], sizeof(float));
+            }
+        } else {
+            for (int k = 0; k < count; k++) {
+                if (vec->nulls[sel[k]]) continue;
+                
+                char *text;
+                const char *s = result_string(sink, &vec->strings[sel[k]], &text);
+                if (!s) return -1;
+                uint32_t length = (uint32_t)strlen(s);
+                if (result_reserve(sink, sizeof(length) + length) != 0) {
+                    free(text);
+                    return -1;
+                }
+                result_put(sink, &length, sizeof(length));
+                result_put(sink, s, length);
+                free(text);
+            }
+        }
+    }
+    
+    uint32_t payload = (uint32_t)(sink->length - start - sizeof(uint32_t));
+    memcpy(sink->buffer + start, &payload, sizeof(payload));
+    
+    if (sink->length >= RESULT_BUFFER_SIZE) return result_flush(sink);
+    return 0;
+}
+
+// Starts a result with the columns of `plan`, which have not been produced
+// yet. Returns -1 if the buffer cannot be allocated.
+int result_sink_open(result_sink_t *sink, database_t *db, FILE *file, result_format_t format,
+                     const operator_t *plan) {
+    memset(sink, 0, sizeof(result_sink_t));
+    sink->db = db;
+    sink->file = file;
+    sink->format = format;
+    sink->capacity = RESULT_BUFFER_SIZE + 1024;
+    sink->buffer = malloc(sink->capacity);
+    if (!sink->buffer) return -1;
+    
+    if (format == RESULT_FORMAT_BINARY) {
+        uint32_t column_count = (uint32_t)plan->column_count;
+        result_put(sink, result_magic, sizeof(result_magic));
+        result_put(sink, &column_count, sizeof(column_count));
+        for (int i = 0; i < plan->column_count; i++) {
+            size_t length = strlen(plan->column_names[i]);
+            if (result_reserve(sink, 2 + length) != 0) return -1;
+            sink->buffer[sink->length++] = (char)plan->column_types[i];
+            sink->buffer[sink->length++] = (char)length;
+            result_put(sink, plan->column_names[i], length);
+        }
+    }
+    return 0;
+}
+
+// Adds the selected rows of the batch
+int result_sink_write(result_sink_t *sink, const batch_t *batch) {
+    if (sink->failed) return -1;
+    
+    int result = sink->format == RESULT_FORMAT_BINARY ? result_write_binary(sink, batch)
+                                                      : result_write_text(sink, batch);
+    if (result == 0) sink->row_count += batch->selected_count;
+    return result;
+}
+
+// Ends a complete result: a binary stream gets its end frame, and the
+// buffer is written and the file flushed
+int result_sink_finish(result_sink_t *sink) {
+    if (sink->failed) return -1;
+    
+    if (sink->format == RESULT_FORMAT_BINARY) {
+        uint32_t end = 0;
+        if (result_reserve(sink, sizeof(end)) != 0) return -1;
+        result_put(sink, &end, sizeof(end));
+    }
+    if (result_flush(sink) != 0 || fflush(sink->file) != 0) {
+        sink->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// Writes out the rows formatted so far, which after an error leaves a
+// binary stream without its end, and frees the buffer
+void result_sink_close(result_sink_t *sink) {
+    if (sink->buffer && !sink->failed) {
+        result_flush(sink);
+        fflush(sink->file);
+    }
+    free(sink->buffer);
+    sink->buffer = NULL;
+}
@@ -0,0 +1,428 @@
+#include "tinydb.h"
+
+// Sequential scans walk a table's page chain (row and columnar tables) or
+// its leaf chain (index-organized tables). Each page is copied into the
+// cursor when the scan reaches it and rows are decoded one at a time on
+// demand, so callers see rows as they are found instead of a materialized
+// result.
+
+int table_scan_open(database_t *db, const char *table_name, transaction_id_t txn_id, table_cursor_t *cursor) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) return -1;
+    
+    cursor->db = db;
+    cursor->schema = schema;
+    txn_snapshot(db, txn_id, &cursor->snapshot);
+    cursor->slot = 0;
+    cursor->row_count = 0;
+    cursor->ranged = 0;
+    cursor->page_id = 0;
+    cursor->morsels = NULL;
+    
+    if (schema->storage_type == STORAGE_INDEX) {
+        cursor->next_page_id = btree_row_first_leaf(db, schema);
+        if (cursor->next_page_id == 0) return -1;
+    } else {
+        cursor->next_page_id = schema->first_page_id;
+    }
+    
+    return 0;
+}
+
+// Opens a cursor over the rows whose primary key is within `bounds`, in
+// key order. The table must have a primary key.
+int table_scan_open_range(database_t *db, const char *table_name, const key_bounds_t *bounds,
+                          transaction_id_t txn_id, table_cursor_t *cursor) {
+    if (table_scan_open(db, table_name, txn_id, cursor) != 0) return -1;
+    
+    table_schema_t *schema = cursor->schema;
+    cursor->key_column = -1;
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_primary_key) cursor->key_column = i;
+    }
+    if (cursor->key_column < 0) return -1;
+    
+    cursor->ranged = 1;
+    cursor->bounds = *bounds;
+    
+    if (schema->storage_type == STORAGE_INDEX) {
+        if (bounds->has_low) {
+            cursor->next_page_id = btree_row_find_leaf(db, schema, &bounds->low);
+            if (cursor->next_page_id == 0) return -1;
+        }
+    } else {
+        btree_range_open(&cursor->range, bounds);
+    }
+    
+    return 0;
+}
+
+// Ranged scans of heap and columnar tables are driven by the primary index
+static int table_scan_uses_index(const table_cursor_t *cursor) {
+    return cursor->ranged && cursor->schema->storage_type != STORAGE_INDEX;
+}
+
+static int table_scan_has_more(const table_cursor_t *cursor) {
+    if (table_scan_uses_index(cursor)) return !cursor->range.done;
+    return cursor->next_page_id != 0;
+}
+
+static int table_scan_load_page(table_cursor_t *cursor) {
+    cursor->slot = 0;
+    
+    if (table_scan_uses_index(cursor)) {
+        int count = btree_range_next(cursor->db, cursor->schema->root_page_id, &cursor->bounds, &cursor->range,
+                                     cursor->entry_pages, cursor->entry_slots, BTREE_ORDER);
+        if (count < 0) return -1;
+        cursor->row_count = count;
+        return 0;
+    }
+    
+    // A shared cursor takes the page the source hands out next; its own
+    // next_page_id then only tells whether the source had more left
+    scan_morsels_t *morsels = cursor->morsels;
+    if (morsels) {
+        pthread_mutex_lock(&morsels->mutex);
+        cursor->next_page_id = morsels->next_page_id;
+        if (cursor->next_page_id == 0) {
+            pthread_mutex_unlock(&morsels->mutex);
+            cursor->row_count = 0;
+            return 0;
+        }
+    }
+    
+    page_t *page = buffer_get_page(cursor->db->buffer_pool, cursor->next_page_id);
+    if (!page) {
+        if (morsels) pthread_mutex_unlock(&morsels->mutex);
+        return -1;
+    }
+    
+    cursor->page_id = cursor->next_page_id;
+    memcpy(cursor->page, page->data, PAGE_SIZE);
+    buffer_release_page(cursor->db->buffer_pool, page);
+    
+    if (cursor->schema->storage_type == STORAGE_INDEX) {
+        btree_row_leaf_t *leaf = (btree_row_leaf_t*)cursor->page;
+        cursor->row_count = leaf->key_count;
+        cursor->next_page_id = leaf->next_leaf;
+    } else {
+        heap_page_header_t *header = (heap_page_header_t*)cursor->page;
+        cursor->row_count = header->tuple_count;
+        cursor->next_page_id = header->next_page_id;
+    }
+    
+    if (morsels) {
+        morsels->next_page_id = cursor->next_page_id;
+        pthread_mutex_unlock(&morsels->mutex);
+    }
+    return 0;
+}
+
+// Pins the page of the row an index entry of a ranged cursor points at.
+// On row pages that is the version of the row the cursor's transaction
+// sees. Returns 1 with the page pinned and the row's slot in *slot, 0 if
+// the transaction sees no version and -1 on error.
+static int table_scan_pin_entry(table_cursor_t *cursor, int entry, page_t **page, slot_id_t *slot) {
+    if (cursor->schema->storage_type == STORAGE_ROW) {
+        return heap_find_version(cursor->db, cursor->entry_pages[entry], cursor->entry_slots[entry],
+                                 &cursor->snapshot, page, slot);
+    }
+    
+    *page = buffer_get_page(cursor->db->buffer_pool, cursor->entry_pages[entry]);
+    if (!*page) return -1;
+    *slot = cursor->entry_slots[entry];
+    return 1;
+}
+
+static int table_scan_read_entry(table_cursor_t *cursor, int entry, tuple_t *tuple) {
+    page_t *page;
+    slot_id_t slot;
+    int found = table_scan_pin_entry(cursor, entry, &page, &slot);
+    if (found <= 0) return found < 0 ? -1 : 1;
+    
+    int result;
+    if (cursor->schema->storage_type == STORAGE_COLUMN) {
+        result = columnar_read_tuple(cursor->db, cursor->schema, page->data, slot, tuple);
+    } else {
+        result = heap_read_tuple(cursor->db, cursor->schema, page->data, slot, tuple);
+    }
+    buffer_release_page(cursor->db->buffer_pool, page);
+    return result;
+}
+
+// Checks a row of an index-organized leaf against the bounds of a ranged
+// cursor. Returns 0 if the row is in range and 1 if it must be skipped;
+// a row past the high bound also ends the scan, since the leaf chain is in
+// key order.
+static int table_scan_skip_row(table_cursor_t *cursor, const tuple_t *row) {
+    if (!cursor->ranged) return 0;
+    
+    int where = key_bounds_check(&cursor->bounds, &row->values[cursor->key_column]);
+    if (where > 0) {
+        cursor->row_count = cursor->slot;
+        cursor->next_page_id = 0;
+    }
+    return where != 0;
+}
+
+// Reads one row of the current page or index leaf. Returns 0 when `tuple`
+// holds the row, 1 when the row is outside the range of the cursor or its
+// slot is empty and -1 on error.
+static int table_scan_read(table_cursor_t *cursor, int slot, tuple_t *tuple) {
+    if (table_scan_uses_index(cursor)) {
+        return table_scan_read_entry(cursor, slot, tuple);
+    }
+    
+    switch (cursor->schema->storage_type) {
+        case STORAGE_INDEX: {
+            const tuple_t *row = &((btree_row_leaf_t*)cursor->page)->rows[slot];
+            if (table_scan_skip_row(cursor, row)) return 1;
+            *tuple = *row;
+            return 0;
+        }
+        case STORAGE_COLUMN:
+            return columnar_read_tuple(cursor->db, cursor->schema, cursor->page, slot, tuple);
+        case STORAGE_ROW:
+            return heap_read_tuple(cursor->db, cursor->schema, cursor->page, slot, tuple);
+    }
+    return -1;
+}
+
+// Stores the next visible row in `tuple`. Returns 1 when a row was
+// produced, 0 at the end of the table and -1 on error.
+int table_scan_next(table_cursor_t *cursor, tuple_t *tuple) {
+    while (1) {
+        while (cursor->slot < cursor->row_count) {
+            int slot = cursor->slot++;
+            int result = table_scan_read(cursor, slot, tuple);
+            if (result < 0) return -1;
+            
+            if (result == 0 && mvcc_is_visible(&tuple->header, &cursor->snapshot)) {
+                return 1;
+            }
+        }
+        
+        if (!table_scan_has_more(cursor)) return 0;
+        if (table_scan_load_page(cursor) != 0) return -1;
+    }
+}
+
+void table_scan_close(table_cursor_t *cursor) {
+    cursor->slot = 0;
+    cursor->row_count = 0;
+    cursor->next_page_id = 0;
+    cursor->morsels = NULL;
+}
+
+// Makes an open, unranged cursor take its pages from a source shared with
+// cursors on other threads instead of following the page chain itself, so
+// together they read each page once. The `first` cursor starts the source
+// at the beginning of the table and must be shared before any other cursor
+// reads from it. It also loads the table's dictionaries, which the workers
+// then only look up.
+void table_scan_share(table_cursor_t *cursor, scan_morsels_t *morsels, int first) {
+    if (first) {
+        morsels->next_page_id = cursor->next_page_id;
+        for (int i = 0; i < cursor->schema->column_count; i++) {
+            dictionary_get(cursor->db, cursor->schema, i);
+        }
+    }
+    cursor->morsels = morsels;
+}
+
+// Decodes the listed columns of one row into the next row of the batch if
+// the row is visible. Negative column ids are skipped. Returns 1 if the row
+// was added, 0 if it was not and -1 on error.
+static int table_scan_decode(table_cursor_t *cursor, const char *page_data, int slot,
+                             const int *column_ids, int column_count, batch_t *batch) {
+    table_schema_t *schema = cursor->schema;
+    tuple_header_t header;
+    value_t values[MAX_COLUMNS];
+    dict_code_t codes[MAX_COLUMNS];
+    const value_t *row_values = values;
+    int row = batch->row_count;
+    
+    switch (schema->storage_type) {
+        case STORAGE_INDEX: {
+            const tuple_t *tuple = &((const btree_row_leaf_t*)page_data)->rows[slot];
+            if (table_scan_skip_row(cursor, tuple)) return 0;
+            header = tuple->header;
+            row_values = tuple->values;
+            break;
+        }
+        case STORAGE_ROW: {
+            int result = heap_read_columns(cursor->db, schema, page_data, slot, column_ids, column_count,
+                                           &header, values, codes);
+            if (result != 0) return result < 0 ? -1 : 0;
+            break;
+        }
+        case STORAGE_COLUMN:
+            if (columnar_read_header(schema, page_data, slot, &header) != 0) return -1;
+            break;
+    }
+    
+    if (!mvcc_is_visible(&header, &cursor->snapshot)) return 0;
+    
+    if (schema->storage_type == STORAGE_COLUMN) {
+        uint16_t rows[1] = { (uint16_t)row };
+        batch->row_slots[row] = (uint16_t)slot;
+        columnar_fetch_rows(cursor->db, schema, page_data, column_ids, column_count, batch, rows, 1);
+        return 1;
+    }
+    
+    // Row records are decoded column by column; index leaves hold whole rows
+    for (int i = 0; i < column_count; i++) {
+        int col = column_ids[i];
+        if (col < 0) continue;
+        
+        if (schema->storage_type == STORAGE_INDEX) {
+            batch_set_value(batch, i, row, &row_values[col]);
+        } else if (schema->columns[col].is_dictionary) {
+            batch->columns[i].nulls[row] = values[i].is_null;
+            batch->columns[i].codes[row] = codes[i];
+        } else {
+            batch_set_value(batch, i, row, &values[i]);
+        }
+    }
+    return 1;
+}
+
+// Points the batch vectors of the listed columns that the table stores as
+// dictionary codes at their dictionary, and the others at none. Rows of
+// index-organized tables hold their strings decoded.
+static int table_scan_bind_dictionaries(table_cursor_t *cursor, const int *column_ids, int column_count,
+                                        batch_t *batch) {
+    table_schema_t *schema = cursor->schema;
+    
+    for (int i = 0; i < column_count; i++) {
+        int col = column_ids[i];
+        if (col < 0) continue;
+        
+        vector_t *vec = &batch->columns[i];
+        vec->dictionary = NULL;
+        if (schema->storage_type == STORAGE_INDEX || !schema->columns[col].is_dictionary) continue;
+        
+        vec->dictionary = dictionary_get(cursor->db, schema, col);
+        if (!vec->dictionary) return -1;
+    }
+    return 0;
+}
+
+// Fills `batch` with the next visible rows and their locations, reading
+// only the listed columns into the batch vectors. Batch columns whose id
+// is negative are left unset for table_scan_fetch. Returns the number of
+// rows produced, 0 at the end of the table and -1 on error.
+int table_scan_next_batch(table_cursor_t *cursor, const int *column_ids, int column_count, batch_t *batch) {
+    table_schema_t *schema = cursor->schema;
+    batch->row_count = 0;
+    if (table_scan_bind_dictionaries(cursor, column_ids, column_count, batch) != 0) return -1;
+    
+    while (batch->row_count < BATCH_SIZE) {
+        if (cursor->slot >= cursor->row_count) {
+            if (!table_scan_has_more(cursor)) break;
+            if (table_scan_load_page(cursor) != 0) return -1;
+            continue;
+        }
+        
+        if (schema->storage_type == STORAGE_COLUMN && !cursor->ranged) {
+            // PAX pages are copied column by column, a whole page range at a time
+            int count = cursor->row_count - cursor->slot;
+            if (count > BATCH_SIZE - batch->row_count) count = BATCH_SIZE - batch->row_count;
+            if (columnar_read_batch(cursor->db, schema, cursor->page_id, cursor->page, cursor->slot, count,
+                                    &cursor->snapshot, column_ids, column_count, batch) < 0) {
+                return -1;
+            }
+            cursor->slot += count;
+            continue;
+        }
+        
+        int slot = cursor->slot++;
+        page_id_t page_id = cursor->page_id;
+        const char *page_data = cursor->page;
+        page_t *page = NULL;
+        
+        if (table_scan_uses_index(cursor)) {
+            slot_id_t entry_slot;
+            int found = table_scan_pin_entry(cursor, slot, &page, &entry_slot);
+            if (found < 0) return -1;
+            if (found == 0) continue;
+            page_id = page->page_id;
+            page_data = page->data;
+            slot = entry_slot;
+        }
+        
+        int added = table_scan_decode(cursor, page_data, slot, column_ids, column_count, batch);
+        if (page) buffer_release_page(cursor->db->buffer_pool, page);
+        if (added < 0) return -1;
+        
+        if (added) {
+            batch->row_pages[batch->row_count] = page_id;
+            batch->row_slots[batch->row_count] = (uint16_t)slot;
+            batch->row_count++;
+        }
+    }
+    
+    batch_select_all(batch);
+    return batch->row_count;
+}
+
+// Reads the listed columns of the selected rows of a batch produced by
+// this cursor, using the row locations the scan recorded. Rows are grouped
+// by page, so each page is visited once; the page the cursor is on is read
+// from its copy. Negative column ids are skipped.
+int table_scan_fetch(table_cursor_t *cursor, const int *column_ids, int column_count, batch_t *batch) {
+    table_schema_t *schema = cursor->schema;
+    uint16_t rows[BATCH_SIZE];
+    if (table_scan_bind_dictionaries(cursor, column_ids, column_count, batch) != 0) return -1;
+    
+    for (int k = 0; k < batch->selected_count;) {
+        page_id_t page_id = batch->row_pages[batch->selection[k]];
+        int count = 0;
+        while (k < batch->selected_count && batch->row_pages[batch->selection[k]] == page_id) {
+            rows[count++] = batch->selection[k++];
+        }
+        
+        const char *page_data = cursor->page;
+        page_t *page = NULL;
+        if (page_id != cursor->page_id || table_scan_uses_index(cursor)) {
+            page = buffer_get_page(cursor->db->buffer_pool, page_id);
+            if (!page) return -1;
+            page_data = page->data;
+        }
+        
+        int result = 0;
+        if (schema->storage_type == STORAGE_COLUMN) {
+            columnar_fetch_rows(cursor->db, schema, page_data, column_ids, column_count, batch, rows, count);
+        } else {
+            for (int r = 0; r < count && result == 0; r++) {
+                int slot = batch->row_slots[rows[r]];
+                value_t values[MAX_COLUMNS];
+                dict_code_t codes[MAX_COLUMNS];
+                const value_t *row_values = values;
+                
+                if (schema->storage_type == STORAGE_INDEX) {
+                    row_values = ((const btree_row_leaf_t*)page_data)->rows[slot].values;
+                } else {
+                    result = heap_read_columns(cursor->db, schema, page_data, slot, column_ids, column_count,
+                                               NULL, values, codes);
+                }
+                
+                for (int i = 0; i < column_count && result == 0; i++) {
+                    if (column_ids[i] < 0) continue;
+                    if (schema->storage_type == STORAGE_INDEX) {
+                        batch_set_value(batch, i, rows[r], &row_values[column_ids[i]]);
+                    } else if (batch->columns[i].dictionary) {
+                        batch->columns[i].nulls[rows[r]] = values[i].is_null;
+                        batch->columns[i].codes[rows[r]] = codes[i];
+                    } else {
+                        batch_set_value(batch, i, rows[r], &values[i]);
+                    }
+                }
+            }
+        }
+        
+        if (page) buffer_release_page(cursor->db->buffer_pool, page);
+        if (result != 0) return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,755 @@
+#include "tinydb.h"
+#include <limits.h>
+
+// Sorting. The input is copied column by column into growable vectors, a
+// permutation of row numbers is merge sorted on the keys, and the output
+// batches are gathered through the permutation.
+//
+// When the copied rows pass the memory budget, they are written in sorted
+// order to a run on temporary pages and copying starts over. The runs are
+// then combined by a k-way merge that holds one page of each run in
+// memory; with more than SORT_MERGE_FANIN runs, earlier passes first merge
+// groups of them into longer runs.
+//
+// Top-N serves ORDER BY ... LIMIT: it keeps the best limit + offset rows
+// seen so far in a bounded max-heap, so the worst of them is replaced as
+// better rows arrive and nothing else is stored.
+
+#define SORT_MERGE_FANIN 64
+
+typedef struct {
+    page_id_t page_id;        // Next page of the run
+    value_t *rows;            // Rows of the current page
+    int row_count;
+    int position;
+} sort_reader_t;
+
+typedef struct {
+    sort_key_t keys[MAX_OUTPUT_COLUMNS];
+    int key_count;
+    size_t memory_budget;
+    size_t row_bytes;
+    vector_t columns[MAX_OUTPUT_COLUMNS];   // Materialized input
+    int row_count;
+    int capacity;
+    int *order;
+    int position;
+    page_id_t *runs;          // Sorted runs, in input order
+    int run_count;
+    int run_capacity;
+    sort_reader_t readers[SORT_MERGE_FANIN];
+    int reader_count;
+    int heap[SORT_MERGE_FANIN];   // Readers with rows left, smallest row first
+    int heap_count;
+    batch_t batch;
+} sort_state_t;
+
+static int sort_grow(operator_t *op, int needed) {
+    sort_state_t *state = op->state;
+    if (needed <= state->capacity) return 0;
+    
+    int capacity = state->capacity ? state->capacity : BATCH_SIZE;
+    while (capacity < needed) capacity *= 2;
+    
+    for (int i = 0; i < op->column_count; i++) {
+        vector_t *vec = &state->columns[i];
+        uint8_t *nulls = realloc(vec->nulls, capacity * sizeof(uint8_t));
+        if (!nulls) return -1;
+        vec->nulls = nulls;
+        
+        switch (vec->type) {
+            case DATA_TYPE_INT: {
+                int *ints = realloc(vec->ints, capacity * sizeof(int));
+                if (!ints) return -1;
+                vec->ints = ints;
+                break;
+            }
+            case DATA_TYPE_FLOAT: {
+                float *floats = realloc(vec->floats, capacity * sizeof(float));
+                if (!floats) return -1;
+                vec->floats = floats;
+                break;
+            }
+            case DATA_TYPE_VARCHAR: {
+                value_t *strings = realloc(vec->strings, capacity * sizeof(value_t));
+                if (!strings) return -1;
+                vec->strings = strings;
+                break;
+            }
+        }
+    }
+    
+    state->capacity = capacity;
+    return 0;
+}
+
+// Appends the selected rows of `batch`, one column at a time
+static int sort_append(operator_t *op, const batch_t *batch) {
+    sort_state_t *state = op->state;
+    if (sort_grow(op, state->row_count + batch->selected_count) != 0) return -1;
+    
+    for (int i = 0; i < op->column_count; i++) {
+        const vector_t *src = &batch->columns[i];
+        vector_t *dst = &state->columns[i];
+        int out = state->row_count;
+        
+        for (int k = 0; k < batch->selected_count; k++) {
+            int row = batch->selection[k];
+            dst->nulls[out] = src->nulls[row];
+            switch (dst->type) {
+                case DATA_TYPE_INT:
+                    dst->ints[out] = src->ints[row];
+                    break;
+                case DATA_TYPE_FLOAT:
+                    dst->floats[out] = src->floats[row];
+                    break;
+                case DATA_TYPE_VARCHAR:
+                    dst->strings[out] = src->strings[row];
+                    break;
+            }
+            out++;
+        }
+    }
+    
+    state->row_count += batch->selected_count;
+    return 0;
+}
+
+static int sort_compare_strings(database_t *db, const value_t *a, const value_t *b) {
+    if (!a->is_external && !b->is_external) return strcmp(a->data.str_val, b->data.str_val);
+    
+    char *a_text = a->is_external ? overflow_read(db, a) : NULL;
+    char *b_text = b->is_external ? overflow_read(db, b) : NULL;
+    int result = strcmp(a_text ? a_text : a->data.str_val, b_text ? b_text : b->data.str_val);
+    free(a_text);
+    free(b_text);
+    return result;
+}
+
+// NULLs sort before every other value, as in the B-tree
+static int sort_compare_rows(database_t *db, const sort_state_t *state, int a, int b) {
+    for (int i = 0; i < state->key_count; i++) {
+        const vector_t *vec = &state->columns[state->keys[i].column];
+        int result;
+        
+        if (vec->nulls[a] || vec->nulls[b]) {
+            result = vec->nulls[b] - vec->nulls[a];
+        } else if (vec->type == DATA_TYPE_INT) {
+            result = (vec->ints[a] > vec->ints[b]) - (vec->ints[a] < vec->ints[b]);
+        } else if (vec->type == DATA_TYPE_FLOAT) {
+            result = (vec->floats[a] > vec->floats[b]) - (vec->floats[a] < vec->floats[b]);
+        } else {
+            result = sort_compare_strings(db, &vec->strings[a], &vec->strings[b]);
+        }
+        
+        if (result != 0) return state->keys[i].descending ? -result : result;
+    }
+    return 0;
+}
+
+// The same order over rows stored as one value_t per column
+static int sort_compare_values(database_t *db, const sort_key_t *keys, int key_count, const value_t *a,
+                               const value_t *b) {
+    for (int i = 0; i < key_count; i++) {
+        const value_t *x = &a[keys[i].column];
+        const value_t *y = &b[keys[i].column];
+        int result;
+        
+        if (x->is_null || y->is_null) {
+            result = (int)y->is_null - (int)x->is_null;
+        } else if (x->type == DATA_TYPE_INT) {
+            result = (x->data.int_val > y->data.int_val) - (x->data.int_val < y->data.int_val);
+        } else if (x->type == DATA_TYPE_FLOAT) {
+            result = (x->data.float_val > y->data.float_val) - (x->data.float_val < y->data.float_val);
+        } else {
+            result = sort_compare_strings(db, x, y);
+        }
+        
+        if (result != 0) return keys[i].descending ? -result : result;
+    }
+    return 0;
+}
+
+// Stable bottom-up merge sort of the permutation
+static int sort_order(operator_t *op) {
+    sort_state_t *state = op->state;
+    int n = state->row_count;
+    
+    free(state->order);
+    state->order = malloc((n > 0 ? n : 1) * sizeof(int));
+    int *buffer = malloc((n > 0 ? n : 1) * sizeof(int));
+    if (!state->order || !buffer) {
+        free(buffer);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        state->order[i] = i;
+    }
+    
+    int *src = state->order;
+    int *dst = buffer;
+    for (int width = 1; width < n; width *= 2) {
+        for (int left = 0; left < n; left += 2 * width) {
+            int mid = left + width < n ? left + width : n;
+            int right = left + 2 * width < n ? left + 2 * width : n;
+            int i = left, j = mid, out = left;
+            
+            while (i < mid && j < right) {
+                if (sort_compare_rows(op->db, state, src[j], src[i]) < 0) {
+                    dst[out++] = src[j++];
+                } else {
+                    dst[out++] = src[i++];
+                }
+            }
+            while (i < mid) dst[out++] = src[i++];
+            while (j < right) dst[out++] = src[j++];
+        }
+        int *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    
+    if (src != state->order) {
+        memcpy(state->order, src, n * sizeof(int));
+    }
+    free(buffer);
+    return 0;
+}
+
+static int sort_add_run(sort_state_t *state, page_id_t head) {
+    if (state->run_count == state->run_capacity) {
+        int capacity = state->run_capacity ? state->run_capacity * 2 : 16;
+        page_id_t *runs = realloc(state->runs, capacity * sizeof(page_id_t));
+        if (!runs) return -1;
+        state->runs = runs;
+        state->run_capacity = capacity;
+    }
+    state->runs[state->run_count++] = head;
+    return 0;
+}
+
+// Sorts the rows copied so far and writes them out as a run
+static int sort_write_run(operator_t *op) {
+    sort_state_t *state = op->state;
+    if (sort_order(op) != 0) return -1;
+    
+    spill_partition_t run;
+    memset(&run, 0, sizeof(run));
+    value_t values[MAX_OUTPUT_COLUMNS];
+    page_id_t head;
+    
+    for (int k = 0; k < state->row_count; k++) {
+        for (int i = 0; i < op->column_count; i++) {
+            vector_get_value(&state->columns[i], state->order[k], &values[i]);
+        }
+        if (spill_append_values(op->db, &run, values, op->column_count) != 0) {
+            spill_release(op->db, &run);
+            return -1;
+        }
+    }
+    if (spill_finish(op->db, &run, &head) != 0) {
+        spill_release(op->db, &run);
+        return -1;
+    }
+    free(run.page);
+    
+    state->row_count = 0;
+    return sort_add_run(state, head);
+}
+
+// Readers compare by their current row, then by run, which keeps the
+// merge stable
+static int sort_reader_less(operator_t *op, int a, int b) {
+    sort_state_t *state = op->state;
+    const sort_reader_t *x = &state->readers[a];
+    const sort_reader_t *y = &state->readers[b];
+    int result = sort_compare_values(op->db, state->keys, state->key_count,
+                                     &x->rows[x->position * op->column_count],
+                                     &y->rows[y->position * op->column_count]);
+    return result < 0 || (result == 0 && a < b);
+}
+
+static void sort_sift_down(operator_t *op, int index) {
+    sort_state_t *state = op->state;
+    int *heap = state->heap;
+    
+    while (1) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < state->heap_count && sort_reader_less(op, heap[left], heap[smallest])) smallest = left;
+        if (right < state->heap_count && sort_reader_less(op, heap[right], heap[smallest])) smallest = right;
+        if (smallest == index) return;
+        
+        int swap = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+// Moves a reader to its next row, reading the next page of its run when
+// the current one is used up. Returns 0 at the end of the run.
+static int sort_reader_advance(operator_t *op, sort_reader_t *reader) {
+    if (++reader->position < reader->row_count) return 1;
+    
+    reader->position = 0;
+    reader->row_count = spill_read_values(op->db, &reader->page_id, reader->rows);
+    return reader->row_count;
+}
+
+// Starts merging `count` runs from runs[first], which the readers take over
+static int sort_merge_open(operator_t *op, int first, int count) {
+    sort_state_t *state = op->state;
+    state->reader_count = count;
+    state->heap_count = 0;
+    
+    for (int i = 0; i < count; i++) {
+        sort_reader_t *reader = &state->readers[i];
+        reader->page_id = state->runs[first + i];
+        state->runs[first + i] = 0;
+        reader->position = -1;
+        reader->row_count = 0;
+        
+        if (!reader->rows) {
+            reader->rows = malloc(SPILL_PAGE_VALUES * sizeof(value_t));
+            if (!reader->rows) return -1;
+        }
+        
+        int result = sort_reader_advance(op, reader);
+        if (result < 0) return -1;
+        if (result > 0) state->heap[state->heap_count++] = i;
+    }
+    
+    for (int i = state->heap_count / 2 - 1; i >= 0; i--) {
+        sort_sift_down(op, i);
+    }
+    return 0;
+}
+
+// The smallest row among the readers, valid until sort_merge_pop()
+static const value_t* sort_merge_top(operator_t *op) {
+    sort_state_t *state = op->state;
+    const sort_reader_t *reader = &state->readers[state->heap[0]];
+    return &reader->rows[reader->position * op->column_count];
+}
+
+static int sort_merge_pop(operator_t *op) {
+    sort_state_t *state = op->state;
+    int result = sort_reader_advance(op, &state->readers[state->heap[0]]);
+    if (result < 0) return -1;
+    
+    if (result == 0) {
+        state->heap[0] = state->heap[--state->heap_count];
+    }
+    if (state->heap_count > 0) sort_sift_down(op, 0);
+    return 0;
+}
+
+// Merges groups of SORT_MERGE_FANIN runs until one merge can produce the
+// output
+static int sort_merge_passes(operator_t *op) {
+    sort_state_t *state = op->state;
+    
+    while (state->run_count > SORT_MERGE_FANIN) {
+        int merged = 0;
+        for (int first = 0; first < state->run_count; first += SORT_MERGE_FANIN) {
+            int count = state->run_count - first;
+            if (count > SORT_MERGE_FANIN) count = SORT_MERGE_FANIN;
+            
+            page_id_t head;
+            if (count == 1) {
+                head = state->runs[first];
+                state->runs[first] = 0;
+            } else {
+                if (sort_merge_open(op, first, count) != 0) return -1;
+                
+                spill_partition_t run;
+                memset(&run, 0, sizeof(run));
+                while (state->heap_count > 0) {
+                    if (spill_append_values(op->db, &run, sort_merge_top(op), op->column_count) != 0 ||
+                        sort_merge_pop(op) != 0) {
+                        spill_release(op->db, &run);
+                        return -1;
+                    }
+                }
+                if (spill_finish(op->db, &run, &head) != 0) {
+                    spill_release(op->db, &run);
+                    return -1;
+                }
+                free(run.page);
+            }
+            state->runs[merged++] = head;
+        }
+        state->run_count = merged;
+    }
+    return 0;
+}
+
+static void sort_free_columns(operator_t *op) {
+    sort_state_t *state = op->state;
+    
+    for (int i = 0; i < op->column_count; i++) {
+        free(state->columns[i].ints);
+        free(state->columns[i].floats);
+        free(state->columns[i].strings);
+        free(state->columns[i].nulls);
+        state->columns[i].ints = NULL;
+        state->columns[i].floats = NULL;
+        state->columns[i].strings = NULL;
+        state->columns[i].nulls = NULL;
+    }
+    free(state->order);
+    state->order = NULL;
+    state->capacity = 0;
+}
+
+static int sort_open(operator_t *op) {
+    sort_state_t *state = op->state;
+    state->row_count = 0;
+    state->position = 0;
+    state->run_count = 0;
+    state->reader_count = 0;
+    state->heap_count = 0;
+    if (batch_init(&state->batch, op->column_count, op->column_types) != 0) return -1;
+    
+    batch_t *input;
+    int result;
+    while ((result = exec_next(op->child, &input)) > 0) {
+        if (sort_append(op, input) != 0) return -1;
+        if (state->row_count * state->row_bytes > state->memory_budget && sort_write_run(op) != 0) return -1;
+    }
+    if (result < 0) return -1;
+    
+    if (state->run_count == 0) return sort_order(op);
+    
+    if (state->row_count > 0 && sort_write_run(op) != 0) return -1;
+    sort_free_columns(op);
+    if (sort_merge_passes(op) != 0) return -1;
+    return sort_merge_open(op, 0, state->run_count);
+}
+
+static int sort_next_merged(operator_t *op, batch_t **batch) {
+    sort_state_t *state = op->state;
+    batch_t *out = &state->batch;
+    int count = 0;
+    
+    while (count < BATCH_SIZE && state->heap_count > 0) {
+        const value_t *row = sort_merge_top(op);
+        for (int i = 0; i < op->column_count; i++) {
+            batch_set_value(out, i, count, &row[i]);
+        }
+        count++;
+        if (sort_merge_pop(op) != 0) return -1;
+    }
+    if (count == 0) return 0;
+    
+    out->row_count = count;
+    batch_select_all(out);
+    *batch = out;
+    return 1;
+}
+
+static int sort_next(operator_t *op, batch_t **batch) {
+    sort_state_t *state = op->state;
+    if (state->reader_count > 0) return sort_next_merged(op, batch);
+    if (state->position >= state->row_count) return 0;
+    
+    int count = state->row_count - state->position;
+    if (count > BATCH_SIZE) count = BATCH_SIZE;
+    const int *order = state->order + state->position;
+    
+    for (int i = 0; i < op->column_count; i++) {
+        const vector_t *src = &state->columns[i];
+        vector_t *dst = &state->batch.columns[i];
+        
+        for (int k = 0; k < count; k++) {
+            dst->nulls[k] = src->nulls[order[k]];
+        }
+        switch (src->type) {
+            case DATA_TYPE_INT:
+                for (int k = 0; k < count; k++) dst->ints[k] = src->ints[order[k]];
+                break;
+            case DATA_TYPE_FLOAT:
+                for (int k = 0; k < count; k++) dst->floats[k] = src->floats[order[k]];
+                break;
+            case DATA_TYPE_VARCHAR:
+                for (int k = 0; k < count; k++) dst->strings[k] = src->strings[order[k]];
+                break;
+        }
+    }
+    
+    state->position += count;
+    state->batch.row_count = count;
+    batch_select_all(&state->batch);
+    *batch = &state->batch;
+    return 1;
+}
+
+static void sort_close(operator_t *op) {
+    sort_state_t *state = op->state;
+    sort_free_columns(op);
+    
+    // Temporary pages of an unfinished sort go back to the free list
+    for (int i = 0; i < state->run_count; i++) {
+        spill_free(op->db, state->runs[i]);
+    }
+    for (int i = 0; i < SORT_MERGE_FANIN; i++) {
+        if (i < state->reader_count) spill_free(op->db, state->readers[i].page_id);
+        free(state->readers[i].rows);
+        state->readers[i].rows = NULL;
+    }
+    free(state->runs);
+    state->runs = NULL;
+    state->run_count = 0;
+    state->run_capacity = 0;
+    state->reader_count = 0;
+    state->heap_count = 0;
+    batch_free(&state->batch);
+}
+
+// Memory one buffered row takes: its column values and two permutation
+// entries
+static size_t sort_row_bytes(const operator_t *op) {
+    size_t bytes = 2 * sizeof(int);
+    for (int i = 0; i < op->column_count; i++) {
+        bytes += 1 + (op->column_types[i] == DATA_TYPE_VARCHAR ? sizeof(value_t) : sizeof(int));
+    }
+    return bytes;
+}
+
+static int sort_check_keys(const operator_t *child, const sort_key_t *keys, int key_count) {
+    if (!child || key_count <= 0 || key_count > MAX_OUTPUT_COLUMNS) return -1;
+    
+    for (int i = 0; i < key_count; i++) {
+        if (keys[i].column < 0 || keys[i].column >= child->column_count) return -1;
+    }
+    return 0;
+}
+
+// Orders the input on the keys, in priority order. Rows with equal keys
+// keep their input order. Input beyond memory_budget bytes (0 selects
+// SORT_MEMORY_BUDGET) is sorted in runs on temporary pages and merged.
+operator_t* exec_sort_create(operator_t *child, const sort_key_t *keys, int key_count, size_t memory_budget) {
+    if (sort_check_keys(child, keys, key_count) != 0) return NULL;
+    
+    operator_t *op = exec_operator_create("Sort", child->db, child, sizeof(sort_state_t));
+    if (!op) return NULL;
+    
+    sort_state_t *state = op->state;
+    memcpy(state->keys, keys, key_count * sizeof(sort_key_t));
+    state->key_count = key_count;
+    state->memory_budget = memory_budget ? memory_budget : SORT_MEMORY_BUDGET;
+    
+    op->column_count = child->column_count;
+    memcpy(op->column_types, child->column_types, sizeof(op->column_types));
+    memcpy(op->column_names, child->column_names, sizeof(op->column_names));
+    for (int i = 0; i < op->column_count; i++) {
+        state->columns[i].type = op->column_types[i];
+    }
+    state->row_bytes = sort_row_bytes(op);
+    
+    op->open = sort_open;
+    op->next = sort_next;
+    op->close = sort_close;
+    return op;
+}
+
+typedef struct {
+    sort_key_t keys[MAX_OUTPUT_COLUMNS];
+    int key_count;
+    long long limit;
+    long long offset;
+    int capacity;             // limit + offset rows
+    value_t *rows;            // Kept rows, one value_t per column
+    long long *sequence;      // Input position of each kept row, for ties
+    int *heap;                // Kept rows, worst first
+    int count;
+    int position;             // Next row of the sorted heap to output
+    batch_t batch;
+} top_n_state_t;
+
+// Orders rows by the keys, then by input position
+static int top_n_compare(database_t *db, const top_n_state_t *state, const value_t *a, long long a_sequence,
+                         const value_t *b, long long b_sequence) {
+    int result = sort_compare_values(db, state->keys, state->key_count, a, b);
+    if (result != 0) return result;
+    return (a_sequence > b_sequence) - (a_sequence < b_sequence);
+}
+
+static int top_n_greater(operator_t *op, int a, int b) {
+    top_n_state_t *state = op->state;
+    return top_n_compare(op->db, state, &state->rows[(size_t)a * op->column_count], state->sequence[a],
+                         &state->rows[(size_t)b * op->column_count], state->sequence[b]) > 0;
+}
+
+static void top_n_sift_down(operator_t *op, int index, int count) {
+    top_n_state_t *state = op->state;
+    int *heap = state->heap;
+    
+    while (1) {
+        int largest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < count && top_n_greater(op, heap[left], heap[largest])) largest = left;
+        if (right < count && top_n_greater(op, heap[right], heap[largest])) largest = right;
+        if (largest == index) return;
+        
+        int swap = heap[index];
+        heap[index] = heap[largest];
+        heap[largest] = swap;
+        index = largest;
+    }
+}
+
+static void top_n_sift_up(operator_t *op, int index) {
+    top_n_state_t *state = op->state;
+    int *heap = state->heap;
+    
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!top_n_greater(op, heap[index], heap[parent])) return;
+        
+        int swap = heap[index];
+        heap[index] = heap[parent];
+        heap[parent] = swap;
+        index = parent;
+    }
+}
+
+// Offers each selected row to the heap. Once it is full, a row only gets
+// in by beating the current worst, which is checked on the keys alone.
+static void top_n_consume(operator_t *op, const batch_t *batch, long long *sequence) {
+    top_n_state_t *state = op->state;
+    int column_count = op->column_count;
+    value_t candidate[MAX_OUTPUT_COLUMNS];
+    
+    for (int k = 0; k < batch->selected_count; k++, (*sequence)++) {
+        int row = batch->selection[k];
+        int slot;
+        
+        if (state->count < state->capacity) {
+            slot = state->count;
+        } else {
+            for (int i = 0; i < state->key_count; i++) {
+                int column = state->keys[i].column;
+                batch_get_value(batch, column, row, &candidate[column]);
+            }
+            slot = state->heap[0];
+            if (top_n_compare(op->db, state, candidate, *sequence, &state->rows[(size_t)slot * column_count],
+                              state->sequence[slot]) >= 0) {
+                continue;
+            }
+        }
+        
+        for (int i = 0; i < column_count; i++) {
+            batch_get_value(batch, i, row, &state->rows[(size_t)slot * column_count + i]);
+        }
+        state->sequence[slot] = *sequence;
+        
+        if (state->count < state->capacity) {
+            state->heap[state->count] = slot;
+            top_n_sift_up(op, state->count++);
+        } else {
+            top_n_sift_down(op, 0, state->count);
+        }
+    }
+}
+
+static int top_n_open(operator_t *op) {
+    top_n_state_t *state = op->state;
+    state->count = 0;
+    state->position = (int)state->offset;
+    if (batch_init(&state->batch, op->column_count, op->column_types) != 0) return -1;
+    
+    int capacity = state->capacity > 0 ? state->capacity : 1;
+    state->rows = malloc((size_t)capacity * op->column_count * sizeof(value_t));
+    state->sequence = malloc(capacity * sizeof(long long));
+    state->heap = malloc(capacity * sizeof(int));
+    if (!state->rows || !state->sequence || !state->heap) return -1;
+    if (state->capacity == 0) return 0;
+    
+    batch_t *input;
+    int result;
+    long long sequence = 0;
+    while ((result = exec_next(op->child, &input)) > 0) {
+        top_n_consume(op, input, &sequence);
+    }
+    if (result < 0) return -1;
+    
+    // Heap sort in place: the worst row moves to the end each round
+    for (int n = state->count - 1; n > 0; n--) {
+        int swap = state->heap[0];
+        state->heap[0] = state->heap[n];
+        state->heap[n] = swap;
+        top_n_sift_down(op, 0, n);
+    }
+    return 0;
+}
+
+static int top_n_next(operator_t *op, batch_t **batch) {
+    top_n_state_t *state = op->state;
+    batch_t *out = &state->batch;
+    
+    int count = state->count - state->position;
+    if (count <= 0) return 0;
+    if (count > BATCH_SIZE) count = BATCH_SIZE;
+    
+    for (int k = 0; k < count; k++) {
+        const value_t *row = &state->rows[(size_t)state->heap[state->position + k] * op->column_count];
+        for (int i = 0; i < op->column_count; i++) {
+            batch_set_value(out, i, k, &row[i]);
+        }
+    }
+    
+    state->position += count;
+    out->row_count = count;
+    batch_select_all(out);
+    *batch = out;
+    return 1;
+}
+
+static void top_n_close(operator_t *op) {
+    top_n_state_t *state = op->state;
+    free(state->rows);
+    free(state->sequence);
+    free(state->heap);
+    state->rows = NULL;
+    state->sequence = NULL;
+    state->heap = NULL;
+    state->count = 0;
+    batch_free(&state->batch);
+}
+
+static void top_n_explain(const operator_t *op, char *detail, size_t size) {
+    const top_n_state_t *state = op->state;
+    snprintf(detail, size, " (limit %lld offset %lld)", state->limit, state->offset);
+}
+
+// Same rows as a sort followed by exec_limit_create(limit, offset), but
+// only limit + offset rows are kept at any time
+operator_t* exec_top_n_create(operator_t *child, const sort_key_t *keys, int key_count, long long limit,
+                              long long offset) {
+    if (sort_check_keys(child, keys, key_count) != 0) return NULL;
+    if (limit < 0 || offset < 0 || limit + offset > INT_MAX / MAX_OUTPUT_COLUMNS) return NULL;
+    
+    operator_t *op = exec_operator_create("Top-N", child->db, child, sizeof(top_n_state_t));
+    if (!op) return NULL;
+    
+    top_n_state_t *state = op->state;
+    memcpy(state->keys, keys, key_count * sizeof(sort_key_t));
+    state->key_count = key_count;
+    state->limit = limit;
+    state->offset = offset;
+    state->capacity = (int)(limit + offset);
+    
+    op->column_count = child->column_count;
+    memcpy(op->column_types, child->column_types, sizeof(op->column_types));
+    memcpy(op->column_names, child->column_names, sizeof(op->column_names));
+    
+    op->open = top_n_open;
+    op->next = top_n_next;
+    op->close = top_n_close;
+    op->explain = top_n_explain;
+    return op;
+}
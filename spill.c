@@ -0,0 +1,262 @@
+#include "tinydb.h"
+
+// Temporary storage for operators that outgrow their memory budget, and
+// the row hashing they partition by. Spilled rows are kept in chains of
+// ordinary database pages taken from the free list and returned to it as
+// soon as they are read back. A chain returns its rows in the order they
+// were appended.
+//
+//   [spill_page_header_t][row][row]...   each row: one value_t per column
+
+typedef struct {
+    page_id_t next_page_id;
+    uint32_t row_count;
+} spill_page_header_t;
+
+static uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hash_string(database_t *db, const value_t *value) {
+    char *text = value->is_external ? overflow_read(db, value) : NULL;
+    const char *p = text ? text : value->data.str_val;
+    
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (*p) {
+        h = (h ^ (uint8_t)*p++) * 0x100000001b3ULL;
+    }
+    free(text);
+    return h;
+}
+
+// Hashes the listed columns of the selected rows into hashes[row], one
+// column at a time. Equal values hash equally whether they are stored
+// inline or in overflow pages, and 0.0 and -0.0 hash alike.
+void batch_hash(database_t *db, const batch_t *batch, const int *columns, int column_count, uint64_t *hashes) {
+    const uint16_t *sel = batch->selection;
+    int count = batch->selected_count;
+    
+    for (int k = 0; k < count; k++) {
+        hashes[sel[k]] = 0x9e3779b97f4a7c15ULL;
+    }
+    
+    for (int i = 0; i < column_count; i++) {
+        const vector_t *vec = &batch->columns[columns[i]];
+        for (int k = 0; k < count; k++) {
+            int row = sel[k];
+            uint64_t h = 0;
+            if (vec->nulls[row]) {
+                h = 0x5bd1e995;
+            } else if (vec->type == DATA_TYPE_INT) {
+                h = (uint32_t)vec->ints[row];
+            } else if (vec->type == DATA_TYPE_FLOAT) {
+                float f = vec->floats[row] == 0.0f ? 0.0f : vec->floats[row];
+                uint32_t bits;
+                memcpy(&bits, &f, sizeof(bits));
+                h = bits;
+            } else {
+                h = hash_string(db, &vec->strings[row]);
+            }
+            hashes[row] = hash_mix(hashes[row] ^ (h + 0x9e3779b97f4a7c15ULL + (hashes[row] << 6)));
+        }
+    }
+}
+
+// Mixes one column of dictionary codes into hashes[row] of the selected
+// rows, as batch_hash() does for a column of values. Codes only hash
+// alike within one dictionary, so the caller must not mix them with
+// hashes of the decoded strings.
+void batch_hash_codes(const batch_t *batch, const dict_code_t *codes, const uint8_t *nulls, uint64_t *hashes) {
+    for (int k = 0; k < batch->selected_count; k++) {
+        int row = batch->selection[k];
+        uint64_t h = nulls[row] ? 0x5bd1e995 : codes[row];
+        hashes[row] = hash_mix(hashes[row] ^ (h + 0x9e3779b97f4a7c15ULL + (hashes[row] << 6)));
+    }
+}
+
+// Compares a stored value with a batch cell of the same type. Two NULLs
+// are equal here; joins, where they must not be, check for NULL first.
+int batch_value_equal(database_t *db, const batch_t *batch, int column, int row, const value_t *value) {
+    const vector_t *vec = &batch->columns[column];
+    if (value->is_null || vec->nulls[row]) return value->is_null && vec->nulls[row];
+    
+    switch (vec->type) {
+        case DATA_TYPE_INT:
+            return value->data.int_val == vec->ints[row];
+        case DATA_TYPE_FLOAT:
+            return value->data.float_val == vec->floats[row];
+        case DATA_TYPE_VARCHAR:
+            break;
+    }
+    
+    const value_t *cell = &vec->strings[row];
+    if (!value->is_external && !cell->is_external) {
+        return strcmp(value->data.str_val, cell->data.str_val) == 0;
+    }
+    
+    char *a_text = value->is_external ? overflow_read(db, value) : NULL;
+    char *b_text = cell->is_external ? overflow_read(db, cell) : NULL;
+    int equal = strcmp(a_text ? a_text : value->data.str_val, b_text ? b_text : cell->data.str_val) == 0;
+    free(a_text);
+    free(b_text);
+    return equal;
+}
+
+static page_id_t spill_new_page(database_t *db) {
+    page_t *page = storage_allocate_page(db);
+    if (!page) return 0;
+    
+    page_id_t page_id = page->page_id;
+    buffer_release_page(db->buffer_pool, page);
+    return page_id;
+}
+
+// Writes the partition's private page to the page reserved for it, linked
+// to next_page_id
+static int spill_write(database_t *db, spill_partition_t *partition, page_id_t next_page_id) {
+    spill_page_header_t *header = (spill_page_header_t*)partition->page;
+    header->next_page_id = next_page_id;
+    
+    page_t *page = buffer_get_page(db->buffer_pool, partition->current);
+    if (!page) return -1;
+    
+    pthread_mutex_lock(&page->page_mutex);
+    memcpy(page->data, partition->page, PAGE_SIZE);
+    page->is_dirty = 1;
+    pthread_mutex_unlock(&page->page_mutex);
+    
+    storage_write_page(db, page->page_id, page->data);
+    buffer_release_page(db->buffer_pool, page);
+    
+    header->row_count = 0;
+    return 0;
+}
+
+// Appends one row of `count` values to the partition. Rows are collected
+// in a private page that is written out when full, so filling many
+// partitions never pins buffer pool pages. The page that follows is
+// reserved before a full one is written, which keeps the chain in the
+// order the rows were appended.
+int spill_append_values(database_t *db, spill_partition_t *partition, const value_t *values, int count) {
+    size_t row_size = count * sizeof(value_t);
+    
+    if (!partition->page) {
+        partition->page = calloc(1, PAGE_SIZE);
+        if (!partition->page) return -1;
+    }
+    
+    spill_page_header_t *header = (spill_page_header_t*)partition->page;
+    size_t rows_per_page = (PAGE_SIZE - sizeof(spill_page_header_t)) / row_size;
+    if (partition->current == 0) {
+        partition->current = spill_new_page(db);
+        if (partition->current == 0) return -1;
+        partition->head = partition->current;
+    } else if (header->row_count == rows_per_page) {
+        page_id_t next_page_id = spill_new_page(db);
+        if (next_page_id == 0 || spill_write(db, partition, next_page_id) != 0) return -1;
+        partition->current = next_page_id;
+    }
+    
+    memcpy(partition->page + sizeof(spill_page_header_t) + header->row_count * row_size, values, row_size);
+    header->row_count++;
+    partition->row_count++;
+    return 0;
+}
+
+// Appends one row of the batch, every column
+int spill_append(database_t *db, spill_partition_t *partition, const batch_t *batch, int row) {
+    value_t values[MAX_OUTPUT_COLUMNS];
+    for (int i = 0; i < batch->column_count; i++) {
+        batch_get_value(batch, i, row, &values[i]);
+    }
+    return spill_append_values(db, partition, values, batch->column_count);
+}
+
+// Writes out what is left of the partition and hands over its chain,
+// leaving the partition empty for reuse. *head is 0 if nothing was spilled.
+int spill_finish(database_t *db, spill_partition_t *partition, page_id_t *head) {
+    if (partition->current != 0 && spill_write(db, partition, 0) != 0) return -1;
+    
+    *head = partition->head;
+    partition->head = 0;
+    partition->current = 0;
+    partition->row_count = 0;
+    return 0;
+}
+
+// Copies the rows of the page at *page_id into `values`, which must hold
+// SPILL_PAGE_VALUES values, frees the page and moves *page_id to the next page of
+// the chain. Returns the number of rows read, 0 at the end of the chain and
+// -1 on error.
+int spill_read_values(database_t *db, page_id_t *page_id, value_t *values) {
+    if (*page_id == 0) return 0;
+    
+    page_t *page = buffer_get_page(db->buffer_pool, *page_id);
+    if (!page) return -1;
+    
+    const spill_page_header_t *header = (const spill_page_header_t*)page->data;
+    page_id_t next_page_id = header->next_page_id;
+    int rows = (int)header->row_count;
+    memcpy(values, page->data + sizeof(spill_page_header_t), PAGE_SIZE - sizeof(spill_page_header_t));
+    
+    buffer_release_page(db->buffer_pool, page);
+    storage_free_page(db, *page_id);
+    
+    *page_id = next_page_id;
+    return rows;
+}
+
+// Reads the next page of a chain into `batch`, which must have the columns
+// the rows were written with. Returns as spill_read_values().
+int spill_read(database_t *db, page_id_t *page_id, batch_t *batch) {
+    value_t values[SPILL_PAGE_VALUES];
+    int rows = spill_read_values(db, page_id, values);
+    if (rows <= 0) return rows;
+    
+    for (int r = 0; r < rows; r++) {
+        for (int i = 0; i < batch->column_count; i++) {
+            batch_set_value(batch, i, r, &values[r * batch->column_count + i]);
+        }
+    }
+    batch->row_count = rows;
+    batch_select_all(batch);
+    return rows;
+}
+
+void spill_free(database_t *db, page_id_t page_id) {
+    while (page_id != 0) {
+        page_t *page = buffer_get_page(db->buffer_pool, page_id);
+        if (!page) return;
+        
+        page_id_t next_page_id = ((spill_page_header_t*)page->data)->next_page_id;
+        buffer_release_page(db->buffer_pool, page);
+        
+        storage_free_page(db, page_id);
+        page_id = next_page_id;
+    }
+}
+
+// Frees the pages and buffer of a partition, for operators closed early.
+// The page being filled has not been written and ends the chain.
+void spill_release(database_t *db, spill_partition_t *partition) {
+    page_id_t page_id = partition->head;
+    while (page_id != 0 && page_id != partition->current) {
+        page_t *page = buffer_get_page(db->buffer_pool, page_id);
+        if (!page) break;
+        
+        page_id_t next_page_id = ((spill_page_header_t*)page->data)->next_page_id;
+        buffer_release_page(db->buffer_pool, page);
+        
+        storage_free_page(db, page_id);
+        page_id = next_page_id;
+    }
+    if (partition->current != 0) storage_free_page(db, partition->current);
+    
+    free(partition->page);
+    memset(partition, 0, sizeof(spill_partition_t));
+}
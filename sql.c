@@ -1,26 +1,76 @@
 #include "tinydb.h"
 #include <ctype.h>
+#include <strings.h>
 
 typedef enum {
     SQL_CREATE_TABLE,
     SQL_INSERT,
     SQL_SELECT,
     SQL_DELETE,
+    SQL_UPDATE,
     SQL_BEGIN,
     SQL_COMMIT,
     SQL_ROLLBACK,
+    SQL_VACUUM,
+    SQL_ANALYZE,
+    SQL_SET,
+    SQL_COPY,
     SQL_UNKNOWN
 } sql_command_t;
 
+// A column reference, optionally qualified by its table: "t.col"
+#define MAX_COLUMN_REF (MAX_TABLE_NAME + MAX_COLUMN_NAME)
+
 typedef struct {
     sql_command_t command;
     char table_name[MAX_TABLE_NAME];
+    char join_table[MAX_TABLE_NAME];           // Right table of FROM ... JOIN, empty without one
+    join_type_t join_type;
+    int join_on[2];                            // ON columns, as names
+
     column_def_t columns[MAX_COLUMNS];
     int column_count;
-    value_t values[MAX_COLUMNS];
+    storage_type_t storage_type;
+    value_t *values;                           // INSERT rows one after the other, or UPDATE strings
     int value_count;
-    value_t where_key;
+    int value_capacity;
+    int row_count;
+    scalar_expr_t items[MAX_OUTPUT_COLUMNS];   // Select list, empty for SELECT *, or UPDATE SET values
+    int item_count;
+    int set_columns[MAX_COLUMNS];              // Column each UPDATE SET item assigns, as a name
+    int set_strings[MAX_COLUMNS];              // Value the item assigns a string from, -1 for an expression
+    uint8_t is_aggregate[MAX_OUTPUT_COLUMNS];  // Item is fn(column), kept as a column node
+    aggregate_fn_t aggregate_fns[MAX_OUTPUT_COLUMNS];
+    int group_by[MAX_OUTPUT_COLUMNS];
+    int group_count;
+    char order_by[MAX_OUTPUT_COLUMNS][MAX_COLUMN_REF];   // Output aliases or columns
+    uint8_t order_descending[MAX_OUTPUT_COLUMNS];
+    int order_count;
+    long long limit;                           // -1 without LIMIT
+    long long offset;
+    int parallelism;                           // SET MAX_PARALLELISM value, 0 for all cores
+    int explain;                               // EXPLAIN [ANALYZE] SELECT: print the plan instead of the rows
+    int explain_analyze;
+    int set_output;                            // SET OUTPUT rather than SET MAX_PARALLELISM
+    result_format_t output_format;
+    char copy_path[MAX_PATH_SIZE];             // COPY file, read with FROM and written with TO
+    int copy_to;
+    copy_format_t copy_format;
+    int copy_header;
+    expr_t where;
     int has_where;
+    char names[MAX_EXPR_NODES][MAX_COLUMN_REF];    // Columns named by the statement
+    int name_count;
+    char **long_strings;               // Buffers behind external values, one slot per value
+    int params[MAX_EXPR_NODES];        // Where each ? goes: an INSERT value, or the WHERE node comparing with it
+    int param_count;
+    
+    // Set by sql_resolve()
+    int resolved;
+    table_schema_t *schema;
+    int aggregate;
+    int output_count;                  // Select-list items before the hidden ORDER BY columns
+    sort_key_t order_keys[MAX_OUTPUT_COLUMNS];
 } sql_statement_t;
 
 static void skip_whitespace(const char **sql) {
@@ -61,6 +111,40 @@ static int parse_string(const char **sql, char *buffer, int max_len) {
     return 1;
 }
 
+// Parses a string literal into a value. Literals that do not fit in
+// str_val are copied to the heap and passed on as pending external values.
+static int parse_string_value(const char **sql, value_t *val, sql_statement_t *stmt, int index) {
+    skip_whitespace(sql);
+    
+    if (**sql != '\'') return 0;
+    const char *start = *sql + 1;
+    const char *end = strchr(start, '\'');
+    size_t length = end ? (size_t)(end - start) : strlen(start);
+    
+    val->type = DATA_TYPE_VARCHAR;
+    val->is_null = 0;
+    val->is_external = 0;
+    
+    if (length < MAX_VALUE_SIZE) {
+        return parse_string(sql, val->data.str_val, MAX_VALUE_SIZE);
+    }
+    
+    if (length > MAX_VARCHAR_SIZE) return 0;
+    char *copy = malloc(length + 1);
+    if (!copy) return 0;
+    memcpy(copy, start, length);
+    copy[length] = '\0';
+    stmt->long_strings[index] = copy;
+    
+    val->is_external = 1;
+    val->data.ext.page_id = 0;
+    val->data.ext.length = length;
+    val->data.ext.data = copy;
+    
+    *sql = end ? end + 1 : start + length;
+    return 1;
+}
+
 static int parse_integer(const char **sql, int *value) {
     skip_whitespace(sql);
     
@@ -141,6 +225,8 @@ static int parse_create_table(const char **sql, sql_statement_t *stmt) {
             return 0;
         }
         
+        col->is_dictionary = match_keyword(sql, "DICTIONARY");
+        
         col->is_primary_key = 0;
         if (match_keyword(sql, "PRIMARY")) {
             if (match_keyword(sql, "KEY")) {
@@ -164,32 +250,65 @@ static int parse_create_table(const char **sql, sql_statement_t *stmt) {
     if (**sql != ')') return 0;
     (*sql)++;
     
+    stmt->storage_type = STORAGE_ROW;
+    if (match_keyword(sql, "STORAGE")) {
+        skip_whitespace(sql);
+        if (**sql == '=') (*sql)++;
+        
+        if (match_keyword(sql, "COLUMN")) {
+            stmt->storage_type = STORAGE_COLUMN;
+        } else if (match_keyword(sql, "INDEX")) {
+            stmt->storage_type = STORAGE_INDEX;
+        } else if (!match_keyword(sql, "ROW")) {
+            return 0;
+        }
+    }
+    
     return 1;
 }
 
-static int parse_insert(const char **sql, sql_statement_t *stmt) {
-    if (!match_keyword(sql, "INTO")) return 0;
-    
-    if (!parse_identifier(sql, stmt->table_name, MAX_TABLE_NAME)) return 0;
-    
-    if (!match_keyword(sql, "VALUES")) return 0;
+// Makes room for one more INSERT value and returns it, cleared
+static value_t* add_value(sql_statement_t *stmt) {
+    if (stmt->value_count == stmt->value_capacity) {
+        int capacity = stmt->value_capacity ? stmt->value_capacity * 2 : MAX_COLUMNS;
+        value_t *values = realloc(stmt->values, capacity * sizeof(value_t));
+        if (!values) return NULL;
+        stmt->values = values;
+        
+        char **long_strings = realloc(stmt->long_strings, capacity * sizeof(char*));
+        if (!long_strings) return NULL;
+        memset(long_strings + stmt->value_capacity, 0, (capacity - stmt->value_capacity) * sizeof(char*));
+        stmt->long_strings = long_strings;
+        stmt->value_capacity = capacity;
+    }
     
+    value_t *val = &stmt->values[stmt->value_count];
+    memset(val, 0, sizeof(value_t));
+    return val;
+}
+
+// Parses one parenthesized row of INSERT values
+static int parse_insert_row(const char **sql, sql_statement_t *stmt) {
     skip_whitespace(sql);
     if (**sql != '(') return 0;
     (*sql)++;
     
-    stmt->value_count = 0;
+    int first = stmt->value_count;
     
-    while (stmt->value_count < MAX_COLUMNS) {
+    while (stmt->value_count - first < MAX_COLUMNS) {
         skip_whitespace(sql);
         if (**sql == ')') break;
         
-        value_t *val = &stmt->values[stmt->value_count];
+        value_t *val = add_value(stmt);
+        if (!val) return 0;
         
-        if (**sql == '\'') {
-            val->type = DATA_TYPE_VARCHAR;
-            val->is_null = 0;
-            if (!parse_string(sql, val->data.str_val, MAX_VALUE_SIZE)) return 0;
+        if (**sql == '?') {
+            if (stmt->param_count >= MAX_EXPR_NODES) return 0;
+            (*sql)++;
+            val->is_null = 1;
+            stmt->params[stmt->param_count++] = stmt->value_count;
+        } else if (**sql == '\'') {
+            if (!parse_string_value(sql, val, stmt, stmt->value_count)) return 0;
         } else if (isdigit(**sql) || **sql == '-') {
             const char *start = *sql;
             int int_val;
@@ -224,50 +343,406 @@ static int parse_insert(const char **sql, sql_statement_t *stmt) {
     return 1;
 }
 
+// INSERT INTO t VALUES (...), (...), ... with the same number of values
+// in every row
+static int parse_insert(const char **sql, sql_statement_t *stmt) {
+    if (!match_keyword(sql, "INTO")) return 0;
+    
+    if (!parse_identifier(sql, stmt->table_name, MAX_TABLE_NAME)) return 0;
+    
+    if (!match_keyword(sql, "VALUES")) return 0;
+    
+    int width = 0;
+    while (1) {
+        if (!parse_insert_row(sql, stmt)) return 0;
+        
+        if (stmt->row_count == 0) {
+            width = stmt->value_count;
+        } else if (stmt->value_count != (stmt->row_count + 1) * width) {
+            return 0;
+        }
+        stmt->row_count++;
+        
+        skip_whitespace(sql);
+        if (**sql != ',') return 1;
+        (*sql)++;
+    }
+}
+
+static int parse_literal(const char **sql, value_t *val) {
+    skip_whitespace(sql);
+    memset(val, 0, sizeof(value_t));
+    
+    if (**sql == '\'') {
+        val->type = DATA_TYPE_VARCHAR;
+        return parse_string(sql, val->data.str_val, MAX_VALUE_SIZE);
+    }
+    if (isdigit(**sql) || **sql == '-') {
+        val->type = DATA_TYPE_INT;
+        return parse_integer(sql, &val->data.int_val);
+    }
+    return 0;
+}
+
+// literal | ?. A parameter is NULL until a value is bound to it.
+static int parse_argument(const char **sql, value_t *val, int *is_param) {
+    skip_whitespace(sql);
+    *is_param = **sql == '?';
+    if (!*is_param) return parse_literal(sql, val);
+    
+    (*sql)++;
+    memset(val, 0, sizeof(value_t));
+    val->is_null = 1;
+    return 1;
+}
+
+static int parse_compare_op(const char **sql, compare_op_t *op) {
+    skip_whitespace(sql);
+    
+    static const struct {
+        const char *text;
+        compare_op_t op;
+    } ops[] = {
+        { "<=", CMP_LE }, { ">=", CMP_GE }, { "<>", CMP_NE }, { "!=", CMP_NE },
+        { "=", CMP_EQ }, { "<", CMP_LT }, { ">", CMP_GT }
+    };
+    
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        size_t len = strlen(ops[i].text);
+        if (strncmp(*sql, ops[i].text, len) == 0) {
+            *sql += len;
+            *op = ops[i].op;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Expressions refer to columns by their index in stmt->names until the
+// statement runs and the names are resolved against the table
+static int parse_column_name(sql_statement_t *stmt, const char *column) {
+    for (int i = 0; i < stmt->name_count; i++) {
+        if (strcmp(stmt->names[i], column) == 0) return i;
+    }
+    if (stmt->name_count >= MAX_EXPR_NODES) return -1;
+    strcpy(stmt->names[stmt->name_count], column);
+    return stmt->name_count++;
+}
+
+// column | table.column
+static int parse_column_ref(const char **sql, char *buffer) {
+    if (!parse_identifier(sql, buffer, MAX_TABLE_NAME)) return 0;
+    if (**sql != '.') return 1;
+    (*sql)++;
+    
+    size_t length = strlen(buffer);
+    buffer[length++] = '.';
+    return parse_identifier(sql, buffer + length, MAX_COLUMN_NAME);
+}
+
+static int parse_comparison(sql_statement_t *stmt, const char *column, compare_op_t op, const value_t *constant,
+                            int is_param) {
+    int name = parse_column_name(stmt, column);
+    if (name < 0) return -1;
+    int node = expr_add_compare(&stmt->where, name, op, constant);
+    if (node >= 0 && is_param) stmt->params[stmt->param_count++] = node;
+    return node;
+}
+
+static int parse_or_condition(const char **sql, sql_statement_t *stmt);
+
+// column <op> argument | column BETWEEN argument AND argument | ( condition )
+// Returns the index of the parsed node, or -1 on a syntax error.
+static int parse_primary_condition(const char **sql, sql_statement_t *stmt) {
+    skip_whitespace(sql);
+    if (**sql == '(') {
+        (*sql)++;
+        int node = parse_or_condition(sql, stmt);
+        skip_whitespace(sql);
+        if (node < 0 || **sql != ')') return -1;
+        (*sql)++;
+        return node;
+    }
+    
+    char column[MAX_COLUMN_REF];
+    if (!parse_column_ref(sql, column)) return -1;
+    
+    value_t low, high;
+    int low_param, high_param;
+    if (match_keyword(sql, "BETWEEN")) {
+        if (!parse_argument(sql, &low, &low_param) || !match_keyword(sql, "AND") ||
+            !parse_argument(sql, &high, &high_param)) {
+            return -1;
+        }
+        int left = parse_comparison(stmt, column, CMP_GE, &low, low_param);
+        int right = parse_comparison(stmt, column, CMP_LE, &high, high_param);
+        return expr_add_logical(&stmt->where, EXPR_AND, left, right);
+    }
+    
+    compare_op_t op;
+    if (!parse_compare_op(sql, &op) || !parse_argument(sql, &low, &low_param)) return -1;
+    return parse_comparison(stmt, column, op, &low, low_param);
+}
+
+static int parse_and_condition(const char **sql, sql_statement_t *stmt) {
+    int node = parse_primary_condition(sql, stmt);
+    while (node >= 0 && match_keyword(sql, "AND")) {
+        node = expr_add_logical(&stmt->where, EXPR_AND, node, parse_primary_condition(sql, stmt));
+    }
+    return node;
+}
+
+static int parse_or_condition(const char **sql, sql_statement_t *stmt) {
+    int node = parse_and_condition(sql, stmt);
+    while (node >= 0 && match_keyword(sql, "OR")) {
+        node = expr_add_logical(&stmt->where, EXPR_OR, node, parse_and_condition(sql, stmt));
+    }
+    return node;
+}
+
+// WHERE conditions are comparisons with literals or parameters combined
+// with AND, OR and parentheses; AND binds tighter than OR. Column names are
+// resolved against the table when the statement runs.
 static int parse_where_clause(const char **sql, sql_statement_t *stmt) {
+    expr_init(&stmt->where);
+    
     if (!match_keyword(sql, "WHERE")) {
         stmt->has_where = 0;
         return 1;
     }
     
     stmt->has_where = 1;
+    stmt->where.root = parse_or_condition(sql, stmt);
+    return stmt->where.root >= 0;
+}
+
+static int parse_scalar(const char **sql, sql_statement_t *stmt, scalar_expr_t *expr);
+
+// ( scalar ) | integer | column
+static int parse_factor(const char **sql, sql_statement_t *stmt, scalar_expr_t *expr) {
+    skip_whitespace(sql);
+    if (**sql == '(') {
+        (*sql)++;
+        int node = parse_scalar(sql, stmt, expr);
+        skip_whitespace(sql);
+        if (node < 0 || **sql != ')') return -1;
+        (*sql)++;
+        return node;
+    }
     
-    char column_name[MAX_COLUMN_NAME];
-    if (!parse_identifier(sql, column_name, MAX_COLUMN_NAME)) return 0;
+    if (isdigit(**sql) || **sql == '-') {
+        value_t constant;
+        if (!parse_literal(sql, &constant)) return -1;
+        return scalar_add_constant(expr, &constant);
+    }
     
-    skip_whitespace(sql);
-    if (**sql != '=') return 0;
-    (*sql)++;
+    char column[MAX_COLUMN_REF];
+    if (!parse_column_ref(sql, column)) return -1;
+    int name = parse_column_name(stmt, column);
+    if (name < 0) return -1;
+    return scalar_add_column(expr, name);
+}
+
+static int parse_term(const char **sql, sql_statement_t *stmt, scalar_expr_t *expr) {
+    int node = parse_factor(sql, stmt, expr);
     
-    skip_whitespace(sql);
-    if (**sql == '\'') {
-        stmt->where_key.type = DATA_TYPE_VARCHAR;
-        stmt->where_key.is_null = 0;
-        if (!parse_string(sql, stmt->where_key.data.str_val, MAX_VALUE_SIZE)) return 0;
-    } else if (isdigit(**sql) || **sql == '-') {
-        int int_val;
-        if (parse_integer(sql, &int_val)) {
-            stmt->where_key.type = DATA_TYPE_INT;
-            stmt->where_key.is_null = 0;
-            stmt->where_key.data.int_val = int_val;
+    while (node >= 0) {
+        skip_whitespace(sql);
+        scalar_kind_t kind;
+        if (**sql == '*') {
+            kind = SCALAR_MUL;
+        } else if (**sql == '/') {
+            kind = SCALAR_DIV;
         } else {
-            return 0;
+            break;
         }
-    } else {
-        return 0;
+        (*sql)++;
+        node = scalar_add_arith(expr, kind, node, parse_factor(sql, stmt, expr));
+    }
+    return node;
+}
+
+// Arithmetic over columns and integers; * and / bind tighter than + and -
+static int parse_scalar(const char **sql, sql_statement_t *stmt, scalar_expr_t *expr) {
+    int node = parse_term(sql, stmt, expr);
+    
+    while (node >= 0) {
+        skip_whitespace(sql);
+        scalar_kind_t kind;
+        if (**sql == '+') {
+            kind = SCALAR_ADD;
+        } else if (**sql == '-') {
+            kind = SCALAR_SUB;
+        } else {
+            break;
+        }
+        (*sql)++;
+        node = scalar_add_arith(expr, kind, node, parse_term(sql, stmt, expr));
+    }
+    return node;
+}
+
+// COUNT(*) | COUNT(column) | SUM | MIN | MAX | AVG (column). Returns 1 if
+// the item is an aggregate, 0 if it is not and -1 on a syntax error.
+static int parse_aggregate(const char **sql, sql_statement_t *stmt, scalar_expr_t *item, aggregate_fn_t *fn) {
+    static const struct {
+        const char *name;
+        aggregate_fn_t fn;
+    } functions[] = {
+        { "COUNT", AGG_COUNT }, { "SUM", AGG_SUM }, { "MIN", AGG_MIN }, { "MAX", AGG_MAX }, { "AVG", AGG_AVG }
+    };
+    
+    const char *start = *sql;
+    for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+        if (!match_keyword(sql, functions[i].name)) continue;
+        
+        // A column may share its name with a function
+        skip_whitespace(sql);
+        if (**sql != '(') break;
+        (*sql)++;
+        
+        *fn = functions[i].fn;
+        if (*fn == AGG_COUNT && match_keyword(sql, "*")) {
+            *fn = AGG_COUNT_STAR;
+        } else {
+            char column[MAX_COLUMN_REF];
+            if (!parse_column_ref(sql, column)) return -1;
+            int name = parse_column_name(stmt, column);
+            if (name < 0) return -1;
+            item->root = scalar_add_column(item, name);
+        }
+        
+        skip_whitespace(sql);
+        if (**sql != ')') return -1;
+        (*sql)++;
+        return 1;
+    }
+    
+    *sql = start;
+    return 0;
+}
+
+// scalar [AS name] | aggregate [AS name]. Without an alias, a computed
+// column is named after its text.
+static int parse_select_item(const char **sql, sql_statement_t *stmt, int index) {
+    scalar_expr_t *item = &stmt->items[index];
+    scalar_init(item);
+    skip_whitespace(sql);
+    const char *start = *sql;
+    
+    int aggregate = parse_aggregate(sql, stmt, item, &stmt->aggregate_fns[index]);
+    if (aggregate < 0) return 0;
+    if (aggregate) {
+        stmt->is_aggregate[index] = 1;
+        if (match_keyword(sql, "AS")) return parse_identifier(sql, item->name, MAX_COLUMN_NAME);
+        return 1;
+    }
+    
+    item->root = parse_scalar(sql, stmt, item);
+    if (item->root < 0) return 0;
+    
+    if (match_keyword(sql, "AS")) {
+        return parse_identifier(sql, item->name, MAX_COLUMN_NAME);
+    }
+    if (item->nodes[item->root].kind != SCALAR_COLUMN) {
+        int length = (int)(*sql - start);
+        while (length > 0 && isspace(start[length - 1])) length--;
+        if (length > MAX_COLUMN_NAME - 1) length = MAX_COLUMN_NAME - 1;
+        memcpy(item->name, start, length);
+        item->name[length] = '\0';
+    }
+    return 1;
+}
+
+// [INNER | LEFT [OUTER]] JOIN table ON column = column
+static int parse_join(const char **sql, sql_statement_t *stmt) {
+    stmt->join_type = JOIN_INNER;
+    if (match_keyword(sql, "LEFT")) {
+        stmt->join_type = JOIN_LEFT;
+        match_keyword(sql, "OUTER");
+        if (!match_keyword(sql, "JOIN")) return 0;
+    } else if (match_keyword(sql, "INNER")) {
+        if (!match_keyword(sql, "JOIN")) return 0;
+    } else if (!match_keyword(sql, "JOIN")) {
+        return 1;
     }
     
+    if (!parse_identifier(sql, stmt->join_table, MAX_TABLE_NAME) || !match_keyword(sql, "ON")) return 0;
+    
+    for (int i = 0; i < 2; i++) {
+        char column[MAX_COLUMN_REF];
+        if (!parse_column_ref(sql, column)) return 0;
+        stmt->join_on[i] = parse_column_name(stmt, column);
+        if (stmt->join_on[i] < 0) return 0;
+        
+        skip_whitespace(sql);
+        if (i == 0 && **sql != '=') return 0;
+        if (i == 0) (*sql)++;
+    }
     return 1;
 }
 
 static int parse_select(const char **sql, sql_statement_t *stmt) {
-    if (!match_keyword(sql, "*")) return 0;
+    skip_whitespace(sql);
+    if (**sql == '*') {
+        (*sql)++;
+    } else {
+        while (1) {
+            if (stmt->item_count >= MAX_OUTPUT_COLUMNS) return 0;
+            if (!parse_select_item(sql, stmt, stmt->item_count++)) return 0;
+            skip_whitespace(sql);
+            if (**sql != ',') break;
+            (*sql)++;
+        }
+    }
     
     if (!match_keyword(sql, "FROM")) return 0;
     
     if (!parse_identifier(sql, stmt->table_name, MAX_TABLE_NAME)) return 0;
     
-    return parse_where_clause(sql, stmt);
+    if (!parse_join(sql, stmt)) return 0;
+    
+    if (!parse_where_clause(sql, stmt)) return 0;
+    
+    if (match_keyword(sql, "GROUP")) {
+        if (!match_keyword(sql, "BY")) return 0;
+        while (1) {
+            char column[MAX_COLUMN_REF];
+            if (stmt->group_count >= MAX_OUTPUT_COLUMNS || !parse_column_ref(sql, column)) return 0;
+            stmt->group_by[stmt->group_count] = parse_column_name(stmt, column);
+            if (stmt->group_by[stmt->group_count++] < 0) return 0;
+            skip_whitespace(sql);
+            if (**sql != ',') break;
+            (*sql)++;
+        }
+    }
+    
+    // ORDER BY names stay unresolved here, as they may be aliases
+    if (match_keyword(sql, "ORDER")) {
+        if (!match_keyword(sql, "BY")) return 0;
+        while (1) {
+            int index = stmt->order_count;
+            if (index >= MAX_OUTPUT_COLUMNS || !parse_column_ref(sql, stmt->order_by[index])) return 0;
+            if (match_keyword(sql, "DESC")) {
+                stmt->order_descending[index] = 1;
+            } else {
+                match_keyword(sql, "ASC");
+            }
+            stmt->order_count++;
+            skip_whitespace(sql);
+            if (**sql != ',') break;
+            (*sql)++;
+        }
+    }
+    
+    if (match_keyword(sql, "LIMIT")) {
+        int limit, offset = 0;
+        if (!parse_integer(sql, &limit) || limit < 0) return 0;
+        if (match_keyword(sql, "OFFSET") && (!parse_integer(sql, &offset) || offset < 0)) return 0;
+        stmt->limit = limit;
+        stmt->offset = offset;
+    }
+    return 1;
 }
 
 static int parse_delete(const char **sql, sql_statement_t *stmt) {
@@ -278,11 +753,103 @@ static int parse_delete(const char **sql, sql_statement_t *stmt) {
     return parse_where_clause(sql, stmt);
 }
 
+// UPDATE t SET column = scalar | 'string' [, ...] [WHERE ...]. Strings go
+// to the values; the other items are expressions over the old row.
+static int parse_update(const char **sql, sql_statement_t *stmt) {
+    if (!parse_identifier(sql, stmt->table_name, MAX_TABLE_NAME) || !match_keyword(sql, "SET")) return 0;
+    
+    while (1) {
+        char column[MAX_COLUMN_REF];
+        if (stmt->item_count >= MAX_COLUMNS || !parse_column_ref(sql, column)) return 0;
+        int index = stmt->item_count++;
+        stmt->set_columns[index] = parse_column_name(stmt, column);
+        if (stmt->set_columns[index] < 0) return 0;
+        
+        skip_whitespace(sql);
+        if (**sql != '=') return 0;
+        (*sql)++;
+        skip_whitespace(sql);
+        
+        scalar_expr_t *item = &stmt->items[index];
+        scalar_init(item);
+        stmt->set_strings[index] = -1;
+        if (**sql == '\'') {
+            value_t *val = add_value(stmt);
+            if (!val || !parse_string_value(sql, val, stmt, stmt->value_count)) return 0;
+            stmt->set_strings[index] = stmt->value_count++;
+        } else {
+            item->root = parse_scalar(sql, stmt, item);
+            if (item->root < 0) return 0;
+        }
+        
+        skip_whitespace(sql);
+        if (**sql != ',') break;
+        (*sql)++;
+    }
+    
+    return parse_where_clause(sql, stmt);
+}
+
+// SET MAX_PARALLELISM [=|TO] n
+static int parse_set(const char **sql, sql_statement_t *stmt) {
+    if (match_keyword(sql, "OUTPUT")) {
+        stmt->set_output = 1;
+    } else if (!match_keyword(sql, "MAX_PARALLELISM")) {
+        return 0;
+    }
+    
+    skip_whitespace(sql);
+    if (**sql == '=') {
+        (*sql)++;
+    } else {
+        match_keyword(sql, "TO");
+    }
+    
+    if (stmt->set_output) {
+        if (match_keyword(sql, "TEXT")) {
+            stmt->output_format = RESULT_FORMAT_TEXT;
+            return 1;
+        }
+        stmt->output_format = RESULT_FORMAT_BINARY;
+        return match_keyword(sql, "BINARY");
+    }
+    return parse_integer(sql, &stmt->parallelism) && stmt->parallelism >= 0;
+}
+
+// COPY t FROM|TO 'file' [CSV [HEADER] | BINARY]
+static int parse_copy(const char **sql, sql_statement_t *stmt) {
+    if (!parse_identifier(sql, stmt->table_name, MAX_TABLE_NAME)) return 0;
+    
+    if (match_keyword(sql, "TO")) {
+        stmt->copy_to = 1;
+    } else if (!match_keyword(sql, "FROM")) {
+        return 0;
+    }
+    if (!parse_string(sql, stmt->copy_path, MAX_PATH_SIZE)) return 0;
+    
+    stmt->copy_format = COPY_FORMAT_CSV;
+    if (match_keyword(sql, "BINARY")) {
+        stmt->copy_format = COPY_FORMAT_BINARY;
+    } else if (match_keyword(sql, "CSV")) {
+        stmt->copy_header = match_keyword(sql, "HEADER");
+    }
+    return 1;
+}
+
 int sql_parse(const char *sql, sql_statement_t *stmt) {
     memset(stmt, 0, sizeof(sql_statement_t));
+    stmt->limit = -1;
     
     const char *ptr = sql;
     
+    if (match_keyword(&ptr, "EXPLAIN")) {
+        stmt->explain = 1;
+        stmt->explain_analyze = match_keyword(&ptr, "ANALYZE");
+        if (!match_keyword(&ptr, "SELECT")) return 0;
+        stmt->command = SQL_SELECT;
+        return parse_select(&ptr, stmt);
+    }
+    
     if (match_keyword(&ptr, "CREATE")) {
         stmt->command = SQL_CREATE_TABLE;
         return parse_create_table(&ptr, stmt);
@@ -295,6 +862,9 @@ int sql_parse(const char *sql, sql_statement_t *stmt) {
     } else if (match_keyword(&ptr, "DELETE")) {
         stmt->command = SQL_DELETE;
         return parse_delete(&ptr, stmt);
+    } else if (match_keyword(&ptr, "UPDATE")) {
+        stmt->command = SQL_UPDATE;
+        return parse_update(&ptr, stmt);
     } else if (match_keyword(&ptr, "BEGIN")) {
         stmt->command = SQL_BEGIN;
         return 1;
@@ -304,76 +874,538 @@ int sql_parse(const char *sql, sql_statement_t *stmt) {
     } else if (match_keyword(&ptr, "ROLLBACK")) {
         stmt->command = SQL_ROLLBACK;
         return 1;
+    } else if (match_keyword(&ptr, "VACUUM")) {
+        stmt->command = SQL_VACUUM;
+        parse_identifier(&ptr, stmt->table_name, MAX_TABLE_NAME);
+        return 1;
+    } else if (match_keyword(&ptr, "ANALYZE")) {
+        stmt->command = SQL_ANALYZE;
+        parse_identifier(&ptr, stmt->table_name, MAX_TABLE_NAME);
+        return 1;
+    } else if (match_keyword(&ptr, "SET")) {
+        stmt->command = SQL_SET;
+        return parse_set(&ptr, stmt);
+    } else if (match_keyword(&ptr, "COPY")) {
+        stmt->command = SQL_COPY;
+        return parse_copy(&ptr, stmt);
     }
     
     stmt->command = SQL_UNKNOWN;
     return 0;
 }
 
-int sql_execute(database_t *db, const char *sql_string, transaction_id_t *current_txn) {
-    sql_statement_t stmt;
+// Finds a column of the statement's tables. With a join, the right
+// table's columns are numbered after the left table's, and a name without
+// a table must belong to only one of them.
+static int sql_find_column(database_t *db, const sql_statement_t *stmt, const char *name) {
+    const char *tables[2] = { stmt->table_name, stmt->join_table };
+    int table_count = stmt->join_table[0] ? 2 : 1;
     
-    if (!sql_parse(sql_string, &stmt)) {
-        printf("SQL parse error\n");
-        return -1;
-    }
+    const char *column = name;
+    const char *dot = strchr(name, '.');
+    if (dot) column = dot + 1;
     
-    switch (stmt.command) {
-        case SQL_CREATE_TABLE:
-            return table_create(db, stmt.table_name, stmt.columns, stmt.column_count);
-            
-        case SQL_INSERT: {
-            if (*current_txn == 0) {
-                printf("No active transaction\n");
-                return -1;
-            }
-            tuple_t tuple;
-            tuple.column_count = stmt.value_count;
-            for (int i = 0; i < stmt.value_count; i++) {
-                tuple.values[i] = stmt.values[i];
+    int found = -1;
+    int offset = 0;
+    for (int t = 0; t < table_count; t++) {
+        table_schema_t *schema = find_table_schema(db, tables[t]);
+        if (!schema) return -1;
+        
+        int qualified_match = dot && (size_t)(dot - name) == strlen(tables[t]) &&
+                              strncmp(name, tables[t], dot - name) == 0;
+        if (!dot || qualified_match) {
+            for (int j = 0; j < schema->column_count; j++) {
+                if (strcmp(schema->columns[j].name, column) != 0) continue;
+                if (found >= 0) {
+                    printf("Ambiguous column %s\n", name);
+                    return -2;
+                }
+                found = offset + j;
             }
-            return tuple_insert(db, stmt.table_name, &tuple, *current_txn);
+        }
+        offset += schema->column_count;
+    }
+    
+    if (found < 0) printf("Unknown column %s\n", name);
+    return found;
+}
+
+// Replaces the column names of the select list and WHERE clause with
+// column numbers
+static int sql_resolve_columns(database_t *db, sql_statement_t *stmt) {
+    if (!find_table_schema(db, stmt->table_name)) return -1;
+    if (stmt->join_table[0] && !find_table_schema(db, stmt->join_table)) {
+        printf("Unknown table %s\n", stmt->join_table);
+        return -1;
+    }
+    
+    int columns[MAX_EXPR_NODES];
+    for (int i = 0; i < stmt->name_count; i++) {
+        columns[i] = sql_find_column(db, stmt, stmt->names[i]);
+        if (columns[i] < 0) return -1;
+    }
+    
+    for (int i = 0; i < stmt->where.node_count; i++) {
+        expr_node_t *node = &stmt->where.nodes[i];
+        if (node->kind == EXPR_COMPARE) node->predicate.column = columns[node->predicate.column];
+    }
+    for (int i = 0; i < stmt->item_count; i++) {
+        for (int j = 0; j < stmt->items[i].node_count; j++) {
+            scalar_node_t *node = &stmt->items[i].nodes[j];
+            if (node->kind == SCALAR_COLUMN) node->column = columns[node->column];
+        }
+    }
+    for (int i = 0; i < stmt->group_count; i++) {
+        stmt->group_by[i] = columns[stmt->group_by[i]];
+    }
+    for (int i = 0; stmt->command == SQL_UPDATE && i < stmt->item_count; i++) {
+        stmt->set_columns[i] = columns[stmt->set_columns[i]];
+    }
+    if (stmt->join_table[0]) {
+        stmt->join_on[0] = columns[stmt->join_on[0]];
+        stmt->join_on[1] = columns[stmt->join_on[1]];
+    }
+    return 0;
+}
+
+// Plans SELECT ... FROM left JOIN right ON a = b. The ON columns may be
+// written in either order but must come one from each table.
+static operator_t* sql_plan_join(database_t *db, sql_statement_t *stmt, transaction_id_t txn_id) {
+    table_schema_t *left = find_table_schema(db, stmt->table_name);
+    table_schema_t *right = find_table_schema(db, stmt->join_table);
+    int left_count = left->column_count;
+    
+    join_spec_t join;
+    strcpy(join.left_table, stmt->table_name);
+    strcpy(join.right_table, stmt->join_table);
+    join.type = stmt->join_type;
+    int a = stmt->join_on[0];
+    int b = stmt->join_on[1];
+    if (a >= left_count) {
+        int swap = a;
+        a = b;
+        b = swap;
+    }
+    if (a >= left_count || b < left_count) {
+        printf("JOIN condition must compare a column of each table\n");
+        return NULL;
+    }
+    join.left_key = a;
+    join.right_key = b - left_count;
+    if (left->columns[join.left_key].type != right->columns[join.right_key].type) {
+        printf("JOIN columns must have the same type\n");
+        return NULL;
+    }
+    
+    return plan_join(db, &join, stmt->item_count > 0 ? stmt->items : NULL, stmt->item_count, &stmt->where, txn_id);
+}
+
+// Plans a query with aggregates or GROUP BY. Plain items must be grouping
+// columns; the aggregation produces the groups and aggregates, and a
+// projection puts them in select-list order.
+static operator_t* sql_plan_aggregate(database_t *db, sql_statement_t *stmt, transaction_id_t txn_id) {
+    table_schema_t *schema = find_table_schema(db, stmt->table_name);
+    if (stmt->item_count == 0) {
+        printf("SELECT * cannot be used with GROUP BY\n");
+        return NULL;
+    }
+    
+    aggregate_spec_t specs[MAX_OUTPUT_COLUMNS];
+    int spec_count = 0;
+    int outputs[MAX_OUTPUT_COLUMNS];
+    
+    for (int i = 0; i < stmt->item_count; i++) {
+        const scalar_expr_t *item = &stmt->items[i];
+        if (stmt->is_aggregate[i]) {
+            specs[spec_count].fn = stmt->aggregate_fns[i];
+            specs[spec_count].column = item->root >= 0 ? item->nodes[item->root].column : 0;
+            outputs[i] = stmt->group_count + spec_count++;
+            continue;
         }
         
-        case SQL_SELECT: {
+        outputs[i] = -1;
+        if (item->node_count == 1 && item->nodes[0].kind == SCALAR_COLUMN) {
+            for (int j = 0; j < stmt->group_count; j++) {
+                if (stmt->group_by[j] == item->nodes[0].column) outputs[i] = j;
+            }
+        }
+        if (outputs[i] < 0) {
+            if (item->node_count == 1 && item->nodes[0].kind == SCALAR_COLUMN) {
+                printf("Column %s must appear in GROUP BY or in an aggregate\n",
+                       schema->columns[item->nodes[0].column].name);
+            } else {
+                printf("Expressions in an aggregate query must be grouping columns\n");
+            }
+            return NULL;
+        }
+    }
+    
+    operator_t *plan = plan_aggregate(db, stmt->table_name, stmt->group_by, stmt->group_count, specs, spec_count,
+                                      &stmt->where, txn_id);
+    if (!plan) return NULL;
+    
+    int identity = stmt->item_count == plan->column_count;
+    scalar_expr_t exprs[MAX_OUTPUT_COLUMNS];
+    for (int i = 0; i < stmt->item_count; i++) {
+        scalar_init(&exprs[i]);
+        exprs[i].root = scalar_add_column(&exprs[i], outputs[i]);
+        strcpy(exprs[i].name, stmt->items[i].name);
+        identity = identity && outputs[i] == i && !exprs[i].name[0];
+    }
+    if (identity) return plan;
+    
+    operator_t *project = exec_project_expr_create(plan, exprs, stmt->item_count);
+    if (!project) {
+        exec_destroy(plan);
+        return NULL;
+    }
+    return project;
+}
+
+// Turns the ORDER BY names into sort keys on the output columns. A name is
+// looked up among the aliases of the select list first, then among the
+// table columns. Columns missing from the select list are appended to it
+// as hidden items, which aggregate queries cannot have.
+static int sql_resolve_order(database_t *db, sql_statement_t *stmt, int aggregate, sort_key_t *keys) {
+    for (int i = 0; i < stmt->order_count; i++) {
+        const char *name = stmt->order_by[i];
+        keys[i].descending = stmt->order_descending[i];
+        keys[i].column = -1;
+        
+        for (int j = 0; j < stmt->item_count && keys[i].column < 0; j++) {
+            if (strcmp(stmt->items[j].name, name) == 0) keys[i].column = j;
+        }
+        if (keys[i].column >= 0) continue;
+        
+        int column = sql_find_column(db, stmt, name);
+        if (column < 0) return -1;
+        if (stmt->item_count == 0) {
+            keys[i].column = column;
+            continue;
+        }
+        
+        for (int j = 0; j < stmt->item_count && keys[i].column < 0; j++) {
+            const scalar_expr_t *item = &stmt->items[j];
+            if (!stmt->is_aggregate[j] && item->node_count == 1 && item->nodes[0].kind == SCALAR_COLUMN &&
+                item->nodes[0].column == column) {
+                keys[i].column = j;
+            }
+        }
+        if (keys[i].column >= 0) continue;
+        
+        if (aggregate) {
+            printf("ORDER BY column %s must appear in the select list\n", name);
+            return -1;
+        }
+        if (stmt->item_count == MAX_OUTPUT_COLUMNS) {
+            printf("Too many columns\n");
+            return -1;
+        }
+        scalar_expr_t *item = &stmt->items[stmt->item_count];
+        scalar_init(item);
+        item->root = scalar_add_column(item, column);
+        keys[i].column = stmt->item_count++;
+    }
+    return 0;
+}
+
+// Looks up the statement's table and, for SELECT and DELETE, resolves its
+// column names and ORDER BY keys. Done once per statement: a prepared
+// statement keeps the result until a table is created or dropped.
+static int sql_resolve(database_t *db, sql_statement_t *stmt) {
+    if (stmt->resolved) return 0;
+    
+    stmt->schema = find_table_schema(db, stmt->table_name);
+    if (!stmt->schema) {
+        printf("Unknown table %s\n", stmt->table_name);
+        return -1;
+    }
+    
+    if (stmt->command == SQL_INSERT) {
+        if (stmt->value_count != stmt->row_count * stmt->schema->column_count) {
+            printf("INSERT has %d values for %d columns\n", stmt->value_count / stmt->row_count,
+                   stmt->schema->column_count);
+            return -1;
+        }
+        stmt->resolved = 1;
+        return 0;
+    }
+    
+    if (sql_resolve_columns(db, stmt) != 0) return -1;
+    
+    stmt->aggregate = stmt->group_count > 0;
+    for (int i = 0; i < stmt->item_count; i++) {
+        stmt->aggregate = stmt->aggregate || stmt->is_aggregate[i];
+    }
+    if (stmt->aggregate && stmt->join_table[0]) {
+        printf("Aggregates and GROUP BY are not supported with JOIN\n");
+        return -1;
+    }
+    
+    stmt->output_count = stmt->item_count;
+    if (sql_resolve_order(db, stmt, stmt->aggregate, stmt->order_keys) != 0) return -1;
+    stmt->resolved = 1;
+    return 0;
+}
+
+// Plans a resolved SELECT or DELETE. Plans are built for each execution,
+// as they hold the statement's constants and transaction.
+static operator_t* sql_plan(database_t *db, sql_statement_t *stmt, transaction_id_t txn_id) {
+    operator_t *plan;
+    if (stmt->join_table[0]) {
+        plan = sql_plan_join(db, stmt, txn_id);
+    } else if (stmt->aggregate) {
+        plan = sql_plan_aggregate(db, stmt, txn_id);
+    } else {
+        return plan_select_sorted(db, stmt->table_name, stmt->item_count > 0 ? stmt->items : NULL,
+                                  stmt->item_count, stmt->output_count, &stmt->where, stmt->order_keys,
+                                  stmt->order_count, stmt->limit, stmt->offset, txn_id);
+    }
+    if (!plan) return NULL;
+    return plan_sort(plan, stmt->order_keys, stmt->order_count, stmt->limit, stmt->offset, stmt->output_count);
+}
+
+// Prints the plan chosen for the statement. EXPLAIN ANALYZE first runs it
+// to the end, discarding the rows, and adds what each operator did.
+static int sql_explain(database_t *db, sql_statement_t *stmt, transaction_id_t txn_id) {
+    operator_t *plan = sql_plan(db, stmt, txn_id);
+    if (!plan) return -1;
+    
+    int result = 0;
+    if (stmt->explain_analyze) {
+        exec_analyze(plan);
+        result = exec_open(plan);
+        batch_t *batch;
+        while (result == 0 && (result = exec_next(plan, &batch)) > 0) {
+            result = 0;
+        }
+        exec_close(plan);
+    }
+    if (result == 0) exec_explain(plan, stmt->explain_analyze);
+    
+    exec_destroy(plan);
+    return result;
+}
+
+// Runs the plan and passes each batch to the result sink as the executor
+// produces it
+static int sql_select(database_t *db, sql_statement_t *stmt, transaction_id_t txn_id) {
+    if (stmt->explain) return sql_explain(db, stmt, txn_id);
+    
+    operator_t *plan = sql_plan(db, stmt, txn_id);
+    if (!plan) return -1;
+    
+    result_sink_t sink;
+    int result = result_sink_open(&sink, db, db->result_file, db->result_format, plan);
+    if (result == 0) result = exec_open(plan);
+    batch_t *batch;
+    while (result == 0 && (result = exec_next(plan, &batch)) > 0) {
+        result = result_sink_write(&sink, batch);
+    }
+    if (result == 0) result = result_sink_finish(&sink);
+    
+    result_sink_close(&sink);
+    exec_destroy(plan);
+    return result;
+}
+
+// Collects the primary keys of the matching rows first and deletes them
+// once the scan is finished, so the scan never sees its own deletions.
+// Returns -2 if the statement failed after deleting some of the rows.
+static int sql_delete(database_t *db, sql_statement_t *stmt, transaction_id_t txn_id) {
+    table_schema_t *schema = stmt->schema;
+    int key_column = -1;
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_primary_key) key_column = i;
+    }
+    if (key_column < 0) {
+        printf("DELETE requires a primary key\n");
+        return -1;
+    }
+    
+    operator_t *plan = sql_plan(db, stmt, txn_id);
+    if (!plan) return -1;
+    
+    value_t *keys = NULL;
+    int key_count = 0;
+    int capacity = 0;
+    int result = exec_open(plan);
+    batch_t *batch;
+    
+    while (result == 0 && (result = exec_next(plan, &batch)) > 0) {
+        result = 0;
+        if (key_count + batch->selected_count > capacity) {
+            capacity = (key_count + batch->selected_count) * 2;
+            value_t *grown = realloc(keys, capacity * sizeof(value_t));
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            keys = grown;
+        }
+        for (int k = 0; k < batch->selected_count; k++) {
+            batch_get_value(batch, key_column, batch->selection[k], &keys[key_count++]);
+        }
+    }
+    exec_destroy(plan);
+    
+    if (result == 0) result = tuple_delete_batch(db, schema, keys, key_count, txn_id);
+    free(keys);
+    return result;
+}
+
+// Computes the new rows by planning the SET values as a query over the
+// table with the WHERE clause, then updates the rows once the scan is
+// finished, so the scan never sees the versions the statement writes.
+// Returns -2 if the statement failed after changing some of the rows.
+static int sql_update(database_t *db, sql_statement_t *stmt, transaction_id_t txn_id) {
+    table_schema_t *schema = stmt->schema;
+    int width = schema->column_count;
+    int key_column = -1;
+    for (int i = 0; i < width; i++) {
+        if (schema->columns[i].is_primary_key) key_column = i;
+    }
+    if (key_column < 0) {
+        printf("UPDATE requires a primary key\n");
+        return -1;
+    }
+    
+    // The new value of each column, then the old key
+    scalar_expr_t items[MAX_COLUMNS + 1];
+    for (int i = 0; i <= width; i++) {
+        scalar_init(&items[i]);
+        items[i].root = scalar_add_column(&items[i], i < width ? i : key_column);
+    }
+    for (int k = 0; k < stmt->item_count; k++) {
+        if (stmt->set_strings[k] < 0) items[stmt->set_columns[k]] = stmt->items[k];
+    }
+    
+    operator_t *plan = plan_select_sorted(db, stmt->table_name, items, width + 1, width + 1, &stmt->where,
+                                          NULL, 0, -1, 0, txn_id);
+    if (!plan) return -1;
+    
+    value_t *rows = NULL;
+    int row_count = 0;
+    int capacity = 0;
+    int result = exec_open(plan);
+    batch_t *batch;
+    
+    while (result == 0 && (result = exec_next(plan, &batch)) > 0) {
+        result = 0;
+        if (row_count + batch->selected_count > capacity) {
+            capacity = (row_count + batch->selected_count) * 2;
+            value_t *grown = realloc(rows, (size_t)capacity * (width + 1) * sizeof(value_t));
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            rows = grown;
+        }
+        for (int k = 0; k < batch->selected_count; k++) {
+            value_t *row = &rows[(size_t)row_count++ * (width + 1)];
+            for (int i = 0; i <= width; i++) {
+                batch_get_value(batch, i, batch->selection[k], &row[i]);
+            }
+        }
+    }
+    exec_destroy(plan);
+    
+    tuple_t *tuples = NULL;
+    value_t *keys = NULL;
+    if (result == 0 && row_count > 0) {
+        tuples = malloc(row_count * sizeof(tuple_t));
+        keys = malloc(row_count * sizeof(value_t));
+        if (!tuples || !keys) result = -1;
+    }
+    for (int r = 0; result == 0 && r < row_count; r++) {
+        tuple_t *tuple = &tuples[r];
+        tuple->column_count = width;
+        memcpy(tuple->values, &rows[(size_t)r * (width + 1)], width * sizeof(value_t));
+        for (int k = 0; k < stmt->item_count; k++) {
+            if (stmt->set_strings[k] >= 0) tuple->values[stmt->set_columns[k]] = stmt->values[stmt->set_strings[k]];
+        }
+        keys[r] = rows[(size_t)r * (width + 1) + width];
+    }
+    if (result == 0) result = tuple_update_batch(db, schema, keys, tuples, row_count, txn_id);
+    
+    free(tuples);
+    free(keys);
+    free(rows);
+    return result;
+}
+
+// A statement that failed after changing some rows ends its transaction,
+// so the partial change can never be committed
+static int sql_finish_write(database_t *db, int result, transaction_id_t *current_txn) {
+    if (result != -2) return result;
+    
+    printf("Statement failed partway, transaction rolled back\n");
+    txn_abort(db, *current_txn);
+    *current_txn = 0;
+    return -1;
+}
+
+static int sql_execute_statement(database_t *db, sql_statement_t *stmt, transaction_id_t *current_txn) {
+    switch (stmt->command) {
+        case SQL_CREATE_TABLE:
+            return table_create_with_storage(db, stmt->table_name, stmt->columns, stmt->column_count,
+                                             stmt->storage_type);
+            
+        case SQL_INSERT: {
             if (*current_txn == 0) {
                 printf("No active transaction\n");
                 return -1;
             }
-            tuple_t *results;
-            int count;
-            value_t *key = stmt.has_where ? &stmt.where_key : NULL;
-            int result = tuple_select(db, stmt.table_name, key, &results, &count, *current_txn);
+            if (sql_resolve(db, stmt) != 0) return -1;
             
-            if (result == 0 && count > 0) {
-                for (int i = 0; i < results->column_count; i++) {
-                    switch (results->values[i].type) {
-                        case DATA_TYPE_INT:
-                            printf("%d\t", results->values[i].data.int_val);
-                            break;
-                        case DATA_TYPE_VARCHAR:
-                            printf("%s\t", results->values[i].data.str_val);
-                            break;
-                        case DATA_TYPE_FLOAT:
-                            printf("%.2f\t", results->values[i].data.float_val);
-                            break;
-                    }
-                }
-                printf("\n");
+            int width = stmt->schema->column_count;
+            if (stmt->row_count == 1) {
+                tuple_t tuple;
+                tuple.column_count = width;
+                memcpy(tuple.values, stmt->values, width * sizeof(value_t));
+                return tuple_insert_into(db, stmt->schema, &tuple, *current_txn);
             }
+            
+            tuple_t *tuples = malloc(stmt->row_count * sizeof(tuple_t));
+            if (!tuples) return -1;
+            for (int r = 0; r < stmt->row_count; r++) {
+                tuples[r].column_count = width;
+                memcpy(tuples[r].values, &stmt->values[r * width], width * sizeof(value_t));
+            }
+            int result = tuple_insert_batch_into(db, stmt->schema, tuples, stmt->row_count, *current_txn);
+            free(tuples);
             return result;
         }
         
+        case SQL_SELECT: {
+            if (*current_txn == 0) {
+                printf("No active transaction\n");
+                return -1;
+            }
+            if (sql_resolve(db, stmt) != 0) return -1;
+            return sql_select(db, stmt, *current_txn);
+        }
+        
         case SQL_DELETE: {
             if (*current_txn == 0) {
                 printf("No active transaction\n");
                 return -1;
             }
-            if (!stmt.has_where) {
+            if (!stmt->has_where) {
                 printf("DELETE requires WHERE clause\n");
                 return -1;
             }
-            return tuple_delete(db, stmt.table_name, &stmt.where_key, *current_txn);
+            if (sql_resolve(db, stmt) != 0) return -1;
+            return sql_finish_write(db, sql_delete(db, stmt, *current_txn), current_txn);
+        }
+        
+        case SQL_UPDATE: {
+            if (*current_txn == 0) {
+                printf("No active transaction\n");
+                return -1;
+            }
+            if (sql_resolve(db, stmt) != 0) return -1;
+            return sql_finish_write(db, sql_update(db, stmt, *current_txn), current_txn);
         }
         
         case SQL_BEGIN:
@@ -398,8 +1430,590 @@ int sql_execute(database_t *db, const char *sql_string, transaction_id_t *curren
             *current_txn = 0;
             return rollback_result;
             
+        case SQL_VACUUM: {
+            vacuum_stats_t stats;
+            if (stmt->table_name[0] == '\0') {
+                return vacuum_all(db, &stats);
+            }
+            return vacuum_table(db, stmt->table_name, &stats);
+        }
+            
+        case SQL_ANALYZE: {
+            // Outside a transaction the rows are read in one of its own
+            transaction_id_t txn_id = *current_txn != 0 ? *current_txn : txn_begin(db);
+            if (txn_id == 0) return -1;
+            
+            int result = stmt->table_name[0] == '\0' ? stats_analyze_all(db, txn_id)
+                                                     : stats_analyze(db, stmt->table_name, txn_id);
+            if (*current_txn == 0) txn_commit(db, txn_id);
+            return result;
+        }
+            
+        case SQL_SET:
+            if (stmt->set_output) {
+                db_set_result_output(db, db->result_file, stmt->output_format);
+                return 0;
+            }
+            db_set_max_parallelism(db, stmt->parallelism);
+            printf("max_parallelism = %d\n", db->max_parallelism);
+            return 0;
+            
+        case SQL_COPY: {
+            if (*current_txn == 0) {
+                printf("No active transaction\n");
+                return -1;
+            }
+            long long rows;
+            int result;
+            if (stmt->copy_to) {
+                result = copy_to_file(db, stmt->table_name, stmt->copy_path, stmt->copy_format,
+                                      stmt->copy_header, *current_txn, &rows);
+            } else {
+                result = copy_from_file(db, stmt->table_name, stmt->copy_path, stmt->copy_format,
+                                        stmt->copy_header, *current_txn, &rows);
+            }
+            if (result == 0) printf("COPY %lld\n", rows);
+            return result;
+        }
+            
         default:
             printf("Unknown command\n");
             return -1;
     }
-}
\ No newline at end of file
+}
+
+static void sql_statement_free(sql_statement_t *stmt) {
+    for (int i = 0; i < stmt->value_count; i++) {
+        free(stmt->long_strings[i]);
+    }
+    free(stmt->long_strings);
+    free(stmt->values);
+    stmt->long_strings = NULL;
+    stmt->values = NULL;
+    stmt->value_count = 0;
+    stmt->value_capacity = 0;
+}
+
+struct sql_prepared_s {
+    database_t *db;
+    sql_statement_t parsed;            // As parsed, with the names unresolved
+    sql_statement_t stmt;              // Copy that runs, resolved on first use and holding the bound values;
+                                       // INSERT values stay in the array of parsed
+    int schema_version;                // db->schema_version when stmt was copied, -1 before
+    value_t values[MAX_EXPR_NODES];    // Value bound to each parameter
+    uint8_t bound[MAX_EXPR_NODES];
+    char *texts[MAX_EXPR_NODES];       // Copies behind bound strings too long for str_val
+};
+
+// Starts again from the parsed statement if tables were created or dropped
+// since stmt was resolved, as the schemas it points at may have moved
+static void sql_prepared_refresh(sql_prepared_t *prepared) {
+    if (prepared->schema_version == prepared->db->schema_version) return;
+    prepared->stmt = prepared->parsed;
+    prepared->schema_version = prepared->db->schema_version;
+}
+
+// Parses the statement and resolves its names, which must refer to
+// existing tables. Returns NULL on error.
+sql_prepared_t* sql_prepare(database_t *db, const char *sql_string) {
+    sql_prepared_t *prepared = calloc(1, sizeof(sql_prepared_t));
+    if (!prepared) return NULL;
+    prepared->db = db;
+    prepared->schema_version = -1;
+    
+    if (!sql_parse(sql_string, &prepared->parsed)) {
+        printf("SQL parse error\n");
+        sql_finalize(prepared);
+        return NULL;
+    }
+    
+    int result = 0;
+    pthread_mutex_lock(&db->statement_mutex);
+    sql_prepared_refresh(prepared);
+    if (prepared->stmt.command == SQL_INSERT || prepared->stmt.command == SQL_SELECT ||
+        prepared->stmt.command == SQL_DELETE || prepared->stmt.command == SQL_UPDATE) {
+        result = sql_resolve(db, &prepared->stmt);
+    }
+    pthread_mutex_unlock(&db->statement_mutex);
+    
+    if (result != 0) {
+        sql_finalize(prepared);
+        return NULL;
+    }
+    return prepared;
+}
+
+int sql_parameter_count(const sql_prepared_t *prepared) {
+    return prepared->parsed.param_count;
+}
+
+// Clears parameter `index` for a new value and returns its slot
+static value_t* sql_bind_slot(sql_prepared_t *prepared, int index) {
+    if (index < 1 || index > prepared->parsed.param_count) {
+        printf("No parameter %d\n", index);
+        return NULL;
+    }
+    
+    int i = index - 1;
+    free(prepared->texts[i]);
+    prepared->texts[i] = NULL;
+    memset(&prepared->values[i], 0, sizeof(value_t));
+    prepared->bound[i] = 1;
+    return &prepared->values[i];
+}
+
+int sql_bind_int(sql_prepared_t *prepared, int index, int value) {
+    value_t *slot = sql_bind_slot(prepared, index);
+    if (!slot) return -1;
+    slot->type = DATA_TYPE_INT;
+    slot->data.int_val = value;
+    return 0;
+}
+
+int sql_bind_float(sql_prepared_t *prepared, int index, float value) {
+    value_t *slot = sql_bind_slot(prepared, index);
+    if (!slot) return -1;
+    slot->type = DATA_TYPE_FLOAT;
+    slot->data.float_val = value;
+    return 0;
+}
+
+// Binds `length` bytes of text. Strings too long for str_val are copied
+// to the heap and can only be bound to INSERT values.
+static int sql_bind_string(sql_prepared_t *prepared, int index, const char *text, size_t length) {
+    if (length > MAX_VARCHAR_SIZE) {
+        printf("String too long\n");
+        return -1;
+    }
+    
+    value_t *slot = sql_bind_slot(prepared, index);
+    if (!slot) return -1;
+    slot->type = DATA_TYPE_VARCHAR;
+    
+    if (length < MAX_VALUE_SIZE) {
+        memcpy(slot->data.str_val, text, length);
+        slot->data.str_val[length] = '\0';
+        return 0;
+    }
+    
+    char *copy = malloc(length + 1);
+    if (!copy) {
+        prepared->bound[index - 1] = 0;
+        return -1;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    prepared->texts[index - 1] = copy;
+    slot->is_external = 1;
+    slot->data.ext.page_id = 0;
+    slot->data.ext.length = length;
+    slot->data.ext.data = copy;
+    return 0;
+}
+
+int sql_bind_text(sql_prepared_t *prepared, int index, const char *text) {
+    return sql_bind_string(prepared, index, text, strlen(text));
+}
+
+int sql_bind_null(sql_prepared_t *prepared, int index) {
+    value_t *slot = sql_bind_slot(prepared, index);
+    if (!slot) return -1;
+    slot->is_null = 1;
+    return 0;
+}
+
+// Puts the bound values in the places of their parameters
+static int sql_prepared_apply(sql_prepared_t *prepared) {
+    sql_statement_t *stmt = &prepared->stmt;
+    
+    for (int i = 0; i < stmt->param_count; i++) {
+        if (!prepared->bound[i]) {
+            printf("Parameter %d is not bound\n", i + 1);
+            return -1;
+        }
+        
+        if (stmt->command == SQL_INSERT) {
+            stmt->values[stmt->params[i]] = prepared->values[i];
+            continue;
+        }
+        if (prepared->values[i].is_external) {
+            printf("Parameter %d is too long for a comparison\n", i + 1);
+            return -1;
+        }
+        stmt->where.nodes[stmt->params[i]].predicate.constant = prepared->values[i];
+    }
+    return 0;
+}
+
+// Runs a prepared statement, with the statement mutex held
+static int sql_prepared_run(sql_prepared_t *prepared, transaction_id_t *current_txn) {
+    sql_prepared_refresh(prepared);
+    int result = sql_prepared_apply(prepared);
+    if (result == 0) result = sql_execute_statement(prepared->db, &prepared->stmt, current_txn);
+    
+    // A statement that failed to resolve may have been resolved in part
+    if (result != 0 && !prepared->stmt.resolved) prepared->stmt = prepared->parsed;
+    return result;
+}
+
+// Runs the statement with the values bound so far. They stay bound, so
+// only those that change need binding again.
+int sql_execute_prepared(sql_prepared_t *prepared, transaction_id_t *current_txn) {
+    database_t *db = prepared->db;
+    
+    pthread_mutex_lock(&db->statement_mutex);
+    int result = sql_prepared_run(prepared, current_txn);
+    pthread_mutex_unlock(&db->statement_mutex);
+    
+    return result;
+}
+
+// Unbinds every parameter
+void sql_reset(sql_prepared_t *prepared) {
+    for (int i = 0; i < MAX_EXPR_NODES; i++) {
+        free(prepared->texts[i]);
+        prepared->texts[i] = NULL;
+        prepared->bound[i] = 0;
+    }
+}
+
+void sql_finalize(sql_prepared_t *prepared) {
+    if (!prepared) return;
+    sql_reset(prepared);
+    sql_statement_free(&prepared->parsed);
+    free(prepared);
+}
+
+// --- Statement cache --------------------------------------------------------
+//
+// Statements sent as text are looked up by their text with the literals
+// taken out, so "SELECT * FROM t WHERE id = 1" and "... id = 2" share one
+// prepared statement and only the first of them is parsed. Texts that do
+// not parse with ? in place of their literals are remembered as such and
+// always take the plain path.
+
+#define SQL_CACHE_KEY_SIZE 1024
+
+typedef struct {
+    char *key;                 // NULL if the entry is free
+    uint64_t hash;
+    sql_prepared_t *prepared;  // NULL for texts that cannot be prepared
+    uint64_t last_used;
+} sql_cache_entry_t;
+
+struct sql_cache_s {
+    sql_cache_entry_t entries[SQL_CACHE_SIZE];
+    uint64_t clock;
+    int schema_version;        // db->schema_version the entries were made with
+    sql_cache_stats_t stats;
+};
+
+// A literal taken out of a statement: the characters of a string, or an
+// integer with its sign
+typedef struct {
+    const char *start;
+    size_t length;
+    int is_string;
+} sql_literal_t;
+
+// Key characters that run together with their neighbours: words and
+// numbers, or the characters of an operator like <=
+static int sql_key_word(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '?';
+}
+
+static int sql_key_operator(char c) {
+    return c && strchr("<>=!", c) != NULL;
+}
+
+// Appends a token to the key. A single space goes before it only where it
+// would otherwise join the last token: between two words or numbers, and
+// between operator characters that were written apart.
+static int sql_key_append(char *key, size_t *length, const char *token, size_t size, int spaced) {
+    int space = 0;
+    if (*length > 0) {
+        char last = key[*length - 1];
+        space = (sql_key_word(last) && sql_key_word(token[0])) ||
+                (spaced && sql_key_operator(last) && sql_key_operator(token[0]));
+    }
+    if (*length + space + size >= SQL_CACHE_KEY_SIZE) return -1;
+    
+    if (space) key[(*length)++] = ' ';
+    memcpy(key + *length, token, size);
+    *length += size;
+    return 0;
+}
+
+// Returns the FROM that ends a select list, or the end of the text
+static const char* sql_select_list_end(const char *p) {
+    while (*p) {
+        if (*p == '\'') {
+            const char *end = strchr(p + 1, '\'');
+            if (!end) break;
+            p = end + 1;
+        } else if (isalnum((unsigned char)*p) || *p == '_') {
+            const char *start = p;
+            while (isalnum((unsigned char)*p) || *p == '_') p++;
+            if (p - start == 4 && strncasecmp(start, "FROM", 4) == 0) return start;
+        } else {
+            p++;
+        }
+    }
+    return p + strlen(p);
+}
+
+// Copies the statement into key with each string or integer literal
+// replaced by ?, recording the literals in order. Spacing is reduced to
+// what keeps the tokens apart, so "id=1" and "id = 1" share a key. The
+// select list is copied as it is written, as computed columns are named
+// after their text, and so are LIMIT and OFFSET counts, which cannot be
+// parameters. Returns the number of literals, or -1 if the statement is
+// not cached: it is too long, has too many literals, a string that would
+// not fit in a WHERE constant or a ? of its own.
+static int sql_normalize(const char *sql, char *key, sql_literal_t *literals) {
+    size_t length = 0;
+    int count = 0;
+    int keep_number = 0;
+    int spaced = 0;
+    
+    const char *p = sql;
+    skip_whitespace(&p);
+    while (*p) {
+        if (isspace((unsigned char)*p)) {
+            skip_whitespace(&p);
+            spaced = 1;
+            continue;
+        }
+        
+        const char *start = p;
+        if (isalpha((unsigned char)*p) || *p == '_') {
+            int first = length == 0;
+            while (isalnum((unsigned char)*p) || *p == '_') p++;
+            size_t word = p - start;
+            if (sql_key_append(key, &length, start, word, spaced) != 0) return -1;
+            keep_number = (word == 5 && strncasecmp(start, "LIMIT", 5) == 0) ||
+                          (word == 6 && strncasecmp(start, "OFFSET", 6) == 0);
+            spaced = 0;
+            
+            if (first && word == 6 && strncasecmp(start, "SELECT", 6) == 0) {
+                skip_whitespace(&p);
+                const char *end = sql_select_list_end(p);
+                size_t size = end - p;
+                while (size > 0 && isspace((unsigned char)p[size - 1])) size--;
+                if (memchr(p, '?', size)) return -1;
+                if (size > 0 && sql_key_append(key, &length, p, size, 1) != 0) return -1;
+                p = end;
+            }
+            continue;
+        }
+        
+        int is_number = isdigit((unsigned char)*p) || (*p == '-' && isdigit((unsigned char)p[1]));
+        if (is_number && keep_number) {
+            p++;
+            while (isdigit((unsigned char)*p)) p++;
+            if (sql_key_append(key, &length, start, p - start, spaced) != 0) return -1;
+            keep_number = 0;
+            spaced = 0;
+            continue;
+        }
+        keep_number = 0;
+        
+        if (*p == '?') return -1;
+        if (!is_number && *p != '\'') {
+            if (sql_key_append(key, &length, p++, 1, spaced) != 0) return -1;
+            spaced = 0;
+            continue;
+        }
+        
+        if (count == MAX_EXPR_NODES) return -1;
+        sql_literal_t *literal = &literals[count++];
+        literal->is_string = *p == '\'';
+        if (literal->is_string) {
+            literal->start = p + 1;
+            const char *end = strchr(p + 1, '\'');
+            literal->length = end ? (size_t)(end - literal->start) : strlen(literal->start);
+            if (literal->length >= MAX_VALUE_SIZE) return -1;
+            p = literal->start + literal->length + (end ? 1 : 0);
+        } else {
+            p++;
+            while (isdigit((unsigned char)*p)) p++;
+            literal->start = start;
+            literal->length = p - start;
+        }
+        if (sql_key_append(key, &length, "?", 1, spaced) != 0) return -1;
+        spaced = 0;
+    }
+    
+    key[length] = '\0';
+    return count;
+}
+
+static uint64_t sql_cache_hash(const char *key) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (*key) {
+        h = (h ^ (uint8_t)*key++) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void sql_cache_release(sql_cache_entry_t *entry) {
+    sql_finalize(entry->prepared);
+    free(entry->key);
+    memset(entry, 0, sizeof(sql_cache_entry_t));
+}
+
+// Creating or dropping a table invalidates every entry. Tables change
+// outside the cache, so it catches up before it is used or reported on.
+static void sql_cache_validate(database_t *db, struct sql_cache_s *cache) {
+    if (cache->schema_version == db->schema_version) return;
+    
+    for (int i = 0; i < SQL_CACHE_SIZE; i++) {
+        if (!cache->entries[i].key) continue;
+        sql_cache_release(&cache->entries[i]);
+        cache->stats.invalidations++;
+    }
+    cache->stats.entries = 0;
+    cache->schema_version = db->schema_version;
+}
+
+// Returns the cached statement for the key, preparing it on a miss. NULL
+// if the text cannot be prepared with literal_count parameters, in which
+// case it has to be parsed as it is.
+static sql_prepared_t* sql_cache_lookup(database_t *db, const char *key, int literal_count) {
+    struct sql_cache_s *cache = db->statement_cache;
+    if (!cache) {
+        cache = calloc(1, sizeof(struct sql_cache_s));
+        if (!cache) return NULL;
+        cache->schema_version = db->schema_version;
+        db->statement_cache = cache;
+    }
+    sql_cache_validate(db, cache);
+    
+    uint64_t hash = sql_cache_hash(key);
+    cache->clock++;
+    
+    sql_cache_entry_t *victim = &cache->entries[0];
+    for (int i = 0; i < SQL_CACHE_SIZE; i++) {
+        sql_cache_entry_t *entry = &cache->entries[i];
+        if (entry->key && entry->hash == hash && strcmp(entry->key, key) == 0) {
+            entry->last_used = cache->clock;
+            if (entry->prepared) {
+                cache->stats.hits++;
+            } else {
+                cache->stats.misses++;
+            }
+            return entry->prepared;
+        }
+        if (victim->key && (!entry->key || entry->last_used < victim->last_used)) victim = entry;
+    }
+    
+    cache->stats.misses++;
+    sql_prepared_t *prepared = calloc(1, sizeof(sql_prepared_t));
+    char *copy = strdup(key);
+    if (!prepared || !copy) {
+        free(prepared);
+        free(copy);
+        return NULL;
+    }
+    prepared->db = db;
+    prepared->schema_version = -1;
+    if (!sql_parse(key, &prepared->parsed) || prepared->parsed.param_count != literal_count) {
+        sql_finalize(prepared);
+        prepared = NULL;
+    }
+    
+    if (victim->key) {
+        sql_cache_release(victim);
+        cache->stats.evictions++;
+    } else {
+        cache->stats.entries++;
+    }
+    victim->key = copy;
+    victim->hash = hash;
+    victim->prepared = prepared;
+    victim->last_used = cache->clock;
+    return prepared;
+}
+
+static int sql_bind_literal(sql_prepared_t *prepared, int index, const sql_literal_t *literal) {
+    if (literal->is_string) return sql_bind_string(prepared, index, literal->start, literal->length);
+    
+    const char *p = literal->start;
+    int value;
+    parse_integer(&p, &value);
+    return sql_bind_int(prepared, index, value);
+}
+
+// Runs an INSERT, SELECT or DELETE through the statement cache. Returns -1
+// without running it if it has to take the plain path, 0 with its result
+// in *result otherwise.
+static int sql_cache_execute(database_t *db, const char *sql_string, transaction_id_t *current_txn, int *result) {
+    const char *ptr = sql_string;
+    if (!match_keyword(&ptr, "INSERT") && !match_keyword(&ptr, "SELECT") && !match_keyword(&ptr, "DELETE")) {
+        return -1;
+    }
+    
+    char key[SQL_CACHE_KEY_SIZE];
+    sql_literal_t literals[MAX_EXPR_NODES];
+    int literal_count = sql_normalize(sql_string, key, literals);
+    if (literal_count < 0) return -1;
+    
+    pthread_mutex_lock(&db->statement_mutex);
+    sql_prepared_t *prepared = sql_cache_lookup(db, key, literal_count);
+    int usable = prepared != NULL;
+    for (int i = 0; usable && i < literal_count; i++) {
+        usable = sql_bind_literal(prepared, i + 1, &literals[i]) == 0;
+    }
+    if (usable) *result = sql_prepared_run(prepared, current_txn);
+    pthread_mutex_unlock(&db->statement_mutex);
+    
+    return usable ? 0 : -1;
+}
+
+void sql_cache_get_stats(database_t *db, sql_cache_stats_t *stats) {
+    pthread_mutex_lock(&db->statement_mutex);
+    if (db->statement_cache) {
+        sql_cache_validate(db, db->statement_cache);
+        *stats = db->statement_cache->stats;
+    } else {
+        memset(stats, 0, sizeof(sql_cache_stats_t));
+    }
+    pthread_mutex_unlock(&db->statement_mutex);
+}
+
+void sql_cache_destroy(database_t *db) {
+    struct sql_cache_s *cache = db->statement_cache;
+    if (!cache) return;
+    
+    for (int i = 0; i < SQL_CACHE_SIZE; i++) {
+        if (cache->entries[i].key) sql_cache_release(&cache->entries[i]);
+    }
+    free(cache);
+    db->statement_cache = NULL;
+}
+
+int sql_execute(database_t *db, const char *sql_string, transaction_id_t *current_txn) {
+    int result;
+    if (sql_cache_execute(db, sql_string, current_txn, &result) == 0) return result;
+    
+    sql_statement_t stmt;
+    if (!sql_parse(sql_string, &stmt)) {
+        printf("SQL parse error\n");
+        sql_statement_free(&stmt);
+        return -1;
+    }
+    if (stmt.param_count > 0) {
+        printf("Parameters can only be used in prepared statements\n");
+        sql_statement_free(&stmt);
+        return -1;
+    }
+    
+    // Statements run one at a time with respect to background maintenance
+    // such as the autovacuum worker.
+    pthread_mutex_lock(&db->statement_mutex);
+    result = sql_execute_statement(db, &stmt, current_txn);
+    pthread_mutex_unlock(&db->statement_mutex);
+    
+    sql_statement_free(&stmt);
+    return result;
+}
@@ -0,0 +1,347 @@
+#include "tinydb.h"
+
+// Table statistics for the planner. ANALYZE reads every row of a table
+// visible to its transaction and stores what it finds in a page of the
+// table's own (schema->stats_page_id), written again by each ANALYZE:
+//
+//   table:  rows, data pages, and how closely the storage order follows
+//           the primary key
+//   column: NULL count, distinct count and, for INT and FLOAT, the range
+//           and an equi-depth histogram of STATS_BUCKETS buckets
+//
+// Statistics are not updated by later writes; the planner uses them as
+// they were when ANALYZE last ran.
+
+// Selectivities assumed where no statistics say otherwise
+#define STATS_DEFAULT_RANGE (1.0 / 3.0)
+
+typedef struct {
+    double *numbers;          // Non-NULL values of INT and FLOAT columns
+    uint64_t *hashes;         // Hashes of the non-NULL VARCHAR values
+    long long count;
+    long long capacity;
+} stats_column_t;
+
+static int compare_numbers(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_hashes(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t stats_hash(const char *text) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (*text) {
+        h = (h ^ (uint8_t)*text++) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Number that sorts like the key: its value, or for a VARCHAR its first
+// six bytes, which a double holds exactly
+static double stats_key_number(const value_t *key) {
+    if (key->type == DATA_TYPE_INT) return key->data.int_val;
+    if (key->type == DATA_TYPE_FLOAT) return key->data.float_val;
+    
+    double number = 0.0;
+    int ended = 0;
+    for (int i = 0; i < 6; i++) {
+        if (!ended && key->data.str_val[i] == '\0') ended = 1;
+        number = number * 256.0 + (ended ? 0 : (uint8_t)key->data.str_val[i]);
+    }
+    return number;
+}
+
+typedef struct {
+    double key;
+    long long position;       // Row number in storage order
+} stats_key_t;
+
+static int compare_keys(const void *a, const void *b) {
+    const stats_key_t *x = a;
+    const stats_key_t *y = b;
+    if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+// Rank correlation of storage order with key order: 1 when the rows are
+// stored by key, 0 when scattered and -1 when stored in reverse
+static double stats_key_correlation(stats_key_t *keys, long long n) {
+    if (n < 2) return 1.0;
+    
+    qsort(keys, n, sizeof(stats_key_t), compare_keys);
+    double squares = 0.0;
+    for (long long rank = 0; rank < n; rank++) {
+        double d = (double)(rank - keys[rank].position);
+        squares += d * d;
+    }
+    return 1.0 - 6.0 * squares / ((double)n * ((double)n * n - 1.0));
+}
+
+static int stats_add(database_t *db, stats_column_t *column, const value_t *value) {
+    if (column->count == column->capacity) {
+        long long capacity = column->capacity ? 2 * column->capacity : 1024;
+        if (value->type == DATA_TYPE_VARCHAR) {
+            uint64_t *grown = realloc(column->hashes, capacity * sizeof(uint64_t));
+            if (!grown) return -1;
+            column->hashes = grown;
+        } else {
+            double *grown = realloc(column->numbers, capacity * sizeof(double));
+            if (!grown) return -1;
+            column->numbers = grown;
+        }
+        column->capacity = capacity;
+    }
+    
+    if (value->type == DATA_TYPE_INT) {
+        column->numbers[column->count++] = value->data.int_val;
+    } else if (value->type == DATA_TYPE_FLOAT) {
+        column->numbers[column->count++] = value->data.float_val;
+    } else if (value->is_external) {
+        char *text = overflow_read(db, value);
+        if (!text) return -1;
+        column->hashes[column->count++] = stats_hash(text);
+        free(text);
+    } else {
+        column->hashes[column->count++] = stats_hash(value->data.str_val);
+    }
+    return 0;
+}
+
+// Sorts the values of a column and summarizes them
+static void stats_summarize(stats_column_t *column, data_type_t type, column_stats_t *out) {
+    long long n = column->count;
+    if (n == 0) return;
+    
+    if (type == DATA_TYPE_VARCHAR) {
+        qsort(column->hashes, n, sizeof(uint64_t), compare_hashes);
+        out->distinct_count = 1;
+        for (long long i = 1; i < n; i++) {
+            if (column->hashes[i] != column->hashes[i - 1]) out->distinct_count++;
+        }
+        return;
+    }
+    
+    double *v = column->numbers;
+    qsort(v, n, sizeof(double), compare_numbers);
+    out->distinct_count = 1;
+    for (long long i = 1; i < n; i++) {
+        if (v[i] != v[i - 1]) out->distinct_count++;
+    }
+    
+    out->has_range = 1;
+    out->min = v[0];
+    out->max = v[n - 1];
+    out->bucket_count = n < STATS_BUCKETS ? (int)n : STATS_BUCKETS;
+    for (int b = 0; b <= out->bucket_count; b++) {
+        out->bounds[b] = v[(long long)b * (n - 1) / out->bucket_count];
+    }
+}
+
+static int stats_store(database_t *db, table_schema_t *schema, const table_stats_t *stats) {
+    page_t *page = schema->stats_page_id == 0 ? storage_allocate_page(db)
+                                              : buffer_get_page(db->buffer_pool, schema->stats_page_id);
+    if (!page) return -1;
+    schema->stats_page_id = page->page_id;
+    
+    pthread_mutex_lock(&page->page_mutex);
+    memset(page->data, 0, PAGE_SIZE);
+    memcpy(page->data, stats, sizeof(table_stats_t));
+    page->is_dirty = 1;
+    pthread_mutex_unlock(&page->page_mutex);
+    
+    storage_write_page(db, page->page_id, page->data);
+    buffer_release_page(db->buffer_pool, page);
+    return 0;
+}
+
+// Gathers the statistics of the table from the rows visible to txn_id
+// and stores them, replacing those of an earlier ANALYZE
+int stats_analyze(database_t *db, const char *table_name, transaction_id_t txn_id) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) {
+        printf("Unknown table %s\n", table_name);
+        return -1;
+    }
+    
+    table_cursor_t *cursor = malloc(sizeof(table_cursor_t));
+    table_stats_t *stats = calloc(1, sizeof(table_stats_t));
+    stats_column_t columns[MAX_COLUMNS];
+    memset(columns, 0, sizeof(columns));
+    if (!cursor || !stats) {
+        free(cursor);
+        free(stats);
+        return -1;
+    }
+    
+    int key_column = -1;
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_primary_key) key_column = i;
+    }
+    
+    stats_key_t *keys = NULL;
+    long long key_capacity = 0;
+    
+    int result = table_scan_open(db, table_name, txn_id, cursor);
+    if (result == 0) {
+        tuple_t tuple;
+        page_id_t page_id = 0;
+        int next;
+        
+        while ((next = table_scan_next(cursor, &tuple)) > 0) {
+            if (cursor->page_id != page_id) {
+                page_id = cursor->page_id;
+                stats->page_count++;
+            }
+            
+            for (int i = 0; i < schema->column_count; i++) {
+                if (tuple.values[i].is_null) {
+                    stats->columns[i].null_count++;
+                } else if (stats_add(db, &columns[i], &tuple.values[i]) != 0) {
+                    next = -1;
+                    break;
+                }
+            }
+            if (next < 0) break;
+            
+            if (key_column >= 0) {
+                if (stats->row_count == key_capacity) {
+                    key_capacity = key_capacity ? 2 * key_capacity : 1024;
+                    stats_key_t *grown = realloc(keys, key_capacity * sizeof(stats_key_t));
+                    if (!grown) {
+                        next = -1;
+                        break;
+                    }
+                    keys = grown;
+                }
+                keys[stats->row_count].key = stats_key_number(&tuple.values[key_column]);
+                keys[stats->row_count].position = stats->row_count;
+            }
+            stats->row_count++;
+        }
+        table_scan_close(cursor);
+        result = next < 0 ? -1 : 0;
+        
+        stats->key_correlation = key_column >= 0 ? stats_key_correlation(keys, stats->row_count) : 0.0;
+    }
+    free(keys);
+    
+    for (int i = 0; i < schema->column_count; i++) {
+        if (result == 0) stats_summarize(&columns[i], schema->columns[i].type, &stats->columns[i]);
+        free(columns[i].numbers);
+        free(columns[i].hashes);
+    }
+    if (result == 0) result = stats_store(db, schema, stats);
+    
+    free(stats);
+    free(cursor);
+    return result;
+}
+
+int stats_analyze_all(database_t *db, transaction_id_t txn_id) {
+    for (int i = 0; i < db->schema_count; i++) {
+        if (stats_analyze(db, db->schemas[i].name, txn_id) != 0) return -1;
+    }
+    return 0;
+}
+
+// Reads the statistics of the table. Returns 1 with them, 0 if the table
+// has not been analyzed and -1 on error.
+int stats_load(database_t *db, const table_schema_t *schema, table_stats_t *stats) {
+    if (schema->stats_page_id == 0) return 0;
+    
+    page_t *page = buffer_get_page(db->buffer_pool, schema->stats_page_id);
+    if (!page) return -1;
+    memcpy(stats, page->data, sizeof(table_stats_t));
+    buffer_release_page(db->buffer_pool, page);
+    return 1;
+}
+
+// Fraction of the non-NULL values of a column below x, read from the
+// histogram by assuming values spread evenly within each bucket
+static double stats_fraction_below(const column_stats_t *column, double x) {
+    if (x <= column->min) return 0.0;
+    if (x > column->max) return 1.0;
+    
+    int b = 0;
+    while (b < column->bucket_count - 1 && x > column->bounds[b + 1]) b++;
+    double low = column->bounds[b];
+    double high = column->bounds[b + 1];
+    double within = high > low ? (x - low) / (high - low) : 0.5;
+    return (b + within) / column->bucket_count;
+}
+
+static int stats_number(const value_t *value, double *number) {
+    if (value->is_null || value->type == DATA_TYPE_VARCHAR) return 0;
+    *number = value->type == DATA_TYPE_INT ? value->data.int_val : value->data.float_val;
+    return 1;
+}
+
+static double stats_equal_fraction(const column_stats_t *column, const value_t *constant) {
+    double x;
+    if (column->has_range && stats_number(constant, &x) && (x < column->min || x > column->max)) return 0.0;
+    return column->distinct_count > 0 ? 1.0 / column->distinct_count : 0.0;
+}
+
+// Estimated fraction of the rows for which `column op constant` holds
+double stats_selectivity(const table_stats_t *stats, int column, compare_op_t op, const value_t *constant) {
+    if (constant->is_null) return 0.0;
+    if (stats->row_count == 0) return 1.0;
+    
+    const column_stats_t *col = &stats->columns[column];
+    double non_null = (double)(stats->row_count - col->null_count) / stats->row_count;
+    double equal = stats_equal_fraction(col, constant);
+    
+    double x;
+    if (op == CMP_EQ) return non_null * equal;
+    if (op == CMP_NE) return non_null * (1.0 - equal);
+    if (!col->has_range || !stats_number(constant, &x)) return non_null * STATS_DEFAULT_RANGE;
+    
+    double below = stats_fraction_below(col, x);
+    double fraction;
+    switch (op) {
+        case CMP_LT: fraction = below; break;
+        case CMP_LE: fraction = below + equal; break;
+        case CMP_GT: fraction = 1.0 - below - equal; break;
+        default:     fraction = 1.0 - below; break;
+    }
+    if (fraction < 0.0) fraction = 0.0;
+    if (fraction > 1.0) fraction = 1.0;
+    return non_null * fraction;
+}
+
+// Estimated fraction of the rows whose column is within the bounds
+double stats_bounds_selectivity(const table_stats_t *stats, int column, const key_bounds_t *bounds) {
+    if (!bounds->has_low && !bounds->has_high) return 1.0;
+    if (!bounds->has_high) {
+        return stats_selectivity(stats, column, bounds->low_inclusive ? CMP_GE : CMP_GT, &bounds->low);
+    }
+    if (!bounds->has_low) {
+        return stats_selectivity(stats, column, bounds->high_inclusive ? CMP_LE : CMP_LT, &bounds->high);
+    }
+    
+    double low, high;
+    int numbers = stats_number(&bounds->low, &low) && stats_number(&bounds->high, &high);
+    int equal = numbers ? low == high
+                        : strcmp(bounds->low.data.str_val, bounds->high.data.str_val) == 0;
+    if (equal && bounds->low_inclusive && bounds->high_inclusive) {
+        return stats_selectivity(stats, column, CMP_EQ, &bounds->low);
+    }
+    if (!numbers || !stats->columns[column].has_range) {
+        return stats_selectivity(stats, column, CMP_GE, &bounds->low);
+    }
+    
+    // Rows at or above the low bound plus rows at or below the high bound
+    // count the rows between them twice and every other non-NULL row once
+    const column_stats_t *col = &stats->columns[column];
+    double non_null = stats->row_count > 0 ? (double)(stats->row_count - col->null_count) / stats->row_count : 1.0;
+    double fraction = stats_selectivity(stats, column, bounds->low_inclusive ? CMP_GE : CMP_GT, &bounds->low) +
+                      stats_selectivity(stats, column, bounds->high_inclusive ? CMP_LE : CMP_LT, &bounds->high) -
+                      non_null;
+    return fraction > 0.0 ? fraction : 0.0;
+}
@@ -60,11 +60,49 @@ static int find_victim_page(buffer_pool_t *pool) {
     return -1;
 }
 
+// Each thread counts its own buffer pool and disk activity
+static pthread_key_t io_stats_key;
+static pthread_once_t io_stats_once = PTHREAD_ONCE_INIT;
+
+static void io_stats_key_create(void) {
+    pthread_key_create(&io_stats_key, free);
+}
+
+// Counters of the calling thread, NULL if they cannot be allocated, in
+// which case nothing is counted
+static io_stats_t* io_stats_local(void) {
+    pthread_once(&io_stats_once, io_stats_key_create);
+    io_stats_t *stats = pthread_getspecific(io_stats_key);
+    if (!stats) {
+        stats = calloc(1, sizeof(io_stats_t));
+        if (stats && pthread_setspecific(io_stats_key, stats) != 0) {
+            free(stats);
+            stats = NULL;
+        }
+    }
+    return stats;
+}
+
+// Copies the totals of the calling thread since it started. Callers take
+// the difference of two readings.
+void io_stats_get(io_stats_t *stats) {
+    io_stats_t *local = io_stats_local();
+    if (local) {
+        *stats = *local;
+    } else {
+        memset(stats, 0, sizeof(io_stats_t));
+    }
+}
+
 page_t* buffer_get_page(buffer_pool_t *pool, page_id_t page_id) {
+    io_stats_t *io = io_stats_local();
+    if (io) io->pages_pinned++;
+    
     pthread_mutex_lock(&pool->buffer_mutex);
     
     for (int i = 0; i < pool->capacity; i++) {
         if (pool->pages[i].page_id == page_id && pool->pages[i].pin_count >= 0) {
+            if (io) io->buffer_hits++;
             pthread_mutex_lock(&pool->pages[i].page_mutex);
             pool->pages[i].pin_count++;
             printf("buffer_get_page: Found page %llu at index %d, new pin_count: %d\n", 
@@ -76,6 +114,7 @@ page_t* buffer_get_page(buffer_pool_t *pool, page_id_t page_id) {
     }
     
     printf("buffer_get_page: Page %llu not found in buffer pool, need to load\n", page_id);
+    if (io) io->buffer_misses++;
     
     int victim_idx = find_victim_page(pool);
     if (victim_idx == -1) {
@@ -120,13 +159,6 @@ page_t* buffer_get_page(buffer_pool_t *pool, page_id_t page_id) {
         memset(victim_page->data, 0, PAGE_SIZE);
     }
     
-    // Debug: check what was loaded for all pages
-    btree_node_t *node = (btree_node_t*)victim_page->data;
-    printf("buffer_get_page: Loaded page %llu, key_count: %d\n", page_id, node->key_count);
-    for (int i = 0; i < node->key_count; i++) {
-        printf("buffer_get_page: Loaded key[%d] = %d\n", i, node->keys[i].data.int_val);
-    }
-    
     printf("buffer_get_page: Loaded page %llu into buffer slot %d\n", page_id, victim_idx);
     
     pthread_mutex_unlock(&victim_page->page_mutex);
@@ -135,8 +167,11 @@ page_t* buffer_get_page(buffer_pool_t *pool, page_id_t page_id) {
     return victim_page;
 }
 
+// Pin counts change under the pool mutex as well, so the victim search,
+// which holds only that one, sees them consistently when scans on other
+// threads release pages
 void buffer_release_page(buffer_pool_t *pool, page_t *page) {
-    (void)pool; // Suppress unused parameter warning
+    pthread_mutex_lock(&pool->buffer_mutex);
     pthread_mutex_lock(&page->page_mutex);
     if (page->pin_count > 0) {
         page->pin_count--;
@@ -144,6 +179,7 @@ void buffer_release_page(buffer_pool_t *pool, page_t *page) {
                page->page_id, page->pin_count);
     }
     pthread_mutex_unlock(&page->page_mutex);
+    pthread_mutex_unlock(&pool->buffer_mutex);
 }
 
 void buffer_flush_page(buffer_pool_t *pool, page_t *page) {
@@ -157,28 +193,36 @@ void buffer_flush_page(buffer_pool_t *pool, page_t *page) {
     printf("buffer_flush_page: Using stored db pointer: %p, data_file: %p\n", (void*)db, (void*)(db ? db->data_file : NULL));
     
     if (db && db->data_file) {
-        // Debug: check what's being flushed
-        if (page->page_id == 1) {
-            btree_node_t *node = (btree_node_t*)page->data;
-            printf("buffer_flush_page: Flushing page %llu, key_count: %d\n", page->page_id, node->key_count);
-            for (int i = 0; i < node->key_count; i++) {
-                printf("buffer_flush_page: Key[%d] = %d\n", i, node->keys[i].data.int_val);
-            }
-        }
         storage_write_page(db, page->page_id, page->data);
     }
     
     page->is_dirty = 0;
 }
 
-static page_id_t allocate_new_page_id(database_t *db) {
-    // Get the current next_page_id from metadata and increment it
+static page_id_t allocate_new_page_id(database_t *db, int *recycled) {
+    // Reuse a page released by VACUUM if there is one, otherwise take the
+    // current next_page_id from metadata and increment it
     page_t *metadata_page = buffer_get_page(db->buffer_pool, METADATA_PAGE_ID);
     if (!metadata_page) return 0;
     
     metadata_t *metadata = (metadata_t*)metadata_page->data;
-    page_id_t current_id = metadata->next_page_id;
-    metadata->next_page_id++;
+    page_id_t current_id;
+    
+    *recycled = 0;
+    if (metadata->free_page_id != 0) {
+        current_id = metadata->free_page_id;
+        page_t *free_page = buffer_get_page(db->buffer_pool, current_id);
+        if (!free_page) {
+            buffer_release_page(db->buffer_pool, metadata_page);
+            return 0;
+        }
+        metadata->free_page_id = ((heap_page_header_t*)free_page->data)->next_page_id;
+        buffer_release_page(db->buffer_pool, free_page);
+        *recycled = 1;
+    } else {
+        current_id = metadata->next_page_id;
+        metadata->next_page_id++;
+    }
     
     pthread_mutex_lock(&metadata_page->page_mutex);
     metadata_page->is_dirty = 1;
@@ -189,16 +233,50 @@ static page_id_t allocate_new_page_id(database_t *db) {
 }
 
 page_t* storage_allocate_page(database_t *db) {
-    page_id_t new_page_id = allocate_new_page_id(db);
+    int recycled;
+    page_id_t new_page_id = allocate_new_page_id(db, &recycled);
+    if (new_page_id == 0) return NULL;
+    
     page_t *page = buffer_get_page(db->buffer_pool, new_page_id);
     if (page) {
         pthread_mutex_lock(&page->page_mutex);
+        if (recycled) {
+            memset(page->data, 0, PAGE_SIZE);
+        }
         page->is_dirty = 1;
         pthread_mutex_unlock(&page->page_mutex);
     }
     return page;
 }
 
+void storage_free_page(database_t *db, page_id_t page_id) {
+    page_t *metadata_page = buffer_get_page(db->buffer_pool, METADATA_PAGE_ID);
+    if (!metadata_page) return;
+    
+    page_t *page = buffer_get_page(db->buffer_pool, page_id);
+    if (!page) {
+        buffer_release_page(db->buffer_pool, metadata_page);
+        return;
+    }
+    
+    metadata_t *metadata = (metadata_t*)metadata_page->data;
+    
+    pthread_mutex_lock(&page->page_mutex);
+    memset(page->data, 0, PAGE_SIZE);
+    ((heap_page_header_t*)page->data)->next_page_id = metadata->free_page_id;
+    page->is_dirty = 1;
+    pthread_mutex_unlock(&page->page_mutex);
+    
+    metadata->free_page_id = page_id;
+    
+    pthread_mutex_lock(&metadata_page->page_mutex);
+    metadata_page->is_dirty = 1;
+    pthread_mutex_unlock(&metadata_page->page_mutex);
+    
+    buffer_release_page(db->buffer_pool, page);
+    buffer_release_page(db->buffer_pool, metadata_page);
+}
+
 int storage_read_page(database_t *db, page_id_t page_id, char *buffer) {
     printf("storage_read_page: ENTRY - Reading page %llu\n", page_id);
     fflush(stdout);
@@ -216,22 +294,18 @@ int storage_read_page(database_t *db, page_id_t page_id, char *buffer) {
     // Debug: print call stack to see who's calling us
     printf("storage_read_page: CALL STACK - this should not happen for pages already in buffer!\n");
     
+    // Held across the seek so a page written by another thread cannot move the position
+    flockfile(db->data_file);
     fseek(db->data_file, position, SEEK_SET);
     size_t bytes_read = fread(buffer, 1, PAGE_SIZE, db->data_file);
+    funlockfile(db->data_file);
+    
+    io_stats_t *io = io_stats_local();
+    if (io) io->bytes_read += bytes_read;
     
     printf("storage_read_page: Attempted to read %d bytes from page %llu, actually read %zu bytes\n", 
            PAGE_SIZE, page_id, bytes_read);
     
-    // Debug: check what was actually read for B-tree pages
-    if (bytes_read > 0 && page_id != METADATA_PAGE_ID) {
-        btree_node_t *node = (btree_node_t*)buffer;
-        printf("storage_read_page: Read page %llu, is_leaf=%d, key_count: %d\n", 
-               page_id, node->is_leaf, node->key_count);
-        for (int i = 0; i < node->key_count; i++) {
-            printf("storage_read_page: Key[%d] = %d\n", i, node->keys[i].data.int_val);
-        }
-    }
-    
     return (bytes_read == PAGE_SIZE) ? 0 : -1;
 }
 
@@ -242,18 +316,14 @@ int storage_write_page(database_t *db, page_id_t page_id, const char *buffer) {
     printf("storage_write_page: Writing page %llu at position %ld (file offset: %ld)\n", 
            page_id, position, ftell(db->data_file));
     
+    flockfile(db->data_file);
     fseek(db->data_file, position, SEEK_SET);
     size_t bytes_written = fwrite(buffer, 1, PAGE_SIZE, db->data_file);
     fflush(db->data_file);
+    funlockfile(db->data_file);
     
-    // Debug: check what was actually written for B-tree pages (skip metadata page)
-    if (page_id != METADATA_PAGE_ID) {
-        btree_node_t *node = (btree_node_t*)buffer;
-        printf("storage_write_page: Wrote page %llu, key_count: %d\n", page_id, node->key_count);
-        for (int i = 0; i < node->key_count; i++) {
-            printf("storage_write_page: Key[%d] = %d\n", i, node->keys[i].data.int_val);
-        }
-    }
+    io_stats_t *io = io_stats_local();
+    if (io) io->bytes_written += bytes_written;
     
     printf("storage_write_page: Wrote %zu bytes for page %llu\n", bytes_written, page_id);
     return (bytes_written == PAGE_SIZE) ? 0 : -1;
@@ -295,7 +365,7 @@ database_t* db_create(const char *filename) {
         return NULL;
     }
     
-    db->max_schemas = 9;
+    db->max_schemas = MAX_TABLES;
     db->schemas = malloc(sizeof(table_schema_t) * db->max_schemas);
     if (!db->schemas) {
         buffer_pool_destroy(db->buffer_pool);
@@ -306,6 +376,15 @@ database_t* db_create(const char *filename) {
     }
     
     db->schema_count = 0;
+    db->txn_manager = NULL; // Created by db_load_metadata or the first txn_begin
+    db->vacuum_worker = NULL;
+    db->dictionaries = NULL;
+    db->max_parallelism = 1;
+    db->schema_version = 0;
+    db->statement_cache = NULL;
+    db->result_file = stdout;
+    db->result_format = RESULT_FORMAT_TEXT;
+    pthread_mutex_init(&db->statement_mutex, NULL);
     
     printf("db_create: Database created successfully, db pointer: %p, data_file: %p\n", (void*)db, (void*)db->data_file);
     
@@ -315,7 +394,13 @@ database_t* db_create(const char *filename) {
 void db_close(database_t *db) {
     if (!db) return;
     
+    vacuum_stop_worker(db);
+    sql_cache_destroy(db);
+    
     buffer_pool_destroy(db->buffer_pool);
+    txn_manager_destroy(db->txn_manager);
+    dictionary_release_all(db);
+    pthread_mutex_destroy(&db->statement_mutex);
     
     if (db->data_file) {
         fclose(db->data_file);
@@ -324,4 +409,20 @@ void db_close(database_t *db) {
     free(db->schemas);
     free(db->filename);
     free(db);
-}
\ No newline at end of file
+}
+
+// Sets how many worker threads a scan may use. 0 selects one per online
+// core; the count is capped at MAX_PARALLELISM.
+void db_set_max_parallelism(database_t *db, int workers) {
+    if (workers <= 0) workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > MAX_PARALLELISM) workers = MAX_PARALLELISM;
+    db->max_parallelism = workers;
+}
+
+// Sends the results of later SELECT statements to `file` in the given
+// format. NULL selects stdout. Messages and errors still go to stdout.
+void db_set_result_output(database_t *db, FILE *file, result_format_t format) {
+    db->result_file = file ? file : stdout;
+    db->result_format = format;
+}
@@ -1,6 +1,6 @@
 #include "tinydb.h"
 
-static table_schema_t* find_table_schema(database_t *db, const char *table_name) {
+table_schema_t* find_table_schema(database_t *db, const char *table_name) {
     for (int i = 0; i < db->schema_count; i++) {
         if (strcmp(db->schemas[i].name, table_name) == 0) {
             return &db->schemas[i];
@@ -10,6 +10,11 @@ static table_schema_t* find_table_schema(database_t *db, const char *table_name)
 }
 
 int table_create(database_t *db, const char *table_name, column_def_t *columns, int column_count) {
+    return table_create_with_storage(db, table_name, columns, column_count, STORAGE_ROW);
+}
+
+int table_create_with_storage(database_t *db, const char *table_name, column_def_t *columns,
+                              int column_count, storage_type_t storage_type) {
     if (db->schema_count >= db->max_schemas) {
         return -1;
     }
@@ -18,15 +23,52 @@ int table_create(database_t *db, const char *table_name, column_def_t *columns,
         return -1;
     }
     
+    int has_dictionary = 0;
+    for (int i = 0; i < column_count; i++) {
+        if (columns[i].type == DATA_TYPE_VARCHAR &&
+            (columns[i].size <= 0 || columns[i].size > MAX_VARCHAR_SIZE)) {
+            printf("VARCHAR size of column %s must be between 1 and %d\n", columns[i].name, MAX_VARCHAR_SIZE);
+            return -1;
+        }
+        if (columns[i].is_dictionary &&
+            (columns[i].type != DATA_TYPE_VARCHAR || columns[i].is_primary_key ||
+             columns[i].size > MAX_VALUE_SIZE - 1)) {
+            printf("Column %s cannot be dictionary encoded\n", columns[i].name);
+            return -1;
+        }
+        if (columns[i].is_dictionary) has_dictionary = 1;
+    }
+    
+    if (storage_type == STORAGE_INDEX) {
+        int has_primary_key = 0;
+        for (int i = 0; i < column_count; i++) {
+            if (columns[i].is_primary_key) has_primary_key = 1;
+        }
+        if (!has_primary_key) {
+            printf("Index-organized tables need a primary key\n");
+            return -1;
+        }
+    }
+    
     table_schema_t *schema = &db->schemas[db->schema_count];
     strncpy(schema->name, table_name, MAX_TABLE_NAME - 1);
     schema->name[MAX_TABLE_NAME - 1] = '\0';
     schema->column_count = column_count;
+    schema->storage_type = storage_type;
+    schema->first_page_id = 0;
+    schema->last_page_id = 0;
+    schema->dictionary_page_id = 0;
+    schema->stats_page_id = 0;
     
     for (int i = 0; i < column_count && i < MAX_COLUMNS; i++) {
         schema->columns[i] = columns[i];
     }
     
+    if (has_dictionary) {
+        schema->dictionary_page_id = dictionary_create(db);
+        if (schema->dictionary_page_id == 0) return -1;
+    }
+    
     page_t *root_page = storage_allocate_page(db);
     if (!root_page) {
         return -1;
@@ -36,7 +78,7 @@ int table_create(database_t *db, const char *table_name, column_def_t *columns,
     memset(root_page->data, 0, PAGE_SIZE);
     
     btree_node_t *root_node = (btree_node_t*)root_page->data;
-    root_node->is_leaf = 1;
+    root_node->is_leaf = (storage_type == STORAGE_INDEX) ? BTREE_ROW_LEAF : BTREE_LEAF;
     root_node->key_count = 0;
     
     pthread_mutex_lock(&root_page->page_mutex);
@@ -50,6 +92,7 @@ int table_create(database_t *db, const char *table_name, column_def_t *columns,
     buffer_release_page(db->buffer_pool, root_page);
     
     db->schema_count++;
+    db->schema_version++;
     return 0;
 }
 
@@ -60,6 +103,7 @@ int table_drop(database_t *db, const char *table_name) {
                 db->schemas[j] = db->schemas[j + 1];
             }
             db->schema_count--;
+            db->schema_version++;
             return 0;
         }
     }
@@ -75,106 +119,721 @@ static value_t* extract_primary_key(table_schema_t *schema, tuple_t *tuple) {
     return NULL;
 }
 
-static int store_tuple_in_page(database_t *db, page_id_t page_id, tuple_t *tuple, slot_id_t *slot) {
-    page_t *page = buffer_get_page(db->buffer_pool, page_id);
-    if (!page) return -1;
+// Row records are variable length so short values only take the space they
+// need:
+//
+//   [tuple_header_t][null bitmap][value]...
+//
+// INT and FLOAT values take 4 bytes. A VARCHAR takes a length byte followed
+// by its characters, or HEAP_EXTERNAL_MARKER followed by the page id and
+// length of its overflow chain. Dictionary columns store their 2-byte code.
+// NULL columns take no space.
+#define HEAP_EXTERNAL_MARKER 0xFF
+#define HEAP_MAX_RECORD_SIZE (sizeof(tuple_header_t) + 1 + MAX_COLUMNS * (1 + MAX_VALUE_SIZE))
+
+static heap_slot_t* heap_page_slots(char *page_data) {
+    return (heap_slot_t*)(page_data + sizeof(heap_page_header_t));
+}
+
+static int heap_page_free_space(const heap_page_header_t *header) {
+    int slots_end = sizeof(heap_page_header_t) + (header->tuple_count + 1) * sizeof(heap_slot_t);
+    return header->free_offset - slots_end;
+}
+
+static int heap_encode_record(database_t *db, table_schema_t *schema, const tuple_t *tuple,
+                              char *record) {
+    char *out = record;
+    uint8_t nulls = 0;
     
-    char *page_data = page->data;
-    int *tuple_count = (int*)page_data;
+    memcpy(out, &tuple->header, sizeof(tuple_header_t));
+    out += sizeof(tuple_header_t);
+    for (int i = 0; i < schema->column_count; i++) {
+        if (tuple->values[i].is_null) nulls |= 1 << i;
+    }
+    *out++ = nulls;
     
-    if (*tuple_count >= (int)((PAGE_SIZE - sizeof(int)) / sizeof(tuple_t))) {
-        buffer_release_page(db->buffer_pool, page);
-        return -1;
+    for (int i = 0; i < schema->column_count; i++) {
+        const value_t *val = &tuple->values[i];
+        if (val->is_null) continue;
+        
+        switch (schema->columns[i].type) {
+            case DATA_TYPE_INT:
+                memcpy(out, &val->data.int_val, sizeof(int));
+                out += sizeof(int);
+                break;
+            case DATA_TYPE_FLOAT:
+                memcpy(out, &val->data.float_val, sizeof(float));
+                out += sizeof(float);
+                break;
+            case DATA_TYPE_VARCHAR:
+                if (schema->columns[i].is_dictionary) {
+                    dict_code_t code;
+                    if (dictionary_encode(db, schema, i, val->data.str_val, &code) != 0) return -1;
+                    memcpy(out, &code, sizeof(dict_code_t));
+                    out += sizeof(dict_code_t);
+                } else if (val->is_external) {
+                    *out++ = (char)HEAP_EXTERNAL_MARKER;
+                    memcpy(out, &val->data.ext.page_id, sizeof(page_id_t));
+                    out += sizeof(page_id_t);
+                    memcpy(out, &val->data.ext.length, sizeof(uint32_t));
+                    out += sizeof(uint32_t);
+                } else {
+                    uint8_t length = (uint8_t)strnlen(val->data.str_val, MAX_VALUE_SIZE - 1);
+                    *out++ = length;
+                    memcpy(out, val->data.str_val, length);
+                    out += length;
+                }
+                break;
+        }
+    }
+    
+    return out - record;
+}
+
+// Decodes the value of column `col` starting at `in` and returns its size
+// in the record.
+static int heap_decode_value(database_t *db, table_schema_t *schema, int col, const char *in, value_t *val) {
+    switch (val->type) {
+        case DATA_TYPE_INT:
+            memcpy(&val->data.int_val, in, sizeof(int));
+            return sizeof(int);
+        case DATA_TYPE_FLOAT:
+            memcpy(&val->data.float_val, in, sizeof(float));
+            return sizeof(float);
+        case DATA_TYPE_VARCHAR: {
+            if (schema->columns[col].is_dictionary) {
+                dict_code_t code;
+                memcpy(&code, in, sizeof(dict_code_t));
+                dictionary_t *dict = dictionary_get(db, schema, col);
+                const char *text = dict ? dictionary_value(dict, code) : NULL;
+                if (text) strcpy(val->data.str_val, text);
+                return sizeof(dict_code_t);
+            }
+            uint8_t length = (uint8_t)*in++;
+            if (length == HEAP_EXTERNAL_MARKER) {
+                val->is_external = 1;
+                memcpy(&val->data.ext.page_id, in, sizeof(page_id_t));
+                memcpy(&val->data.ext.length, in + sizeof(page_id_t), sizeof(uint32_t));
+                return 1 + sizeof(page_id_t) + sizeof(uint32_t);
+            }
+            memcpy(val->data.str_val, in, length);
+            return 1 + length;
+        }
     }
+    return 0;
+}
+
+// Size of the value of column `col` starting at `in`, without decoding it
+static int heap_value_size(const table_schema_t *schema, int col, const char *in) {
+    if (schema->columns[col].is_dictionary) return sizeof(dict_code_t);
+    
+    switch (schema->columns[col].type) {
+        case DATA_TYPE_INT:
+            return sizeof(int);
+        case DATA_TYPE_FLOAT:
+            return sizeof(float);
+        case DATA_TYPE_VARCHAR: {
+            uint8_t length = (uint8_t)*in;
+            if (length == HEAP_EXTERNAL_MARKER) return 1 + sizeof(page_id_t) + sizeof(uint32_t);
+            return 1 + length;
+        }
+    }
+    return 0;
+}
+
+static void heap_decode_record(database_t *db, table_schema_t *schema, const char *record,
+                               tuple_t *tuple) {
+    const char *in = record;
     
-    tuple_t *tuples = (tuple_t*)(page_data + sizeof(int));
-    tuples[*tuple_count] = *tuple;
-    *slot = *tuple_count;
-    (*tuple_count)++;
+    memset(tuple, 0, sizeof(tuple_t));
+    memcpy(&tuple->header, in, sizeof(tuple_header_t));
+    in += sizeof(tuple_header_t);
+    uint8_t nulls = (uint8_t)*in++;
+    tuple->column_count = schema->column_count;
     
+    for (int i = 0; i < schema->column_count; i++) {
+        value_t *val = &tuple->values[i];
+        val->type = schema->columns[i].type;
+        val->is_null = (nulls >> i) & 1;
+        if (val->is_null) continue;
+        
+        in += heap_decode_value(db, schema, i, in, val);
+    }
+}
+
+static void mark_page_dirty(page_t *page) {
     pthread_mutex_lock(&page->page_mutex);
     page->is_dirty = 1;
     pthread_mutex_unlock(&page->page_mutex);
+}
+
+// Allocates an empty data page and links it at the end of the table's page
+// chain. The returned page is pinned.
+page_t* table_append_page(database_t *db, table_schema_t *schema, int capacity) {
+    page_t *page = storage_allocate_page(db);
+    if (!page) return NULL;
     
-    storage_write_page(db, page_id, page->data);
+    memset(page->data, 0, PAGE_SIZE);
+    heap_page_header_t *header = (heap_page_header_t*)page->data;
+    header->tuple_count = 0;
+    header->capacity = capacity;
+    header->free_offset = PAGE_SIZE;
+    header->next_page_id = 0;
+    
+    if (schema->last_page_id != 0) {
+        page_t *last_page = buffer_get_page(db->buffer_pool, schema->last_page_id);
+        if (!last_page) {
+            buffer_release_page(db->buffer_pool, page);
+            return NULL;
+        }
+        ((heap_page_header_t*)last_page->data)->next_page_id = page->page_id;
+        mark_page_dirty(last_page);
+        storage_write_page(db, last_page->page_id, last_page->data);
+        buffer_release_page(db->buffer_pool, last_page);
+    } else {
+        schema->first_page_id = page->page_id;
+    }
+    schema->last_page_id = page->page_id;
+    
+    return page;
+}
+
+// Adds a record to a row page that has room for it
+static void heap_page_append(page_t *page, const char *record, int length, page_id_t *page_id, slot_id_t *slot) {
+    heap_page_header_t *header = (heap_page_header_t*)page->data;
+    heap_slot_t *slots = heap_page_slots(page->data);
+    header->free_offset -= length;
+    memcpy(page->data + header->free_offset, record, length);
+    slots[header->tuple_count].offset = header->free_offset;
+    slots[header->tuple_count].length = length;
+    *page_id = page->page_id;
+    *slot = header->tuple_count;
+    header->tuple_count++;
+}
+
+static int store_tuple_in_page(database_t *db, table_schema_t *schema, tuple_t *tuple,
+                               page_id_t *page_id, slot_id_t *slot) {
+    char record[HEAP_MAX_RECORD_SIZE];
+    int length = heap_encode_record(db, schema, tuple, record);
+    if (length < 0) return -1;
+    page_t *page = NULL;
+    
+    if (schema->last_page_id != 0) {
+        page = buffer_get_page(db->buffer_pool, schema->last_page_id);
+        if (!page) return -1;
+        
+        heap_page_header_t *header = (heap_page_header_t*)page->data;
+        if (heap_page_free_space(header) < length) {
+            buffer_release_page(db->buffer_pool, page);
+            page = NULL;
+        }
+    }
+    
+    if (!page) {
+        // Row pages are limited by free space rather than a row count
+        page = table_append_page(db, schema, 0);
+        if (!page) return -1;
+    }
+    
+    heap_page_append(page, record, length, page_id, slot);
+    mark_page_dirty(page);
+    
+    storage_write_page(db, page->page_id, page->data);
     buffer_release_page(db->buffer_pool, page);
     
     return 0;
 }
 
+// Make every value match its column type, widening INT literals into FLOAT
+// columns. Columnar pages store raw column values, so mismatches are errors.
+static int coerce_tuple_to_schema(table_schema_t *schema, tuple_t *tuple) {
+    for (int i = 0; i < schema->column_count; i++) {
+        value_t *val = &tuple->values[i];
+        if (val->is_null) continue;
+        
+        if (val->type != schema->columns[i].type) {
+            if (val->type == DATA_TYPE_INT && schema->columns[i].type == DATA_TYPE_FLOAT) {
+                val->data.float_val = (float)val->data.int_val;
+                val->type = DATA_TYPE_FLOAT;
+            } else {
+                printf("Type mismatch for column %s\n", schema->columns[i].name);
+                return -1;
+            }
+        }
+        
+        if (val->type == DATA_TYPE_VARCHAR) {
+            size_t length = val->is_external ? val->data.ext.length
+                                             : strnlen(val->data.str_val, MAX_VALUE_SIZE);
+            if (length > (size_t)schema->columns[i].size) {
+                printf("Value too long for column %s\n", schema->columns[i].name);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
 int tuple_insert(database_t *db, const char *table_name, tuple_t *tuple, transaction_id_t txn_id) {
     table_schema_t *schema = find_table_schema(db, table_name);
     if (!schema) return -1;
-    
+    return tuple_insert_into(db, schema, tuple, txn_id);
+}
+
+// tuple_insert() for callers that have already looked the table up
+int tuple_insert_into(database_t *db, table_schema_t *schema, tuple_t *tuple, transaction_id_t txn_id) {
     if (tuple->column_count != schema->column_count) return -1;
+    if (coerce_tuple_to_schema(schema, tuple) != 0) return -1;
     
+    memset(&tuple->header, 0, sizeof(tuple_header_t));
     tuple->header.xmin = txn_id;
-    tuple->header.xmax = 0;
-    tuple->header.is_deleted = 0;
     
-    page_t *data_page = storage_allocate_page(db);
-    if (!data_page) return -1;
+    value_t *primary_key = extract_primary_key(schema, tuple);
+    if (primary_key && primary_key->is_external) {
+        printf("Primary key value too long\n");
+        return -1;
+    }
+    
+    // Index-organized tables store the row in the primary-key leaf itself
+    if (schema->storage_type == STORAGE_INDEX) {
+        if (overflow_store_tuple(db, tuple) != 0) return -1;
+        if (btree_row_insert(db, schema, tuple) != 0) {
+            overflow_free_tuple(db, tuple);
+            return -1;
+        }
+        return 0;
+    }
     
+    page_id_t page_id;
     slot_id_t slot;
-    if (store_tuple_in_page(db, data_page->page_id, tuple, &slot) != 0) {
-        buffer_release_page(db->buffer_pool, data_page);
+    
+    // Data pages are shared by many rows, so reject duplicates before the
+    // row lands in a page where scans would see it.
+    if (primary_key && btree_search(db, schema->root_page_id, primary_key, &page_id, &slot) == 0) {
         return -1;
     }
     
-    value_t *primary_key = extract_primary_key(schema, tuple);
+    int result;
+    if (schema->storage_type == STORAGE_COLUMN) {
+        result = columnar_insert(db, schema, tuple, &page_id, &slot);
+    } else {
+        // Long strings move to overflow pages so the row only keeps references
+        if (overflow_store_tuple(db, tuple) != 0) return -1;
+        result = store_tuple_in_page(db, schema, tuple, &page_id, &slot);
+        if (result != 0) overflow_free_tuple(db, tuple);
+    }
+    if (result != 0) return -1;
+    
     if (primary_key) {
-        if (btree_insert(db, schema->root_page_id, primary_key, 
-                        data_page->page_id, slot) != 0) {
-            buffer_release_page(db->buffer_pool, data_page);
+        if (btree_insert(db, schema->root_page_id, primary_key, page_id, slot) != 0) {
             return -1;
         }
     }
     
-    buffer_release_page(db->buffer_pool, data_page);
     return 0;
 }
 
-static tuple_t* load_tuple_from_page(database_t *db, page_id_t page_id, slot_id_t slot) {
-    page_t *page = buffer_get_page(db->buffer_pool, page_id);
-    if (!page) return NULL;
+// Stores the rows in the given order. The page being filled stays pinned
+// and is written once, when the next page is linked after it or the last
+// row is in, instead of once per row.
+static int store_tuples_in_pages(database_t *db, table_schema_t *schema, tuple_t *tuples, const int *order,
+                                 int count, page_id_t *page_ids, slot_id_t *slots) {
+    page_t *page = NULL;
+    if (schema->last_page_id != 0) {
+        page = buffer_get_page(db->buffer_pool, schema->last_page_id);
+        if (!page) return -1;
+    }
+    
+    int result = 0;
+    for (int k = 0; k < count; k++) {
+        char record[HEAP_MAX_RECORD_SIZE];
+        int length = heap_encode_record(db, schema, &tuples[order[k]], record);
+        if (length < 0) {
+            result = -1;
+            break;
+        }
+        
+        if (!page || heap_page_free_space((heap_page_header_t*)page->data) < length) {
+            // Linking the new page writes out the one before it
+            page_t *next = table_append_page(db, schema, 0);
+            if (page) buffer_release_page(db->buffer_pool, page);
+            page = next;
+            if (!page) return -1;
+        }
+        heap_page_append(page, record, length, &page_ids[k], &slots[k]);
+    }
+    
+    if (page) {
+        mark_page_dirty(page);
+        storage_write_page(db, page->page_id, page->data);
+        buffer_release_page(db->buffer_pool, page);
+    }
+    return result;
+}
+
+typedef struct {
+    const value_t *key;
+    int index;
+} batch_key_t;
+
+static int batch_key_compare(const void *a, const void *b) {
+    const batch_key_t *x = a;
+    const batch_key_t *y = b;
+    int cmp = 0;
+    
+    switch (x->key->type) {
+        case DATA_TYPE_INT:
+            cmp = (x->key->data.int_val > y->key->data.int_val) - (x->key->data.int_val < y->key->data.int_val);
+            break;
+        case DATA_TYPE_FLOAT:
+            cmp = (x->key->data.float_val > y->key->data.float_val) -
+                  (x->key->data.float_val < y->key->data.float_val);
+            break;
+        case DATA_TYPE_VARCHAR:
+            cmp = strcmp(x->key->data.str_val, y->key->data.str_val);
+            break;
+    }
+    return cmp != 0 ? cmp : x->index - y->index;
+}
+
+int tuple_insert_batch(database_t *db, const char *table_name, tuple_t *tuples, int count, transaction_id_t txn_id) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) return -1;
+    return tuple_insert_batch_into(db, schema, tuples, count, txn_id);
+}
+
+// Inserts many rows at once. Every row is checked before any is stored,
+// so a type error or a duplicate key, within the batch or with the table,
+// rejects the whole batch. The rows are stored in primary key order: row
+// pages are filled one after the other and each written once, and the
+// index entries go in sorted, leaf by leaf.
+int tuple_insert_batch_into(database_t *db, table_schema_t *schema, tuple_t *tuples, int count,
+                            transaction_id_t txn_id) {
+    if (count <= 0) return 0;
+    
+    int key_column = -1;
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_primary_key) key_column = i;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        tuple_t *tuple = &tuples[i];
+        if (tuple->column_count != schema->column_count) return -1;
+        if (coerce_tuple_to_schema(schema, tuple) != 0) return -1;
+        
+        memset(&tuple->header, 0, sizeof(tuple_header_t));
+        tuple->header.xmin = txn_id;
+        
+        if (key_column >= 0 && tuple->values[key_column].is_external) {
+            printf("Primary key value too long\n");
+            return -1;
+        }
+    }
+    
+    int *order = malloc(count * sizeof(int));
+    batch_key_t *sorted = malloc(count * sizeof(batch_key_t));
+    value_t *keys = malloc(count * sizeof(value_t));
+    page_id_t *page_ids = malloc(count * sizeof(page_id_t));
+    slot_id_t *slots = malloc(count * sizeof(slot_id_t));
+    int result = (order && sorted && keys && page_ids && slots) ? 0 : -1;
+    
+    for (int i = 0; result == 0 && i < count; i++) {
+        sorted[i].key = key_column >= 0 ? &tuples[i].values[key_column] : NULL;
+        sorted[i].index = i;
+    }
+    if (result == 0 && key_column >= 0) {
+        qsort(sorted, count, sizeof(batch_key_t), batch_key_compare);
+        for (int k = 0; k < count; k++) {
+            keys[k] = *sorted[k].key;
+            if (k > 0 && batch_key_compare(&(batch_key_t){ sorted[k - 1].key, 0 },
+                                           &(batch_key_t){ sorted[k].key, 0 }) == 0) {
+                printf("Duplicate primary key in batch\n");
+                result = -1;
+            }
+        }
+    }
+    for (int k = 0; result == 0 && k < count; k++) {
+        order[k] = sorted[k].index;
+    }
+    
+    // Reject keys the table already has before anything is written
+    if (result == 0 && key_column >= 0) {
+        if (schema->storage_type == STORAGE_INDEX) {
+            for (int k = 0; result == 0 && k < count; k++) {
+                tuple_t existing;
+                if (btree_row_search(db, schema, &keys[k], &existing) == 0) result = -1;
+            }
+        } else if (btree_search_sorted(db, schema->root_page_id, keys, count) != count) {
+            result = -1;
+        }
+    }
+    
+    for (int k = 0; result == 0 && k < count; k++) {
+        if (schema->storage_type == STORAGE_COLUMN) break;
+        if (overflow_store_tuple(db, &tuples[order[k]]) != 0) result = -1;
+    }
+    
+    if (result == 0) {
+        if (schema->storage_type == STORAGE_INDEX) {
+            for (int k = 0; result == 0 && k < count; k++) {
+                result = btree_row_insert(db, schema, &tuples[order[k]]);
+            }
+        } else if (schema->storage_type == STORAGE_COLUMN) {
+            for (int k = 0; result == 0 && k < count; k++) {
+                result = columnar_insert(db, schema, &tuples[order[k]], &page_ids[k], &slots[k]);
+            }
+        } else {
+            result = store_tuples_in_pages(db, schema, tuples, order, count, page_ids, slots);
+            for (int i = 0; result != 0 && i < count; i++) {
+                overflow_free_tuple(db, &tuples[i]);
+            }
+        }
+    }
+    
+    if (result == 0 && key_column >= 0 && schema->storage_type != STORAGE_INDEX) {
+        result = btree_insert_sorted(db, schema->root_page_id, keys, page_ids, slots, count);
+    }
+    
+    free(order);
+    free(sorted);
+    free(keys);
+    free(page_ids);
+    free(slots);
+    return result;
+}
+
+// Decodes one row of a row page image. External values stay as overflow
+// references until someone reads them. Returns 1 for a slot VACUUM has
+// emptied.
+int heap_read_tuple(database_t *db, table_schema_t *schema, const char *page_data, int slot, tuple_t *tuple) {
+    const heap_page_header_t *header = (const heap_page_header_t*)page_data;
+    if (slot < 0 || slot >= header->tuple_count) return -1;
+    
+    const heap_slot_t *slots = (const heap_slot_t*)(page_data + sizeof(heap_page_header_t));
+    if (slots[slot].length == 0) return 1;
+    heap_decode_record(db, schema, page_data + slots[slot].offset, tuple);
+    return 0;
+}
+
+// Decodes only the listed columns of one row into values[i]; entries of
+// column_ids that are negative are skipped. The columns in between are
+// stepped over without being decoded. When `codes` is given, dictionary
+// columns are left as their code in codes[i] instead of being looked up.
+// Returns 1 for an empty slot.
+int heap_read_columns(database_t *db, table_schema_t *schema, const char *page_data, int slot,
+                      const int *column_ids, int column_count, tuple_header_t *header, value_t *values,
+                      dict_code_t *codes) {
+    const heap_page_header_t *page_header = (const heap_page_header_t*)page_data;
+    if (slot < 0 || slot >= page_header->tuple_count) return -1;
+    
+    const heap_slot_t *slots = (const heap_slot_t*)(page_data + sizeof(heap_page_header_t));
+    if (slots[slot].length == 0) return 1;
+    const char *in = page_data + slots[slot].offset;
+    const char *starts[MAX_COLUMNS];
+    
+    if (header) memcpy(header, in, sizeof(tuple_header_t));
+    in += sizeof(tuple_header_t);
+    uint8_t nulls = (uint8_t)*in++;
+    
+    int last = -1;
+    for (int i = 0; i < column_count; i++) {
+        if (column_ids[i] > last) last = column_ids[i];
+    }
+    for (int col = 0; col <= last; col++) {
+        starts[col] = in;
+        if (!((nulls >> col) & 1)) in += heap_value_size(schema, col, in);
+    }
     
-    // buffer_get_page already handles loading page data from disk if needed
+    for (int i = 0; i < column_count; i++) {
+        int col = column_ids[i];
+        if (col < 0) continue;
+        
+        value_t *val = &values[i];
+        memset(val, 0, sizeof(value_t));
+        val->type = schema->columns[col].type;
+        val->is_null = (nulls >> col) & 1;
+        if (val->is_null) continue;
+        
+        if (codes && schema->columns[col].is_dictionary) {
+            memcpy(&codes[i], starts[col], sizeof(dict_code_t));
+        } else {
+            heap_decode_value(db, schema, col, starts[col], val);
+        }
+    }
+    return 0;
+}
+
+// Header of the record in `slot`, or -1 if the page has none there
+static int heap_read_header(const char *page_data, int slot, tuple_header_t *header) {
+    const heap_page_header_t *page_header = (const heap_page_header_t*)page_data;
+    const heap_slot_t *slots = (const heap_slot_t*)(page_data + sizeof(heap_page_header_t));
+    if (slot < 0 || slot >= page_header->tuple_count || slots[slot].length == 0) return -1;
+    
+    memcpy(header, page_data + slots[slot].offset, sizeof(tuple_header_t));
+    return 0;
+}
+
+static void heap_write_header(page_t *page, int slot, const tuple_header_t *header) {
+    heap_slot_t *slots = heap_page_slots(page->data);
+    memcpy(page->data + slots[slot].offset, header, sizeof(tuple_header_t));
+}
+
+// Follows the update chain of a row from page_id/slot, where the primary
+// index points, to the version the snapshot sees. Versions written by an UPDATE
+// usually share the page of the version they replace, so the chain is
+// mostly walked on one pinned page. Returns 1 with that version's page
+// pinned in *page and its slot in *version_slot, 0 if the snapshot sees no
+// version and -1 on error.
+int heap_find_version(database_t *db, page_id_t page_id, slot_id_t slot, const snapshot_t *snapshot, page_t **page,
+                      slot_id_t *version_slot) {
+    page_t *current = buffer_get_page(db->buffer_pool, page_id);
+    if (!current) return -1;
+    
+    // A successor must have been written by the transaction that replaced
+    // its predecessor; anything else is a slot VACUUM has emptied
+    transaction_id_t creator = 0;
+    while (1) {
+        tuple_header_t header;
+        if (heap_read_header(current->data, slot, &header) != 0) break;
+        if (creator != 0 && header.xmin != creator) break;
+        
+        if (mvcc_is_visible(&header, snapshot)) {
+            *page = current;
+            *version_slot = slot;
+            return 1;
+        }
+        if (!(header.flags & TUPLE_UPDATED)) break;
+        
+        creator = header.xmax;
+        slot = header.next_slot;
+        if (header.next_page_id != current->page_id) {
+            buffer_release_page(db->buffer_pool, current);
+            current = buffer_get_page(db->buffer_pool, header.next_page_id);
+            if (!current) return -1;
+        }
+    }
+    
+    buffer_release_page(db->buffer_pool, current);
+    return 0;
+}
+
+// Primary-key lookup into the caller's row for index-organized and column
+// tables. For index-organized tables the B-tree descent ends at the row
+// itself; otherwise it yields the column page location to read. Returns -1
+// if there is no row with the key.
+static int lookup_tuple(database_t *db, table_schema_t *schema, const value_t *key, tuple_t *row,
+                        page_id_t *tuple_page_id, slot_id_t *tuple_slot) {
+    if (schema->storage_type == STORAGE_INDEX) {
+        return btree_row_search(db, schema, key, row);
+    }
+    
+    if (btree_search(db, schema->root_page_id, key, tuple_page_id, tuple_slot) != 0) {
+        return -1;
+    }
+    return columnar_load_tuple(db, schema, *tuple_page_id, *tuple_slot, row);
+}
+
+// Reads the listed columns of the row with the key, if txn_id can see it,
+// into row->values[0..column_count), or every column if column_ids is
+// NULL. The row is read into the caller's buffer, so lookups may run on
+// any number of threads at once. On row pages, the columns of the version
+// txn_id sees are decoded straight from the pinned page and the others are
+// not decoded at all. Returns 1 with the row, 0 if there is none and -1 on
+// error.
+int tuple_fetch(database_t *db, table_schema_t *schema, const value_t *key, const int *column_ids,
+                int column_count, tuple_t *row, transaction_id_t txn_id) {
+    if (!column_ids) column_count = schema->column_count;
+    if (column_count < 0 || column_count > MAX_COLUMNS) return -1;
+    row->column_count = column_count;
     
-    char *page_data = page->data;
-    int *tuple_count = (int*)page_data;
+    snapshot_t snapshot;
+    txn_snapshot(db, txn_id, &snapshot);
     
-    if ((int)slot >= *tuple_count) {
+    if (schema->storage_type == STORAGE_ROW) {
+        page_id_t page_id;
+        slot_id_t slot;
+        if (btree_search(db, schema->root_page_id, key, &page_id, &slot) != 0) return 0;
+        
+        page_t *page;
+        int found = heap_find_version(db, page_id, slot, &snapshot, &page, &slot);
+        if (found <= 0) return found;
+        
+        int all[MAX_COLUMNS];
+        for (int i = 0; !column_ids && i < column_count; i++) {
+            all[i] = i;
+        }
+        int result = heap_read_columns(db, schema, page->data, slot, column_ids ? column_ids : all, column_count,
+                                       &row->header, row->values, NULL);
         buffer_release_page(db->buffer_pool, page);
-        return NULL;
+        return result == 0 ? 1 : -1;
     }
     
-    tuple_t *tuples = (tuple_t*)(page_data + sizeof(int));
-    static tuple_t result_tuple;
-    result_tuple = tuples[slot];
+    tuple_t full;
+    page_id_t page_id;
+    slot_id_t slot;
+    if (lookup_tuple(db, schema, key, &full, &page_id, &slot) != 0) return 0;
     
-    buffer_release_page(db->buffer_pool, page);
-    return &result_tuple;
+    row->header = full.header;
+    for (int i = 0; i < column_count; i++) {
+        row->values[i] = full.values[column_ids ? column_ids[i] : i];
+    }
+    return mvcc_is_visible(&row->header, &snapshot) ? 1 : 0;
 }
 
+// Each thread gets its own row for tuple_select() to return
+static pthread_key_t select_row_key;
+static pthread_once_t select_row_once = PTHREAD_ONCE_INIT;
+
+static void select_row_key_create(void) {
+    pthread_key_create(&select_row_key, free);
+}
+
+// Looks up the row with the key. *results points at a row owned by the
+// calling thread, valid until its next tuple_select(); use tuple_fetch()
+// to read into a buffer of your own.
 int tuple_select(database_t *db, const char *table_name, value_t *key, 
                 tuple_t **results, int *count, transaction_id_t txn_id) {
     table_schema_t *schema = find_table_schema(db, table_name);
-    if (!schema) return -1;
+    if (!schema || !key) return -1;
     
     *count = 0;
     
-    page_id_t tuple_page_id;
-    slot_id_t tuple_slot;
-    
-    if (btree_search(db, schema->root_page_id, key, &tuple_page_id, &tuple_slot) == 0) {
-        tuple_t *tuple = load_tuple_from_page(db, tuple_page_id, tuple_slot);
-        if (tuple && mvcc_is_visible(&tuple->header, txn_id, db->txn_manager)) {
-            *results = tuple;
-            *count = 1;
-            return 0;
+    pthread_once(&select_row_once, select_row_key_create);
+    tuple_t *row = pthread_getspecific(select_row_key);
+    if (!row) {
+        row = malloc(sizeof(tuple_t));
+        if (!row || pthread_setspecific(select_row_key, row) != 0) {
+            free(row);
+            return -1;
         }
     }
     
+    int found = tuple_fetch(db, schema, key, NULL, 0, row, txn_id);
+    if (found < 0) return -1;
+    if (found) {
+        *results = row;
+        *count = 1;
+    }
+    return 0;
+}
+
+// Pins the version of the row with the key that txn_id is about to change.
+// A version another transaction has already deleted or replaced stays as
+// it is until that transaction aborts. Returns 0 with the page pinned.
+static int heap_lock_version(database_t *db, table_schema_t *schema, const value_t *key, transaction_id_t txn_id,
+                             page_t **page, slot_id_t *slot, tuple_header_t *header) {
+    snapshot_t snapshot;
+    txn_snapshot(db, txn_id, &snapshot);
+    
+    page_id_t page_id;
+    if (btree_search(db, schema->root_page_id, key, &page_id, slot) != 0) return -1;
+    if (heap_find_version(db, page_id, *slot, &snapshot, page, slot) != 1) return -1;
+    
+    heap_read_header((*page)->data, *slot, header);
+    if (header->xmax != 0 && txn_get_state(db, header->xmax) != TXN_STATE_ABORTED) {
+        printf("Row was changed by a concurrent transaction\n");
+        buffer_release_page(db->buffer_pool, *page);
+        return -1;
+    }
     return 0;
 }
 
@@ -182,30 +841,345 @@ int tuple_delete(database_t *db, const char *table_name, value_t *key, transacti
     table_schema_t *schema = find_table_schema(db, table_name);
     if (!schema) return -1;
     
+    if (schema->storage_type == STORAGE_ROW) {
+        page_t *page;
+        slot_id_t slot;
+        tuple_header_t header;
+        if (heap_lock_version(db, schema, key, txn_id, &page, &slot, &header) != 0) return -1;
+        
+        // The version an aborted update wrote is no longer the row's successor
+        mvcc_mark_deleted(&header, txn_id);
+        header.flags &= ~TUPLE_UPDATED;
+        heap_write_header(page, slot, &header);
+        
+        mark_page_dirty(page);
+        storage_write_page(db, page->page_id, page->data);
+        buffer_release_page(db->buffer_pool, page);
+        return 0;
+    }
+    
     page_id_t tuple_page_id;
     slot_id_t tuple_slot;
+    tuple_t row;
     
-    if (btree_search(db, schema->root_page_id, key, &tuple_page_id, &tuple_slot) == 0) {
-        tuple_t *tuple = load_tuple_from_page(db, tuple_page_id, tuple_slot);
-        if (tuple && mvcc_is_visible(&tuple->header, txn_id, db->txn_manager)) {
-            mvcc_mark_deleted(&tuple->header, txn_id);
-            
-            page_t *page = buffer_get_page(db->buffer_pool, tuple_page_id);
-            if (page) {
-                char *page_data = page->data;
-                tuple_t *tuples = (tuple_t*)(page_data + sizeof(int));
-                tuples[tuple_slot] = *tuple;
-                
-                pthread_mutex_lock(&page->page_mutex);
-                page->is_dirty = 1;
-                pthread_mutex_unlock(&page->page_mutex);
-                
-                storage_write_page(db, tuple_page_id, page->data);
-                buffer_release_page(db->buffer_pool, page);
-            }
-            return 0;
+    snapshot_t snapshot;
+    txn_snapshot(db, txn_id, &snapshot);
+    
+    tuple_t *tuple = lookup_tuple(db, schema, key, &row, &tuple_page_id, &tuple_slot) == 0 ? &row : NULL;
+    if (tuple && mvcc_is_visible(&tuple->header, &snapshot)) {
+        if (schema->storage_type == STORAGE_INDEX) {
+            return btree_row_mark_deleted(db, schema, key, txn_id);
         }
+        return columnar_mark_deleted(db, schema, tuple_page_id, tuple_slot, txn_id);
     }
     
     return -1;
-}
\ No newline at end of file
+}
+
+static int key_equals(const value_t *a, const value_t *b) {
+    switch (a->type) {
+        case DATA_TYPE_INT:
+            return a->data.int_val == b->data.int_val;
+        case DATA_TYPE_FLOAT:
+            return a->data.float_val == b->data.float_val;
+        case DATA_TYPE_VARCHAR:
+            return strcmp(a->data.str_val, b->data.str_val) == 0;
+    }
+    return 0;
+}
+
+// Gives the new version its own copies of the long strings it keeps from
+// the old one, as VACUUM frees the overflow chains of a version with it.
+// copies[i] is the buffer behind value i until the row is stored.
+static int copy_external_values(database_t *db, tuple_t *row, char **copies) {
+    for (int i = 0; i < row->column_count; i++) {
+        value_t *val = &row->values[i];
+        if (val->is_null || !val->is_external || val->data.ext.page_id == 0) continue;
+        
+        copies[i] = overflow_read(db, val);
+        if (!copies[i]) return -1;
+        val->data.ext.page_id = 0;
+        val->data.ext.data = copies[i];
+    }
+    return 0;
+}
+
+// Writes `row` over the version at `slot` of the pinned page if txn_id
+// wrote that version and the page has room, and as its successor otherwise
+static int heap_replace_version(database_t *db, table_schema_t *schema, page_t *page, slot_id_t slot,
+                                tuple_header_t *old, tuple_t *row, transaction_id_t txn_id) {
+    heap_page_header_t *header = (heap_page_header_t*)page->data;
+    heap_slot_t *slots = heap_page_slots(page->data);
+    
+    if (overflow_store_tuple(db, row) != 0) return -1;
+    memset(&row->header, 0, sizeof(tuple_header_t));
+    row->header.xmin = txn_id;
+    row->header.flags = TUPLE_HEAP_ONLY;
+    
+    char record[HEAP_MAX_RECORD_SIZE];
+    int length = heap_encode_record(db, schema, row, record);
+    if (length < 0) {
+        overflow_free_tuple(db, row);
+        return -1;
+    }
+    
+    int in_place = old->xmin == txn_id &&
+                   (length <= slots[slot].length || length <= heap_page_free_space(header) + (int)sizeof(heap_slot_t));
+    if (in_place) {
+        // The index points at the record only if it pointed at the old one
+        row->header.flags = old->flags & TUPLE_HEAP_ONLY;
+        memcpy(record, &row->header, sizeof(tuple_header_t));
+        
+        tuple_t previous;
+        heap_decode_record(db, schema, page->data + slots[slot].offset, &previous);
+        if (length > slots[slot].length) {
+            header->free_offset -= length;
+            slots[slot].offset = header->free_offset;
+        }
+        memcpy(page->data + slots[slot].offset, record, length);
+        slots[slot].length = length;
+        overflow_free_tuple(db, &previous);
+    } else {
+        page_id_t new_page_id;
+        slot_id_t new_slot;
+        if (heap_page_free_space(header) >= length) {
+            heap_page_append(page, record, length, &new_page_id, &new_slot);
+        } else if (store_tuple_in_page(db, schema, row, &new_page_id, &new_slot) != 0) {
+            overflow_free_tuple(db, row);
+            return -1;
+        }
+        
+        old->xmax = txn_id;
+        old->flags |= TUPLE_UPDATED;
+        old->next_page_id = new_page_id;
+        old->next_slot = (uint16_t)new_slot;
+        heap_write_header(page, slot, old);
+    }
+    
+    mark_page_dirty(page);
+    storage_write_page(db, page->page_id, page->data);
+    return 0;
+}
+
+// Checks that txn_id may change the version of the row with the key that
+// it sees, without changing anything
+static int tuple_check_writable(database_t *db, table_schema_t *schema, const value_t *key, transaction_id_t txn_id) {
+    if (schema->storage_type == STORAGE_ROW) {
+        page_t *page;
+        slot_id_t slot;
+        tuple_header_t header;
+        if (heap_lock_version(db, schema, key, txn_id, &page, &slot, &header) != 0) return -1;
+        buffer_release_page(db->buffer_pool, page);
+        return 0;
+    }
+    
+    tuple_t row;
+    return tuple_fetch(db, schema, key, NULL, 0, &row, txn_id) == 1 ? 0 : -1;
+}
+
+// Deletes the rows with the keys. Every row is checked before any is
+// deleted, so a missing row or one changed by a concurrent transaction
+// rejects the whole batch with -1. Returns -2 if deleting failed after
+// some rows were deleted; the caller must then abort the transaction.
+int tuple_delete_batch(database_t *db, table_schema_t *schema, const value_t *keys, int count,
+                       transaction_id_t txn_id) {
+    for (int i = 0; i < count; i++) {
+        if (tuple_check_writable(db, schema, &keys[i], txn_id) != 0) return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (tuple_delete(db, schema->name, (value_t*)&keys[i], txn_id) != 0) return -2;
+    }
+    return 0;
+}
+
+// Replaces the versions of the rows with the keys that txn_id sees by
+// `rows`. A version the transaction wrote itself is overwritten in place:
+// no other transaction can see it, and a rollback discards it anyway. Any
+// other version stays for the snapshots that still see it and is linked to
+// the new one, which goes on the same page when it fits, so the primary
+// index is left alone either way. A new key deletes the row and inserts it
+// under that key. Only row tables can be updated.
+//
+// As with tuple_insert_batch_into(), every row is checked before any is
+// written: a type error, new keys that repeat or are already in the index,
+// and rows changed by a concurrent transaction reject the whole batch with
+// -1. Returns -2 if writing failed after some rows were changed; the
+// caller must then abort the transaction.
+int tuple_update_batch(database_t *db, table_schema_t *schema, const value_t *keys, tuple_t *rows, int count,
+                       transaction_id_t txn_id) {
+    if (schema->storage_type != STORAGE_ROW) {
+        printf("UPDATE is only supported on row tables\n");
+        return -1;
+    }
+    if (count <= 0) return 0;
+    
+    batch_key_t *sorted = malloc(count * sizeof(batch_key_t));
+    int *moved = malloc(count * sizeof(int));
+    char **copies = calloc((size_t)count * MAX_COLUMNS, sizeof(char*));
+    int result = (sorted && moved && copies) ? 0 : -1;
+    int moved_count = 0;
+    
+    for (int i = 0; result == 0 && i < count; i++) {
+        tuple_t *row = &rows[i];
+        value_t *new_key = NULL;
+        if (row->column_count != schema->column_count || coerce_tuple_to_schema(schema, row) != 0 ||
+            !(new_key = extract_primary_key(schema, row))) {
+            result = -1;
+            break;
+        }
+        if (new_key->is_external) {
+            printf("Primary key value too long\n");
+            result = -1;
+            break;
+        }
+        sorted[i].key = new_key;
+        sorted[i].index = i;
+        if (!key_equals(&keys[i], new_key)) moved[moved_count++] = i;
+    }
+    
+    // New keys must be unique among the rows and, where they change, new to the table
+    if (result == 0) {
+        qsort(sorted, count, sizeof(batch_key_t), batch_key_compare);
+        for (int k = 1; result == 0 && k < count; k++) {
+            if (batch_key_compare(&(batch_key_t){ sorted[k - 1].key, 0 }, &(batch_key_t){ sorted[k].key, 0 }) == 0) {
+                printf("Duplicate primary key\n");
+                result = -1;
+            }
+        }
+    }
+    for (int m = 0; result == 0 && m < moved_count; m++) {
+        page_id_t page_id;
+        slot_id_t slot;
+        if (btree_search(db, schema->root_page_id, extract_primary_key(schema, &rows[moved[m]]), &page_id,
+                         &slot) == 0) {
+            printf("Duplicate primary key\n");
+            result = -1;
+        }
+    }
+    
+    for (int i = 0; result == 0 && i < count; i++) {
+        result = tuple_check_writable(db, schema, &keys[i], txn_id);
+    }
+    for (int i = 0; result == 0 && i < count; i++) {
+        result = copy_external_values(db, &rows[i], &copies[(size_t)i * MAX_COLUMNS]);
+    }
+    
+    // Nothing has been written so far
+    for (int i = 0, m = 0; result == 0 && i < count; i++) {
+        if (m < moved_count && moved[m] == i) {
+            m++;
+            if (tuple_delete(db, schema->name, (value_t*)&keys[i], txn_id) != 0) result = -2;
+            continue;
+        }
+        
+        page_t *page;
+        slot_id_t slot;
+        tuple_header_t old;
+        if (heap_lock_version(db, schema, &keys[i], txn_id, &page, &slot, &old) != 0) {
+            result = -2;
+            break;
+        }
+        if (heap_replace_version(db, schema, page, slot, &old, &rows[i], txn_id) != 0) result = -2;
+        buffer_release_page(db->buffer_pool, page);
+    }
+    for (int m = 0; result == 0 && m < moved_count; m++) {
+        if (tuple_insert_into(db, schema, &rows[moved[m]], txn_id) != 0) result = -2;
+    }
+    
+    for (size_t i = 0; copies && i < (size_t)count * MAX_COLUMNS; i++) {
+        free(copies[i]);
+    }
+    free(sorted);
+    free(moved);
+    free(copies);
+    return result;
+}
+
+// Compacts one row page. Dead versions are dropped, together with their
+// overflow chains, and the remaining records are repacked at the end of the
+// page. Slots keep their numbers, as the primary index and update chains
+// point at them: a dropped version leaves an empty slot, and only the empty
+// slots at the end are given back. A row's index entry moves to the oldest
+// version of its update chain that is still needed, and is removed with
+// the row's last version. Returns the number of versions left on the page.
+int heap_vacuum_page(database_t *db, table_schema_t *schema, page_id_t page_id,
+                     vacuum_stats_t *stats) {
+    page_t *page = buffer_get_page(db->buffer_pool, page_id);
+    if (!page) return -1;
+    
+    heap_page_header_t *header = (heap_page_header_t*)page->data;
+    heap_slot_t *slots = heap_page_slots(page->data);
+    int pk = -1;
+    for (int i = 0; i < schema->column_count; i++) {
+        if (schema->columns[i].is_primary_key) pk = i;
+    }
+    
+    char compacted[PAGE_SIZE];
+    memset(compacted, 0, PAGE_SIZE);
+    memcpy(compacted, header, sizeof(heap_page_header_t));
+    heap_page_header_t *new_header = (heap_page_header_t*)compacted;
+    heap_slot_t *new_slots = heap_page_slots(compacted);
+    new_header->free_offset = PAGE_SIZE;
+    
+    int kept = 0;
+    int used = 0;
+    int changed = 0;
+    for (int slot = 0; slot < header->tuple_count; slot++) {
+        if (slots[slot].length == 0) continue;
+        
+        tuple_t tuple;
+        heap_decode_record(db, schema, page->data + slots[slot].offset, &tuple);
+        transaction_id_t xmax = tuple.header.xmax;
+        
+        if (vacuum_tuple_is_dead(db, &tuple.header, stats->horizon)) {
+            if (pk >= 0 && txn_get_state(db, tuple.header.xmin) == TXN_STATE_ABORTED) {
+                // Versions of aborted updates were never in the index
+                if (!(tuple.header.flags & TUPLE_HEAP_ONLY)) {
+                    vacuum_index_relocate(db, schema, &tuple.values[pk], page_id, slot, -1);
+                }
+            } else if (pk >= 0 && !(tuple.header.flags & TUPLE_UPDATED)) {
+                // The row's last version, so its whole chain is dead
+                btree_delete(db, schema->root_page_id, &tuple.values[pk]);
+            }
+            overflow_free_tuple(db, &tuple);
+            stats->tuples_removed++;
+            changed = 1;
+            continue;
+        }
+        
+        // The version an aborted update wrote is dead and no longer follows
+        if (tuple.header.xmax != xmax) {
+            tuple.header.flags &= ~TUPLE_UPDATED;
+            tuple.header.next_page_id = 0;
+            tuple.header.next_slot = 0;
+            changed = 1;
+        }
+        
+        // Once no snapshot can see the versions before it, the index points here
+        if ((tuple.header.flags & TUPLE_HEAP_ONLY) && tuple.header.xmin < stats->horizon &&
+            txn_get_state(db, tuple.header.xmin) == TXN_STATE_COMMITTED) {
+            if (pk >= 0) btree_update(db, schema->root_page_id, &tuple.values[pk], page_id, slot);
+            tuple.header.flags &= ~TUPLE_HEAP_ONLY;
+            changed = 1;
+        }
+        
+        new_header->free_offset -= slots[slot].length;
+        memcpy(compacted + new_header->free_offset, page->data + slots[slot].offset, slots[slot].length);
+        memcpy(compacted + new_header->free_offset, &tuple.header, sizeof(tuple_header_t));
+        new_slots[slot].offset = new_header->free_offset;
+        new_slots[slot].length = slots[slot].length;
+        kept++;
+        used = slot + 1;
+    }
+    
+    if (used != header->tuple_count) changed = 1;
+    if (changed) {
+        new_header->tuple_count = used;
+        memcpy(page->data, compacted, PAGE_SIZE);
+        mark_page_dirty(page);
+        storage_write_page(db, page_id, page->data);
+    }
+    
+    buffer_release_page(db->buffer_pool, page);
+    return kept;
+}
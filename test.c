@@ -188,6 +188,3937 @@ void test_rollback() {
     printf("=== Rollback Test Passed ===\n\n");
 }
 
+typedef struct {
+    long long sum;
+    int rows;
+} column_sum_t;
+
+static int sum_int_column(const column_vector_t *columns, int row_count, const uint8_t *visible, void *arg) {
+    column_sum_t *acc = (column_sum_t*)arg;
+    const int *values = (const int*)columns[0].data;
+    
+    assert(columns[0].type == DATA_TYPE_INT);
+    for (int i = 0; i < row_count; i++) {
+        if (visible[i]) {
+            acc->sum += values[i];
+            acc->rows++;
+        }
+    }
+    return 0;
+}
+
+void test_columnar_storage() {
+    printf("=== Testing Columnar Storage ===\n");
+    
+    database_t *db = db_create("test_columnar.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    
+    int result = sql_execute(db, "CREATE TABLE sales (id INT PRIMARY KEY, region VARCHAR(8), amount INT) STORAGE = COLUMN", &txn);
+    assert(result == 0);
+    assert(find_table_schema(db, "sales")->storage_type == STORAGE_COLUMN);
+    printf("✓ Columnar table created\n");
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    long long expected = 0;
+    for (int i = 1; i <= 300; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO sales VALUES (%d, '%s', %d)", i, (i % 2) ? "east" : "west", i * 10);
+        result = sql_execute(db, sql, &txn);
+        assert(result == 0);
+        expected += i * 10;
+    }
+    
+    result = sql_execute(db, "INSERT INTO sales VALUES (7, 'dup', 1)", &txn);
+    assert(result != 0);
+    printf("✓ 300 rows inserted, duplicate key rejected\n");
+    
+    int amount_column = 2;
+    column_sum_t acc = {0, 0};
+    result = columnar_scan(db, "sales", &amount_column, 1, txn, sum_int_column, &acc);
+    assert(result == 0);
+    assert(acc.rows == 300);
+    assert(acc.sum == expected);
+    printf("✓ Single-column scan sums %d rows\n", acc.rows);
+    
+    value_t key = { .type = DATA_TYPE_INT };
+    key.data.int_val = 150;
+    tuple_t *row = NULL;
+    int count = 0;
+    result = tuple_select(db, "sales", &key, &row, &count, txn);
+    assert(result == 0 && count == 1);
+    assert(row->values[0].data.int_val == 150);
+    assert(strcmp(row->values[1].data.str_val, "west") == 0);
+    assert(row->values[2].data.int_val == 1500);
+    printf("✓ Point lookup materializes the row from column minipages\n");
+    
+    result = sql_execute(db, "DELETE FROM sales WHERE id = 150", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    db_checkpoint(db);
+    db_close(db);
+    
+    db = db_create("test_columnar.db");
+    assert(db != NULL);
+    result = db_recovery(db);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    acc.sum = 0;
+    acc.rows = 0;
+    result = columnar_scan(db, "sales", &amount_column, 1, txn, sum_int_column, &acc);
+    assert(result == 0);
+    assert(acc.rows == 299);
+    assert(acc.sum == expected - 1500);
+    printf("✓ Deleted row hidden after reopening the database\n");
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    db_close(db);
+    
+    printf("=== Columnar Storage Test Passed ===\n\n");
+}
+
+static int count_table_pages(database_t *db, const char *table_name) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    int pages = 0;
+    
+    for (page_id_t page_id = schema->first_page_id; page_id != 0; pages++) {
+        page_t *page = buffer_get_page(db->buffer_pool, page_id);
+        assert(page != NULL);
+        page_id = ((heap_page_header_t*)page->data)->next_page_id;
+        buffer_release_page(db->buffer_pool, page);
+    }
+    return pages;
+}
+
+static int key_is_visible(database_t *db, const char *table_name, int id, transaction_id_t txn) {
+    value_t key = { .type = DATA_TYPE_INT };
+    key.data.int_val = id;
+    tuple_t *row = NULL;
+    int count = 0;
+    
+    assert(tuple_select(db, table_name, &key, &row, &count, txn) == 0);
+    if (count == 1) {
+        assert(row->values[0].data.int_val == id);
+    }
+    return count;
+}
+
+void test_vacuum() {
+    printf("=== Testing VACUUM ===\n");
+    
+    database_t *db = db_create("test_vacuum.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0, reader = 0;
+    char sql[256];
+    vacuum_stats_t stats;
+    
+    int result = sql_execute(db, "CREATE TABLE items (id INT PRIMARY KEY, name VARCHAR(16))", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 1; i <= 300; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO items VALUES (%d, 'item%d')", i, i);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    int pages_before = count_table_pages(db, "items");
+    
+    // A reader that started before the deletes keeps the old versions alive
+    result = sql_execute(db, "BEGIN", &reader);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 2; i <= 300; i += 2) {
+        snprintf(sql, sizeof(sql), "DELETE FROM items WHERE id = %d", i);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    for (int i = 1; i <= 120; i += 2) {
+        snprintf(sql, sizeof(sql), "DELETE FROM items WHERE id = %d", i);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = vacuum_table(db, "items", &stats);
+    assert(result == 0);
+    assert(stats.tuples_removed == 0);
+    assert(key_is_visible(db, "items", 2, reader) == 1);
+    printf("✓ Versions still visible to a running transaction are kept\n");
+    
+    result = sql_execute(db, "COMMIT", &reader);
+    assert(result == 0);
+    
+    result = sql_execute(db, "VACUUM items", &txn);
+    assert(result == 0);
+    result = vacuum_table(db, "items", &stats);
+    assert(result == 0);
+    assert(stats.tuples_removed == 0);
+    assert(count_table_pages(db, "items") < pages_before);
+    printf("✓ Dead versions removed and empty pages freed (%d -> %d pages)\n",
+           pages_before, count_table_pages(db, "items"));
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 1; i <= 300; i++) {
+        int expected = (i % 2 == 1 && i > 120) ? 1 : 0;
+        assert(key_is_visible(db, "items", i, txn) == expected);
+    }
+    printf("✓ Index entries follow compacted tuples\n");
+    
+    result = sql_execute(db, "INSERT INTO items VALUES (2, 'again')", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO items VALUES (100, 'aborted')", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "ROLLBACK", &txn);
+    assert(result == 0);
+    
+    result = vacuum_table(db, "items", &stats);
+    assert(result == 0);
+    assert(stats.tuples_removed == 2);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO items VALUES (100, 'kept')", &txn);
+    assert(result == 0);
+    assert(key_is_visible(db, "items", 100, txn) == 1);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ Aborted inserts reclaimed, keys reusable\n");
+    
+    result = sql_execute(db, "CREATE TABLE metrics (id INT PRIMARY KEY, value INT) STORAGE = COLUMN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 1; i <= 400; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO metrics VALUES (%d, %d)", i, i);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 1; i <= 400; i += 3) {
+        snprintf(sql, sizeof(sql), "DELETE FROM metrics WHERE id = %d", i);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = vacuum_table(db, "metrics", &stats);
+    assert(result == 0);
+    assert(stats.tuples_removed == 134);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    int value_column = 1;
+    column_sum_t acc = {0, 0};
+    result = columnar_scan(db, "metrics", &value_column, 1, txn, sum_int_column, &acc);
+    assert(result == 0);
+    assert(acc.rows == 266);
+    for (int i = 1; i <= 400; i++) {
+        assert(key_is_visible(db, "metrics", i, txn) == (i % 3 != 1));
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ Columnar pages compacted\n");
+    
+    result = vacuum_start_worker(db, 1);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "DELETE FROM items WHERE id = 100", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    struct timespec pause = { 2, 500000000 };
+    nanosleep(&pause, NULL);
+    vacuum_stop_worker(db);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO items VALUES (100, 'reused')", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ Background worker reclaimed a deleted row\n");
+    
+    db_close(db);
+    
+    printf("=== VACUUM Test Passed ===\n\n");
+}
+
+typedef struct {
+    int rows;
+    int last_key;
+    int ordered;
+} key_range_t;
+
+static int collect_key_range(const tuple_t *row, void *arg) {
+    key_range_t *range = (key_range_t*)arg;
+    int key = row->values[0].data.int_val;
+    
+    if (range->rows > 0 && key <= range->last_key) {
+        range->ordered = 0;
+    }
+    range->last_key = key;
+    range->rows++;
+    return 0;
+}
+
+void test_index_organized() {
+    printf("=== Testing Index-Organized Tables ===\n");
+    
+    database_t *db = db_create("test_iot.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    
+    int result = sql_execute(db, "CREATE TABLE events (name VARCHAR(16)) STORAGE = INDEX", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "CREATE TABLE events (id INT PRIMARY KEY, name VARCHAR(16)) STORAGE = INDEX", &txn);
+    assert(result == 0);
+    table_schema_t *schema = find_table_schema(db, "events");
+    assert(schema->storage_type == STORAGE_INDEX);
+    printf("✓ Index-organized table created, primary key required\n");
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 0; i < 200; i++) {
+        int id = (i * 37) % 200 + 1;
+        snprintf(sql, sizeof(sql), "INSERT INTO events VALUES (%d, 'event%d')", id, id);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    result = sql_execute(db, "INSERT INTO events VALUES (42, 'dup')", &txn);
+    assert(result != 0);
+    printf("✓ 200 rows inserted out of order, duplicate key rejected\n");
+    
+    value_t key = { .type = DATA_TYPE_INT };
+    tuple_t *row = NULL;
+    int count = 0;
+    for (int id = 1; id <= 200; id += 17) {
+        key.data.int_val = id;
+        result = tuple_select(db, "events", &key, &row, &count, txn);
+        assert(result == 0 && count == 1);
+        snprintf(sql, sizeof(sql), "event%d", id);
+        assert(row->values[0].data.int_val == id);
+        assert(strcmp(row->values[1].data.str_val, sql) == 0);
+    }
+    printf("✓ Point lookups read the row from the leaf\n");
+    
+    value_t low = { .type = DATA_TYPE_INT };
+    value_t high = { .type = DATA_TYPE_INT };
+    low.data.int_val = 50;
+    high.data.int_val = 80;
+    key_range_t range = {0, 0, 1};
+    result = btree_row_scan(db, schema, &low, &high, txn, collect_key_range, &range);
+    assert(result == 0);
+    assert(range.rows == 31 && range.ordered && range.last_key == 80);
+    printf("✓ Range scan returns %d rows in key order\n", range.rows);
+    
+    for (int id = 60; id < 70; id++) {
+        snprintf(sql, sizeof(sql), "DELETE FROM events WHERE id = %d", id);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    vacuum_stats_t stats;
+    result = vacuum_table(db, "events", &stats);
+    assert(result == 0);
+    assert(stats.tuples_removed == 10);
+    
+    db_checkpoint(db);
+    db_close(db);
+    
+    db = db_create("test_iot.db");
+    assert(db != NULL);
+    result = db_recovery(db);
+    assert(result == 0);
+    schema = find_table_schema(db, "events");
+    assert(schema->storage_type == STORAGE_INDEX);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    range = (key_range_t){0, 0, 1};
+    result = btree_row_scan(db, schema, &low, &high, txn, collect_key_range, &range);
+    assert(result == 0);
+    assert(range.rows == 21 && range.ordered);
+    
+    range = (key_range_t){0, 0, 1};
+    result = btree_row_scan(db, schema, NULL, NULL, txn, collect_key_range, &range);
+    assert(result == 0);
+    assert(range.rows == 190 && range.ordered && range.last_key == 200);
+    printf("✓ Deleted rows vacuumed, ordering survives reopening the database\n");
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    db_close(db);
+    
+    printf("=== Index-Organized Table Test Passed ===\n\n");
+}
+
+static int count_free_pages(database_t *db) {
+    page_t *metadata_page = buffer_get_page(db->buffer_pool, 1);
+    assert(metadata_page != NULL);
+    page_id_t page_id = ((metadata_t*)metadata_page->data)->free_page_id;
+    buffer_release_page(db->buffer_pool, metadata_page);
+    
+    int pages = 0;
+    while (page_id != 0) {
+        page_t *page = buffer_get_page(db->buffer_pool, page_id);
+        assert(page != NULL);
+        page_id = ((heap_page_header_t*)page->data)->next_page_id;
+        buffer_release_page(db->buffer_pool, page);
+        pages++;
+    }
+    return pages;
+}
+
+void test_overflow_values() {
+    printf("=== Testing Overflow Values ===\n");
+    
+    database_t *db = db_create("test_overflow.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    
+    int result = sql_execute(db, "CREATE TABLE docs (id INT PRIMARY KEY, title VARCHAR(16), body VARCHAR(20000))", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 1; i <= 50; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO docs VALUES (%d, 'doc%d', 'short')", i, i);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    assert(count_table_pages(db, "docs") == 1);
+    printf("✓ 50 short rows fit in a single page\n");
+    
+    int body_length = 10000;
+    char *body = malloc(body_length + 1);
+    for (int i = 0; i < body_length; i++) {
+        body[i] = 'a' + i % 26;
+    }
+    body[body_length] = '\0';
+    char *insert = malloc(body_length + 64);
+    snprintf(insert, body_length + 64, "INSERT INTO docs VALUES (100, 'long', '%s')", body);
+    result = sql_execute(db, insert, &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "INSERT INTO docs VALUES (101, 'this title is too long', 'x')", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ %d-byte value stored, over-long value rejected\n", body_length);
+    
+    db_checkpoint(db);
+    db_close(db);
+    
+    db = db_create("test_overflow.db");
+    assert(db != NULL);
+    result = db_recovery(db);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    value_t key = { .type = DATA_TYPE_INT };
+    key.data.int_val = 100;
+    tuple_t *row = NULL;
+    int count = 0;
+    result = tuple_select(db, "docs", &key, &row, &count, txn);
+    assert(result == 0 && count == 1);
+    assert(!row->values[1].is_external);
+    assert(row->values[2].is_external);
+    assert(row->values[2].data.ext.length == (uint32_t)body_length);
+    char *stored = overflow_read(db, &row->values[2]);
+    assert(stored != NULL && strcmp(stored, body) == 0);
+    free(stored);
+    printf("✓ Overflow chain read back after reopening the database\n");
+    
+    int free_before = count_free_pages(db);
+    result = sql_execute(db, "DELETE FROM docs WHERE id = 100", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    vacuum_stats_t stats;
+    result = vacuum_table(db, "docs", &stats);
+    assert(result == 0);
+    assert(stats.tuples_removed == 1);
+    assert(count_free_pages(db) == free_before + 3);
+    printf("✓ VACUUM frees the overflow pages of dead rows\n");
+    
+    result = sql_execute(db, "CREATE TABLE notes (id INT PRIMARY KEY, body VARCHAR(20000)) STORAGE = INDEX", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    snprintf(insert, body_length + 64, "INSERT INTO notes VALUES (1, '%s')", body);
+    result = sql_execute(db, insert, &txn);
+    assert(result == 0);
+    assert(count_free_pages(db) == free_before);
+    
+    key.data.int_val = 1;
+    result = tuple_select(db, "notes", &key, &row, &count, txn);
+    assert(result == 0 && count == 1);
+    stored = overflow_read(db, &row->values[1]);
+    assert(stored != NULL && strcmp(stored, body) == 0);
+    free(stored);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ Index-organized rows reuse freed pages for overflow chains\n");
+    
+    free(insert);
+    free(body);
+    db_close(db);
+    
+    printf("=== Overflow Values Test Passed ===\n\n");
+}
+
+typedef struct {
+    int code;
+    int matches;
+    int codes_seen;
+} code_count_t;
+
+static int count_matching_codes(const column_vector_t *columns, int row_count,
+                                const uint8_t *visible, void *arg) {
+    code_count_t *acc = (code_count_t*)arg;
+    const dict_code_t *codes = (const dict_code_t*)columns[0].data;
+    
+    assert(columns[0].dictionary != NULL);
+    assert(columns[0].width == sizeof(dict_code_t));
+    for (int row = 0; row < row_count; row++) {
+        if (!visible[row]) continue;
+        if (codes[row] == acc->code) acc->matches++;
+        if (codes[row] >= acc->codes_seen) acc->codes_seen = codes[row] + 1;
+    }
+    return 0;
+}
+
+void test_dictionary_encoding() {
+    printf("=== Testing Dictionary Encoding ===\n");
+    
+    database_t *db = db_create("test_dictionary.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    const char *statuses[] = { "pending", "shipped", "delivered", "returned" };
+    
+    int result = sql_execute(db, "CREATE TABLE bad (id INT DICTIONARY PRIMARY KEY)", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "CREATE TABLE orders (id INT PRIMARY KEY, status VARCHAR(12) DICTIONARY, amount INT) STORAGE = COLUMN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE orders_plain (id INT PRIMARY KEY, status VARCHAR(12), amount INT) STORAGE = COLUMN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE tickets (id INT PRIMARY KEY, status VARCHAR(12) DICTIONARY)", &txn);
+    assert(result == 0);
+    printf("✓ Dictionary columns declared, invalid column rejected\n");
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 1; i <= 400; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO orders VALUES (%d, '%s', %d)", i, statuses[i % 4], i);
+        assert(sql_execute(db, sql, &txn) == 0);
+        snprintf(sql, sizeof(sql), "INSERT INTO orders_plain VALUES (%d, '%s', %d)", i, statuses[i % 4], i);
+        assert(sql_execute(db, sql, &txn) == 0);
+        snprintf(sql, sizeof(sql), "INSERT INTO tickets VALUES (%d, '%s')", i, statuses[i % 4]);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    assert(count_table_pages(db, "orders") < count_table_pages(db, "orders_plain"));
+    printf("✓ Encoded columnar table uses %d pages instead of %d\n",
+           count_table_pages(db, "orders"), count_table_pages(db, "orders_plain"));
+    
+    db_checkpoint(db);
+    db_close(db);
+    
+    db = db_create("test_dictionary.db");
+    assert(db != NULL);
+    result = db_recovery(db);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    table_schema_t *schema = find_table_schema(db, "orders");
+    dictionary_t *dict = dictionary_get(db, schema, 1);
+    assert(dict != NULL && dictionary_size(dict) == 4);
+    
+    int status_column = 1;
+    code_count_t acc = { dictionary_find(dict, "shipped"), 0, 0 };
+    assert(acc.code >= 0);
+    result = columnar_scan(db, "orders", &status_column, 1, txn, count_matching_codes, &acc);
+    assert(result == 0);
+    assert(acc.matches == 100 && acc.codes_seen == 4);
+    printf("✓ Scan filters on integer codes after reopening the database\n");
+    
+    value_t key = { .type = DATA_TYPE_INT };
+    tuple_t *row = NULL;
+    int count = 0;
+    key.data.int_val = 7;
+    result = tuple_select(db, "orders", &key, &row, &count, txn);
+    assert(result == 0 && count == 1);
+    assert(strcmp(row->values[1].data.str_val, statuses[3]) == 0);
+    key.data.int_val = 10;
+    result = tuple_select(db, "tickets", &key, &row, &count, txn);
+    assert(result == 0 && count == 1);
+    assert(strcmp(row->values[1].data.str_val, statuses[2]) == 0);
+    printf("✓ Point lookups decode codes in row and columnar tables\n");
+    
+    result = sql_execute(db, "INSERT INTO orders VALUES (401, 'cancelled', 0)", &txn);
+    assert(result == 0);
+    assert(dictionary_size(dict) == 5 && dictionary_find(dict, "cancelled") == 4);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ New values get the next code\n");
+    
+    db_close(db);
+    
+    printf("=== Dictionary Encoding Test Passed ===\n\n");
+}
+
+static int scan_count(database_t *db, const char *table_name, transaction_id_t txn, long long *key_sum) {
+    table_cursor_t cursor;
+    tuple_t tuple;
+    int rows = 0;
+    
+    assert(table_scan_open(db, table_name, txn, &cursor) == 0);
+    *key_sum = 0;
+    while (table_scan_next(&cursor, &tuple) > 0) {
+        *key_sum += tuple.values[0].data.int_val;
+        rows++;
+    }
+    table_scan_close(&cursor);
+    return rows;
+}
+
+void test_table_scan() {
+    printf("=== Testing Table Scans ===\n");
+    
+    database_t *db = db_create("test_scan.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    transaction_id_t other = 0;
+    char sql[256];
+    const char *tables[] = { "scan_row", "scan_column", "scan_index" };
+    
+    int result = sql_execute(db, "CREATE TABLE scan_row (id INT PRIMARY KEY, label VARCHAR(16))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE scan_column (id INT PRIMARY KEY, label VARCHAR(16)) STORAGE = COLUMN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE scan_index (id INT PRIMARY KEY, label VARCHAR(16)) STORAGE = INDEX", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 3; t++) {
+        for (int i = 1; i <= 500; i++) {
+            snprintf(sql, sizeof(sql), "INSERT INTO %s VALUES (%d, 'row%d')", tables[t], i, i);
+            assert(sql_execute(db, sql, &txn) == 0);
+        }
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 3; t++) {
+        for (int i = 10; i <= 500; i += 10) {
+            snprintf(sql, sizeof(sql), "DELETE FROM %s WHERE id = %d", tables[t], i);
+            assert(sql_execute(db, sql, &txn) == 0);
+        }
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    // Rows inserted by a transaction that has not committed stay hidden
+    result = sql_execute(db, "BEGIN", &other);
+    assert(result == 0);
+    for (int t = 0; t < 3; t++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO %s VALUES (1000, 'pending')", tables[t]);
+        assert(sql_execute(db, sql, &other) == 0);
+    }
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    long long expected_sum = 500 * 501 / 2 - 10 * (50 * 51 / 2);
+    for (int t = 0; t < 3; t++) {
+        long long key_sum;
+        assert(scan_count(db, tables[t], txn, &key_sum) == 450);
+        assert(key_sum == expected_sum);
+    }
+    printf("✓ Row, columnar and index-organized scans return the 450 visible rows\n");
+    
+    for (int t = 0; t < 3; t++) {
+        long long key_sum;
+        assert(scan_count(db, tables[t], other, &key_sum) == 451);
+    }
+    printf("✓ A transaction sees its own uncommitted rows\n");
+    
+    table_cursor_t cursor;
+    tuple_t tuple;
+    assert(table_scan_open(db, "scan_index", txn, &cursor) == 0);
+    int previous = 0;
+    while (table_scan_next(&cursor, &tuple) > 0) {
+        assert(tuple.values[0].data.int_val > previous);
+        previous = tuple.values[0].data.int_val;
+    }
+    table_scan_close(&cursor);
+    assert(table_scan_open(db, "missing", txn, &cursor) != 0);
+    printf("✓ Index-organized scans are ordered by key\n");
+    
+    result = sql_execute(db, "SELECT * FROM scan_row", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "ROLLBACK", &other);
+    assert(result == 0);
+    printf("✓ SELECT without WHERE streams the table\n");
+    
+    db_close(db);
+    
+    printf("=== Table Scan Test Passed ===\n\n");
+}
+
+// Runs the plan to completion, collecting one INT column of its output
+static int collect_int_column(operator_t *plan, int column, int *values, int max_values) {
+    int count = 0;
+    batch_t *batch;
+    
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        for (int k = 0; k < batch->selected_count; k++) {
+            value_t value;
+            batch_get_value(batch, column, batch->selection[k], &value);
+            if (count < max_values) values[count] = value.data.int_val;
+            count++;
+        }
+    }
+    exec_destroy(plan);
+    return count;
+}
+
+void test_executor() {
+    printf("=== Testing Vectorized Executor ===\n");
+    
+    database_t *db = db_create("test_executor.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    const char *tables[] = { "exec_row", "exec_column" };
+    const int rows = 2500;
+    
+    int result = sql_execute(db, "CREATE TABLE exec_row (id INT PRIMARY KEY, qty INT, price FLOAT, "
+                                 "name VARCHAR(16))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE exec_column (id INT PRIMARY KEY, qty INT, price FLOAT, "
+                             "name VARCHAR(16)) STORAGE = COLUMN", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 2; t++) {
+        for (int i = 1; i <= rows; i++) {
+            snprintf(sql, sizeof(sql), "INSERT INTO %s VALUES (%d, %d, %d, 'item%04d')",
+                     tables[t], i, i % 10, i % 100, i);
+            assert(sql_execute(db, sql, &txn) == 0);
+        }
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    // Expected results of qty >= 5 AND price < 50.0, computed row by row
+    long long expected_count = 0;
+    long long expected_sum = 0;
+    int expected_min = 0;
+    int expected_max = 0;
+    for (int i = 1; i <= rows; i++) {
+        if (i % 10 >= 5 && i % 100 < 50) {
+            if (expected_count == 0) expected_min = i;
+            expected_max = i;
+            expected_count++;
+            expected_sum += i;
+        }
+    }
+    
+    for (int t = 0; t < 2; t++) {
+        int scan_columns[] = { 0, 1, 2 };
+        predicate_t predicates[2];
+        memset(predicates, 0, sizeof(predicates));
+        predicates[0].column = 1;
+        predicates[0].op = CMP_GE;
+        predicates[0].constant.type = DATA_TYPE_INT;
+        predicates[0].constant.data.int_val = 5;
+        predicates[1].column = 2;
+        predicates[1].op = CMP_LT;
+        predicates[1].constant.type = DATA_TYPE_FLOAT;
+        predicates[1].constant.data.float_val = 50.0f;
+        aggregate_spec_t specs[] = {
+            { AGG_COUNT_STAR, 0 }, { AGG_SUM, 0 }, { AGG_MIN, 0 }, { AGG_MAX, 0 }, { AGG_AVG, 1 }
+        };
+        
+        operator_t *plan = exec_scan_create(db, tables[t], scan_columns, 3, txn);
+        assert(plan != NULL);
+        plan = exec_filter_create(plan, predicates, 2);
+        assert(plan != NULL);
+        plan = exec_aggregate_create(plan, specs, 5);
+        assert(plan != NULL);
+        assert(plan->column_types[4] == DATA_TYPE_FLOAT);
+        
+        batch_t *batch;
+        value_t value;
+        assert(exec_open(plan) == 0);
+        assert(exec_next(plan, &batch) == 1);
+        assert(batch->selected_count == 1);
+        batch_get_value(batch, 0, 0, &value);
+        assert(value.data.int_val == expected_count);
+        batch_get_value(batch, 1, 0, &value);
+        assert(value.data.int_val == expected_sum);
+        batch_get_value(batch, 2, 0, &value);
+        assert(value.data.int_val == expected_min);
+        batch_get_value(batch, 3, 0, &value);
+        assert(value.data.int_val == expected_max);
+        batch_get_value(batch, 4, 0, &value);
+        assert(value.data.float_val == 7.0f);
+        assert(exec_next(plan, &batch) == 0);
+        exec_destroy(plan);
+    }
+    printf("✓ Scan, filter and aggregate agree on row and columnar tables\n");
+    
+    predicate_t none;
+    memset(&none, 0, sizeof(none));
+    none.column = 1;
+    none.op = CMP_GT;
+    none.constant.type = DATA_TYPE_INT;
+    none.constant.data.int_val = 100;
+    aggregate_spec_t empty_specs[] = { { AGG_COUNT_STAR, 0 }, { AGG_SUM, 1 } };
+    operator_t *plan = exec_scan_create(db, "exec_column", NULL, 0, txn);
+    plan = exec_aggregate_create(exec_filter_create(plan, &none, 1), empty_specs, 2);
+    assert(plan != NULL);
+    
+    batch_t *batch;
+    value_t value;
+    assert(exec_open(plan) == 0);
+    assert(exec_next(plan, &batch) == 1);
+    batch_get_value(batch, 0, 0, &value);
+    assert(value.data.int_val == 0 && !value.is_null);
+    batch_get_value(batch, 1, 0, &value);
+    assert(value.is_null);
+    exec_destroy(plan);
+    printf("✓ Aggregates over an empty input give COUNT 0 and NULL\n");
+    
+    // ORDER BY qty DESC, id ASC with OFFSET 2 LIMIT 5: qty 9 holds ids 9, 19, 29, ...
+    sort_key_t keys[] = { { 1, 1 }, { 0, 0 } };
+    int project_columns[] = { 0 };
+    int ids[8];
+    plan = exec_scan_create(db, "exec_row", NULL, 0, txn);
+    plan = exec_project_create(exec_limit_create(exec_sort_create(plan, keys, 2, 0), 5, 2), project_columns, 1);
+    assert(plan != NULL);
+    assert(plan->column_count == 1 && strcmp(plan->column_names[0], "id") == 0);
+    assert(collect_int_column(plan, 0, ids, 8) == 5);
+    for (int i = 0; i < 5; i++) {
+        assert(ids[i] == 29 + 10 * i);
+    }
+    printf("✓ Sort, limit and project produce the expected rows\n");
+    
+    // A limit spanning batches stops early; an offset past the end yields nothing
+    plan = exec_limit_create(exec_scan_create(db, "exec_column", NULL, 0, txn), 1500, 700);
+    assert(collect_int_column(plan, 0, ids, 1) == 1500);
+    assert(ids[0] == 701);
+    plan = exec_limit_create(exec_scan_create(db, "exec_row", NULL, 0, txn), 10, rows);
+    assert(collect_int_column(plan, 0, ids, 1) == 0);
+    assert(exec_scan_create(db, "missing", NULL, 0, txn) == NULL);
+    printf("✓ Limits and offsets work across batch boundaries\n");
+    
+    result = sql_execute(db, "SELECT * FROM exec_column", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ SELECT without WHERE runs through the executor\n");
+    
+    db_close(db);
+    
+    printf("=== Vectorized Executor Test Passed ===\n\n");
+}
+
+static int where_int(expr_t *expr, int column, compare_op_t op, int constant) {
+    value_t value;
+    memset(&value, 0, sizeof(value));
+    value.type = DATA_TYPE_INT;
+    value.data.int_val = constant;
+    return expr_add_compare(expr, column, op, &value);
+}
+
+// Runs plan_select and counts the rows it returns, summing the first column
+static int plan_count(database_t *db, const char *table_name, const expr_t *where, transaction_id_t txn,
+                      const char *expected_plan, long long *key_sum) {
+    operator_t *plan = plan_select(db, table_name, NULL, 0, where, txn);
+    assert(plan != NULL);
+    assert(strcmp(plan->name, expected_plan) == 0);
+    
+    int count = 0;
+    batch_t *batch;
+    *key_sum = 0;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        for (int k = 0; k < batch->selected_count; k++) {
+            value_t value;
+            batch_get_value(batch, 0, batch->selection[k], &value);
+            *key_sum += value.data.int_val;
+            count++;
+        }
+    }
+    exec_destroy(plan);
+    return count;
+}
+
+void test_where_clause() {
+    printf("=== Testing WHERE Clauses ===\n");
+    
+    database_t *db = db_create("test_where.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    const char *tables[] = { "where_row", "where_column", "where_index" };
+    const char *storage[] = { "ROW", "COLUMN", "INDEX" };
+    
+    for (int t = 0; t < 3; t++) {
+        snprintf(sql, sizeof(sql), "CREATE TABLE %s (id INT PRIMARY KEY, qty INT, name VARCHAR(16)) STORAGE = %s",
+                 tables[t], storage[t]);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    
+    int result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 3; t++) {
+        for (int i = 1; i <= 300; i++) {
+            snprintf(sql, sizeof(sql), "INSERT INTO %s VALUES (%d, %d, 'n%d')", tables[t], i, i % 7, i);
+            assert(sql_execute(db, sql, &txn) == 0);
+        }
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    for (int t = 0; t < 3; t++) {
+        expr_t where;
+        long long key_sum;
+        
+        // id > 100 AND id <= 200
+        expr_init(&where);
+        where.root = expr_add_logical(&where, EXPR_AND, where_int(&where, 0, CMP_GT, 100),
+                                      where_int(&where, 0, CMP_LE, 200));
+        assert(plan_count(db, tables[t], &where, txn, "Range Scan", &key_sum) == 100);
+        assert(key_sum == 15050);
+        
+        // id = 150
+        expr_init(&where);
+        where.root = where_int(&where, 0, CMP_EQ, 150);
+        assert(plan_count(db, tables[t], &where, txn, "Range Scan", &key_sum) == 1);
+        assert(key_sum == 150);
+        
+        // id >= 50 AND id <= 60 AND qty = 3: the range scan also filters on qty
+        expr_init(&where);
+        int range = expr_add_logical(&where, EXPR_AND, where_int(&where, 0, CMP_GE, 50),
+                                     where_int(&where, 0, CMP_LE, 60));
+        where.root = expr_add_logical(&where, EXPR_AND, range, where_int(&where, 1, CMP_EQ, 3));
+        assert(plan_count(db, tables[t], &where, txn, "Range Scan", &key_sum) == 2);
+        assert(key_sum == 52 + 59);
+        
+        // id > 200 AND id < 100 is empty
+        expr_init(&where);
+        where.root = expr_add_logical(&where, EXPR_AND, where_int(&where, 0, CMP_GT, 200),
+                                      where_int(&where, 0, CMP_LT, 100));
+        assert(plan_count(db, tables[t], &where, txn, "Range Scan", &key_sum) == 0);
+        
+        // qty = 0 OR id < 5 cannot use the index
+        expr_init(&where);
+        where.root = expr_add_logical(&where, EXPR_OR, where_int(&where, 1, CMP_EQ, 0),
+                                      where_int(&where, 0, CMP_LT, 5));
+        assert(plan_count(db, tables[t], &where, txn, "Scan", &key_sum) == 42 + 4);
+        
+        // name = 'n42'
+        value_t name;
+        memset(&name, 0, sizeof(name));
+        name.type = DATA_TYPE_VARCHAR;
+        strcpy(name.data.str_val, "n42");
+        expr_init(&where);
+        where.root = expr_add_compare(&where, 2, CMP_EQ, &name);
+        assert(plan_count(db, tables[t], &where, txn, "Scan", &key_sum) == 1);
+        assert(key_sum == 42);
+    }
+    printf("✓ Primary-key ranges use range scans on row, columnar and index-organized tables\n");
+    printf("✓ OR and non-key predicates use a filtered scan\n");
+    
+    result = sql_execute(db, "SELECT * FROM where_row WHERE id > 290 AND id <= 295", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT * FROM where_column WHERE (id = 1 OR id = 2) AND qty <> 0", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT * FROM where_index WHERE name = 'n7' OR id BETWEEN 3 AND 4", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT * FROM where_row WHERE missing = 1", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT * FROM where_row WHERE id >", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT * FROM where_row WHERE qty = 'text'", &txn);
+    assert(result != 0);
+    printf("✓ SQL comparison operators, BETWEEN, AND/OR and parentheses\n");
+    
+    for (int t = 0; t < 3; t++) {
+        long long key_sum;
+        snprintf(sql, sizeof(sql), "DELETE FROM %s WHERE id BETWEEN 10 AND 19 OR name = 'n250'", tables[t]);
+        assert(sql_execute(db, sql, &txn) == 0);
+        snprintf(sql, sizeof(sql), "DELETE FROM %s WHERE qty = 100", tables[t]);
+        assert(sql_execute(db, sql, &txn) == 0);
+        assert(plan_count(db, tables[t], NULL, txn, "Scan", &key_sum) == 289);
+        assert(key_sum == 300 * 301 / 2 - 145 - 250);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ DELETE removes every matching row\n");
+    
+    db_close(db);
+    
+    printf("=== WHERE Clause Test Passed ===\n\n");
+}
+
+static scalar_expr_t item_column(int column) {
+    scalar_expr_t item;
+    scalar_init(&item);
+    item.root = scalar_add_column(&item, column);
+    return item;
+}
+
+static int item_int(scalar_expr_t *item, int constant) {
+    value_t value;
+    memset(&value, 0, sizeof(value));
+    value.type = DATA_TYPE_INT;
+    value.data.int_val = constant;
+    return scalar_add_constant(item, &value);
+}
+
+void test_projection() {
+    printf("=== Testing Projection and Late Materialization ===\n");
+    
+    database_t *db = db_create("test_projection.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    const char *tables[] = { "proj_row", "proj_column", "proj_index" };
+    const char *storage[] = { "ROW", "COLUMN", "INDEX" };
+    
+    for (int t = 0; t < 3; t++) {
+        snprintf(sql, sizeof(sql),
+                 "CREATE TABLE %s (id INT PRIMARY KEY, qty INT, price FLOAT, name VARCHAR(16)) STORAGE = %s",
+                 tables[t], storage[t]);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    
+    int result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 3; t++) {
+        for (int i = 1; i <= 300; i++) {
+            snprintf(sql, sizeof(sql), "INSERT INTO %s VALUES (%d, %d, %d, 'p%d')", tables[t], i, i % 7, i, i);
+            assert(sql_execute(db, sql, &txn) == 0);
+        }
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    for (int t = 0; t < 3; t++) {
+        // SELECT id, name, qty * 2 + id AS total, price / 2 ... WHERE qty = 3
+        scalar_expr_t items[4];
+        items[0] = item_column(0);
+        items[1] = item_column(3);
+        scalar_init(&items[2]);
+        int doubled = scalar_add_arith(&items[2], SCALAR_MUL, scalar_add_column(&items[2], 1), item_int(&items[2], 2));
+        items[2].root = scalar_add_arith(&items[2], SCALAR_ADD, doubled, scalar_add_column(&items[2], 0));
+        strcpy(items[2].name, "total");
+        scalar_init(&items[3]);
+        items[3].root = scalar_add_arith(&items[3], SCALAR_DIV, scalar_add_column(&items[3], 2), item_int(&items[3], 2));
+        
+        expr_t where;
+        expr_init(&where);
+        where.root = where_int(&where, 1, CMP_EQ, 3);
+        
+        for (int ranged = 0; ranged < 2; ranged++) {
+            if (ranged) {
+                // id BETWEEN 100 AND 199 AND qty = 3
+                int range = expr_add_logical(&where, EXPR_AND, where_int(&where, 0, CMP_GE, 100),
+                                             where_int(&where, 0, CMP_LE, 199));
+                where.root = expr_add_logical(&where, EXPR_AND, range, where.root);
+            }
+            
+            operator_t *plan = plan_select(db, tables[t], items, 4, &where, txn);
+            assert(plan != NULL);
+            assert(strcmp(plan->name, "Project") == 0);
+            assert(plan->column_count == 4);
+            assert(plan->column_types[1] == DATA_TYPE_VARCHAR);
+            assert(plan->column_types[2] == DATA_TYPE_INT);
+            assert(plan->column_types[3] == DATA_TYPE_FLOAT);
+            assert(strcmp(plan->column_names[2], "total") == 0);
+            
+            int count = 0;
+            batch_t *batch;
+            assert(exec_open(plan) == 0);
+            while (exec_next(plan, &batch) > 0) {
+                for (int k = 0; k < batch->selected_count; k++) {
+                    value_t id, name, total, half;
+                    int row = batch->selection[k];
+                    batch_get_value(batch, 0, row, &id);
+                    batch_get_value(batch, 1, row, &name);
+                    batch_get_value(batch, 2, row, &total);
+                    batch_get_value(batch, 3, row, &half);
+                    
+                    char expected[16];
+                    snprintf(expected, sizeof(expected), "p%d", id.data.int_val);
+                    assert(id.data.int_val % 7 == 3);
+                    assert(strcmp(name.data.str_val, expected) == 0);
+                    assert(total.data.int_val == 6 + id.data.int_val);
+                    assert(half.data.float_val == id.data.int_val / 2.0f);
+                    count++;
+                }
+            }
+            exec_destroy(plan);
+            assert(count == (ranged ? 15 : 43));
+        }
+        
+        // Selecting columns in table order needs no projection, and only
+        // the referenced columns are read
+        scalar_expr_t all[4] = { item_column(0), item_column(1), item_column(2), item_column(3) };
+        operator_t *plan = plan_select(db, tables[t], all, 4, NULL, txn);
+        assert(plan != NULL && strcmp(plan->name, "Scan") == 0 && plan->column_count == 4);
+        exec_destroy(plan);
+        
+        plan = plan_select(db, tables[t], &all[1], 1, &where, txn);
+        assert(plan != NULL && strcmp(plan->name, "Range Scan") == 0 && plan->column_count == 1);
+        exec_destroy(plan);
+        
+        // id / qty is NULL where qty = 0
+        scalar_expr_t ratio;
+        scalar_init(&ratio);
+        ratio.root = scalar_add_arith(&ratio, SCALAR_DIV, scalar_add_column(&ratio, 0), scalar_add_column(&ratio, 1));
+        plan = plan_select(db, tables[t], &ratio, 1, NULL, txn);
+        assert(plan != NULL);
+        
+        int nulls = 0;
+        batch_t *batch;
+        assert(exec_open(plan) == 0);
+        while (exec_next(plan, &batch) > 0) {
+            for (int k = 0; k < batch->selected_count; k++) {
+                value_t value;
+                batch_get_value(batch, 0, batch->selection[k], &value);
+                nulls += value.is_null;
+            }
+        }
+        exec_destroy(plan);
+        assert(nulls == 42);
+        
+        // VARCHAR columns cannot take part in arithmetic
+        scalar_expr_t bad;
+        scalar_init(&bad);
+        bad.root = scalar_add_arith(&bad, SCALAR_ADD, scalar_add_column(&bad, 3), item_int(&bad, 1));
+        assert(plan_select(db, tables[t], &bad, 1, NULL, txn) == NULL);
+    }
+    printf("✓ Filter columns are decoded first, the rest only for matching rows\n");
+    printf("✓ Arithmetic is typed INT or FLOAT, and division by zero is NULL\n");
+    
+    result = sql_execute(db, "SELECT name, qty * 2 + id AS total FROM proj_row WHERE qty = 3", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT (id + 1) * 2, price - 1 FROM proj_column WHERE id BETWEEN 1 AND 5", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT qty, id FROM proj_index WHERE id < 4", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT name + 1 FROM proj_row", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT missing FROM proj_row", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT id, FROM proj_row", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ SQL select lists with expressions and aliases\n");
+    
+    db_close(db);
+    
+    printf("=== Projection Test Passed ===\n\n");
+}
+
+// Runs a grouped aggregation of (COUNT(*), SUM(qty), MIN(id), MAX(id)) by
+// bucket and checks every group against the values inserted below
+static void check_groups(database_t *db, const char *table_name, size_t memory_budget, transaction_id_t txn) {
+    int scan_columns[] = { 0, 1, 2 };
+    int group_column = 1;
+    aggregate_spec_t specs[] = { { AGG_COUNT_STAR, 0 }, { AGG_SUM, 2 }, { AGG_MIN, 0 }, { AGG_MAX, 0 } };
+    
+    operator_t *plan = exec_scan_create(db, table_name, scan_columns, 3, txn);
+    plan = exec_group_aggregate_create(plan, &group_column, 1, specs, 4, memory_budget);
+    assert(plan != NULL);
+    assert(plan->column_count == 5);
+    assert(strcmp(plan->column_names[0], "bucket") == 0);
+    assert(strcmp(plan->column_names[2], "SUM(qty)") == 0);
+    
+    uint8_t seen[150] = {0};
+    int groups = 0;
+    batch_t *batch;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        for (int k = 0; k < batch->selected_count; k++) {
+            int row = batch->selection[k];
+            value_t bucket, count, sum, min, max;
+            batch_get_value(batch, 0, row, &bucket);
+            batch_get_value(batch, 1, row, &count);
+            batch_get_value(batch, 2, row, &sum);
+            batch_get_value(batch, 3, row, &min);
+            batch_get_value(batch, 4, row, &max);
+            
+            // Bucket b holds ids b+1, b+151, b+301 and b+451 with qty = id % 10
+            int b = bucket.data.int_val;
+            assert(b >= 0 && b < 150 && !seen[b]);
+            seen[b] = 1;
+            assert(count.data.int_val == 4);
+            assert(sum.data.int_val == (b + 1) % 10 * 4);
+            assert(min.data.int_val == b + 1);
+            assert(max.data.int_val == b + 451);
+            groups++;
+        }
+    }
+    exec_destroy(plan);
+    assert(groups == 150);
+}
+
+// Groups (COUNT(*), SUM(qty), MIN(tier), MAX(tier)) of the dictionary
+// tables below by region, with NULL as region 5, and checks them against
+// a row-by-row count
+static void check_dictionary_groups(operator_t *plan, int rows) {
+    long long counts[6] = {0}, sums[6] = {0};
+    int min_tier[6], max_tier[6];
+    for (int r = 0; r < 6; r++) {
+        min_tier[r] = 9;
+        max_tier[r] = -1;
+    }
+    for (int id = 1; id <= rows; id++) {
+        int r = id % 7 == 0 ? 5 : id % 5;
+        counts[r]++;
+        sums[r] += id % 10;
+        if (id % 3 < min_tier[r]) min_tier[r] = id % 3;
+        if (id % 3 > max_tier[r]) max_tier[r] = id % 3;
+    }
+    
+    uint8_t seen[6] = {0};
+    batch_t *batch;
+    assert(plan != NULL && exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        for (int k = 0; k < batch->selected_count; k++) {
+            value_t region, count, sum, min, max;
+            batch_get_value(batch, 0, batch->selection[k], &region);
+            batch_get_value(batch, 1, batch->selection[k], &count);
+            batch_get_value(batch, 2, batch->selection[k], &sum);
+            batch_get_value(batch, 3, batch->selection[k], &min);
+            batch_get_value(batch, 4, batch->selection[k], &max);
+            
+            int r = region.is_null ? 5 : region.data.str_val[7] - '0';
+            assert(region.is_null || strncmp(region.data.str_val, "region-", 7) == 0);
+            assert(r >= 0 && r < 6 && !seen[r]);
+            seen[r] = 1;
+            assert(count.data.int_val == counts[r] && sum.data.int_val == sums[r]);
+            assert(min.data.str_val[4] - '0' == min_tier[r] && max.data.str_val[4] - '0' == max_tier[r]);
+        }
+    }
+    exec_destroy(plan);
+    for (int r = 0; r < 6; r++) {
+        assert(seen[r]);
+    }
+}
+
+void test_group_by() {
+    printf("=== Testing GROUP BY and Aggregates ===\n");
+    
+    database_t *db = db_create("test_group.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    const char *tables[] = { "group_row", "group_column" };
+    const char *storage[] = { "ROW", "COLUMN" };
+    
+    for (int t = 0; t < 2; t++) {
+        snprintf(sql, sizeof(sql),
+                 "CREATE TABLE %s (id INT PRIMARY KEY, bucket INT, qty INT, region VARCHAR(16)) STORAGE = %s",
+                 tables[t], storage[t]);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    
+    int result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 2; t++) {
+        for (int i = 1; i <= 600; i++) {
+            snprintf(sql, sizeof(sql), "INSERT INTO %s VALUES (%d, %d, %d, 'r%d')", tables[t], i, (i - 1) % 150,
+                     i % 10, i % 5);
+            assert(sql_execute(db, sql, &txn) == 0);
+        }
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    for (int t = 0; t < 2; t++) {
+        check_groups(db, tables[t], 0, txn);
+        check_groups(db, tables[t], 4096, txn);
+    }
+    printf("✓ Hash aggregation returns every group once\n");
+    printf("✓ Groups beyond the memory budget are spilled and aggregated in later passes\n");
+    
+    for (int t = 0; t < 2; t++) {
+        // SELECT region, COUNT(*), SUM(qty) ... WHERE id > 100 GROUP BY region
+        int group_column = 3;
+        aggregate_spec_t specs[] = { { AGG_COUNT_STAR, 0 }, { AGG_SUM, 2 } };
+        expr_t where;
+        expr_init(&where);
+        where.root = where_int(&where, 0, CMP_GT, 100);
+        
+        operator_t *plan = plan_aggregate(db, tables[t], &group_column, 1, specs, 2, &where, txn);
+        assert(plan != NULL);
+        assert(strcmp(plan->name, "Hash Aggregate") == 0);
+        assert(plan->column_types[0] == DATA_TYPE_VARCHAR);
+        
+        int groups = 0;
+        batch_t *batch;
+        assert(exec_open(plan) == 0);
+        while (exec_next(plan, &batch) > 0) {
+            for (int k = 0; k < batch->selected_count; k++) {
+                value_t region, count, sum;
+                batch_get_value(batch, 0, batch->selection[k], &region);
+                batch_get_value(batch, 1, batch->selection[k], &count);
+                batch_get_value(batch, 2, batch->selection[k], &sum);
+                
+                // ids 101..600 with id % 5 = r; qty = id % 10 alternates r and r + 5
+                int r = region.data.str_val[1] - '0';
+                assert(count.data.int_val == 100);
+                assert(sum.data.int_val == 50 * r + 50 * (r + 5));
+                groups++;
+            }
+        }
+        exec_destroy(plan);
+        assert(groups == 5);
+        
+        // Ungrouped aggregates over whole batches and over a filtered selection
+        aggregate_spec_t totals[] = { { AGG_SUM, 0 }, { AGG_MIN, 2 }, { AGG_MAX, 0 }, { AGG_AVG, 1 } };
+        for (int filtered = 0; filtered < 2; filtered++) {
+            plan = plan_aggregate(db, tables[t], NULL, 0, totals, 4, filtered ? &where : NULL, txn);
+            assert(plan != NULL);
+            assert(strcmp(plan->name, "Aggregate") == 0);
+            
+            value_t sum, min, max, avg;
+            assert(exec_open(plan) == 0);
+            assert(exec_next(plan, &batch) == 1);
+            batch_get_value(batch, 0, 0, &sum);
+            batch_get_value(batch, 1, 0, &min);
+            batch_get_value(batch, 2, 0, &max);
+            batch_get_value(batch, 3, 0, &avg);
+            exec_destroy(plan);
+            
+            assert(sum.data.int_val == (filtered ? 600 * 601 / 2 - 100 * 101 / 2 : 600 * 601 / 2));
+            assert(min.data.int_val == 0);
+            assert(max.data.int_val == 600);
+            assert(avg.data.float_val == (filtered ? 79.5f : 74.5f));
+        }
+    }
+    printf("✓ GROUP BY on VARCHAR columns and ungrouped aggregates\n");
+    
+    // Dictionary group columns are grouped by code: directly, through
+    // spill passes and in parallel workers, whose tables are merged
+    const char *dict_tables[] = { "group_dict_row", "group_dict_column" };
+    const int dict_rows = 3000;
+    tuple_t *tuples = calloc(dict_rows, sizeof(tuple_t));
+    assert(tuples != NULL);
+    for (int i = 0; i < dict_rows; i++) {
+        int id = i + 1;
+        tuple_t *tuple = &tuples[i];
+        tuple->column_count = 4;
+        tuple->values[0].type = DATA_TYPE_INT;
+        tuple->values[0].data.int_val = id;
+        tuple->values[1].type = DATA_TYPE_VARCHAR;
+        tuple->values[1].is_null = id % 7 == 0;
+        snprintf(tuple->values[1].data.str_val, MAX_VALUE_SIZE, "region-%d", id % 5);
+        tuple->values[2].type = DATA_TYPE_INT;
+        tuple->values[2].data.int_val = id % 10;
+        tuple->values[3].type = DATA_TYPE_VARCHAR;
+        snprintf(tuple->values[3].data.str_val, MAX_VALUE_SIZE, "tier%d", id % 3);
+    }
+    for (int t = 0; t < 2; t++) {
+        snprintf(sql, sizeof(sql), "CREATE TABLE %s (id INT PRIMARY KEY, region VARCHAR(16) DICTIONARY, qty INT, "
+                 "tier VARCHAR(8) DICTIONARY) STORAGE = %s", dict_tables[t], storage[t]);
+        assert(sql_execute(db, sql, &txn) == 0);
+        assert(tuple_insert_batch(db, dict_tables[t], tuples, dict_rows, txn) == 0);
+    }
+    free(tuples);
+    
+    int dict_group = 1;
+    aggregate_spec_t dict_specs[] = { { AGG_COUNT_STAR, 0 }, { AGG_SUM, 2 }, { AGG_MIN, 3 }, { AGG_MAX, 3 } };
+    for (int t = 0; t < 2; t++) {
+        check_dictionary_groups(exec_group_aggregate_create(exec_scan_create(db, dict_tables[t], NULL, 0, txn),
+                                                            &dict_group, 1, dict_specs, 4, 0), dict_rows);
+        check_dictionary_groups(exec_group_aggregate_create(exec_scan_create(db, dict_tables[t], NULL, 0, txn),
+                                                            &dict_group, 1, dict_specs, 4, 1), dict_rows);
+        
+        operator_t *scans[4];
+        for (int w = 0; w < 4; w++) {
+            scans[w] = exec_scan_create(db, dict_tables[t], NULL, 0, txn);
+            assert(scans[w] != NULL && exec_scan_share(scans[w], scans[0]) == 0);
+        }
+        check_dictionary_groups(exec_parallel_aggregate_create(scans, 4, &dict_group, 1, dict_specs, 4, 0),
+                                dict_rows);
+        for (int w = 0; w < 4; w++) {
+            scans[w] = exec_scan_create(db, dict_tables[t], NULL, 0, txn);
+            assert(scans[w] != NULL && exec_scan_share(scans[w], scans[0]) == 0);
+        }
+        check_dictionary_groups(exec_parallel_aggregate_create(scans, 4, &dict_group, 1, dict_specs, 4, 1),
+                                dict_rows);
+    }
+    printf("✓ GROUP BY on dictionary columns hashes codes and decodes each group once\n");
+    
+    result = sql_execute(db, "SELECT region, COUNT(*), SUM(qty) AS total, AVG(qty) FROM group_row GROUP BY region",
+                         &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT COUNT(*), MAX(region) FROM group_column WHERE qty > 5", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT SUM(id), bucket FROM group_column WHERE bucket < 3 GROUP BY bucket, qty", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT qty, COUNT(*) FROM group_row", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT SUM(region) FROM group_row", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT * FROM group_row GROUP BY qty", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT COUNT(id FROM group_row", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ SQL aggregates with GROUP BY\n");
+    
+    db_close(db);
+    
+    printf("=== GROUP BY Test Passed ===\n\n");
+}
+
+// Runs orders (id, cust, amount) JOIN customers (id, region) ON cust = id
+// with the given build budget and checks every output row. Customer c has
+// ids c, c+250, ... among the 2000 orders; customers 1..200 exist.
+static void check_join(database_t *db, join_type_t type, size_t memory_budget, transaction_id_t txn) {
+    int order_columns[] = { 0, 1, 2 };
+    int customer_columns[] = { 0, 1 };
+    int left_key = 1, right_key = 0;
+    
+    operator_t *left = exec_scan_create(db, "orders", order_columns, 3, txn);
+    operator_t *right = exec_scan_create(db, "customers", customer_columns, 2, txn);
+    operator_t *plan = exec_hash_join_create(left, right, &left_key, &right_key, 1, type, memory_budget);
+    assert(plan != NULL);
+    assert(plan->column_count == 5);
+    assert(strcmp(plan->column_names[3], "id") == 0);
+    
+    int matched = 0, unmatched = 0;
+    batch_t *batch;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        for (int k = 0; k < batch->selected_count; k++) {
+            int row = batch->selection[k];
+            value_t cust, id, region;
+            batch_get_value(batch, 1, row, &cust);
+            batch_get_value(batch, 3, row, &id);
+            batch_get_value(batch, 4, row, &region);
+            
+            if (id.is_null) {
+                assert(type == JOIN_LEFT && region.is_null);
+                assert(cust.data.int_val == 0 || cust.data.int_val > 200);
+                unmatched++;
+            } else {
+                assert(id.data.int_val == cust.data.int_val);
+                assert(region.data.int_val == id.data.int_val % 7);
+                matched++;
+            }
+        }
+    }
+    exec_destroy(plan);
+    assert(matched == 1600);
+    assert(unmatched == (type == JOIN_LEFT ? 400 : 0));
+}
+
+void test_join() {
+    printf("=== Testing Joins ===\n");
+    
+    database_t *db = db_create("test_join.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    int result = sql_execute(db, "CREATE TABLE customers (id INT PRIMARY KEY, region INT, name VARCHAR(16))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE orders (id INT PRIMARY KEY, cust INT, amount INT) STORAGE = COLUMN",
+                         &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 1; i <= 200; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO customers VALUES (%d, %d, 'c%d')", i, i % 7, i);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    for (int i = 1; i <= 2000; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO orders VALUES (%d, %d, %d)", i, i % 250, i % 13);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    check_join(db, JOIN_INNER, 0, txn);
+    check_join(db, JOIN_LEFT, 0, txn);
+    printf("✓ Hash join matches keys, LEFT JOIN pads unmatched rows with NULLs\n");
+    
+    check_join(db, JOIN_INNER, 4096, txn);
+    check_join(db, JOIN_LEFT, 4096, txn);
+    printf("✓ Build sides over the memory budget are partitioned to disk\n");
+    
+    // Eight orders per customer: one probe batch yields more than a batch
+    int customer_columns[] = { 0, 1 };
+    int order_columns[] = { 1, 2 };
+    int left_key = 0, right_key = 0;
+    operator_t *plan = exec_hash_join_create(exec_scan_create(db, "customers", customer_columns, 2, txn),
+                                             exec_scan_create(db, "orders", order_columns, 2, txn),
+                                             &left_key, &right_key, 1, JOIN_INNER, 0);
+    assert(plan != NULL);
+    int rows = 0;
+    batch_t *batch;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        assert(batch->selected_count <= BATCH_SIZE);
+        rows += batch->selected_count;
+    }
+    exec_destroy(plan);
+    assert(rows == 1600);
+    printf("✓ Matches of one probe batch continue across output batches\n");
+    
+    // SELECT orders.id, name FROM orders JOIN customers ON cust = customers.id WHERE amount = 5
+    join_spec_t join = { "orders", "customers", JOIN_INNER, 1, 0 };
+    scalar_expr_t items[2];
+    items[0] = item_column(0);
+    items[1] = item_column(5);
+    expr_t where;
+    expr_init(&where);
+    where.root = where_int(&where, 2, CMP_EQ, 5);
+    
+    for (int filtered = 0; filtered < 2; filtered++) {
+        plan = plan_join(db, &join, items, 2, filtered ? &where : NULL, txn);
+        assert(plan != NULL);
+        assert(strcmp(plan->child->name, filtered ? "Index Join" : "Hash Join") == 0);
+        
+        int expected = 0;
+        for (int i = 1; i <= 2000; i++) {
+            if (i % 250 >= 1 && i % 250 <= 200 && (!filtered || i % 13 == 5)) expected++;
+        }
+        
+        rows = 0;
+        assert(exec_open(plan) == 0);
+        while (exec_next(plan, &batch) > 0) {
+            for (int k = 0; k < batch->selected_count; k++) {
+                value_t id, name;
+                batch_get_value(batch, 0, batch->selection[k], &id);
+                batch_get_value(batch, 1, batch->selection[k], &name);
+                if (filtered) assert(id.data.int_val % 13 == 5);
+                assert(atoi(name.data.str_val + 1) == id.data.int_val % 250);
+                rows++;
+            }
+        }
+        exec_destroy(plan);
+        assert(rows == expected);
+    }
+    printf("✓ Filtered outer rows are joined through the primary index\n");
+    
+    result = sql_execute(db, "SELECT orders.id, name, amount FROM orders JOIN customers ON cust = customers.id "
+                             "WHERE region = 2 AND amount < 2", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT name, orders.id FROM customers LEFT OUTER JOIN orders ON customers.id = cust "
+                             "WHERE customers.id < 3", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT * FROM orders INNER JOIN customers ON orders.cust = customers.id "
+                             "WHERE orders.id = 7", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT id FROM orders JOIN customers ON cust = customers.id", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT name FROM orders JOIN customers ON orders.cust = orders.amount", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT COUNT(*) FROM orders JOIN customers ON cust = customers.id", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT name FROM orders JOIN customers WHERE cust = 1", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ SQL INNER and LEFT JOIN with qualified column names\n");
+    
+    db_close(db);
+    
+    printf("=== Join Test Passed ===\n\n");
+}
+
+// Test input of `rows` rows (key, seq) in batches of 8: key cycles through
+// 0..100 in a scrambled order and seq counts the rows
+typedef struct {
+    int rows;
+    int next;
+    batch_t batch;
+} generator_state_t;
+
+static int generator_open(operator_t *op) {
+    generator_state_t *state = op->state;
+    state->next = 0;
+    return batch_init(&state->batch, op->column_count, op->column_types);
+}
+
+static int generator_next(operator_t *op, batch_t **batch) {
+    generator_state_t *state = op->state;
+    int count = 0;
+    for (; count < 8 && state->next < state->rows; count++, state->next++) {
+        state->batch.columns[0].ints[count] = state->next * 37 % 101;
+        state->batch.columns[0].nulls[count] = 0;
+        state->batch.columns[1].ints[count] = state->next;
+        state->batch.columns[1].nulls[count] = 0;
+    }
+    if (count == 0) return 0;
+    
+    state->batch.row_count = count;
+    batch_select_all(&state->batch);
+    *batch = &state->batch;
+    return 1;
+}
+
+static void generator_close(operator_t *op) {
+    generator_state_t *state = op->state;
+    batch_free(&state->batch);
+}
+
+static operator_t* generator_create(database_t *db, int rows) {
+    operator_t *op = exec_operator_create("Generator", db, NULL, sizeof(generator_state_t));
+    assert(op != NULL);
+    ((generator_state_t*)op->state)->rows = rows;
+    op->column_count = 2;
+    op->column_types[0] = DATA_TYPE_INT;
+    op->column_types[1] = DATA_TYPE_INT;
+    strcpy(op->column_names[0], "key");
+    strcpy(op->column_names[1], "seq");
+    op->open = generator_open;
+    op->next = generator_next;
+    op->close = generator_close;
+    return op;
+}
+
+// Reads the (key, seq) output of a plan into the arrays
+static int collect_rows(operator_t *plan, int *keys, int *seqs, int max_rows) {
+    int rows = 0;
+    batch_t *batch;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        for (int k = 0; k < batch->selected_count; k++) {
+            assert(rows < max_rows);
+            keys[rows] = batch->columns[0].ints[batch->selection[k]];
+            seqs[rows] = batch->columns[1].ints[batch->selection[k]];
+            rows++;
+        }
+    }
+    exec_destroy(plan);
+    return rows;
+}
+
+void test_order_by() {
+    printf("=== Testing ORDER BY and LIMIT ===\n");
+    
+    database_t *db = db_create("test_order.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    static int keys[8000], seqs[8000], expected_keys[8000], expected_seqs[8000];
+    sort_key_t by_key = { 0, 0 };
+    
+    // In memory, and with a budget small enough that every input batch
+    // becomes a run and the runs need more than one merge pass
+    for (int external = 0; external < 2; external++) {
+        operator_t *plan = exec_sort_create(generator_create(db, 8000), &by_key, 1, external ? 1 : 0);
+        assert(plan != NULL);
+        assert(collect_rows(plan, keys, seqs, 8000) == 8000);
+        for (int i = 1; i < 8000; i++) {
+            assert(keys[i - 1] < keys[i] || (keys[i - 1] == keys[i] && seqs[i - 1] < seqs[i]));
+        }
+    }
+    printf("✓ External merge sort over temporary pages matches the stable in-memory order\n");
+    
+    sort_key_t descending = { 0, 1 };
+    for (int offset = 0; offset <= 30; offset += 30) {
+        operator_t *plan = exec_limit_create(exec_sort_create(generator_create(db, 8000), &descending, 1, 0), 50,
+                                             offset);
+        int expected = collect_rows(plan, expected_keys, expected_seqs, 8000);
+        assert(expected == 50);
+        
+        plan = exec_top_n_create(generator_create(db, 8000), &descending, 1, 50, offset);
+        assert(plan != NULL);
+        assert(collect_rows(plan, keys, seqs, 8000) == 50);
+        for (int i = 0; i < 50; i++) {
+            assert(keys[i] == expected_keys[i] && seqs[i] == expected_seqs[i]);
+        }
+    }
+    operator_t *plan = exec_top_n_create(generator_create(db, 20), &by_key, 1, 50, 10);
+    assert(collect_rows(plan, keys, seqs, 8000) == 10);
+    printf("✓ Top-N returns the same rows as sort followed by LIMIT\n");
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    int result = sql_execute(db, "CREATE TABLE ranked (id INT PRIMARY KEY, score INT, name VARCHAR(16))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 0; i < 300; i++) {
+        int id = i * 7 % 300 + 1;
+        snprintf(sql, sizeof(sql), "INSERT INTO ranked VALUES (%d, %d, 'n%d')", id, id % 11, id);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    // ORDER BY id reads the primary index; ORDER BY id DESC sorts
+    scalar_expr_t items[2];
+    items[0] = item_column(0);
+    items[1] = item_column(1);
+    sort_key_t by_id = { 0, 0 };
+    plan = plan_select_sorted(db, "ranked", items, 2, 2, NULL, &by_id, 1, -1, 0, txn);
+    assert(plan != NULL && strcmp(plan->name, "Range Scan") == 0);
+    assert(collect_rows(plan, keys, seqs, 8000) == 300);
+    for (int i = 0; i < 300; i++) {
+        assert(keys[i] == i + 1);
+    }
+    
+    sort_key_t by_id_descending = { 0, 1 };
+    plan = plan_select_sorted(db, "ranked", items, 2, 2, NULL, &by_id_descending, 1, 3, 0, txn);
+    assert(plan != NULL && strcmp(plan->name, "Top-N") == 0);
+    assert(collect_rows(plan, keys, seqs, 8000) == 3);
+    assert(keys[0] == 300 && keys[2] == 298);
+    
+    // Sorting on a column that is not output: score is dropped afterwards
+    sort_key_t by_score[] = { { 1, 1 }, { 0, 0 } };
+    plan = plan_select_sorted(db, "ranked", items, 2, 1, NULL, by_score, 2, 4, 0, txn);
+    assert(plan != NULL && strcmp(plan->name, "Project") == 0 && plan->column_count == 1);
+    batch_t *batch;
+    assert(exec_open(plan) == 0);
+    assert(exec_next(plan, &batch) == 1 && batch->selected_count == 4);
+    assert(batch->columns[0].ints[batch->selection[0]] == 10);
+    assert(batch->columns[0].ints[batch->selection[1]] == 21);
+    exec_destroy(plan);
+    printf("✓ Primary key order uses the index, other orders sort\n");
+    
+    result = sql_execute(db, "SELECT id, name FROM ranked ORDER BY score DESC, id LIMIT 3", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT id * 2 AS twice, score FROM ranked WHERE id < 20 ORDER BY twice DESC", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT * FROM ranked ORDER BY id LIMIT 2 OFFSET 5", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT name FROM ranked LIMIT 2", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT score, COUNT(*) AS n FROM ranked GROUP BY score ORDER BY n DESC, score LIMIT 3",
+                         &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT score, COUNT(*) FROM ranked GROUP BY score ORDER BY id", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT name FROM ranked ORDER BY missing", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT name FROM ranked LIMIT -1", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ SQL ORDER BY with aliases, hidden columns, LIMIT and OFFSET\n");
+    
+    db_close(db);
+    
+    printf("=== ORDER BY Test Passed ===\n\n");
+}
+
+// Groups `table_name` by bucket with workers sharing one scan and checks
+// every group. Row i has bucket (i - 1) % 200, qty i % 10 and name
+// 'n<i % 7>', for i = 1..2000.
+static void check_parallel_groups(database_t *db, const char *table_name, int worker_count, size_t memory_budget,
+                                  transaction_id_t txn) {
+    int scan_columns[] = { 0, 1, 2, 3 };
+    int group_column = 1;
+    aggregate_spec_t specs[] = { { AGG_COUNT_STAR, 0 }, { AGG_SUM, 2 }, { AGG_MIN, 0 }, { AGG_MAX, 3 } };
+    
+    operator_t *workers[MAX_PARALLELISM];
+    for (int w = 0; w < worker_count; w++) {
+        workers[w] = exec_scan_create(db, table_name, scan_columns, 4, txn);
+        assert(workers[w] != NULL);
+        assert(exec_scan_share(workers[w], workers[0]) == 0);
+    }
+    operator_t *plan = exec_parallel_aggregate_create(workers, worker_count, &group_column, 1, specs, 4,
+                                                      memory_budget);
+    assert(plan != NULL);
+    assert(strcmp(plan->name, "Parallel Hash Aggregate") == 0);
+    assert(strcmp(plan->column_names[4], "MAX(name)") == 0);
+    
+    uint8_t seen[200] = {0};
+    int groups = 0;
+    batch_t *batch;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        for (int k = 0; k < batch->selected_count; k++) {
+            int row = batch->selection[k];
+            value_t bucket, count, sum, min, max;
+            batch_get_value(batch, 0, row, &bucket);
+            batch_get_value(batch, 1, row, &count);
+            batch_get_value(batch, 2, row, &sum);
+            batch_get_value(batch, 3, row, &min);
+            batch_get_value(batch, 4, row, &max);
+            
+            int b = bucket.data.int_val;
+            assert(b >= 0 && b < 200 && !seen[b]);
+            seen[b] = 1;
+            assert(count.data.int_val == 10);
+            assert(sum.data.int_val == (b + 1) % 10 * 10);
+            assert(min.data.int_val == b + 1);
+            
+            int best = 0;
+            for (int i = b + 1; i <= 2000; i += 200) {
+                if (i % 7 > best) best = i % 7;
+            }
+            char expected[16];
+            snprintf(expected, sizeof(expected), "n%d", best);
+            assert(strcmp(max.data.str_val, expected) == 0);
+            groups++;
+        }
+    }
+    exec_destroy(plan);
+    assert(groups == 200);
+}
+
+void test_parallel_scan() {
+    printf("=== Testing Parallel Scans ===\n");
+    
+    database_t *db = db_create("test_parallel.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[256];
+    const char *tables[] = { "parallel_row", "parallel_column", "parallel_index" };
+    const char *storage[] = { "ROW", "COLUMN", "INDEX" };
+    
+    for (int t = 0; t < 3; t++) {
+        snprintf(sql, sizeof(sql),
+                 "CREATE TABLE %s (id INT PRIMARY KEY, bucket INT, qty INT, name VARCHAR(16)) STORAGE = %s",
+                 tables[t], storage[t]);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    
+    int result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 3; t++) {
+        for (int i = 1; i <= 2000; i++) {
+            snprintf(sql, sizeof(sql), "INSERT INTO %s VALUES (%d, %d, %d, 'n%d')", tables[t], i, (i - 1) % 200,
+                     i % 10, i % 7);
+            assert(sql_execute(db, sql, &txn) == 0);
+        }
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    assert(db->max_parallelism == 1);
+    db_set_max_parallelism(db, 4);
+    assert(db->max_parallelism == 4);
+    
+    // WHERE qty > 4 keeps ids ending in 5..9
+    expr_t where;
+    expr_init(&where);
+    where.root = where_int(&where, 2, CMP_GT, 4);
+    long long expected_sum = 0;
+    for (int i = 1; i <= 2000; i++) {
+        if (i % 10 > 4) expected_sum += i;
+    }
+    
+    for (int t = 0; t < 3; t++) {
+        operator_t *plan = plan_select(db, tables[t], NULL, 0, &where, txn);
+        assert(plan != NULL);
+        assert(strcmp(plan->name, "Gather") == 0);
+        
+        uint8_t seen[2001] = {0};
+        int count = 0;
+        long long sum = 0;
+        batch_t *batch;
+        assert(exec_open(plan) == 0);
+        while (exec_next(plan, &batch) > 0) {
+            for (int k = 0; k < batch->selected_count; k++) {
+                value_t id;
+                batch_get_value(batch, 0, batch->selection[k], &id);
+                assert(id.data.int_val >= 1 && id.data.int_val <= 2000 && !seen[id.data.int_val]);
+                seen[id.data.int_val] = 1;
+                sum += id.data.int_val;
+                count++;
+            }
+        }
+        exec_destroy(plan);
+        assert(count == 1000);
+        assert(sum == expected_sum);
+        
+        // Closing before the end stops workers waiting to hand over a batch
+        plan = plan_select(db, tables[t], NULL, 0, NULL, txn);
+        assert(exec_open(plan) == 0);
+        assert(exec_next(plan, &batch) == 1);
+        exec_destroy(plan);
+    }
+    printf("✓ Workers divide the pages of a table and filter them, returning each row once\n");
+    
+    aggregate_spec_t totals[] = { { AGG_COUNT_STAR, 0 }, { AGG_SUM, 0 }, { AGG_MIN, 3 }, { AGG_MAX, 2 },
+                                  { AGG_AVG, 2 } };
+    for (int t = 0; t < 3; t++) {
+        for (int filtered = 0; filtered < 2; filtered++) {
+            operator_t *plan = plan_aggregate(db, tables[t], NULL, 0, totals, 5, filtered ? &where : NULL, txn);
+            assert(plan != NULL);
+            assert(strcmp(plan->name, "Parallel Aggregate") == 0);
+            
+            value_t count, sum, min, max, avg;
+            batch_t *batch;
+            assert(exec_open(plan) == 0);
+            assert(exec_next(plan, &batch) == 1);
+            batch_get_value(batch, 0, 0, &count);
+            batch_get_value(batch, 1, 0, &sum);
+            batch_get_value(batch, 2, 0, &min);
+            batch_get_value(batch, 3, 0, &max);
+            batch_get_value(batch, 4, 0, &avg);
+            assert(exec_next(plan, &batch) == 0);
+            exec_destroy(plan);
+            
+            assert(count.data.int_val == (filtered ? 1000 : 2000));
+            assert(sum.data.int_val == (filtered ? expected_sum : 2000 * 2001 / 2));
+            assert(strcmp(min.data.str_val, "n0") == 0);
+            assert(max.data.int_val == 9);
+            assert(avg.data.float_val == (filtered ? 7.0f : 4.5f));
+        }
+    }
+    printf("✓ Ungrouped aggregates merge the partial results of each worker\n");
+    
+    for (int t = 0; t < 3; t++) {
+        check_parallel_groups(db, tables[t], 4, 0, txn);
+        check_parallel_groups(db, tables[t], 3, 4096, txn);
+    }
+    
+    int group_column = 1;
+    aggregate_spec_t specs[] = { { AGG_COUNT, 3 } };
+    operator_t *plan = plan_aggregate(db, "parallel_row", &group_column, 1, specs, 1, &where, txn);
+    assert(plan != NULL);
+    assert(strcmp(plan->name, "Parallel Hash Aggregate") == 0);
+    exec_destroy(plan);
+    printf("✓ Grouped aggregates merge worker tables and spill the groups that do not fit\n");
+    
+    // Primary key bounds and single-page tables are read by one scan
+    expr_t range;
+    expr_init(&range);
+    range.root = where_int(&range, 0, CMP_LT, 100);
+    long long key_sum;
+    assert(plan_count(db, "parallel_row", &range, txn, "Range Scan", &key_sum) == 99);
+    
+    result = sql_execute(db, "SET MAX_PARALLELISM = 0", &txn);
+    assert(result == 0);
+    assert(db->max_parallelism >= 1 && db->max_parallelism <= MAX_PARALLELISM);
+    result = sql_execute(db, "SET max_parallelism TO 64", &txn);
+    assert(result == 0);
+    assert(db->max_parallelism == MAX_PARALLELISM);
+    result = sql_execute(db, "SET MAX_PARALLELISM -1", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SET WORK_MEM = 4", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "SELECT bucket, COUNT(*), AVG(qty) FROM parallel_column WHERE qty > 7 GROUP BY bucket "
+                         "ORDER BY bucket LIMIT 3", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SET MAX_PARALLELISM 1", &txn);
+    assert(result == 0);
+    assert(db->max_parallelism == 1);
+    
+    plan = plan_aggregate(db, "parallel_row", NULL, 0, totals, 5, NULL, txn);
+    assert(strcmp(plan->name, "Aggregate") == 0);
+    exec_destroy(plan);
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ SET MAX_PARALLELISM chooses between serial and parallel plans\n");
+    
+    db_close(db);
+    
+    printf("=== Parallel Scan Test Passed ===\n\n");
+}
+
+void test_prepared_statements() {
+    printf("=== Testing Prepared Statements ===\n");
+    
+    database_t *db = db_create("test_prepared.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    int result = sql_execute(db, "CREATE TABLE prepared_old (id INT PRIMARY KEY)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE prepared_users (id INT PRIMARY KEY, name VARCHAR(200), score FLOAT)",
+                         &txn);
+    assert(result == 0);
+    
+    sql_prepared_t *insert = sql_prepare(db, "INSERT INTO prepared_users VALUES (?, ?, ?)");
+    assert(insert != NULL);
+    assert(sql_parameter_count(insert) == 3);
+    assert(sql_prepare(db, "INSERT INTO prepared_missing VALUES (?)") == NULL);
+    assert(sql_prepare(db, "INSERT INTO prepared_users VALUES (?, ?)") == NULL);
+    assert(sql_prepare(db, "SELECT * FROM prepared_users WHERE nickname = ?") == NULL);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    char name[128];
+    for (int i = 1; i <= 300; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        assert(sql_bind_int(insert, 1, i) == 0);
+        assert(sql_bind_text(insert, 2, name) == 0);
+        assert(sql_bind_float(insert, 3, i / 2.0f) == 0);
+        assert(sql_execute_prepared(insert, &txn) == 0);
+    }
+    
+    // Values stay bound until reset; a long string goes to overflow pages
+    memset(name, 'x', 100);
+    name[100] = '\0';
+    assert(sql_bind_int(insert, 1, 301) == 0);
+    assert(sql_bind_text(insert, 2, name) == 0);
+    assert(sql_bind_null(insert, 3) == 0);
+    assert(sql_execute_prepared(insert, &txn) == 0);
+    assert(sql_execute_prepared(insert, &txn) != 0);
+    assert(sql_bind_int(insert, 4, 0) != 0);
+    sql_reset(insert);
+    assert(sql_execute_prepared(insert, &txn) != 0);
+    
+    long long key_sum;
+    assert(scan_count(db, "prepared_users", txn, &key_sum) == 301);
+    assert(key_sum == 301 * 302 / 2);
+    
+    value_t key = { .type = DATA_TYPE_INT };
+    key.data.int_val = 301;
+    tuple_t *row = NULL;
+    int count = 0;
+    assert(tuple_select(db, "prepared_users", &key, &row, &count, txn) == 0 && count == 1);
+    assert(row->values[1].is_external && row->values[2].is_null);
+    key.data.int_val = 42;
+    assert(tuple_select(db, "prepared_users", &key, &row, &count, txn) == 0 && count == 1);
+    assert(strcmp(row->values[1].data.str_val, "user42") == 0 && row->values[2].data.float_val == 21.0f);
+    printf("✓ A prepared INSERT runs with new bound values each time\n");
+    
+    sql_prepared_t *select = sql_prepare(db, "SELECT name, score FROM prepared_users WHERE id = ?");
+    assert(select != NULL && sql_parameter_count(select) == 1);
+    for (int i = 1; i <= 3; i++) {
+        assert(sql_bind_int(select, 1, i * 100) == 0);
+        assert(sql_execute_prepared(select, &txn) == 0);
+    }
+    sql_finalize(select);
+    
+    select = sql_prepare(db, "SELECT COUNT(*) FROM prepared_users WHERE name = ? OR score > ?");
+    assert(select != NULL && sql_parameter_count(select) == 2);
+    assert(sql_bind_text(select, 1, "user7") == 0);
+    assert(sql_bind_int(select, 2, 149) == 0);
+    assert(sql_execute_prepared(select, &txn) == 0);
+    assert(sql_bind_text(select, 1, name) == 0);
+    assert(sql_execute_prepared(select, &txn) != 0);
+    sql_finalize(select);
+    
+    result = sql_execute(db, "SELECT * FROM prepared_users WHERE id = ?", &txn);
+    assert(result != 0);
+    printf("✓ Prepared queries take parameters in WHERE, plain SQL does not\n");
+    
+    sql_prepared_t *delete = sql_prepare(db, "DELETE FROM prepared_users WHERE id BETWEEN ? AND ?");
+    assert(delete != NULL && sql_parameter_count(delete) == 2);
+    assert(sql_bind_int(delete, 1, 10) == 0);
+    assert(sql_bind_int(delete, 2, 19) == 0);
+    assert(sql_execute_prepared(delete, &txn) == 0);
+    assert(sql_bind_int(delete, 1, 290) == 0);
+    assert(sql_bind_int(delete, 2, 400) == 0);
+    assert(sql_execute_prepared(delete, &txn) == 0);
+    assert(scan_count(db, "prepared_users", txn, &key_sum) == 301 - 10 - 12);
+    assert(key_is_visible(db, "prepared_users", 15, txn) == 0);
+    assert(key_is_visible(db, "prepared_users", 289, txn) == 1);
+    sql_finalize(delete);
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ A prepared DELETE removes each bound range\n");
+    
+    // Dropping a table moves the schemas after it; statements resolve again
+    assert(table_drop(db, "prepared_old") == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    assert(sql_bind_int(insert, 1, 1000) == 0);
+    assert(sql_bind_text(insert, 2, "late") == 0);
+    assert(sql_bind_float(insert, 3, 1.5f) == 0);
+    assert(sql_execute_prepared(insert, &txn) == 0);
+    assert(key_is_visible(db, "prepared_users", 1000, txn) == 1);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    assert(table_drop(db, "prepared_users") == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    assert(sql_execute_prepared(insert, &txn) != 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    sql_finalize(insert);
+    printf("✓ Prepared statements follow tables being created and dropped\n");
+    
+    db_close(db);
+    
+    printf("=== Prepared Statement Test Passed ===\n\n");
+}
+
+// Runs a query with binary output and reads the name of its first column
+static void first_column_name(database_t *db, const char *sql, transaction_id_t *txn, char *name) {
+    FILE *file = tmpfile();
+    assert(file != NULL);
+    db_set_result_output(db, file, RESULT_FORMAT_BINARY);
+    assert(sql_execute(db, sql, txn) == 0);
+    db_set_result_output(db, NULL, RESULT_FORMAT_TEXT);
+    rewind(file);
+    
+    char magic[8];
+    uint32_t column_count;
+    assert(fread(magic, 1, 8, file) == 8 && memcmp(magic, "TINYRES1", 8) == 0);
+    assert(fread(&column_count, sizeof(column_count), 1, file) == 1 && column_count > 0);
+    fgetc(file);
+    int length = fgetc(file);
+    assert(length > 0 && fread(name, 1, length, file) == (size_t)length);
+    name[length] = '\0';
+    fclose(file);
+}
+
+void test_statement_cache() {
+    printf("=== Testing Statement Cache ===\n");
+    
+    database_t *db = db_create("test_statement_cache.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    sql_cache_stats_t stats;
+    char sql[256];
+    sql_cache_get_stats(db, &stats);
+    assert(stats.hits == 0 && stats.misses == 0 && stats.entries == 0);
+    
+    int result = sql_execute(db, "CREATE TABLE cached (id INT PRIMARY KEY, name VARCHAR(20), qty INT)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = -50; i < 150; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO cached VALUES (%d, 'item%d', %d)", i, i, i % 7);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    sql_cache_get_stats(db, &stats);
+    assert(stats.misses == 1 && stats.hits == 199 && stats.entries == 1);
+    
+    value_t key = { .type = DATA_TYPE_INT };
+    key.data.int_val = -7;
+    tuple_t *row = NULL;
+    int count = 0;
+    assert(tuple_select(db, "cached", &key, &row, &count, txn) == 0 && count == 1);
+    assert(strcmp(row->values[1].data.str_val, "item-7") == 0 && row->values[2].data.int_val == 0);
+    long long key_sum;
+    assert(scan_count(db, "cached", txn, &key_sum) == 200);
+    printf("✓ INSERTs differing only in their literals share one cached statement\n");
+    
+    result = sql_execute(db, "SELECT * FROM cached WHERE id = 5", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "  SELECT *   FROM cached\tWHERE id =   77 ", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT*FROM cached WHERE id=78", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT * FROM cached WHERE name = 'item12'", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT * FROM cached ORDER BY id DESC LIMIT 2", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT * FROM cached ORDER BY id DESC LIMIT 3 OFFSET 1", &txn);
+    assert(result == 0);
+    sql_cache_get_stats(db, &stats);
+    assert(stats.misses == 5 && stats.hits == 201 && stats.entries == 5);
+    
+    // The select list is kept as it is written, constants included
+    result = sql_execute(db, "SELECT id * 2 FROM cached WHERE id = 3", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT id * 2 FROM cached WHERE id = 4", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT * FROM cached WHERE id = ?", &txn);
+    assert(result != 0);
+    sql_cache_get_stats(db, &stats);
+    assert(stats.misses == 6 && stats.hits == 202 && stats.entries == 6);
+    printf("✓ Spacing around tokens is ignored; select lists and LIMIT counts stay part of the key\n");
+    
+    result = sql_execute(db, "DELETE FROM cached WHERE id BETWEEN -50 AND -41", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "DELETE FROM cached WHERE id BETWEEN 140 AND 200", &txn);
+    assert(result == 0);
+    assert(scan_count(db, "cached", txn, &key_sum) == 180);
+    assert(key_is_visible(db, "cached", -40, txn) == 1 && key_is_visible(db, "cached", -41, txn) == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ Cached DELETEs take negative literals and BETWEEN bounds\n");
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 0; i < SQL_CACHE_SIZE + 5; i++) {
+        snprintf(sql, sizeof(sql), "SELECT id AS c%d FROM cached WHERE id = %d", i, i);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    sql_cache_get_stats(db, &stats);
+    assert(stats.entries == SQL_CACHE_SIZE && stats.evictions == 7 + 5);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ The least recently used statements are evicted\n");
+    
+    result = sql_execute(db, "CREATE TABLE cached_other (id INT PRIMARY KEY)", &txn);
+    assert(result == 0);
+    sql_cache_get_stats(db, &stats);
+    assert(stats.invalidations == SQL_CACHE_SIZE && stats.entries == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO cached VALUES (1000, 'new', 1)", &txn);
+    assert(result == 0);
+    sql_cache_get_stats(db, &stats);
+    assert(stats.invalidations == SQL_CACHE_SIZE && stats.entries == 1);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    assert(table_drop(db, "cached") == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO cached VALUES (1001, 'gone', 1)", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "INSERT INTO cached_other VALUES (1)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    sql_cache_get_stats(db, &stats);
+    assert(stats.invalidations == SQL_CACHE_SIZE + 1);
+    printf("✓ Creating or dropping a table empties the cache\n");
+    
+    result = sql_execute(db, "CREATE TABLE cached_left (id INT PRIMARY KEY, v INT)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE cached_right (id INT PRIMARY KEY, lid INT)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int i = 0; i < 10; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO cached_left VALUES (%d, %d)", i, i * 10);
+        assert(sql_execute(db, sql, &txn) == 0);
+        snprintf(sql, sizeof(sql), "INSERT INTO cached_right VALUES (%d, %d)", 100 + i, i);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    sql_cache_get_stats(db, &stats);
+    long long hits = stats.hits;
+    long long misses = stats.misses;
+    result = sql_execute(db, "SELECT cached_left.v, cached_right.id FROM cached_left "
+                             "JOIN cached_right ON cached_left.id = cached_right.lid WHERE cached_left.id = 1", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "SELECT cached_left.v, cached_right.id FROM cached_left "
+                             "JOIN cached_right ON cached_left.id=cached_right.lid WHERE cached_left.id=2", &txn);
+    assert(result == 0);
+    sql_cache_get_stats(db, &stats);
+    assert(stats.misses == misses + 1 && stats.hits == hits + 1);
+    
+    // Computed columns keep the name they were written with
+    char name[256];
+    first_column_name(db, "SELECT id*v FROM cached_left WHERE id = 3", &txn, name);
+    assert(strcmp(name, "id*v") == 0);
+    first_column_name(db, "SELECT id * v FROM cached_left WHERE id=4", &txn, name);
+    assert(strcmp(name, "id * v") == 0);
+    first_column_name(db, "SELECT id * v FROM cached_left WHERE id = 5", &txn, name);
+    assert(strcmp(name, "id * v") == 0);
+    sql_cache_get_stats(db, &stats);
+    assert(stats.misses == misses + 3 && stats.hits == hits + 2);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ Qualified names and computed columns are served from the cache\n");
+    
+    db_close(db);
+    
+    printf("=== Statement Cache Test Passed ===\n\n");
+}
+
+// Checks that a scan sees the rows in ascending key order
+static int scan_is_sorted(database_t *db, const char *table_name, transaction_id_t txn) {
+    table_cursor_t cursor;
+    tuple_t tuple;
+    int sorted = 1;
+    int first = 1;
+    int previous = 0;
+    
+    assert(table_scan_open(db, table_name, txn, &cursor) == 0);
+    while (table_scan_next(&cursor, &tuple) > 0) {
+        if (!first && tuple.values[0].data.int_val <= previous) sorted = 0;
+        previous = tuple.values[0].data.int_val;
+        first = 0;
+    }
+    table_scan_close(&cursor);
+    return sorted;
+}
+
+void test_batch_insert() {
+    printf("=== Testing Batch Insert ===\n");
+    
+    database_t *db = db_create("test_batch_insert.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    long long key_sum;
+    char long_text[300];
+    memset(long_text, 'x', sizeof(long_text) - 1);
+    long_text[sizeof(long_text) - 1] = '\0';
+    
+    int result = sql_execute(db, "CREATE TABLE batch_row (id INT PRIMARY KEY, label VARCHAR(400))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE batch_column (id INT PRIMARY KEY, label VARCHAR(400)) STORAGE = COLUMN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE batch_index (id INT PRIMARY KEY, label VARCHAR(400)) STORAGE = INDEX", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    char *sql = malloc(64 * 1024);
+    assert(sql != NULL);
+    int length = sprintf(sql, "INSERT INTO batch_row VALUES (5, 'five'), (-3, '%s'), (9, 'nine'),\n (1, 'one')",
+                         long_text);
+    assert(length > 0);
+    result = sql_execute(db, sql, &txn);
+    assert(result == 0);
+    assert(scan_count(db, "batch_row", txn, &key_sum) == 4 && key_sum == 12);
+    assert(scan_is_sorted(db, "batch_row", txn));
+    
+    value_t key = { .type = DATA_TYPE_INT };
+    tuple_t *row = NULL;
+    int count = 0;
+    key.data.int_val = -3;
+    assert(tuple_select(db, "batch_row", &key, &row, &count, txn) == 0 && count == 1);
+    assert(row->values[1].is_external && row->values[1].data.ext.length == strlen(long_text));
+    printf("✓ INSERT takes several rows and stores them in key order\n");
+    
+    // Mismatched rows, and keys repeated within the statement or already
+    // in the table, reject the whole statement
+    result = sql_execute(db, "INSERT INTO batch_row VALUES (20, 'a'), (21)", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "INSERT INTO batch_row VALUES (20, 'a'), (21, 'b'), (20, 'c')", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "INSERT INTO batch_row VALUES (20, 'a'), (9, 'b')", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "INSERT INTO batch_row VALUES (20, 'a'), (21, 7)", &txn);
+    assert(result != 0);
+    assert(scan_count(db, "batch_row", txn, &key_sum) == 4 && key_sum == 12);
+    printf("✓ A bad row or duplicate key rejects the whole batch\n");
+    
+    // A large statement fills many pages and index leaves
+    const char *tables[] = { "batch_row", "batch_column", "batch_index" };
+    for (int t = 0; t < 3; t++) {
+        length = sprintf(sql, "INSERT INTO %s VALUES ", tables[t]);
+        for (int i = 0; i < 1000; i++) {
+            int id = 100 + (i * 617) % 1000;
+            length += sprintf(sql + length, "%s(%d, 'label %d')", i ? ", " : "", id, id);
+        }
+        result = sql_execute(db, sql, &txn);
+        assert(result == 0);
+        int base = t == 0 ? 4 : 0;
+        assert(scan_count(db, tables[t], txn, &key_sum) == base + 1000);
+        assert(key_sum == (t == 0 ? 12 : 0) + 1000LL * 100 + 999LL * 1000 / 2);
+        for (int id = 100; id < 1100; id += 7) {
+            assert(key_is_visible(db, tables[t], id, txn) == 1);
+        }
+    }
+    assert(scan_is_sorted(db, "batch_row", txn) && scan_is_sorted(db, "batch_index", txn));
+    printf("✓ Large batches go to row, column and index-organized tables\n");
+    
+    tuple_t tuples[300];
+    for (int i = 0; i < 300; i++) {
+        tuples[i].column_count = 2;
+        tuples[i].values[0] = (value_t){ .type = DATA_TYPE_INT };
+        tuples[i].values[0].data.int_val = 2000 + (299 - i);
+        tuples[i].values[1] = (value_t){ .type = DATA_TYPE_VARCHAR };
+        snprintf(tuples[i].values[1].data.str_val, MAX_VALUE_SIZE, "api %d", i);
+    }
+    assert(tuple_insert_batch(db, "batch_index", tuples, 300, txn) == 0);
+    assert(tuple_insert_batch(db, "batch_index", tuples, 300, txn) != 0);
+    tuples[150].values[0].data.int_val = tuples[10].values[0].data.int_val;
+    assert(tuple_insert_batch(db, "batch_row", tuples, 300, txn) != 0);
+    assert(scan_count(db, "batch_row", txn, &key_sum) == 1004);
+    tuples[150].values[0].data.int_val = 5000;
+    assert(tuple_insert_batch(db, "batch_row", tuples, 300, txn) == 0);
+    assert(scan_count(db, "batch_row", txn, &key_sum) == 1304);
+    assert(scan_count(db, "batch_index", txn, &key_sum) == 1300);
+    assert(key_is_visible(db, "batch_row", 5000, txn) == 1 && key_is_visible(db, "batch_index", 5000, txn) == 0);
+    assert(tuple_insert_batch(db, "missing", tuples, 300, txn) != 0);
+    printf("✓ tuple_insert_batch() checks keys against the table first\n");
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    free(sql);
+    db_close(db);
+    
+    printf("=== Batch Insert Test Passed ===\n\n");
+}
+
+void test_copy() {
+    printf("=== Testing COPY ===\n");
+    
+    database_t *db = db_create("test_copy.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    long long key_sum;
+    value_t key = { .type = DATA_TYPE_INT };
+    tuple_t *row = NULL;
+    int count = 0;
+    
+    int result = sql_execute(db, "CREATE TABLE copy_in (id INT PRIMARY KEY, name VARCHAR(400), score FLOAT)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE copy_binary (id INT PRIMARY KEY, name VARCHAR(400), score FLOAT)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE copy_csv (id INT PRIMARY KEY, name VARCHAR(400), score FLOAT) "
+                             "STORAGE = INDEX", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE copy_narrow (id INT PRIMARY KEY, name VARCHAR(16)) STORAGE = COLUMN", &txn);
+    assert(result == 0);
+    
+    // Enough rows for several chunks, keys out of order, and fields that
+    // need quoting
+    FILE *file = fopen("test_copy.csv", "w");
+    assert(file != NULL);
+    fprintf(file, "id,name,score\n");
+    for (int i = 0; i < 30000; i++) {
+        int id = (i * 7919) % 30000;
+        fprintf(file, "%d,row %d,%d.5\n", id, id, id % 100);
+    }
+    fprintf(file, "-1,\"quoted, with \"\"quotes\"\"\nand a newline\",\r\n");
+    fprintf(file, "-2,,0.25\n\n");
+    fprintf(file, "-3,\"");
+    for (int i = 0; i < 300; i++) fputc('a' + i % 26, file);
+    fprintf(file, "\",1e3");
+    fclose(file);
+    
+    result = sql_execute(db, "SET MAX_PARALLELISM = 4", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COPY copy_in FROM 'test_copy.csv' CSV HEADER", &txn);
+    assert(result == 0);
+    assert(scan_count(db, "copy_in", txn, &key_sum) == 30003);
+    assert(key_sum == 29999LL * 30000 / 2 - 6);
+    
+    key.data.int_val = 4242;
+    assert(tuple_select(db, "copy_in", &key, &row, &count, txn) == 0 && count == 1);
+    assert(strcmp(row->values[1].data.str_val, "row 4242") == 0 && row->values[2].data.float_val == 42.5f);
+    key.data.int_val = -1;
+    assert(tuple_select(db, "copy_in", &key, &row, &count, txn) == 0 && count == 1);
+    assert(strcmp(row->values[1].data.str_val, "quoted, with \"quotes\"\nand a newline") == 0);
+    assert(row->values[2].is_null);
+    key.data.int_val = -2;
+    assert(tuple_select(db, "copy_in", &key, &row, &count, txn) == 0 && count == 1);
+    assert(row->values[1].is_null && row->values[2].data.float_val == 0.25f);
+    key.data.int_val = -3;
+    assert(tuple_select(db, "copy_in", &key, &row, &count, txn) == 0 && count == 1);
+    assert(row->values[1].is_external && row->values[1].data.ext.length == 300);
+    assert(row->values[2].data.float_val == 1000.0f);
+    printf("✓ COPY FROM loads a CSV file with quoted fields and NULLs on worker threads\n");
+    
+    result = sql_execute(db, "COPY copy_in TO 'test_copy.bin' BINARY", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COPY copy_binary FROM 'test_copy.bin' BINARY", &txn);
+    assert(result == 0);
+    assert(scan_count(db, "copy_binary", txn, &key_sum) == 30003);
+    assert(key_sum == 29999LL * 30000 / 2 - 6);
+    
+    result = sql_execute(db, "COPY copy_in TO 'test_copy_out.csv' CSV HEADER", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COPY copy_csv FROM 'test_copy_out.csv' CSV HEADER", &txn);
+    assert(result == 0);
+    assert(scan_count(db, "copy_csv", txn, &key_sum) == 30003);
+    
+    const char *tables[] = { "copy_binary", "copy_csv" };
+    for (int t = 0; t < 2; t++) {
+        key.data.int_val = -1;
+        assert(tuple_select(db, tables[t], &key, &row, &count, txn) == 0 && count == 1);
+        assert(strcmp(row->values[1].data.str_val, "quoted, with \"quotes\"\nand a newline") == 0);
+        assert(row->values[2].is_null);
+        key.data.int_val = -2;
+        assert(tuple_select(db, tables[t], &key, &row, &count, txn) == 0 && count == 1);
+        assert(row->values[1].is_null && row->values[2].data.float_val == 0.25f);
+        key.data.int_val = 29999;
+        assert(tuple_select(db, tables[t], &key, &row, &count, txn) == 0 && count == 1);
+        assert(strcmp(row->values[1].data.str_val, "row 29999") == 0 && row->values[2].data.float_val == 99.5f);
+    }
+    printf("✓ COPY TO writes binary and CSV files that load back unchanged\n");
+    
+    // Errors name the line, and a load stops at the first bad row
+    file = fopen("test_copy.csv", "w");
+    assert(file != NULL);
+    fprintf(file, "1,one\n2,two\nx,three\n");
+    fclose(file);
+    result = sql_execute(db, "COPY copy_narrow FROM 'test_copy.csv'", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "COPY copy_narrow FROM 'test_copy.bin' BINARY", &txn);
+    assert(result != 0);
+    file = fopen("test_copy.csv", "w");
+    assert(file != NULL);
+    fprintf(file, "1,one\n2,two\n1,again\n");
+    fclose(file);
+    result = sql_execute(db, "COPY copy_narrow FROM 'test_copy.csv'", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "COPY copy_narrow FROM 'test_copy_missing.csv'", &txn);
+    assert(result != 0);
+    assert(scan_count(db, "copy_narrow", txn, &key_sum) == 0);
+    
+    long long rows;
+    file = fopen("test_copy.csv", "w");
+    assert(file != NULL);
+    fprintf(file, "7,seven\n8,\"eight\"\n");
+    fclose(file);
+    assert(copy_from_file(db, "copy_narrow", "test_copy.csv", COPY_FORMAT_CSV, 0, txn, &rows) == 0 && rows == 2);
+    assert(scan_count(db, "copy_narrow", txn, &key_sum) == 2 && key_sum == 15);
+    printf("✓ Bad values, duplicate keys and other tables' files are rejected\n");
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COPY copy_narrow FROM 'test_copy.csv'", &txn);
+    assert(result != 0);
+    
+    remove("test_copy.csv");
+    remove("test_copy_out.csv");
+    remove("test_copy.bin");
+    db_close(db);
+    
+    printf("=== COPY Test Passed ===\n\n");
+}
+
+// Counts the rows of the table for which `column op constant` holds
+static int filter_count(database_t *db, const char *table_name, int column, compare_op_t op,
+                        const value_t *constant, transaction_id_t txn) {
+    predicate_t predicate;
+    memset(&predicate, 0, sizeof(predicate));
+    predicate.column = column;
+    predicate.op = op;
+    predicate.constant = *constant;
+    
+    operator_t *plan = exec_filter_create(exec_scan_create(db, table_name, NULL, 0, txn), &predicate, 1);
+    assert(plan != NULL);
+    int count = 0;
+    batch_t *batch;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        count += batch->selected_count;
+    }
+    exec_destroy(plan);
+    return count;
+}
+
+static int compare_matches(compare_op_t op, int cmp) {
+    switch (op) {
+        case CMP_EQ: return cmp == 0;
+        case CMP_NE: return cmp != 0;
+        case CMP_LT: return cmp < 0;
+        case CMP_LE: return cmp <= 0;
+        case CMP_GT: return cmp > 0;
+        case CMP_GE: return cmp >= 0;
+    }
+    return 0;
+}
+
+void test_filter_kernels() {
+    printf("=== Testing Filter Kernels ===\n");
+    
+    database_t *db = db_create("test_filter_kernels.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    const int rows = 3000;
+    int result = sql_execute(db, "CREATE TABLE kernels (id INT PRIMARY KEY, qty INT, price FLOAT, "
+                                 "name VARCHAR(100))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    // Every seventh qty and price is NULL, and every fifth name is long
+    // enough for an overflow page
+    char names[3000][100];
+    tuple_t *tuples = calloc(rows, sizeof(tuple_t));
+    assert(tuples != NULL);
+    for (int i = 0; i < rows; i++) {
+        snprintf(names[i], sizeof(names[i]), i % 5 == 0 ? "%04d-%080d" : "%04d", (i * 37) % 1000, i);
+        tuple_t *tuple = &tuples[i];
+        tuple->column_count = 4;
+        tuple->values[0].type = DATA_TYPE_INT;
+        tuple->values[0].data.int_val = i;
+        tuple->values[1].type = DATA_TYPE_INT;
+        tuple->values[1].data.int_val = i % 50 - 25;
+        tuple->values[1].is_null = i % 7 == 0;
+        tuple->values[2].type = DATA_TYPE_FLOAT;
+        tuple->values[2].data.float_val = (i % 40) * 0.5f;
+        tuple->values[2].is_null = i % 7 == 0;
+        tuple->values[3].type = DATA_TYPE_VARCHAR;
+        if (strlen(names[i]) < MAX_VALUE_SIZE) {
+            strcpy(tuple->values[3].data.str_val, names[i]);
+        } else {
+            tuple->values[3].is_external = 1;
+            tuple->values[3].data.ext.length = strlen(names[i]);
+            tuple->values[3].data.ext.data = names[i];
+        }
+    }
+    assert(tuple_insert_batch(db, "kernels", tuples, rows, txn) == 0);
+    free(tuples);
+    
+    const compare_op_t ops[] = { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE };
+    for (int o = 0; o < 6; o++) {
+        compare_op_t op = ops[o];
+        value_t int_constant = { .type = DATA_TYPE_INT };
+        int_constant.data.int_val = 3;
+        value_t float_constant = { .type = DATA_TYPE_FLOAT };
+        float_constant.data.float_val = 3.5f;
+        value_t text_constant = { .type = DATA_TYPE_VARCHAR };
+        strcpy(text_constant.data.str_val, "0370");
+        
+        int expected[5] = { 0 };
+        for (int i = 0; i < rows; i++) {
+            int qty = i % 50 - 25;
+            float price = (i % 40) * 0.5f;
+            if (i % 7 != 0) {
+                expected[0] += compare_matches(op, (qty > 3) - (qty < 3));
+                expected[1] += compare_matches(op, ((float)qty > 3.5f) - ((float)qty < 3.5f));
+                expected[2] += compare_matches(op, (price > 3.5f) - (price < 3.5f));
+                expected[3] += compare_matches(op, (price > 3.0f) - (price < 3.0f));
+            }
+            expected[4] += compare_matches(op, strcmp(names[i], "0370"));
+        }
+        
+        assert(filter_count(db, "kernels", 1, op, &int_constant, txn) == expected[0]);
+        assert(filter_count(db, "kernels", 1, op, &float_constant, txn) == expected[1]);
+        assert(filter_count(db, "kernels", 2, op, &float_constant, txn) == expected[2]);
+        assert(filter_count(db, "kernels", 2, op, &int_constant, txn) == expected[3]);
+        assert(filter_count(db, "kernels", 3, op, &text_constant, txn) == expected[4]);
+        
+        value_t null_constant = { .type = DATA_TYPE_INT, .is_null = 1 };
+        assert(filter_count(db, "kernels", 1, op, &null_constant, txn) == 0);
+    }
+    printf("✓ Every column type, constant type and operator matches a row-by-row check\n");
+    
+    value_t text_constant = { .type = DATA_TYPE_VARCHAR };
+    predicate_t mismatch;
+    memset(&mismatch, 0, sizeof(mismatch));
+    mismatch.column = 1;
+    mismatch.op = CMP_EQ;
+    mismatch.constant = text_constant;
+    operator_t *scan = exec_scan_create(db, "kernels", NULL, 0, txn);
+    assert(exec_filter_create(scan, &mismatch, 1) == NULL);
+    exec_destroy(scan);
+    printf("✓ Comparisons of strings with numbers are rejected when the filter is built\n");
+    
+    // Dictionary columns are filtered on their codes, in row and PAX tables
+    const char *statuses[] = { "pending", "shipped", "delivered", "returned" };
+    const char *tables[] = { "labels", "labels_pax" };
+    assert(sql_execute(db, "CREATE TABLE labels (id INT PRIMARY KEY, status VARCHAR(12) DICTIONARY)", &txn) == 0);
+    assert(sql_execute(db, "CREATE TABLE labels_pax (id INT PRIMARY KEY, status VARCHAR(12) DICTIONARY) "
+                           "STORAGE = COLUMN", &txn) == 0);
+    tuples = calloc(400, sizeof(tuple_t));
+    assert(tuples != NULL);
+    for (int i = 0; i < 400; i++) {
+        tuples[i].column_count = 2;
+        tuples[i].values[0].type = DATA_TYPE_INT;
+        tuples[i].values[0].data.int_val = i;
+        tuples[i].values[1].type = DATA_TYPE_VARCHAR;
+        tuples[i].values[1].is_null = i % 10 == 0;
+        strcpy(tuples[i].values[1].data.str_val, statuses[i % 4]);
+    }
+    for (int t = 0; t < 2; t++) {
+        assert(tuple_insert_batch(db, tables[t], tuples, 400, txn) == 0);
+        
+        const dictionary_t *dict = dictionary_get(db, find_table_schema(db, tables[t]), 1);
+        operator_t *scan = exec_scan_create(db, tables[t], NULL, 0, txn);
+        batch_t *batch;
+        assert(exec_open(scan) == 0 && exec_next(scan, &batch) == 1);
+        const vector_t *status = &batch->columns[1];
+        assert(status->dictionary == dict);
+        for (int k = 0; k < batch->selected_count; k++) {
+            int row = batch->selection[k];
+            int id = batch->columns[0].ints[row];
+            if (id % 10 == 0) continue;
+            assert(status->codes[row] == dictionary_find(dict, statuses[id % 4]));
+            assert(strcmp(status->strings[row].data.str_val, statuses[id % 4]) == 0);
+        }
+        exec_destroy(scan);
+        
+        value_t shipped = { .type = DATA_TYPE_VARCHAR };
+        strcpy(shipped.data.str_val, "shipped");
+        value_t missing = { .type = DATA_TYPE_VARCHAR };
+        strcpy(missing.data.str_val, "missing");
+        assert(filter_count(db, tables[t], 1, CMP_EQ, &shipped, txn) == 100);
+        assert(filter_count(db, tables[t], 1, CMP_NE, &shipped, txn) == 260);
+        assert(filter_count(db, tables[t], 1, CMP_EQ, &missing, txn) == 0);
+        assert(filter_count(db, tables[t], 1, CMP_NE, &missing, txn) == 360);
+        assert(filter_count(db, tables[t], 1, CMP_LT, &shipped, txn) == 260);
+        assert(filter_count(db, tables[t], 1, CMP_GE, &missing, txn) == 280);
+        
+        // Pushed into the scan, the filter reads the codes before the
+        // other columns are fetched for the matching rows
+        expr_t where;
+        expr_init(&where);
+        where.root = expr_add_compare(&where, 1, CMP_EQ, &shipped);
+        scan = exec_scan_create(db, tables[t], NULL, 0, txn);
+        assert(exec_scan_push_filter(scan, &where) == 0 && exec_open(scan) == 0);
+        int matched = 0;
+        while (exec_next(scan, &batch) > 0) {
+            for (int k = 0; k < batch->selected_count; k++) {
+                int row = batch->selection[k];
+                assert(batch->columns[0].ints[row] % 4 == 1);
+                assert(strcmp(batch->columns[1].strings[row].data.str_val, "shipped") == 0);
+                matched++;
+            }
+        }
+        assert(matched == 100);
+        exec_destroy(scan);
+    }
+    free(tuples);
+    printf("✓ Dictionary columns are compared by code, and a value not in the dictionary equals no row\n");
+    
+    // Row 0 has a long name; with its overflow page emptied the value can
+    // no longer be read, which must fail the query rather than drop the row
+    value_t key = { .type = DATA_TYPE_INT };
+    tuple_t *row = NULL;
+    int count = 0;
+    key.data.int_val = 0;
+    assert(tuple_select(db, "kernels", &key, &row, &count, txn) == 0 && count == 1);
+    assert(row->values[3].is_external);
+    page_t *overflow = buffer_get_page(db->buffer_pool, row->values[3].data.ext.page_id);
+    assert(overflow != NULL);
+    overflow_page_header_t *overflow_header = (overflow_page_header_t*)overflow->data;
+    uint32_t length = overflow_header->length;
+    overflow_header->length = 0;
+    
+    strcpy(text_constant.data.str_val, "0370");
+    predicate_t unreadable;
+    memset(&unreadable, 0, sizeof(unreadable));
+    unreadable.column = 3;
+    unreadable.op = CMP_LT;
+    unreadable.constant = text_constant;
+    operator_t *plan = exec_filter_create(exec_scan_create(db, "kernels", NULL, 0, txn), &unreadable, 1);
+    assert(plan != NULL && exec_open(plan) == 0);
+    batch_t *batch;
+    while ((result = exec_next(plan, &batch)) > 0) {
+    }
+    assert(result == -1);
+    exec_destroy(plan);
+    assert(sql_execute(db, "SELECT id FROM kernels WHERE name >= '0370'", &txn) != 0);
+    
+    overflow_header->length = length;
+    buffer_release_page(db->buffer_pool, overflow);
+    int below = 0;
+    for (int i = 0; i < rows; i++) {
+        below += strcmp(names[i], "0370") < 0;
+    }
+    assert(filter_count(db, "kernels", 3, CMP_LT, &text_constant, txn) == below);
+    printf("✓ A string that cannot be read fails the filter\n");
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    db_close(db);
+    
+    printf("=== Filter Kernels Test Passed ===\n\n");
+}
+
+typedef struct {
+    database_t *db;
+    const char *table_name;
+    transaction_id_t txn;
+    int first;
+    int mismatches;
+} lookup_worker_t;
+
+// Looks up keys from `first` on, through both APIs, and counts the rows
+// that do not belong to the key asked for
+static void* lookup_worker(void *arg) {
+    lookup_worker_t *worker = arg;
+    table_schema_t *schema = find_table_schema(worker->db, worker->table_name);
+    int columns[] = { 2, 0 };
+    
+    for (int i = 0; i < 2000; i++) {
+        int id = (worker->first + i * 13) % 1000;
+        value_t key = { .type = DATA_TYPE_INT };
+        key.data.int_val = id;
+        
+        tuple_t *row = NULL;
+        int count = 0;
+        if (tuple_select(worker->db, worker->table_name, &key, &row, &count, worker->txn) != 0 || count != 1 ||
+            row->values[0].data.int_val != id || row->values[1].data.int_val != id * 3) {
+            worker->mismatches++;
+        }
+        
+        tuple_t fetched;
+        if (tuple_fetch(worker->db, schema, &key, columns, 2, &fetched, worker->txn) != 1 ||
+            fetched.column_count != 2 || fetched.values[1].data.int_val != id ||
+            atoi(fetched.values[0].data.str_val) != id) {
+            worker->mismatches++;
+        }
+    }
+    return NULL;
+}
+
+void test_result_rows() {
+    printf("=== Testing Result Rows ===\n");
+    
+    database_t *db = db_create("test_result_rows.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    transaction_id_t other = 0;
+    char sql[4096];
+    const char *tables[] = { "rows_row", "rows_column", "rows_index" };
+    const char *storage[] = { "ROW", "COLUMN", "INDEX" };
+    
+    for (int t = 0; t < 3; t++) {
+        snprintf(sql, sizeof(sql), "CREATE TABLE %s (id INT PRIMARY KEY, triple INT, label VARCHAR(16)) "
+                 "STORAGE = %s", tables[t], storage[t]);
+        assert(sql_execute(db, sql, &txn) == 0);
+    }
+    int result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 3; t++) {
+        for (int i = 0; i < 1000; i += 100) {
+            int length = snprintf(sql, sizeof(sql), "INSERT INTO %s VALUES ", tables[t]);
+            for (int id = i; id < i + 100; id++) {
+                length += snprintf(sql + length, sizeof(sql) - length, "%s(%d, %d, '%d')",
+                                   id > i ? ", " : "", id, id * 3, id);
+            }
+            assert(sql_execute(db, sql, &txn) == 0);
+        }
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 3; t++) {
+        table_schema_t *schema = find_table_schema(db, tables[t]);
+        value_t key = { .type = DATA_TYPE_INT };
+        key.data.int_val = 321;
+        tuple_t row;
+        int columns[] = { 1 };
+        assert(tuple_fetch(db, schema, &key, NULL, 0, &row, txn) == 1);
+        assert(row.column_count == 3 && row.values[0].data.int_val == 321 && row.values[1].data.int_val == 963);
+        assert(strcmp(row.values[2].data.str_val, "321") == 0);
+        assert(tuple_fetch(db, schema, &key, columns, 1, &row, txn) == 1);
+        assert(row.column_count == 1 && row.values[0].data.int_val == 963);
+        
+        key.data.int_val = 5000;
+        assert(tuple_fetch(db, schema, &key, NULL, 0, &row, txn) == 0);
+    }
+    printf("✓ tuple_fetch() reads whole rows or chosen columns into the caller's buffer\n");
+    
+    // A row inserted by a transaction that has not committed is not found
+    result = sql_execute(db, "BEGIN", &other);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO rows_row VALUES (5000, 1, 'late')", &other);
+    assert(result == 0);
+    value_t late = { .type = DATA_TYPE_INT };
+    late.data.int_val = 5000;
+    tuple_t row;
+    assert(tuple_fetch(db, find_table_schema(db, "rows_row"), &late, NULL, 0, &row, txn) == 0);
+    assert(tuple_fetch(db, find_table_schema(db, "rows_row"), &late, NULL, 0, &row, other) == 1);
+    result = sql_execute(db, "ROLLBACK", &other);
+    assert(result == 0);
+    printf("✓ Rows another transaction cannot see yet are not returned\n");
+    
+    for (int t = 0; t < 3; t++) {
+        lookup_worker_t workers[4];
+        pthread_t threads[4];
+        for (int w = 0; w < 4; w++) {
+            workers[w] = (lookup_worker_t){ db, tables[t], txn, w * 250, 0 };
+            assert(pthread_create(&threads[w], NULL, lookup_worker, &workers[w]) == 0);
+        }
+        for (int w = 0; w < 4; w++) {
+            pthread_join(threads[w], NULL);
+            assert(workers[w].mismatches == 0);
+        }
+    }
+    printf("✓ Lookups from several threads each get their own rows\n");
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    db_close(db);
+    
+    printf("=== Result Rows Test Passed ===\n\n");
+}
+
+void test_result_output() {
+    printf("=== Testing Result Output ===\n");
+    
+    database_t *db = db_create("test_result_output.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char line[1024];
+    
+    int result = sql_execute(db, "CREATE TABLE result_out (id INT PRIMARY KEY, name VARCHAR(400), score FLOAT)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE result_precise (id INT PRIMARY KEY, score FLOAT)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    // Every seventh name is NULL and every eleventh is long
+    FILE *file = fopen("test_result_output.csv", "w");
+    assert(file != NULL);
+    for (int id = 0; id < 5000; id++) {
+        if (id % 7 == 0) {
+            fprintf(file, "%d,,%d.1\n", id, id);
+        } else if (id % 11 == 0) {
+            fprintf(file, "%d,%0300d,%d.1\n", id, id, id);
+        } else {
+            fprintf(file, "%d,name %d,%d.1\n", id, id, id);
+        }
+    }
+    fclose(file);
+    result = sql_execute(db, "COPY result_out FROM 'test_result_output.csv'", &txn);
+    assert(result == 0);
+    
+    file = fopen("test_result_output.csv", "w");
+    assert(file != NULL);
+    fprintf(file, "1,0.00123\n2,123456.7\n3,-2.5e-10\n");
+    fclose(file);
+    result = sql_execute(db, "COPY result_precise FROM 'test_result_output.csv'", &txn);
+    assert(result == 0);
+    remove("test_result_output.csv");
+    
+    // Text: floats keep their digits, NULLs are spelled out
+    file = tmpfile();
+    assert(file != NULL);
+    db_set_result_output(db, file, RESULT_FORMAT_TEXT);
+    result = sql_execute(db, "SELECT * FROM result_out ORDER BY id", &txn);
+    assert(result == 0);
+    rewind(file);
+    int lines = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (lines == 0) assert(strcmp(line, "0\tNULL\t0.1\t\n") == 0);
+        if (lines == 12) assert(strcmp(line, "12\tname 12\t12.1\t\n") == 0);
+        lines++;
+    }
+    assert(lines == 5000);
+    fclose(file);
+    
+    file = tmpfile();
+    assert(file != NULL);
+    db_set_result_output(db, file, RESULT_FORMAT_TEXT);
+    result = sql_execute(db, "SELECT * FROM result_precise ORDER BY id", &txn);
+    assert(result == 0);
+    rewind(file);
+    assert(fgets(line, sizeof(line), file) && strcmp(line, "1\t0.00123\t\n") == 0);
+    assert(fgets(line, sizeof(line), file) && strcmp(line, "2\t123456.7\t\n") == 0);
+    assert(fgets(line, sizeof(line), file) && strcmp(line, "3\t-2.5e-10\t\n") == 0);
+    fclose(file);
+    printf("✓ Text output is written through a buffer with exact floats\n");
+    
+    // Binary: header, then one frame per batch stored column by column
+    file = tmpfile();
+    assert(file != NULL);
+    db_set_result_output(db, file, RESULT_FORMAT_TEXT);
+    result = sql_execute(db, "SET OUTPUT = BINARY", &txn);
+    assert(result == 0);
+    assert(db->result_format == RESULT_FORMAT_BINARY && db->result_file == file);
+    result = sql_execute(db, "SELECT id, name AS label, score FROM result_out WHERE id >= 100", &txn);
+    assert(result == 0);
+    rewind(file);
+    
+    char magic[8];
+    uint32_t column_count;
+    assert(fread(magic, 1, 8, file) == 8 && memcmp(magic, "TINYRES1", 8) == 0);
+    assert(fread(&column_count, sizeof(column_count), 1, file) == 1 && column_count == 3);
+    const char *names[] = { "id", "label", "score" };
+    data_type_t types[] = { DATA_TYPE_INT, DATA_TYPE_VARCHAR, DATA_TYPE_FLOAT };
+    for (int i = 0; i < 3; i++) {
+        int type = fgetc(file);
+        int length = fgetc(file);
+        assert(type == (int)types[i] && length == (int)strlen(names[i]));
+        assert(fread(line, 1, length, file) == (size_t)length && memcmp(line, names[i], length) == 0);
+    }
+    
+    long long rows = 0;
+    long long id_sum = 0;
+    int nulls = 0;
+    int long_names = 0;
+    int frames = 0;
+    uint32_t payload;
+    while (fread(&payload, sizeof(payload), 1, file) == 1 && payload > 0) {
+        char *frame = malloc(payload);
+        assert(frame && fread(frame, 1, payload, file) == payload);
+        char *p = frame;
+        uint32_t row_count;
+        memcpy(&row_count, p, sizeof(row_count));
+        p += sizeof(row_count);
+        assert(row_count > 0 && row_count <= BATCH_SIZE);
+        
+        int ids[BATCH_SIZE];
+        for (uint32_t r = 0; r < row_count; r++) assert(p[r] == 0);
+        p += row_count;
+        memcpy(ids, p, row_count * sizeof(int32_t));
+        p += row_count * sizeof(int32_t);
+        
+        char *name_nulls = p;
+        p += row_count;
+        for (uint32_t r = 0; r < row_count; r++) {
+            assert(name_nulls[r] == (ids[r] % 7 == 0));
+            if (name_nulls[r]) {
+                nulls++;
+                continue;
+            }
+            uint32_t length;
+            memcpy(&length, p, sizeof(length));
+            p += sizeof(length);
+            if (ids[r] % 11 == 0) {
+                assert(length == 300);
+                long_names++;
+            } else {
+                snprintf(line, sizeof(line), "name %d", ids[r]);
+                assert(length == strlen(line) && memcmp(p, line, length) == 0);
+            }
+            p += length;
+        }
+        
+        for (uint32_t r = 0; r < row_count; r++) assert(p[r] == 0);
+        p += row_count;
+        for (uint32_t r = 0; r < row_count; r++) {
+            float score;
+            memcpy(&score, p, sizeof(score));
+            p += sizeof(score);
+            snprintf(line, sizeof(line), "%d.1", ids[r]);
+            assert(score == strtof(line, NULL));
+            id_sum += ids[r];
+        }
+        assert(p == frame + payload);
+        rows += row_count;
+        frames++;
+        free(frame);
+    }
+    assert(payload == 0 && fgetc(file) == EOF);
+    assert(rows == 4900 && frames >= 5);
+    assert(id_sum == 4999LL * 5000 / 2 - 99LL * 100 / 2);
+    assert(nulls == 700 && long_names > 0);
+    fclose(file);
+    printf("✓ Binary output is length-prefixed and typed by column\n");
+    
+    db_set_result_output(db, NULL, RESULT_FORMAT_TEXT);
+    assert(db->result_file == stdout);
+    result = sql_execute(db, "SET OUTPUT TEXT", &txn);
+    assert(result == 0 && db->result_format == RESULT_FORMAT_TEXT);
+    result = sql_execute(db, "SET OUTPUT = CSV", &txn);
+    assert(result != 0);
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    db_close(db);
+    
+    printf("=== Result Output Test Passed ===\n\n");
+}
+
+// Runs the plan under EXPLAIN ANALYZE and returns how many rows it produced
+static long long analyze_run(operator_t *plan) {
+    long long rows = 0;
+    batch_t *batch;
+    exec_analyze(plan);
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        rows += batch->selected_count;
+    }
+    exec_close(plan);
+    return rows;
+}
+
+void test_explain() {
+    printf("=== Testing EXPLAIN ANALYZE ===\n");
+    
+    database_t *db = db_create("test_explain.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[4096];
+    
+    int result = sql_execute(db, "CREATE TABLE explain_t (id INT PRIMARY KEY, grp INT, name VARCHAR(32))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int first = 0; first < 3000; first += 100) {
+        int length = sprintf(sql, "INSERT INTO explain_t VALUES ");
+        for (int id = first; id < first + 100; id++) {
+            length += sprintf(sql + length, "%s(%d, %d, 'name %d')", id > first ? ", " : "", id, id % 10, id);
+        }
+        result = sql_execute(db, sql, &txn);
+        assert(result == 0);
+    }
+    result = sql_execute(db, "CREATE TABLE explain_g (id INT PRIMARY KEY, label VARCHAR(16))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO explain_g VALUES (0, 'zero'), (1, 'one'), (2, 'two')", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    
+    // A full scan: counters add up and the scan pins every page
+    io_stats_t before, after;
+    io_stats_get(&before);
+    operator_t *plan = plan_select(db, "explain_t", NULL, 0, NULL, txn);
+    assert(plan != NULL && strcmp(plan->name, "Scan") == 0);
+    assert(analyze_run(plan) == 3000);
+    io_stats_get(&after);
+    
+    const operator_stats_t *stats = &plan->stats;
+    assert(stats->rows == 3000 && stats->batches >= 3 && stats->loops == stats->batches + 1);
+    assert(stats->seconds > 0);
+    assert(stats->io.pages_pinned > 1);
+    assert(stats->io.buffer_hits + stats->io.buffer_misses == stats->io.pages_pinned);
+    assert(after.pages_pinned - before.pages_pinned >= stats->io.pages_pinned);
+    exec_explain(plan, 1);
+    exec_destroy(plan);
+    printf("✓ Operators count rows, time and buffer pins\n");
+    
+    // A key range is read through the primary index
+    expr_t where;
+    expr_init(&where);
+    int low = where_int(&where, 0, CMP_GE, 100);
+    int high = where_int(&where, 0, CMP_LT, 150);
+    where.root = expr_add_logical(&where, EXPR_AND, low, high);
+    plan = plan_select(db, "explain_t", NULL, 0, &where, txn);
+    assert(plan != NULL);
+    assert(analyze_run(plan) == 50);
+    const operator_t *leaf = plan;
+    while (leaf->child) leaf = leaf->child;
+    assert(strcmp(leaf->name, "Range Scan") == 0 && leaf->stats.rows == 50);
+    assert(leaf->stats.io.pages_pinned > 0);
+    assert(leaf->stats.io.buffer_hits + leaf->stats.io.buffer_misses == leaf->stats.io.pages_pinned);
+    exec_explain(plan, 1);
+    exec_destroy(plan);
+    printf("✓ Range scans show that they used the primary key\n");
+    
+    // Parallel workers report on their own
+    db_set_max_parallelism(db, 4);
+    plan = plan_select(db, "explain_t", NULL, 0, NULL, txn);
+    assert(plan != NULL && strcmp(plan->name, "Gather") == 0 && plan->worker_count == 4);
+    assert(analyze_run(plan) == 3000);
+    assert(plan->stats.rows == 3000);
+    long long worker_rows = 0;
+    long long worker_pins = 0;
+    for (int i = 0; i < plan->worker_count; i++) {
+        worker_rows += plan->workers[i]->stats.rows;
+        worker_pins += plan->workers[i]->stats.io.pages_pinned;
+    }
+    assert(worker_rows == 3000 && worker_pins > 0);
+    exec_explain(plan, 1);
+    exec_destroy(plan);
+    db_set_max_parallelism(db, 1);
+    printf("✓ Worker plans of a Gather are analyzed separately\n");
+    
+    // The workers of a parallel aggregate run their own tables
+    int scan_columns[] = { 0, 1 };
+    int group_column = 1;
+    aggregate_spec_t count_spec = { AGG_COUNT_STAR, 0 };
+    operator_t *scans[4];
+    for (int w = 0; w < 4; w++) {
+        scans[w] = exec_scan_create(db, "explain_t", scan_columns, 2, txn);
+        assert(scans[w] != NULL && exec_scan_share(scans[w], scans[0]) == 0);
+    }
+    plan = exec_parallel_aggregate_create(scans, 4, &group_column, 1, &count_spec, 1, 1 << 20);
+    assert(plan != NULL && plan->worker_count == 4);
+    assert(analyze_run(plan) == 10);
+    worker_rows = 0;
+    long long scanned = 0;
+    for (int i = 0; i < plan->worker_count; i++) {
+        const operator_t *local = plan->workers[i];
+        assert(local->stats.loops == 1 && local->stats.seconds > 0);
+        worker_rows += local->stats.rows;
+        scanned += local->child->stats.rows;
+    }
+    assert(worker_rows >= 10 && scanned == 3000);
+    exec_explain(plan, 1);
+    exec_destroy(plan);
+    printf("✓ Workers of a parallel aggregate report their own runs\n");
+    
+    // Without exec_analyze nothing is counted
+    plan = plan_select(db, "explain_t", NULL, 0, NULL, txn);
+    assert(plan != NULL);
+    batch_t *batch;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+    }
+    assert(plan->stats.loops == 0 && plan->stats.rows == 0 && plan->stats.io.pages_pinned == 0);
+    exec_destroy(plan);
+    
+    result = sql_execute(db, "EXPLAIN SELECT id, name FROM explain_t WHERE id BETWEEN 10 AND 20", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "EXPLAIN ANALYZE SELECT grp, COUNT(*) FROM explain_t GROUP BY grp ORDER BY grp", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "EXPLAIN ANALYZE SELECT explain_t.id, label FROM explain_t JOIN explain_g "
+                             "ON grp = explain_g.id LIMIT 5", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "EXPLAIN DELETE FROM explain_t WHERE id = 1", &txn);
+    assert(result != 0);
+    printf("✓ EXPLAIN and EXPLAIN ANALYZE print the plan of a SELECT\n");
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    db_close(db);
+    
+    printf("=== EXPLAIN ANALYZE Test Passed ===\n\n");
+}
+
+// Finds the first operator of the plan with the given name
+static const operator_t* plan_find(const operator_t *op, const char *name) {
+    if (!op) return NULL;
+    if (strcmp(op->name, name) == 0) return op;
+    const operator_t *found = plan_find(op->child, name);
+    return found ? found : plan_find(op->inner, name);
+}
+
+static long long plan_rows(operator_t *plan) {
+    long long rows = 0;
+    batch_t *batch;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        rows += batch->selected_count;
+    }
+    exec_close(plan);
+    return rows;
+}
+
+void test_analyze() {
+    printf("=== Testing ANALYZE and Cost-Based Planning ===\n");
+    
+    database_t *db = db_create("test_analyze.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    char sql[4096];
+    
+    // analyze_s is stored in key order, analyze_r in a scrambled one
+    int result = sql_execute(db, "CREATE TABLE analyze_s (id INT PRIMARY KEY, grp INT, name VARCHAR(32))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE analyze_r (id INT PRIMARY KEY, grp INT, name VARCHAR(32))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "CREATE TABLE analyze_g (id INT PRIMARY KEY, label VARCHAR(16))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int t = 0; t < 2; t++) {
+        for (int first = 0; first < 3000; first += 100) {
+            int length = sprintf(sql, "INSERT INTO %s VALUES ", t == 0 ? "analyze_s" : "analyze_r");
+            for (int i = first; i < first + 100; i++) {
+                int id = t == 0 ? i : (i * 1237) % 3000;
+                length += sprintf(sql + length, "%s(%d, %d, 'name %d')", i > first ? ", " : "", id, id % 10, id % 500);
+            }
+            result = sql_execute(db, sql, &txn);
+            assert(result == 0);
+        }
+    }
+    result = sql_execute(db, "INSERT INTO analyze_g VALUES (0, 'zero'), (1, 'one'), (2, 'two')", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    // Before ANALYZE, key bounds always mean a range scan
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    long long key_sum;
+    expr_t range;
+    expr_init(&range);
+    range.root = expr_add_logical(&range, EXPR_AND, where_int(&range, 0, CMP_GE, 100),
+                                  where_int(&range, 0, CMP_LE, 199));
+    assert(plan_count(db, "analyze_r", &range, txn, "Range Scan", &key_sum) == 100);
+    table_stats_t stats;
+    assert(stats_load(db, find_table_schema(db, "analyze_r"), &stats) == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    // Outside a transaction ANALYZE runs in one of its own
+    result = sql_execute(db, "ANALYZE", &txn);
+    assert(result == 0 && txn == 0);
+    result = sql_execute(db, "ANALYZE missing", &txn);
+    assert(result != 0);
+    
+    assert(stats_load(db, find_table_schema(db, "analyze_r"), &stats) == 1);
+    assert(stats.row_count == 3000 && stats.page_count > 1);
+    assert(stats.key_correlation > -0.2 && stats.key_correlation < 0.2);
+    assert(stats.columns[0].distinct_count == 3000 && stats.columns[0].null_count == 0);
+    assert(stats.columns[1].distinct_count == 10 && stats.columns[2].distinct_count == 500);
+    assert(stats.columns[0].has_range && !stats.columns[2].has_range);
+    assert(stats.columns[0].min == 0 && stats.columns[0].max == 2999);
+    assert(stats.columns[0].bucket_count == STATS_BUCKETS);
+    assert(stats.columns[0].bounds[0] == 0 && stats.columns[0].bounds[STATS_BUCKETS] == 2999);
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        assert(stats.columns[0].bounds[b] <= stats.columns[0].bounds[b + 1]);
+    }
+    printf("✓ ANALYZE gathers row, distinct and range statistics\n");
+    
+    value_t constant = { .type = DATA_TYPE_INT };
+    constant.data.int_val = 3;
+    double selectivity = stats_selectivity(&stats, 1, CMP_EQ, &constant);
+    assert(selectivity > 0.09 && selectivity < 0.11);
+    constant.data.int_val = 1500;
+    selectivity = stats_selectivity(&stats, 0, CMP_LT, &constant);
+    assert(selectivity > 0.48 && selectivity < 0.52);
+    constant.data.int_val = 5000;
+    assert(stats_selectivity(&stats, 0, CMP_GE, &constant) == 0.0);
+    assert(stats_selectivity(&stats, 0, CMP_EQ, &constant) == 0.0);
+    key_bounds_t bounds;
+    key_bounds_init(&bounds);
+    constant.data.int_val = 100;
+    key_bounds_tighten(&bounds, CMP_GE, &constant);
+    constant.data.int_val = 199;
+    key_bounds_tighten(&bounds, CMP_LE, &constant);
+    selectivity = stats_bounds_selectivity(&stats, 0, &bounds);
+    assert(selectivity > 0.025 && selectivity < 0.042);
+    printf("✓ Selectivities are estimated from the histograms\n");
+    
+    assert(stats_load(db, find_table_schema(db, "analyze_s"), &stats) == 1);
+    assert(stats.key_correlation == 1.0);
+    
+    // A range is read through the index only where that is cheaper: the
+    // rows of the scrambled table would each cost a page read
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    assert(plan_count(db, "analyze_r", &range, txn, "Scan", &key_sum) == 100);
+    assert(key_sum == (100 + 199) * 100 / 2);
+    assert(plan_count(db, "analyze_s", &range, txn, "Range Scan", &key_sum) == 100);
+    expr_t point;
+    expr_init(&point);
+    point.root = where_int(&point, 0, CMP_EQ, 42);
+    assert(plan_count(db, "analyze_r", &point, txn, "Range Scan", &key_sum) == 1 && key_sum == 42);
+    expr_t wide;
+    expr_init(&wide);
+    wide.root = where_int(&wide, 0, CMP_GE, 0);
+    assert(plan_count(db, "analyze_s", &wide, txn, "Scan", &key_sum) == 3000);
+    printf("✓ Access paths are chosen by cost\n");
+    
+    // ORDER BY the key sorts the scrambled table, unless a LIMIT needs few rows
+    sort_key_t by_id = { 0, 0 };
+    operator_t *plan = plan_select_sorted(db, "analyze_r", NULL, 0, 0, NULL, &by_id, 1, -1, 0, txn);
+    assert(plan != NULL && strcmp(plan->name, "Sort") == 0);
+    assert(plan_rows(plan) == 3000);
+    exec_destroy(plan);
+    plan = plan_select_sorted(db, "analyze_r", NULL, 0, 0, NULL, &by_id, 1, 5, 0, txn);
+    assert(plan != NULL && plan_find(plan, "Range Scan") != NULL && plan_find(plan, "Top-N") == NULL);
+    assert(plan_rows(plan) == 5);
+    exec_destroy(plan);
+    plan = plan_select_sorted(db, "analyze_s", NULL, 0, 0, NULL, &by_id, 1, -1, 0, txn);
+    assert(plan != NULL && strcmp(plan->name, "Range Scan") == 0);
+    exec_destroy(plan);
+    
+    // The hash table is built on the small table, whichever side it is on
+    join_spec_t join = { "analyze_r", "analyze_g", JOIN_INNER, 1, 0 };
+    plan = plan_join(db, &join, NULL, 0, NULL, txn);
+    assert(plan != NULL && strcmp(plan->name, "Hash Join") == 0);
+    assert(strcmp(plan->inner->column_names[1], "label") == 0);
+    assert(plan_rows(plan) == 900);
+    exec_destroy(plan);
+    
+    join_spec_t swapped = { "analyze_g", "analyze_r", JOIN_INNER, 0, 1 };
+    plan = plan_join(db, &swapped, NULL, 0, NULL, txn);
+    assert(plan != NULL && plan->column_count == 5);
+    assert(strcmp(plan->column_names[1], "label") == 0 && strcmp(plan->column_names[4], "name") == 0);
+    const operator_t *hash_join = plan_find(plan, "Hash Join");
+    assert(hash_join != NULL && strcmp(hash_join->inner->column_names[1], "label") == 0);
+    batch_t *batch;
+    long long rows = 0;
+    assert(exec_open(plan) == 0);
+    while (exec_next(plan, &batch) > 0) {
+        for (int k = 0; k < batch->selected_count; k++) {
+            value_t g_id, grp;
+            batch_get_value(batch, 0, batch->selection[k], &g_id);
+            batch_get_value(batch, 3, batch->selection[k], &grp);
+            assert(g_id.data.int_val == grp.data.int_val);
+            rows++;
+        }
+    }
+    exec_destroy(plan);
+    assert(rows == 900);
+    
+    // A LEFT join keeps its sides
+    swapped.type = JOIN_LEFT;
+    plan = plan_join(db, &swapped, NULL, 0, NULL, txn);
+    assert(plan != NULL && strcmp(plan->inner->column_names[1], "grp") == 0);
+    assert(plan_rows(plan) == 900);
+    exec_destroy(plan);
+    
+    // Few left rows are looked up in the right table's primary index
+    join_spec_t by_key = { "analyze_r", "analyze_s", JOIN_INNER, 0, 0 };
+    plan = plan_join(db, &by_key, NULL, 0, &point, txn);
+    assert(plan != NULL && strcmp(plan->name, "Index Join") == 0);
+    assert(plan_rows(plan) == 1);
+    exec_destroy(plan);
+    plan = plan_join(db, &by_key, NULL, 0, NULL, txn);
+    assert(plan != NULL && strcmp(plan->name, "Hash Join") == 0);
+    assert(plan_rows(plan) == 3000);
+    exec_destroy(plan);
+    printf("✓ Join methods and sides are chosen by cost\n");
+    
+    // ANALYZE in a transaction counts its own rows
+    result = sql_execute(db, "INSERT INTO analyze_g VALUES (3, 'three')", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "ANALYZE analyze_g", &txn);
+    assert(result == 0 && txn != 0);
+    assert(stats_load(db, find_table_schema(db, "analyze_g"), &stats) == 1 && stats.row_count == 4);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    db_checkpoint(db);
+    db_close(db);
+    
+    db = db_create("test_analyze.db");
+    assert(db != NULL);
+    db_recovery(db);
+    assert(stats_load(db, find_table_schema(db, "analyze_r"), &stats) == 1);
+    assert(stats.row_count == 3000 && stats.columns[1].distinct_count == 10);
+    assert(stats_load(db, find_table_schema(db, "analyze_g"), &stats) == 1 && stats.row_count == 4);
+    db_close(db);
+    printf("✓ Statistics persist across restarts\n");
+    
+    printf("=== ANALYZE Test Passed ===\n\n");
+}
+
+// Column `column` of the row with the key as txn sees it, or -1 without one
+static int update_read(database_t *db, int id, int column, transaction_id_t txn) {
+    value_t key = { .type = DATA_TYPE_INT };
+    key.data.int_val = id;
+    tuple_t row;
+    if (tuple_fetch(db, find_table_schema(db, "accounts"), &key, &column, 1, &row, txn) != 1) return -1;
+    return row.values[0].data.int_val;
+}
+
+// Where the primary index points for the key, and where the version txn
+// sees is
+static void update_locate(database_t *db, int id, transaction_id_t txn, page_id_t *index_page, slot_id_t *index_slot,
+                          page_id_t *version_page, slot_id_t *version_slot) {
+    value_t key = { .type = DATA_TYPE_INT };
+    key.data.int_val = id;
+    table_schema_t *schema = find_table_schema(db, "accounts");
+    assert(btree_search(db, schema->root_page_id, &key, index_page, index_slot) == 0);
+    
+    snapshot_t snapshot;
+    txn_snapshot(db, txn, &snapshot);
+    page_t *page;
+    assert(heap_find_version(db, *index_page, *index_slot, &snapshot, &page, version_slot) == 1);
+    *version_page = page->page_id;
+    buffer_release_page(db->buffer_pool, page);
+}
+
+void test_update() {
+    printf("=== Testing UPDATE ===\n");
+    
+    database_t *db = db_create("test_update.db");
+    assert(db != NULL);
+    
+    db_recovery(db);
+    
+    transaction_id_t txn = 0, reader = 0, other = 0;
+    char sql[8192];
+    
+    int result = sql_execute(db, "CREATE TABLE accounts (id INT PRIMARY KEY, balance INT, note VARCHAR(32))", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int first = 1; first <= 200; first += 50) {
+        int length = sprintf(sql, "INSERT INTO accounts VALUES ");
+        for (int i = first; i < first + 50; i++) {
+            length += sprintf(sql + length, "%s(%d, %d, 'n')", i > first ? ", " : "", i, i * 10);
+        }
+        result = sql_execute(db, sql, &txn);
+        assert(result == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    int pages = count_table_pages(db, "accounts");
+    
+    // A reader that started before the updates keeps seeing the old rows
+    result = sql_execute(db, "BEGIN", &reader);
+    assert(result == 0);
+    
+    page_id_t index_page, before_page, version_page;
+    slot_id_t index_slot, before_slot, version_slot;
+    update_locate(db, 190, reader, &before_page, &before_slot, &version_page, &version_slot);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "UPDATE accounts SET balance = balance + 5 WHERE id = 190", &txn);
+    assert(result == 0);
+    assert(update_read(db, 190, 1, txn) == 1905);
+    assert(update_read(db, 190, 1, reader) == 1900);
+    update_locate(db, 190, txn, &index_page, &index_slot, &version_page, &version_slot);
+    assert(index_page == before_page && index_slot == before_slot);
+    assert(version_page == index_page && version_slot != index_slot);
+    assert(count_table_pages(db, "accounts") == pages);
+    printf("✓ A new version goes on the same page and the index is left alone\n");
+    
+    slot_id_t hot_slot = version_slot;
+    result = sql_execute(db, "UPDATE accounts SET balance = balance * 2, note = 'twice' WHERE id = 190", &txn);
+    assert(result == 0);
+    assert(update_read(db, 190, 1, txn) == 3810);
+    update_locate(db, 190, txn, &index_page, &index_slot, &version_page, &version_slot);
+    assert(version_page == index_page && version_slot == hot_slot);
+    printf("✓ A version the transaction wrote itself is overwritten in place\n");
+    
+    // The first pages are full, so their rows' new versions go elsewhere
+    result = sql_execute(db, "UPDATE accounts SET balance = 0 WHERE id = 7", &txn);
+    assert(result == 0);
+    update_locate(db, 7, txn, &index_page, &index_slot, &version_page, &version_slot);
+    assert(version_page != index_page);
+    assert(update_read(db, 7, 1, txn) == 0 && update_read(db, 7, 1, reader) == 70);
+    
+    result = sql_execute(db, "UPDATE accounts SET note = 'bulk', balance = balance - id WHERE id BETWEEN 10 AND 19", &txn);
+    assert(result == 0);
+    for (int id = 10; id <= 19; id++) {
+        assert(update_read(db, id, 1, txn) == id * 9);
+    }
+    result = sql_execute(db, "UPDATE accounts SET balance = 'text' WHERE id = 20", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "UPDATE accounts SET missing = 1 WHERE id = 20", &txn);
+    assert(result != 0);
+    
+    // Another transaction cannot change a row that is being changed
+    result = sql_execute(db, "BEGIN", &other);
+    assert(result == 0);
+    result = sql_execute(db, "UPDATE accounts SET balance = 1 WHERE id = 190", &other);
+    assert(result != 0);
+    result = sql_execute(db, "DELETE FROM accounts WHERE id = 7", &other);
+    assert(result != 0);
+    
+    // A statement that reaches such a row changes none of the others
+    int balance = update_read(db, 185, 1, other);
+    result = sql_execute(db, "UPDATE accounts SET balance = 1 WHERE id BETWEEN 185 AND 195", &other);
+    assert(result != 0);
+    assert(update_read(db, 185, 1, other) == balance);
+    result = sql_execute(db, "DELETE FROM accounts WHERE id BETWEEN 5 AND 9", &other);
+    assert(result != 0);
+    assert(key_is_visible(db, "accounts", 5, other) == 1);
+    result = sql_execute(db, "ROLLBACK", &other);
+    assert(result == 0);
+    printf("✓ Concurrent changes to the same row are refused\n");
+    
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    assert(update_read(db, 190, 1, reader) == 1900 && update_read(db, 7, 1, reader) == 70);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    assert(update_read(db, 190, 1, txn) == 3810 && update_read(db, 7, 1, txn) == 0);
+    result = sql_execute(db, "UPDATE accounts SET balance = -1 WHERE id <= 5", &txn);
+    assert(result == 0);
+    assert(update_read(db, 3, 1, txn) == -1);
+    result = sql_execute(db, "ROLLBACK", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int id = 1; id <= 5; id++) {
+        assert(update_read(db, id, 1, txn) == id * 10);
+    }
+    
+    // After a rolled-back update the row can be updated again
+    result = sql_execute(db, "UPDATE accounts SET balance = balance + 1 WHERE id = 3", &txn);
+    assert(result == 0);
+    assert(update_read(db, 3, 1, txn) == 31);
+    printf("✓ Rolled-back updates leave the old rows\n");
+    
+    result = sql_execute(db, "UPDATE accounts SET id = 300 WHERE id = 200", &txn);
+    assert(result == 0);
+    assert(update_read(db, 200, 1, txn) == -1 && update_read(db, 300, 1, txn) == 2000);
+    result = sql_execute(db, "UPDATE accounts SET id = 1 WHERE id = 2", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ A new key moves the row\n");
+    
+    // Scans see one version of each row
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    table_cursor_t cursor;
+    tuple_t tuple;
+    int rows = 0;
+    long long total = 0;
+    assert(table_scan_open(db, "accounts", txn, &cursor) == 0);
+    while (table_scan_next(&cursor, &tuple) == 1) {
+        rows++;
+        total += tuple.values[1].data.int_val;
+    }
+    table_scan_close(&cursor);
+    assert(rows == 200);
+    long long expected = 0;
+    for (int id = 1; id <= 200; id++) {
+        expected += id * 10;
+    }
+    expected += 3810 - 1900 - 70 + 1 - 145;
+    assert(total == expected);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "COMMIT", &reader);
+    assert(result == 0);
+    vacuum_stats_t stats;
+    result = vacuum_table(db, "accounts", &stats);
+    assert(result == 0);
+    assert(stats.tuples_removed == 19);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    update_locate(db, 7, txn, &index_page, &index_slot, &version_page, &version_slot);
+    assert(index_page == version_page && index_slot == version_slot);
+    update_locate(db, 190, txn, &index_page, &index_slot, &version_page, &version_slot);
+    assert(index_page == version_page && index_slot == version_slot);
+    assert(update_read(db, 7, 1, txn) == 0 && update_read(db, 190, 1, txn) == 3810);
+    assert(update_read(db, 200, 1, txn) == -1 && update_read(db, 12, 1, txn) == 108);
+    result = sql_execute(db, "INSERT INTO accounts VALUES (200, 1, 'again')", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ VACUUM removes old versions and moves index entries to the rows\n");
+    
+    // New keys are all checked before the first row changes
+    result = sql_execute(db, "CREATE TABLE swaps (id INT PRIMARY KEY, value INT)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO swaps VALUES (2, 0), (3, 0), (7, 0)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "UPDATE swaps SET id = 10 - id", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "UPDATE swaps SET id = 5 WHERE id < 5", &txn);
+    assert(result != 0);
+    assert(txn != 0);
+    for (int id = 0; id <= 10; id++) {
+        assert(key_is_visible(db, "swaps", id, txn) == (id == 2 || id == 3 || id == 7));
+    }
+    result = sql_execute(db, "UPDATE swaps SET id = id + 100", &txn);
+    assert(result == 0);
+    for (int id = 0; id <= 110; id++) {
+        assert(key_is_visible(db, "swaps", id, txn) == (id == 102 || id == 103 || id == 107));
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ A failed UPDATE changes no rows\n");
+    
+    result = sql_execute(db, "CREATE TABLE columns (id INT PRIMARY KEY, value INT) STORAGE = COLUMN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO columns VALUES (1, 1)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "UPDATE columns SET value = 2 WHERE id = 1", &txn);
+    assert(result != 0);
+    result = sql_execute(db, "UPDATE accounts SET balance = 7", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    db_checkpoint(db);
+    db_close(db);
+    db = db_create("test_update.db");
+    assert(db != NULL);
+    db_recovery(db);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int id = 1; id <= 300; id += 7) {
+        assert(update_read(db, id, 1, txn) == (id <= 200 || id == 300 ? 7 : -1));
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    printf("✓ Updated rows persist\n");
+    
+    db_close(db);
+    
+    printf("=== UPDATE Test Passed ===\n\n");
+}
+
+typedef struct {
+    database_t *db;
+    int mismatches;
+} status_worker_t;
+
+// Begins and ends transactions while checking the outcome of each through
+// both txn_get_state and mvcc_is_visible
+static void* status_worker(void *arg) {
+    status_worker_t *worker = arg;
+    
+    for (int i = 0; i < 3000; i++) {
+        transaction_id_t txn = txn_begin(worker->db);
+        if (txn == 0) {
+            worker->mismatches++;
+            continue;
+        }
+        tuple_header_t header = { txn, 0, 0, 0, 0, 0 };
+        snapshot_t own;
+        txn_snapshot(worker->db, txn, &own);
+        if (txn_get_state(worker->db, txn) != TXN_STATE_ACTIVE || !mvcc_is_visible(&header, &own)) {
+            worker->mismatches++;
+        }
+        
+        // As seen by a transaction that begins after this one ends
+        snapshot_t later = { worker->db->txn_manager, txn + 1, txn + 1, txn + 1, 0, NULL };
+        int commit = i % 3 != 0;
+        if ((commit ? txn_commit(worker->db, txn) : txn_abort(worker->db, txn)) != 0 ||
+            txn_get_state(worker->db, txn) != (commit ? TXN_STATE_COMMITTED : TXN_STATE_ABORTED) ||
+            mvcc_is_visible(&header, &later) != commit) {
+            worker->mismatches++;
+        }
+    }
+    return NULL;
+}
+
+void test_transaction_status() {
+    printf("=== Testing Transaction Status Log ===\n");
+    
+    database_t *db = db_create("test_txn_status.db");
+    assert(db != NULL);
+    db_recovery(db);
+    
+    transaction_id_t txn = 0;
+    int result = sql_execute(db, "CREATE TABLE items (id INT PRIMARY KEY, value INT)", &txn);
+    assert(result == 0);
+    
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "INSERT INTO items VALUES (1, 10)", &txn);
+    assert(result == 0);
+    transaction_id_t aborted = txn;
+    result = sql_execute(db, "ROLLBACK", &txn);
+    assert(result == 0);
+    
+    // Far more transactions than can run at once
+    for (int i = 0; i < 5 * MAX_TRANSACTIONS; i++) {
+        transaction_id_t other = txn_begin(db);
+        assert(other != 0);
+        assert(txn_commit(db, other) == 0);
+        assert(txn_commit(db, other) != 0 && txn_abort(db, other) != 0);
+    }
+    assert(txn_get_state(db, aborted) == TXN_STATE_ABORTED);
+    
+    txn = txn_begin(db);
+    assert(key_is_visible(db, "items", 1, txn) == 0);
+    assert(txn_commit(db, txn) == 0);
+    printf("✓ Outcomes of old transactions are kept\n");
+    
+    static transaction_id_t running[MAX_TRANSACTIONS];
+    for (int i = 0; i < MAX_TRANSACTIONS; i++) {
+        running[i] = txn_begin(db);
+        assert(running[i] != 0);
+    }
+    assert(txn_begin(db) == 0);
+    assert(txn_oldest_active(db) == running[0]);
+    assert(txn_abort(db, running[0]) == 0);
+    // The others began while it ran and still see it as running
+    assert(txn_oldest_active(db) == running[0]);
+    running[0] = txn_begin(db);
+    assert(running[0] != 0);
+    for (int i = 0; i < MAX_TRANSACTIONS; i++) {
+        assert(txn_commit(db, running[i]) == 0);
+    }
+    assert(txn_oldest_active(db) == db->txn_manager->next_txn_id);
+    printf("✓ At most %d transactions run at once\n", MAX_TRANSACTIONS);
+    
+    status_worker_t workers[4];
+    pthread_t threads[4];
+    for (int w = 0; w < 4; w++) {
+        workers[w].db = db;
+        workers[w].mismatches = 0;
+        assert(pthread_create(&threads[w], NULL, status_worker, &workers[w]) == 0);
+    }
+    for (int w = 0; w < 4; w++) {
+        pthread_join(threads[w], NULL);
+        assert(workers[w].mismatches == 0);
+    }
+    printf("✓ Concurrent transactions see each other's outcomes\n");
+    
+    transaction_id_t next = db->txn_manager->next_txn_id;
+    db_checkpoint(db);
+    db_close(db);
+    db = db_create("test_txn_status.db");
+    assert(db != NULL);
+    db_recovery(db);
+    
+    txn = txn_begin(db);
+    assert(txn == next);
+    assert(txn_get_state(db, next - 1) == TXN_STATE_COMMITTED);
+    assert(txn_get_state(db, txn) == TXN_STATE_ACTIVE);
+    assert(txn_commit(db, txn) == 0);
+    printf("✓ Transaction ids continue after a restart\n");
+    
+    db_close(db);
+    
+    printf("=== Transaction Status Log Test Passed ===\n\n");
+}
+
+void test_snapshots() {
+    printf("=== Testing Snapshots ===\n");
+    
+    database_t *db = db_create("test_snapshots.db");
+    assert(db != NULL);
+    db_recovery(db);
+    
+    transaction_id_t txn = 0, reader = 0, writer = 0;
+    int result = sql_execute(db, "CREATE TABLE accounts (id INT PRIMARY KEY, balance INT)", &txn);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &txn);
+    assert(result == 0);
+    for (int id = 1; id <= 20; id++) {
+        char sql[128];
+        snprintf(sql, sizeof(sql), "INSERT INTO accounts VALUES (%d, %d)", id, id * 10);
+        result = sql_execute(db, sql, &txn);
+        assert(result == 0);
+    }
+    result = sql_execute(db, "COMMIT", &txn);
+    assert(result == 0);
+    
+    // The writer has the smaller id but commits while the reader runs
+    result = sql_execute(db, "BEGIN", &writer);
+    assert(result == 0);
+    result = sql_execute(db, "BEGIN", &reader);
+    assert(result == 0);
+    assert(writer < reader);
+    transaction_id_t writer_id = writer;
+    
+    snapshot_t snapshot;
+    txn_snapshot(db, reader, &snapshot);
+    assert(snapshot.xmin == writer && snapshot.xmax == reader);
+    assert(snapshot.in_progress_count == 1 && snapshot.in_progress[0] == writer);
+    
+    result = sql_execute(db, "INSERT INTO accounts VALUES (21, 210)", &writer);
+    assert(result == 0);
+    result = sql_execute(db, "DELETE FROM accounts WHERE id = 1", &writer);
+    assert(result == 0);
+    result = sql_execute(db, "UPDATE accounts SET balance = 0 WHERE id = 2", &writer);
+    assert(result == 0);
+    result = sql_execute(db, "COMMIT", &writer);
+    assert(result == 0);
+    
+    long long key_sum;
+    assert(scan_count(db, "accounts", reader, &key_sum) == 20 && key_sum == 210);
+    assert(key_is_visible(db, "accounts", 21, reader) == 0);
+    assert(key_is_visible(db, "accounts", 1, reader) == 1);
+    assert(update_read(db, 2, 1, reader) == 20);
+    printf("✓ Changes committed after the snapshot stay invisible\n");
+    
+    result = sql_execute(db, "UPDATE accounts SET balance = 1 WHERE id = 2", &reader);
+    assert(result != 0);
+    result = sql_execute(db, "UPDATE accounts SET balance = 1 WHERE id = 3", &reader);
+    assert(result == 0);
+    assert(update_read(db, 3, 1, reader) == 1);
+    printf("✓ Rows changed since the snapshot cannot be updated\n");
+    
+    vacuum_stats_t stats;
+    result = vacuum_table(db, "accounts", &stats);
+    assert(result == 0);
+    assert(stats.horizon == writer_id);
+    assert(key_is_visible(db, "accounts", 1, reader) == 1 && update_read(db, 2, 1, reader) == 20);
+    result = sql_execute(db, "COMMIT", &reader);
+    assert(result == 0);
+    
+    txn = txn_begin(db);
+    assert(scan_count(db, "accounts", txn, &key_sum) == 20 && key_sum == 230);
+    assert(update_read(db, 2, 1, txn) == 0 && update_read(db, 3, 1, txn) == 1);
+    assert(txn_commit(db, txn) == 0);
+    result = vacuum_table(db, "accounts", &stats);
+    assert(result == 0);
+    assert(stats.tuples_removed == 3);
+    printf("✓ VACUUM keeps versions running snapshots see\n");
+    
+    db_close(db);
+    
+    printf("=== Snapshots Test Passed ===\n\n");
+}
+
 int main() {
     printf("Starting TinyDB Test Suite\n");
     printf("==========================\n\n");
@@ -196,6 +4127,31 @@ int main() {
     test_mvcc();
     test_persistence();
     test_rollback();
+    test_columnar_storage();
+    test_vacuum();
+    test_index_organized();
+    test_overflow_values();
+    test_dictionary_encoding();
+    test_table_scan();
+    test_executor();
+    test_where_clause();
+    test_projection();
+    test_group_by();
+    test_join();
+    test_order_by();
+    test_parallel_scan();
+    test_prepared_statements();
+    test_statement_cache();
+    test_batch_insert();
+    test_copy();
+    test_filter_kernels();
+    test_result_rows();
+    test_result_output();
+    test_explain();
+    test_analyze();
+    test_update();
+    test_transaction_status();
+    test_snapshots();
     
     printf("All tests passed! 🎉\n");
     printf("TinyDB is working correctly with:\n");
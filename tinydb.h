@@ -1,6 +1,8 @@
 #ifndef TINYDB_H
 #define TINYDB_H
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,7 +15,11 @@
 #define MAX_COLUMN_NAME 32
 #define MAX_COLUMNS 8
 #define MAX_VALUE_SIZE 64
+#define MAX_VARCHAR_SIZE 65536   // Strings that do not fit in MAX_VALUE_SIZE go to overflow pages
 #define MAX_TRANSACTIONS 1024
+#define TXN_STATUS_PAGE_SIZE 65536   // Transaction statuses per page of the status log
+#define TXN_STATUS_PAGES 4096
+#define MAX_TABLES 8
 #define BTREE_ORDER 49
 
 typedef uint64_t transaction_id_t;
@@ -26,6 +32,12 @@ typedef enum {
     DATA_TYPE_FLOAT
 } data_type_t;
 
+typedef enum {
+    STORAGE_ROW,
+    STORAGE_COLUMN,
+    STORAGE_INDEX      // Index-organized: rows live in the primary-key B+tree leaves
+} storage_type_t;
+
 typedef enum {
     TXN_STATE_ACTIVE,
     TXN_STATE_COMMITTED,
@@ -37,6 +49,7 @@ typedef struct {
     char name[MAX_COLUMN_NAME];
     int size;
     int is_primary_key;
+    int is_dictionary;        // VARCHAR stored as a code into the table's dictionary
 } column_def_t;
 
 typedef struct {
@@ -44,28 +57,79 @@ typedef struct {
     int column_count;
     column_def_t columns[MAX_COLUMNS];
     page_id_t root_page_id;
+    storage_type_t storage_type;
+    page_id_t first_page_id;  // First data page of the table (0 if none)
+    page_id_t last_page_id;   // Page that receives new rows
+    page_id_t dictionary_page_id;  // First page of the table's dictionary (0 if none)
+    page_id_t stats_page_id;  // Page holding the statistics of the last ANALYZE (0 if none)
 } table_schema_t;
 
 typedef struct {
     int schema_count;
     int next_page_id;
-    char reserved[PAGE_SIZE - 2 * sizeof(int) - 9 * sizeof(table_schema_t)];
+    transaction_id_t next_txn_id;
+    page_id_t free_page_id;   // Head of the list of pages released by VACUUM
+    char reserved[PAGE_SIZE - 2 * sizeof(int) - sizeof(transaction_id_t) - sizeof(page_id_t)
+                  - MAX_TABLES * sizeof(table_schema_t)];
 } metadata_t;
 
+// Header at the start of every table data page (row and columnar). A table's
+// data pages form a chain through next_page_id starting at first_page_id.
+typedef struct {
+    int tuple_count;
+    int capacity;
+    int free_offset;          // Row pages: start of the record area, which grows down from the page end
+    page_id_t next_page_id;
+} heap_page_header_t;
+
+// Row pages are slotted: a slot per tuple follows the header and points at
+// the tuple's variable-length record at the end of the page.
+typedef struct {
+    uint16_t offset;
+    uint16_t length;
+} heap_slot_t;
+
+// A string too long for str_val. Before the row is stored `data` points at
+// the caller's copy; once stored, the value lives in the overflow chain
+// starting at page_id and is only read back by overflow_read.
+typedef struct {
+    page_id_t page_id;
+    uint32_t length;
+    const char *data;
+} external_value_t;
+
 typedef struct {
     union {
         int int_val;
         float float_val;
         char str_val[MAX_VALUE_SIZE];
+        external_value_t ext;     // Valid when is_external is set
     } data;
     data_type_t type;
-    int is_null;
+    uint8_t is_null;
+    uint8_t is_external;
 } value_t;
 
+// Header of each page in an overflow chain
+typedef struct {
+    page_id_t next_page_id;
+    uint32_t length;          // Bytes of the value stored in this page
+} overflow_page_header_t;
+
+// Version flags of row records. UPDATE leaves the old version in place,
+// marks it TUPLE_UPDATED and links it to the new version through
+// next_page_id/next_slot; the new version is TUPLE_HEAP_ONLY until VACUUM
+// points the primary index at it.
+#define TUPLE_UPDATED 0x1
+#define TUPLE_HEAP_ONLY 0x2
+
 typedef struct {
     transaction_id_t xmin;
     transaction_id_t xmax;
     int is_deleted;
+    uint16_t flags;
+    uint16_t next_slot;       // Newer version of an updated row, on next_page_id
+    page_id_t next_page_id;
 } tuple_header_t;
 
 typedef struct {
@@ -74,6 +138,41 @@ typedef struct {
     int column_count;
 } tuple_t;
 
+// Dictionary-encoded columns store a code per value. Codes are assigned in
+// insertion order and never reused, so equal strings always share a code.
+typedef uint16_t dict_code_t;
+#define DICTIONARY_MAX_CODES 65535
+
+typedef struct dictionary_s dictionary_t;
+
+// Header of each page in a table's dictionary chain, followed by entries
+typedef struct {
+    int entry_count;
+    page_id_t next_page_id;
+} dictionary_page_header_t;
+
+typedef struct {
+    uint16_t column;
+    dict_code_t code;
+    char value[MAX_VALUE_SIZE];
+} dictionary_entry_t;
+
+// A read-only view of one column of a columnar page. Values are stored
+// densely, `width` bytes apart; VARCHAR values are NUL-terminated, or
+// dict_code_t codes when `dictionary` is set.
+typedef struct {
+    data_type_t type;
+    int width;
+    const char *data;
+    const uint8_t *null_bitmap;
+    const dictionary_t *dictionary;
+} column_vector_t;
+
+// Called once per columnar page. `visible[i]` is non-zero when row i is
+// visible to the scanning transaction. Return non-zero to stop the scan.
+typedef int (*column_scan_fn)(const column_vector_t *columns, int row_count,
+                              const uint8_t *visible, void *arg);
+
 typedef struct {
     page_id_t page_id;
     char data[PAGE_SIZE];
@@ -93,18 +192,48 @@ typedef struct {
     struct database_s *db; // Reference to the database that owns this buffer pool
 } buffer_pool_t;
 
+// Buffer pool and disk activity of one thread. Each thread counts its own,
+// so EXPLAIN ANALYZE can charge an operator with what its calls did.
+typedef struct {
+    long long pages_pinned;    // buffer_get_page() calls
+    long long buffer_hits;     // Pins of pages already in the pool
+    long long buffer_misses;   // Pins that read the page from disk
+    long long bytes_read;
+    long long bytes_written;
+} io_stats_t;
+
+typedef struct transaction_manager_s transaction_manager_t;
+
+// The transactions whose changes one transaction sees: those that had
+// committed when it began, and itself
+typedef struct {
+    transaction_manager_t *manager;
+    transaction_id_t txn_id;
+    transaction_id_t xmin;                  // Transactions below had finished
+    transaction_id_t xmax;                  // Transactions from here on had not begun
+    int in_progress_count;
+    const transaction_id_t *in_progress;    // Running ones in [xmin, xmax), ascending
+} snapshot_t;
+
 typedef struct {
     transaction_id_t txn_id;
-    transaction_state_t state;
     time_t start_time;
-    pthread_mutex_t txn_mutex;
+    snapshot_t *snapshot;   // Taken at txn_begin, NULL while the slot is free
 } transaction_t;
 
-typedef struct {
-    transaction_t transactions[MAX_TRANSACTIONS];
+// Status log of the transactions begun in this session: one byte per id
+// from first_txn_id on, in pages allocated as ids are handed out. Pages,
+// statuses and snapshots are written under txn_manager_mutex and read with
+// atomic loads.
+struct transaction_manager_s {
+    uint8_t *status_pages[TXN_STATUS_PAGES];
+    transaction_id_t first_txn_id;
     transaction_id_t next_txn_id;
+    transaction_t transactions[MAX_TRANSACTIONS];   // Running transactions, at txn_id % MAX_TRANSACTIONS
+    transaction_id_t running[MAX_TRANSACTIONS];     // Their ids, ascending
+    int running_count;
     pthread_mutex_t txn_manager_mutex;
-} transaction_manager_t;
+};
 
 typedef struct {
     int is_leaf;
@@ -119,7 +248,123 @@ typedef struct {
     } pointers;
 } btree_node_t;
 
-typedef struct database_s {
+typedef struct {
+    transaction_id_t horizon;  // Oldest transaction that may still read old versions
+    int pages_scanned;
+    int tuples_removed;
+    int pages_freed;
+} vacuum_stats_t;
+
+// Statistics ANALYZE gathers about a column. The range and histogram are
+// kept for INT and FLOAT columns only.
+#define STATS_BUCKETS 32
+
+typedef struct {
+    long long null_count;
+    long long distinct_count;
+    int has_range;
+    int bucket_count;
+    double min;
+    double max;
+    double bounds[STATS_BUCKETS + 1];   // Equi-depth histogram: each bucket holds about the same number of
+                                        // values, bounds[0] is the minimum and bounds[bucket_count] the maximum
+} column_stats_t;
+
+typedef struct {
+    long long row_count;
+    long long page_count;     // Data pages, or leaves of an index-organized table
+    double key_correlation;   // Rank correlation of storage order with primary key order, -1 to 1
+    column_stats_t columns[MAX_COLUMNS];
+} table_stats_t;
+
+// File formats of COPY
+typedef enum {
+    COPY_FORMAT_CSV,
+    COPY_FORMAT_BINARY
+} copy_format_t;
+
+#define MAX_PATH_SIZE 256
+
+// Formats of SELECT results: tab-separated text, or the binary stream
+// described in result.c for programs that read the results
+typedef enum {
+    RESULT_FORMAT_TEXT,
+    RESULT_FORMAT_BINARY
+} result_format_t;
+
+struct vacuum_worker_s;
+
+#define BTREE_LEAF 1
+#define BTREE_ROW_LEAF 2
+#define BTREE_ROW_LEAF_CAPACITY ((int)((PAGE_SIZE - 2 * sizeof(int) - sizeof(page_id_t)) / sizeof(tuple_t)))
+
+// Leaf of an index-organized table. Shares is_leaf/key_count with
+// btree_node_t; rows are kept sorted by primary key and leaves are linked
+// left to right for ordered scans.
+typedef struct {
+    int is_leaf;
+    int key_count;
+    page_id_t next_leaf;
+    tuple_t rows[BTREE_ROW_LEAF_CAPACITY];
+} btree_row_leaf_t;
+
+// Called for every visible row of a scan. Return non-zero to stop the scan.
+typedef int (*row_scan_fn)(const tuple_t *row, void *arg);
+
+typedef struct database_s database_t;
+
+// Primary-key bounds of a range scan. A bound that is not set is open.
+typedef struct {
+    value_t low;
+    value_t high;
+    int has_low;
+    int has_high;
+    int low_inclusive;
+    int high_inclusive;
+} key_bounds_t;
+
+// Position of a range scan over the primary index between two calls to
+// btree_range_next: the key the next leaf visit starts from.
+typedef struct {
+    value_t next_key;
+    int has_next_key;         // 0 to start at the leftmost leaf
+    int next_inclusive;
+    int done;
+} btree_range_t;
+
+// Page source shared by the cursors of a parallel scan. Pages go one at a
+// time to whichever cursor asks next, so a worker that finishes early just
+// takes more of the table.
+typedef struct {
+    pthread_mutex_t mutex;
+    page_id_t next_page_id;   // Next page to hand out, 0 once the table is exhausted
+} scan_morsels_t;
+
+// Sequential scan over all rows of a table visible to one transaction.
+// The cursor works on a private copy of one page at a time, so it holds no
+// buffer pins between calls and uses the same memory for any table size.
+// A ranged cursor only visits rows whose primary key is within its bounds:
+// index-organized tables start at the leaf holding the low bound, other
+// tables read the rows that the primary index lists, one leaf at a time.
+typedef struct {
+    database_t *db;
+    table_schema_t *schema;
+    snapshot_t snapshot;      // Of the cursor's transaction
+    page_id_t page_id;        // Page held in page[]
+    page_id_t next_page_id;   // Page to read once the current one is done
+    int slot;                 // Next row of the current page
+    int row_count;            // Rows on the current page
+    int ranged;
+    int key_column;
+    key_bounds_t bounds;
+    btree_range_t range;
+    char page[PAGE_SIZE];     // Copy of the current page
+    page_id_t entry_pages[BTREE_ORDER];   // Rows of the current index leaf (ranged heap scans)
+    slot_id_t entry_slots[BTREE_ORDER];
+    scan_morsels_t *morsels;  // Shared page source of a parallel scan, NULL otherwise
+} table_cursor_t;
+
+struct database_s {
     FILE *data_file;
     char *filename;
     buffer_pool_t *buffer_pool;
@@ -127,41 +372,528 @@ typedef struct database_s {
     table_schema_t *schemas;
     int schema_count;
     int max_schemas;
-} database_t;
+    pthread_mutex_t statement_mutex;   // Serializes statements with background maintenance
+    struct vacuum_worker_s *vacuum_worker;
+    dictionary_t *dictionaries;        // Dictionaries loaded so far
+    int max_parallelism;               // Worker threads a scan may use, 1 to run on the caller's thread
+    int schema_version;                // Changes whenever a table is created or dropped
+    struct sql_cache_s *statement_cache;   // Created by the first statement that can be cached
+    FILE *result_file;                 // Where SELECT results go, stdout by default
+    result_format_t result_format;
+};
+
+// Vectorized execution. Operators exchange batches of up to BATCH_SIZE rows
+// stored column by column, so the inner loops run over plain typed arrays.
+#define BATCH_SIZE 1024
+#define MAX_OUTPUT_COLUMNS (2 * MAX_COLUMNS)
+
+// One column of a batch. Only the arrays matching `type` are allocated.
+// VARCHAR values stay value_t so overflow references pass through unread.
+// Scans read dictionary-encoded columns as codes and set `dictionary`;
+// `strings` then holds the decoded values of the selected rows only.
+typedef struct {
+    data_type_t type;
+    int *ints;
+    float *floats;
+    value_t *strings;
+    dict_code_t *codes;
+    const dictionary_t *dictionary;
+    uint8_t *nulls;
+} vector_t;
+
+// Filters do not move data: they shrink the selection vector, which lists
+// the active rows of the batch in ascending order. Scans also record where
+// each row is stored, so columns can be read after filtering, and only for
+// the rows that are left.
+typedef struct {
+    int column_count;
+    int row_count;
+    int selected_count;
+    uint16_t selection[BATCH_SIZE];
+    vector_t columns[MAX_OUTPUT_COLUMNS];
+    page_id_t row_pages[BATCH_SIZE];
+    uint16_t row_slots[BATCH_SIZE];
+} batch_t;
+
+typedef enum {
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE
+} compare_op_t;
+
+// column <op> constant, on an input column of the filter
+typedef struct {
+    int column;
+    compare_op_t op;
+    value_t constant;
+} predicate_t;
+
+#define MAX_EXPR_NODES 64
+
+typedef enum {
+    EXPR_COMPARE,
+    EXPR_AND,
+    EXPR_OR
+} expr_kind_t;
+
+// Boolean expression over the input columns of a filter, kept as a flat
+// array of nodes that refer to their operands by index.
+typedef struct {
+    expr_kind_t kind;
+    predicate_t predicate;    // EXPR_COMPARE
+    int left;                 // EXPR_AND, EXPR_OR
+    int right;
+} expr_node_t;
+
+typedef struct {
+    expr_node_t nodes[MAX_EXPR_NODES];
+    int node_count;
+    int root;                 // -1 when empty, which matches every row
+} expr_t;
+
+#define MAX_SCALAR_NODES 16
+
+typedef enum {
+    SCALAR_COLUMN,
+    SCALAR_CONSTANT,
+    SCALAR_ADD,
+    SCALAR_SUB,
+    SCALAR_MUL,
+    SCALAR_DIV
+} scalar_kind_t;
+
+typedef struct {
+    scalar_kind_t kind;
+    int column;               // SCALAR_COLUMN
+    value_t constant;         // SCALAR_CONSTANT, INT or FLOAT
+    int left;                 // Arithmetic operands
+    int right;
+} scalar_node_t;
+
+// Arithmetic expression producing one output column, stored like expr_t.
+// INT op INT stays INT (division by zero gives NULL); anything involving
+// FLOAT is FLOAT.
+typedef struct {
+    scalar_node_t nodes[MAX_SCALAR_NODES];
+    int node_count;
+    int root;
+    char name[MAX_COLUMN_NAME];
+} scalar_expr_t;
+
+typedef enum {
+    AGG_COUNT_STAR,
+    AGG_COUNT,
+    AGG_SUM,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_AVG
+} aggregate_fn_t;
+
+typedef struct {
+    aggregate_fn_t fn;
+    int column;               // Ignored for AGG_COUNT_STAR
+} aggregate_spec_t;
+
+#define AGG_MEMORY_BUDGET (4 * 1024 * 1024)   // Default hash table size for GROUP BY
+
+// Rows an operator writes to temporary pages. They are collected in a
+// private page and written to a chain of database pages when it fills up.
+typedef struct {
+    char *page;
+    page_id_t head;           // First page of the chain
+    page_id_t current;        // Page reserved for the private page, 0 before the first row
+    long long row_count;
+} spill_partition_t;
+
+#define SPILL_PAGE_VALUES (PAGE_SIZE / sizeof(value_t) + 1)  // Buffer size for spill_read_values()
+
+typedef struct {
+    int column;
+    int descending;
+} sort_key_t;
+
+#define SORT_MEMORY_BUDGET (4 * 1024 * 1024)  // Default buffered input size for ORDER BY
+
+typedef enum {
+    JOIN_INNER,
+    JOIN_LEFT                 // Keeps unmatched left rows, with NULL right columns
+} join_type_t;
+
+#define JOIN_MEMORY_BUDGET (4 * 1024 * 1024)  // Default build side size for hash joins
+
+typedef struct {
+    char left_table[MAX_TABLE_NAME];
+    char right_table[MAX_TABLE_NAME];
+    join_type_t type;
+    int left_key;             // ON left_key = right_key, as table column numbers
+    int right_key;
+} join_spec_t;
+
+// Worker threads feeding one consumer. A worker hands over one batch at a
+// time and waits until the consumer has finished with it, so batches are
+// passed without copying and each worker is at most one batch ahead.
+#define MAX_PARALLELISM 16
+
+typedef struct parallel_s parallel_t;
+typedef int (*parallel_fn_t)(parallel_t *par, int worker, void *arg);
+
+typedef struct {
+    parallel_t *par;
+    int index;
+} parallel_worker_t;
+
+struct parallel_s {
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;             // A batch was handed over or a worker ended
+    pthread_cond_t consumed;          // The consumer took back a batch or is stopping
+    pthread_t threads[MAX_PARALLELISM];
+    parallel_worker_t workers[MAX_PARALLELISM];
+    batch_t *batches[MAX_PARALLELISM];   // Batch handed over by each worker, NULL if none
+    int worker_count;                 // 0 when no threads are running
+    int running;                      // Workers that have not returned yet
+    int current;                      // Worker whose batch the consumer holds, -1 if none
+    int failed;
+    int stopping;
+    parallel_fn_t fn;
+    void *arg;
+};
+
+typedef struct operator_s operator_t;
+
+// What an operator did while its plan ran under EXPLAIN ANALYZE. Time and
+// I/O include the operator's children, as they run within its calls.
+typedef struct {
+    long long rows;           // Selected rows of the batches returned
+    long long batches;
+    long long loops;          // next() calls
+    double seconds;           // Wall time in open(), next() and close()
+    io_stats_t io;            // Activity of the thread running the operator
+} operator_stats_t;
+
+// Under EXPLAIN ANALYZE, each call to an operator is timed and charged
+// with the buffer and disk activity of its thread in the meantime
+typedef struct {
+    struct timespec start;
+    io_stats_t io;
+} exec_measure_t;
+
+// An operator produces batches on demand. next() returns 1 and points
+// *batch at a batch owned by the operator (valid until the following call),
+// 0 when the input is exhausted or -1 on error.
+struct operator_s {
+    const char *name;
+    database_t *db;
+    int (*open)(operator_t *op);
+    int (*next)(operator_t *op, batch_t **batch);
+    void (*close)(operator_t *op);
+    operator_t *child;
+    operator_t *inner;        // Second input of a join, opened after child
+    void (*destroy)(operator_t *op);   // Frees what the state owns beyond close(), if anything
+    int is_open;
+    int column_count;
+    data_type_t column_types[MAX_OUTPUT_COLUMNS];
+    char column_names[MAX_OUTPUT_COLUMNS][MAX_COLUMN_NAME];
+    void *state;
+    void (*explain)(const operator_t *op, char *detail, size_t size);   // Describes the operator for EXPLAIN, if set
+    operator_t **workers;     // Inputs run on worker threads, owned by the state (parallel operators)
+    int worker_count;
+    int analyze;              // Gather stats while running
+    operator_stats_t stats;
+};
+
+// Destination of the rows of a query. Rows are formatted into a buffer
+// that is written to the file as it fills, rather than printed value by
+// value.
+typedef struct {
+    database_t *db;
+    FILE *file;
+    result_format_t format;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    long long row_count;
+    int failed;               // A write failed; the sink refuses further rows
+} result_sink_t;
 
 database_t* db_create(const char *filename);
 void db_close(database_t *db);
+void db_set_max_parallelism(database_t *db, int workers);
+void db_set_result_output(database_t *db, FILE *file, result_format_t format);
 int db_load_metadata(database_t *db);
 int db_save_metadata(database_t *db);
 
 int table_create(database_t *db, const char *table_name, column_def_t *columns, int column_count);
+int table_create_with_storage(database_t *db, const char *table_name, column_def_t *columns,
+                              int column_count, storage_type_t storage_type);
 int table_drop(database_t *db, const char *table_name);
+table_schema_t* find_table_schema(database_t *db, const char *table_name);
+page_t* table_append_page(database_t *db, table_schema_t *schema, int capacity);
+
+transaction_manager_t* txn_manager_create(void);
+void txn_manager_destroy(transaction_manager_t *manager);
+void txn_manager_resume(transaction_manager_t *manager, transaction_id_t next_txn_id);
 
 transaction_id_t txn_begin(database_t *db);
 int txn_commit(database_t *db, transaction_id_t txn_id);
 int txn_abort(database_t *db, transaction_id_t txn_id);
 
-int mvcc_is_visible(tuple_header_t *header, transaction_id_t txn_id, transaction_manager_t *manager);
+transaction_id_t txn_oldest_active(database_t *db);
+transaction_state_t txn_get_state(database_t *db, transaction_id_t txn_id);
+
+void txn_snapshot(database_t *db, transaction_id_t txn_id, snapshot_t *snapshot);
+int mvcc_is_visible(const tuple_header_t *header, const snapshot_t *snapshot);
 void mvcc_mark_deleted(tuple_header_t *header, transaction_id_t txn_id);
 
 int tuple_insert(database_t *db, const char *table_name, tuple_t *tuple, transaction_id_t txn_id);
+int tuple_insert_into(database_t *db, table_schema_t *schema, tuple_t *tuple, transaction_id_t txn_id);
+int tuple_insert_batch(database_t *db, const char *table_name, tuple_t *tuples, int count, transaction_id_t txn_id);
+int tuple_insert_batch_into(database_t *db, table_schema_t *schema, tuple_t *tuples, int count,
+                            transaction_id_t txn_id);
 int tuple_delete(database_t *db, const char *table_name, value_t *key, transaction_id_t txn_id);
+int tuple_delete_batch(database_t *db, table_schema_t *schema, const value_t *keys, int count,
+                       transaction_id_t txn_id);
+int tuple_update_batch(database_t *db, table_schema_t *schema, const value_t *keys, tuple_t *rows, int count,
+                       transaction_id_t txn_id);
 int tuple_select(database_t *db, const char *table_name, value_t *key, tuple_t **results, int *count, transaction_id_t txn_id);
+int tuple_fetch(database_t *db, table_schema_t *schema, const value_t *key, const int *column_ids,
+                int column_count, tuple_t *row, transaction_id_t txn_id);
+int heap_read_tuple(database_t *db, table_schema_t *schema, const char *page_data, int slot, tuple_t *tuple);
+int heap_read_columns(database_t *db, table_schema_t *schema, const char *page_data, int slot,
+                      const int *column_ids, int column_count, tuple_header_t *header, value_t *values,
+                      dict_code_t *codes);
+int heap_find_version(database_t *db, page_id_t page_id, slot_id_t slot, const snapshot_t *snapshot, page_t **page,
+                      slot_id_t *version_slot);
+
+int table_scan_open(database_t *db, const char *table_name, transaction_id_t txn_id, table_cursor_t *cursor);
+int table_scan_next(table_cursor_t *cursor, tuple_t *tuple);
+void table_scan_close(table_cursor_t *cursor);
+void table_scan_share(table_cursor_t *cursor, scan_morsels_t *morsels, int first);
+int table_scan_open_range(database_t *db, const char *table_name, const key_bounds_t *bounds,
+                          transaction_id_t txn_id, table_cursor_t *cursor);
 
 buffer_pool_t* buffer_pool_create(int capacity, database_t *db);
 void buffer_pool_destroy(buffer_pool_t *pool);
 page_t* buffer_get_page(buffer_pool_t *pool, page_id_t page_id);
 void buffer_release_page(buffer_pool_t *pool, page_t *page);
 void buffer_flush_page(buffer_pool_t *pool, page_t *page);
+void io_stats_get(io_stats_t *stats);
 
 int btree_insert(database_t *db, page_id_t root_page_id, const value_t *key, page_id_t tuple_page_id, slot_id_t tuple_slot);
 int btree_search(database_t *db, page_id_t root_page_id, const value_t *key, page_id_t *tuple_page_id, slot_id_t *tuple_slot);
+int btree_insert_sorted(database_t *db, page_id_t root_page_id, const value_t *keys,
+                        const page_id_t *tuple_page_ids, const slot_id_t *tuple_slots, int count);
+int btree_search_sorted(database_t *db, page_id_t root_page_id, const value_t *keys, int count);
 int btree_delete(database_t *db, page_id_t root_page_id, const value_t *key);
+int btree_update(database_t *db, page_id_t root_page_id, const value_t *key,
+                 page_id_t tuple_page_id, slot_id_t tuple_slot);
 
 page_t* storage_allocate_page(database_t *db);
+void storage_free_page(database_t *db, page_id_t page_id);
 int storage_read_page(database_t *db, page_id_t page_id, char *buffer);
 int storage_write_page(database_t *db, page_id_t page_id, const char *buffer);
-btree_node_t* btree_create_node(database_t *db, int is_leaf);
+btree_node_t* btree_create_node(database_t *db, int is_leaf, page_t **page_handle);
+
+int btree_row_insert(database_t *db, table_schema_t *schema, const tuple_t *tuple);
+int btree_row_search(database_t *db, table_schema_t *schema, const value_t *key, tuple_t *row);
+int btree_row_mark_deleted(database_t *db, table_schema_t *schema, const value_t *key,
+                           transaction_id_t txn_id);
+int btree_row_scan(database_t *db, table_schema_t *schema, const value_t *low, const value_t *high,
+                   transaction_id_t txn_id, row_scan_fn callback, void *arg);
+int btree_row_vacuum(database_t *db, table_schema_t *schema, vacuum_stats_t *stats);
+page_id_t btree_row_first_leaf(database_t *db, table_schema_t *schema);
+page_id_t btree_row_find_leaf(database_t *db, table_schema_t *schema, const value_t *key);
+
+void key_bounds_init(key_bounds_t *bounds);
+void key_bounds_tighten(key_bounds_t *bounds, compare_op_t op, const value_t *key);
+int key_bounds_check(const key_bounds_t *bounds, const value_t *key);
+void btree_range_open(btree_range_t *range, const key_bounds_t *bounds);
+int btree_range_next(database_t *db, page_id_t root_page_id, const key_bounds_t *bounds, btree_range_t *range,
+                     page_id_t *page_ids, slot_id_t *slots, int max_entries);
+
+int columnar_insert(database_t *db, table_schema_t *schema, const tuple_t *tuple,
+                    page_id_t *page_id, slot_id_t *slot);
+int columnar_load_tuple(database_t *db, table_schema_t *schema, page_id_t page_id,
+                        slot_id_t slot, tuple_t *tuple);
+int columnar_read_header(const table_schema_t *schema, const char *page_data, int slot, tuple_header_t *header);
+int columnar_read_tuple(database_t *db, table_schema_t *schema, const char *page_data,
+                        int slot, tuple_t *tuple);
+int columnar_mark_deleted(database_t *db, table_schema_t *schema, page_id_t page_id,
+                          slot_id_t slot, transaction_id_t txn_id);
+int columnar_scan(database_t *db, const char *table_name, const int *column_ids, int column_count,
+                  transaction_id_t txn_id, column_scan_fn callback, void *arg);
+int columnar_vacuum_page(database_t *db, table_schema_t *schema, page_id_t page_id,
+                         vacuum_stats_t *stats);
+
+int overflow_write(database_t *db, const char *data, uint32_t length, page_id_t *first_page_id);
+char* overflow_read(database_t *db, const value_t *value);
+void overflow_free(database_t *db, page_id_t first_page_id);
+int overflow_store_tuple(database_t *db, tuple_t *tuple);
+void overflow_free_tuple(database_t *db, const tuple_t *tuple);
+
+page_id_t dictionary_create(database_t *db);
+dictionary_t* dictionary_get(database_t *db, table_schema_t *schema, int column);
+int dictionary_encode(database_t *db, table_schema_t *schema, int column, const char *value,
+                      dict_code_t *code);
+int dictionary_find(const dictionary_t *dict, const char *value);
+const char* dictionary_value(const dictionary_t *dict, dict_code_t code);
+int dictionary_size(const dictionary_t *dict);
+void dictionary_release_all(database_t *db);
+
+int heap_vacuum_page(database_t *db, table_schema_t *schema, page_id_t page_id,
+                     vacuum_stats_t *stats);
+
+int stats_analyze(database_t *db, const char *table_name, transaction_id_t txn_id);
+int stats_analyze_all(database_t *db, transaction_id_t txn_id);
+int stats_load(database_t *db, const table_schema_t *schema, table_stats_t *stats);
+double stats_selectivity(const table_stats_t *stats, int column, compare_op_t op, const value_t *constant);
+double stats_bounds_selectivity(const table_stats_t *stats, int column, const key_bounds_t *bounds);
+
+int vacuum_table(database_t *db, const char *table_name, vacuum_stats_t *stats);
+int vacuum_all(database_t *db, vacuum_stats_t *stats);
+int vacuum_tuple_is_dead(database_t *db, tuple_header_t *header, transaction_id_t horizon);
+int vacuum_index_relocate(database_t *db, table_schema_t *schema, const value_t *key,
+                          page_id_t page_id, slot_id_t old_slot, int new_slot);
+int vacuum_start_worker(database_t *db, int interval_seconds);
+void vacuum_stop_worker(database_t *db);
+
+int copy_from_file(database_t *db, const char *table_name, const char *path, copy_format_t format, int header,
+                   transaction_id_t txn_id, long long *row_count);
+int copy_to_file(database_t *db, const char *table_name, const char *path, copy_format_t format, int header,
+                 transaction_id_t txn_id, long long *row_count);
+
+int result_sink_open(result_sink_t *sink, database_t *db, FILE *file, result_format_t format,
+                     const operator_t *plan);
+int result_sink_write(result_sink_t *sink, const batch_t *batch);
+int result_sink_finish(result_sink_t *sink);
+void result_sink_close(result_sink_t *sink);
+
+int batch_init(batch_t *batch, int column_count, const data_type_t *types);
+void batch_free(batch_t *batch);
+void batch_select_all(batch_t *batch);
+void batch_get_value(const batch_t *batch, int column, int row, value_t *value);
+void vector_get_value(const vector_t *vec, int row, value_t *value);
+void batch_set_value(batch_t *batch, int column, int row, const value_t *value);
+
+int table_scan_next_batch(table_cursor_t *cursor, const int *column_ids, int column_count, batch_t *batch);
+int table_scan_fetch(table_cursor_t *cursor, const int *column_ids, int column_count, batch_t *batch);
+int columnar_read_batch(database_t *db, table_schema_t *schema, page_id_t page_id, const char *page_data,
+                        int first, int count, const snapshot_t *snapshot, const int *column_ids, int column_count,
+                        batch_t *batch);
+void columnar_fetch_rows(database_t *db, table_schema_t *schema, const char *page_data,
+                         const int *column_ids, int column_count, batch_t *batch, const uint16_t *rows, int count);
+
+void batch_hash(database_t *db, const batch_t *batch, const int *columns, int column_count, uint64_t *hashes);
+void batch_hash_codes(const batch_t *batch, const dict_code_t *codes, const uint8_t *nulls, uint64_t *hashes);
+int batch_value_equal(database_t *db, const batch_t *batch, int column, int row, const value_t *value);
+int spill_append(database_t *db, spill_partition_t *partition, const batch_t *batch, int row);
+int spill_append_values(database_t *db, spill_partition_t *partition, const value_t *values, int count);
+int spill_finish(database_t *db, spill_partition_t *partition, page_id_t *head);
+int spill_read(database_t *db, page_id_t *page_id, batch_t *batch);
+int spill_read_values(database_t *db, page_id_t *page_id, value_t *values);
+void spill_free(database_t *db, page_id_t page_id);
+void spill_release(database_t *db, spill_partition_t *partition);
+
+operator_t* exec_operator_create(const char *name, database_t *db, operator_t *child, size_t state_size);
+int exec_open(operator_t *op);
+int exec_next(operator_t *op, batch_t **batch);
+void exec_close(operator_t *op);
+void exec_destroy(operator_t *op);
+void exec_analyze(operator_t *op);
+void exec_measure_start(exec_measure_t *measure);
+void exec_measure_end(operator_t *op, const exec_measure_t *measure);
+void exec_explain(const operator_t *op, int analyze);
+
+operator_t* exec_scan_create(database_t *db, const char *table_name, const int *column_ids, int column_count,
+                             transaction_id_t txn_id);
+operator_t* exec_range_scan_create(database_t *db, const char *table_name, const key_bounds_t *bounds,
+                                   const int *column_ids, int column_count, transaction_id_t txn_id);
+int exec_scan_push_filter(operator_t *scan, const expr_t *expr);
+int exec_scan_share(operator_t *scan, operator_t *leader);
+void exec_keep_codes(operator_t *op);
+operator_t* exec_filter_create(operator_t *child, const predicate_t *predicates, int predicate_count);
+operator_t* exec_filter_expr_create(operator_t *child, const expr_t *expr);
+operator_t* exec_project_create(operator_t *child, const int *columns, int column_count);
+operator_t* exec_project_expr_create(operator_t *child, const scalar_expr_t *exprs, int expr_count);
+operator_t* exec_limit_create(operator_t *child, long long limit, long long offset);
+operator_t* exec_aggregate_create(operator_t *child, const aggregate_spec_t *specs, int spec_count);
+operator_t* exec_group_aggregate_create(operator_t *child, const int *group_columns, int group_count,
+                                        const aggregate_spec_t *specs, int spec_count, size_t memory_budget);
+operator_t* exec_sort_create(operator_t *child, const sort_key_t *keys, int key_count, size_t memory_budget);
+operator_t* exec_top_n_create(operator_t *child, const sort_key_t *keys, int key_count, long long limit,
+                              long long offset);
+operator_t* exec_hash_join_create(operator_t *left, operator_t *right, const int *left_keys, const int *right_keys,
+                                  int key_count, join_type_t type, size_t memory_budget);
+operator_t* exec_index_join_create(operator_t *left, int left_key, const char *table_name, const int *column_ids,
+                                   int column_count, join_type_t type, transaction_id_t txn_id);
+operator_t* exec_gather_create(operator_t **workers, int worker_count);
+operator_t* exec_parallel_aggregate_create(operator_t **workers, int worker_count, const int *group_columns,
+                                           int group_count, const aggregate_spec_t *specs, int spec_count,
+                                           size_t memory_budget);
+
+int parallel_start(parallel_t *par, int worker_count, parallel_fn_t fn, void *arg);
+int parallel_emit(parallel_t *par, int worker, batch_t *batch);
+int parallel_next(parallel_t *par, batch_t **batch);
+void parallel_stop(parallel_t *par);
+
+void expr_init(expr_t *expr);
+int expr_add_compare(expr_t *expr, int column, compare_op_t op, const value_t *constant);
+int expr_add_logical(expr_t *expr, expr_kind_t kind, int left, int right);
+
+void scalar_init(scalar_expr_t *expr);
+int scalar_add_column(scalar_expr_t *expr, int column);
+int scalar_add_constant(scalar_expr_t *expr, const value_t *constant);
+int scalar_add_arith(scalar_expr_t *expr, scalar_kind_t kind, int left, int right);
+
+operator_t* plan_select(database_t *db, const char *table_name, const scalar_expr_t *items, int item_count,
+                        const expr_t *where, transaction_id_t txn_id);
+operator_t* plan_aggregate(database_t *db, const char *table_name, const int *group_columns, int group_count,
+                           const aggregate_spec_t *specs, int spec_count, const expr_t *where,
+                           transaction_id_t txn_id);
+operator_t* plan_join(database_t *db, const join_spec_t *join, const scalar_expr_t *items, int item_count,
+                      const expr_t *where, transaction_id_t txn_id);
+operator_t* plan_sort(operator_t *plan, const sort_key_t *keys, int key_count, long long limit, long long offset,
+                      int output_count);
+operator_t* plan_select_sorted(database_t *db, const char *table_name, const scalar_expr_t *items, int item_count,
+                               int output_count, const expr_t *where, const sort_key_t *keys, int key_count,
+                               long long limit, long long offset, transaction_id_t txn_id);
+
+// Prepared statements. A statement is parsed once and its names resolved
+// against the tables once; each ? in it (an INSERT value or the literal of
+// a WHERE comparison) takes the value bound to it, numbered from 1 in the
+// order they appear, and the statement can be run again with new values.
+typedef struct sql_prepared_s sql_prepared_t;
+
+int sql_execute(database_t *db, const char *sql_string, transaction_id_t *current_txn);
+sql_prepared_t* sql_prepare(database_t *db, const char *sql_string);
+int sql_parameter_count(const sql_prepared_t *prepared);
+int sql_bind_int(sql_prepared_t *prepared, int index, int value);
+int sql_bind_float(sql_prepared_t *prepared, int index, float value);
+int sql_bind_text(sql_prepared_t *prepared, int index, const char *text);
+int sql_bind_null(sql_prepared_t *prepared, int index);
+int sql_execute_prepared(sql_prepared_t *prepared, transaction_id_t *current_txn);
+void sql_reset(sql_prepared_t *prepared);
+void sql_finalize(sql_prepared_t *prepared);
+
+// Statement cache. sql_execute() keeps the INSERT, SELECT and DELETE
+// statements it runs as prepared statements, keyed by their text with the
+// literals replaced by ?, and runs text that only differs in its literals
+// without parsing it again. The least recently used entry makes room for
+// a new one; creating or dropping a table empties the cache.
+#define SQL_CACHE_SIZE 32
+
+typedef struct {
+    long long hits;
+    long long misses;
+    long long evictions;
+    long long invalidations;   // Entries dropped because a table was created or dropped
+    int entries;
+} sql_cache_stats_t;
+
+void sql_cache_get_stats(database_t *db, sql_cache_stats_t *stats);
+void sql_cache_destroy(database_t *db);
 
 int db_recovery(database_t *db);
 int db_checkpoint(database_t *db);
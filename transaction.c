@@ -1,17 +1,24 @@
 #include "tinydb.h"
 
-transaction_manager_t* txn_manager_create() {
+// The status log keeps a byte per transaction begun in this session: 0 for
+// an id never handed out, otherwise its transaction_state_t plus one.
+// Transactions of earlier sessions are all finished, and those whose changes
+// survived the restart are taken as committed, so ids with no status read as
+// committed.
+
+transaction_manager_t* txn_manager_create(void) {
     transaction_manager_t *manager = malloc(sizeof(transaction_manager_t));
     if (!manager) return NULL;
     
+    memset(manager->status_pages, 0, sizeof(manager->status_pages));
+    manager->first_txn_id = 1;
     manager->next_txn_id = 1;
-    pthread_mutex_init(&manager->txn_manager_mutex, NULL);
-    
+    manager->running_count = 0;
     for (int i = 0; i < MAX_TRANSACTIONS; i++) {
         manager->transactions[i].txn_id = 0;
-        manager->transactions[i].state = TXN_STATE_ABORTED;
-        pthread_mutex_init(&manager->transactions[i].txn_mutex, NULL);
+        manager->transactions[i].snapshot = NULL;
     }
+    pthread_mutex_init(&manager->txn_manager_mutex, NULL);
     
     return manager;
 }
@@ -19,17 +26,60 @@ transaction_manager_t* txn_manager_create() {
 void txn_manager_destroy(transaction_manager_t *manager) {
     if (!manager) return;
     
-    pthread_mutex_lock(&manager->txn_manager_mutex);
-    
+    for (int i = 0; i < TXN_STATUS_PAGES; i++) {
+        free(manager->status_pages[i]);
+    }
     for (int i = 0; i < MAX_TRANSACTIONS; i++) {
-        pthread_mutex_destroy(&manager->transactions[i].txn_mutex);
+        free(manager->transactions[i].snapshot);
     }
-    
-    pthread_mutex_unlock(&manager->txn_manager_mutex);
     pthread_mutex_destroy(&manager->txn_manager_mutex);
     free(manager);
 }
 
+// Continues the ids of an earlier session at next_txn_id. The status log
+// starts there when no transaction has begun yet; otherwise the skipped ids
+// simply have no status.
+void txn_manager_resume(transaction_manager_t *manager, transaction_id_t next_txn_id) {
+    pthread_mutex_lock(&manager->txn_manager_mutex);
+    if (next_txn_id > manager->next_txn_id) {
+        if (manager->next_txn_id == manager->first_txn_id) {
+            manager->first_txn_id = next_txn_id;
+        }
+        manager->next_txn_id = next_txn_id;
+    }
+    pthread_mutex_unlock(&manager->txn_manager_mutex);
+}
+
+// Status byte of txn_id, or NULL if its page has not been allocated. With
+// `create` set the page is allocated, which needs txn_manager_mutex held.
+static uint8_t* txn_status_entry(transaction_manager_t *manager, transaction_id_t txn_id, int create) {
+    if (txn_id < manager->first_txn_id) return NULL;
+    
+    uint64_t index = txn_id - manager->first_txn_id;
+    if (index >= (uint64_t)TXN_STATUS_PAGES * TXN_STATUS_PAGE_SIZE) return NULL;
+    
+    uint8_t **slot = &manager->status_pages[index / TXN_STATUS_PAGE_SIZE];
+    uint8_t *page = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (!page && create) {
+        page = calloc(TXN_STATUS_PAGE_SIZE, 1);
+        if (!page) return NULL;
+        __atomic_store_n(slot, page, __ATOMIC_RELEASE);
+    }
+    return page ? &page[index % TXN_STATUS_PAGE_SIZE] : NULL;
+}
+
+static transaction_state_t txn_status(transaction_manager_t *manager, transaction_id_t txn_id) {
+    if (!manager) return TXN_STATE_COMMITTED;
+    
+    uint8_t *entry = txn_status_entry(manager, txn_id, 0);
+    uint8_t status = entry ? __atomic_load_n(entry, __ATOMIC_ACQUIRE) : 0;
+    return status == 0 ? TXN_STATE_COMMITTED : (transaction_state_t)(status - 1);
+}
+
+// Starts a transaction with a snapshot of the transactions running now.
+// An id whose slot in transactions[] still holds a transaction begun
+// MAX_TRANSACTIONS ids earlier is skipped; it never runs, so it has no
+// status and no versions.
 transaction_id_t txn_begin(database_t *db) {
     if (!db->txn_manager) {
         db->txn_manager = txn_manager_create();
@@ -40,143 +90,166 @@ transaction_id_t txn_begin(database_t *db) {
     
     pthread_mutex_lock(&manager->txn_manager_mutex);
     
-    int slot = -1;
-    for (int i = 0; i < MAX_TRANSACTIONS; i++) {
-        if (manager->transactions[i].state == TXN_STATE_ABORTED || 
-            manager->transactions[i].state == TXN_STATE_COMMITTED) {
-            slot = i;
-            break;
-        }
+    int count = manager->running_count;
+    if (count == MAX_TRANSACTIONS) {
+        pthread_mutex_unlock(&manager->txn_manager_mutex);
+        return 0;
+    }
+    while (manager->transactions[manager->next_txn_id % MAX_TRANSACTIONS].snapshot) {
+        manager->next_txn_id++;
     }
     
-    if (slot == -1) {
+    transaction_id_t txn_id = manager->next_txn_id;
+    uint8_t *entry = txn_status_entry(manager, txn_id, 1);
+    snapshot_t *snapshot = entry ? malloc(sizeof(snapshot_t) + count * sizeof(transaction_id_t)) : NULL;
+    if (!snapshot) {
         pthread_mutex_unlock(&manager->txn_manager_mutex);
         return 0;
     }
     
-    transaction_id_t txn_id = manager->next_txn_id++;
-    transaction_t *txn = &manager->transactions[slot];
+    transaction_id_t *in_progress = (transaction_id_t*)(snapshot + 1);
+    memcpy(in_progress, manager->running, count * sizeof(transaction_id_t));
+    snapshot->manager = manager;
+    snapshot->txn_id = txn_id;
+    snapshot->xmin = count > 0 ? in_progress[0] : txn_id;
+    snapshot->xmax = txn_id;
+    snapshot->in_progress_count = count;
+    snapshot->in_progress = in_progress;
+    
+    manager->next_txn_id++;
+    manager->running[manager->running_count++] = txn_id;
+    __atomic_store_n(entry, (uint8_t)(TXN_STATE_ACTIVE + 1), __ATOMIC_RELEASE);
     
-    pthread_mutex_lock(&txn->txn_mutex);
+    transaction_t *txn = &manager->transactions[txn_id % MAX_TRANSACTIONS];
     txn->txn_id = txn_id;
-    txn->state = TXN_STATE_ACTIVE;
     txn->start_time = time(NULL);
-    pthread_mutex_unlock(&txn->txn_mutex);
+    __atomic_store_n(&txn->snapshot, snapshot, __ATOMIC_RELEASE);
     
     pthread_mutex_unlock(&manager->txn_manager_mutex);
     
     return txn_id;
 }
 
-static transaction_t* find_transaction(transaction_manager_t *manager, transaction_id_t txn_id) {
-    for (int i = 0; i < MAX_TRANSACTIONS; i++) {
-        if (manager->transactions[i].txn_id == txn_id) {
-            return &manager->transactions[i];
-        }
-    }
-    return NULL;
-}
-
-int txn_commit(database_t *db, transaction_id_t txn_id) {
+// Records the outcome of a running transaction and drops it and its
+// snapshot from the running set
+static int txn_finish(database_t *db, transaction_id_t txn_id, transaction_state_t state) {
     if (!db->txn_manager) return -1;
     
     transaction_manager_t *manager = db->txn_manager;
     pthread_mutex_lock(&manager->txn_manager_mutex);
     
-    transaction_t *txn = find_transaction(manager, txn_id);
-    if (!txn) {
+    uint8_t *entry = txn_status_entry(manager, txn_id, 0);
+    if (!entry || *entry != TXN_STATE_ACTIVE + 1) {
         pthread_mutex_unlock(&manager->txn_manager_mutex);
         return -1;
     }
     
-    pthread_mutex_lock(&txn->txn_mutex);
-    if (txn->state != TXN_STATE_ACTIVE) {
-        pthread_mutex_unlock(&txn->txn_mutex);
-        pthread_mutex_unlock(&manager->txn_manager_mutex);
-        return -1;
-    }
+    __atomic_store_n(entry, (uint8_t)(state + 1), __ATOMIC_RELEASE);
     
-    txn->state = TXN_STATE_COMMITTED;
-    pthread_mutex_unlock(&txn->txn_mutex);
+    int i = 0;
+    while (manager->running[i] != txn_id) i++;
+    memmove(&manager->running[i], &manager->running[i + 1],
+            (manager->running_count - i - 1) * sizeof(transaction_id_t));
+    manager->running_count--;
+    
+    transaction_t *txn = &manager->transactions[txn_id % MAX_TRANSACTIONS];
+    snapshot_t *snapshot = txn->snapshot;
+    __atomic_store_n(&txn->snapshot, NULL, __ATOMIC_RELEASE);
     pthread_mutex_unlock(&manager->txn_manager_mutex);
     
+    free(snapshot);
+    
     return 0;
 }
 
+int txn_commit(database_t *db, transaction_id_t txn_id) {
+    return txn_finish(db, txn_id, TXN_STATE_COMMITTED);
+}
+
 int txn_abort(database_t *db, transaction_id_t txn_id) {
-    if (!db->txn_manager) return -1;
-    
+    return txn_finish(db, txn_id, TXN_STATE_ABORTED);
+}
+
+// Oldest transaction that a running transaction may still see as running,
+// or the next id to be handed out when nothing is running. Versions deleted
+// before it are invisible to every current and future snapshot. Snapshots
+// taken later never have an older xmin, so the first running one has it.
+transaction_id_t txn_oldest_active(database_t *db) {
     transaction_manager_t *manager = db->txn_manager;
-    pthread_mutex_lock(&manager->txn_manager_mutex);
+    if (!manager) return UINT64_MAX;
     
-    transaction_t *txn = find_transaction(manager, txn_id);
-    if (!txn) {
-        pthread_mutex_unlock(&manager->txn_manager_mutex);
-        return -1;
+    pthread_mutex_lock(&manager->txn_manager_mutex);
+    transaction_id_t oldest = manager->next_txn_id;
+    if (manager->running_count > 0) {
+        oldest = manager->transactions[manager->running[0] % MAX_TRANSACTIONS].snapshot->xmin;
     }
+    pthread_mutex_unlock(&manager->txn_manager_mutex);
     
-    pthread_mutex_lock(&txn->txn_mutex);
-    if (txn->state != TXN_STATE_ACTIVE) {
-        pthread_mutex_unlock(&txn->txn_mutex);
-        pthread_mutex_unlock(&manager->txn_manager_mutex);
-        return -1;
+    return oldest;
+}
+
+// Transactions of earlier sessions are reported as committed, the same
+// assumption mvcc_is_visible makes for them.
+transaction_state_t txn_get_state(database_t *db, transaction_id_t txn_id) {
+    return txn_status(db->txn_manager, txn_id);
+}
+
+// Copies the snapshot of a running transaction, without locking: its
+// in-progress list stays valid until the transaction ends. Only the
+// transaction's own threads may ask, since the slot of a transaction that
+// has ended is reused. Any other id gets a snapshot in which the
+// transactions below it that have committed so far are visible.
+void txn_snapshot(database_t *db, transaction_id_t txn_id, snapshot_t *snapshot) {
+    transaction_manager_t *manager = db->txn_manager;
+    if (manager && txn_status(manager, txn_id) == TXN_STATE_ACTIVE) {
+        const snapshot_t *taken = __atomic_load_n(&manager->transactions[txn_id % MAX_TRANSACTIONS].snapshot,
+                                                  __ATOMIC_ACQUIRE);
+        if (taken && taken->txn_id == txn_id) {
+            *snapshot = *taken;
+            return;
+        }
     }
     
-    txn->state = TXN_STATE_ABORTED;
-    pthread_mutex_unlock(&txn->txn_mutex);
-    pthread_mutex_unlock(&manager->txn_manager_mutex);
+    snapshot->manager = manager;
+    snapshot->txn_id = txn_id;
+    snapshot->xmin = txn_id;
+    snapshot->xmax = txn_id;
+    snapshot->in_progress_count = 0;
+    snapshot->in_progress = NULL;
+}
+
+// Whether the snapshot sees the changes of the transaction xid
+static int snapshot_sees(const snapshot_t *snapshot, transaction_id_t xid) {
+    if (xid == snapshot->txn_id) return 1;
+    if (xid >= snapshot->xmax) return 0;
     
-    return 0;
+    if (xid >= snapshot->xmin) {
+        int low = 0, high = snapshot->in_progress_count;
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (snapshot->in_progress[mid] < xid) low = mid + 1;
+            else high = mid;
+        }
+        if (low < snapshot->in_progress_count && snapshot->in_progress[low] == xid) return 0;
+    }
+    
+    // Finished before the snapshot was taken; only its outcome is left to read
+    return txn_status(snapshot->manager, xid) == TXN_STATE_COMMITTED;
 }
 
-int mvcc_is_visible(tuple_header_t *header, transaction_id_t txn_id, transaction_manager_t *manager) {
+// A version is visible when the snapshot sees its creator but not its
+// deleter. Takes no lock: the snapshot is fixed, and the outcome of a
+// transaction that finished before it is one atomic load from the status log.
+int mvcc_is_visible(const tuple_header_t *header, const snapshot_t *snapshot) {
     if (header->is_deleted) {
         return 0;
     }
     
-    if (header->xmin > txn_id) {
+    if (!snapshot_sees(snapshot, header->xmin)) {
         return 0;
     }
     
-    pthread_mutex_lock(&manager->txn_manager_mutex);
-    transaction_t *creating_txn = find_transaction(manager, header->xmin);
-    if (creating_txn) {
-        pthread_mutex_lock(&creating_txn->txn_mutex);
-        if (creating_txn->state != TXN_STATE_COMMITTED) {
-            if (creating_txn->txn_id != txn_id) {
-                pthread_mutex_unlock(&creating_txn->txn_mutex);
-                pthread_mutex_unlock(&manager->txn_manager_mutex);
-                return 0;
-            }
-        }
-        pthread_mutex_unlock(&creating_txn->txn_mutex);
-    }
-    
-    if (header->xmax != 0 && header->xmax <= txn_id) {
-        transaction_t *deleting_txn = find_transaction(manager, header->xmax);
-        if (deleting_txn) {
-            pthread_mutex_lock(&deleting_txn->txn_mutex);
-            // If the deleting transaction is the current transaction, tuple is not visible
-            if (deleting_txn->txn_id == txn_id) {
-                pthread_mutex_unlock(&deleting_txn->txn_mutex);
-                pthread_mutex_unlock(&manager->txn_manager_mutex);
-                return 0;
-            }
-            // If the deleting transaction is committed, tuple is not visible
-            if (deleting_txn->state == TXN_STATE_COMMITTED) {
-                pthread_mutex_unlock(&deleting_txn->txn_mutex);
-                pthread_mutex_unlock(&manager->txn_manager_mutex);
-                return 0;
-            }
-            pthread_mutex_unlock(&deleting_txn->txn_mutex);
-        } else {
-            pthread_mutex_unlock(&manager->txn_manager_mutex);
-            return 0;
-        }
-    }
-    
-    pthread_mutex_unlock(&manager->txn_manager_mutex);
-    return 1;
+    return header->xmax == 0 || !snapshot_sees(snapshot, header->xmax);
 }
 
 void mvcc_mark_deleted(tuple_header_t *header, transaction_id_t txn_id) {
@@ -0,0 +1,217 @@
+#include "tinydb.h"
+#include <errno.h>
+
+struct vacuum_worker_s {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int interval_seconds;
+    int stop;
+};
+
+// A version is dead once no current or future transaction can see it:
+// either its creator aborted, or it was deleted by a transaction that
+// committed before the oldest running transaction began. Deletions by
+// aborted transactions are undone in the header as a side effect.
+int vacuum_tuple_is_dead(database_t *db, tuple_header_t *header, transaction_id_t horizon) {
+    if (header->is_deleted) return 1;
+    
+    transaction_state_t creator = txn_get_state(db, header->xmin);
+    if (creator == TXN_STATE_ABORTED) return 1;
+    if (creator == TXN_STATE_ACTIVE) return 0;
+    
+    if (header->xmax == 0) return 0;
+    
+    transaction_state_t deleter = txn_get_state(db, header->xmax);
+    if (deleter == TXN_STATE_ABORTED) {
+        header->xmax = 0;
+        return 0;
+    }
+    
+    return deleter == TXN_STATE_COMMITTED && header->xmax < horizon;
+}
+
+// Keeps the primary index in step with a tuple that VACUUM moved from
+// old_slot to new_slot on the same page, or removed when new_slot is -1.
+// Entries that point elsewhere belong to another version and are left alone.
+int vacuum_index_relocate(database_t *db, table_schema_t *schema, const value_t *key,
+                          page_id_t page_id, slot_id_t old_slot, int new_slot) {
+    page_id_t index_page_id;
+    slot_id_t index_slot;
+    
+    if (btree_search(db, schema->root_page_id, key, &index_page_id, &index_slot) != 0) {
+        return 0;
+    }
+    if (index_page_id != page_id || index_slot != old_slot) {
+        return 0;
+    }
+    
+    if (new_slot < 0) {
+        return btree_delete(db, schema->root_page_id, key);
+    }
+    return btree_update(db, schema->root_page_id, key, page_id, (slot_id_t)new_slot);
+}
+
+static int set_next_page(database_t *db, page_id_t page_id, page_id_t next_page_id) {
+    page_t *page = buffer_get_page(db->buffer_pool, page_id);
+    if (!page) return -1;
+    
+    ((heap_page_header_t*)page->data)->next_page_id = next_page_id;
+    
+    pthread_mutex_lock(&page->page_mutex);
+    page->is_dirty = 1;
+    pthread_mutex_unlock(&page->page_mutex);
+    
+    storage_write_page(db, page_id, page->data);
+    buffer_release_page(db->buffer_pool, page);
+    return 0;
+}
+
+static page_id_t get_next_page(database_t *db, page_id_t page_id) {
+    page_t *page = buffer_get_page(db->buffer_pool, page_id);
+    if (!page) return 0;
+    
+    page_id_t next_page_id = ((heap_page_header_t*)page->data)->next_page_id;
+    buffer_release_page(db->buffer_pool, page);
+    return next_page_id;
+}
+
+static int vacuum_schema(database_t *db, table_schema_t *schema, vacuum_stats_t *stats) {
+    if (schema->storage_type == STORAGE_INDEX) {
+        return btree_row_vacuum(db, schema, stats);
+    }
+    
+    page_id_t prev_page_id = 0;
+    page_id_t page_id = schema->first_page_id;
+    
+    while (page_id != 0) {
+        page_id_t next_page_id = get_next_page(db, page_id);
+        int remaining;
+        
+        if (schema->storage_type == STORAGE_COLUMN) {
+            remaining = columnar_vacuum_page(db, schema, page_id, stats);
+        } else {
+            remaining = heap_vacuum_page(db, schema, page_id, stats);
+        }
+        if (remaining < 0) return -1;
+        stats->pages_scanned++;
+        
+        // Empty pages leave the chain and go to the free list. The last page
+        // stays: it is where the next insert goes.
+        if (remaining == 0 && page_id != schema->last_page_id) {
+            if (prev_page_id == 0) {
+                schema->first_page_id = next_page_id;
+            } else if (set_next_page(db, prev_page_id, next_page_id) != 0) {
+                return -1;
+            }
+            storage_free_page(db, page_id);
+            stats->pages_freed++;
+        } else {
+            prev_page_id = page_id;
+        }
+        
+        page_id = next_page_id;
+    }
+    
+    return 0;
+}
+
+int vacuum_table(database_t *db, const char *table_name, vacuum_stats_t *stats) {
+    table_schema_t *schema = find_table_schema(db, table_name);
+    if (!schema) return -1;
+    
+    memset(stats, 0, sizeof(vacuum_stats_t));
+    stats->horizon = txn_oldest_active(db);
+    
+    int result = vacuum_schema(db, schema, stats);
+    printf("vacuum: Table %s, scanned %d pages, removed %d dead tuples, freed %d pages\n",
+           schema->name, stats->pages_scanned, stats->tuples_removed, stats->pages_freed);
+    return result;
+}
+
+int vacuum_all(database_t *db, vacuum_stats_t *stats) {
+    memset(stats, 0, sizeof(vacuum_stats_t));
+    stats->horizon = txn_oldest_active(db);
+    
+    for (int i = 0; i < db->schema_count; i++) {
+        if (vacuum_schema(db, &db->schemas[i], stats) != 0) {
+            return -1;
+        }
+    }
+    
+    printf("vacuum: Scanned %d pages, removed %d dead tuples, freed %d pages\n",
+           stats->pages_scanned, stats->tuples_removed, stats->pages_freed);
+    return 0;
+}
+
+static void* vacuum_worker_main(void *arg) {
+    database_t *db = (database_t*)arg;
+    struct vacuum_worker_s *worker = db->vacuum_worker;
+    
+    pthread_mutex_lock(&worker->mutex);
+    while (!worker->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += worker->interval_seconds;
+        
+        int rc = 0;
+        while (!worker->stop && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&worker->cond, &worker->mutex, &deadline);
+        }
+        if (worker->stop) break;
+        pthread_mutex_unlock(&worker->mutex);
+        
+        vacuum_stats_t stats;
+        pthread_mutex_lock(&db->statement_mutex);
+        vacuum_all(db, &stats);
+        pthread_mutex_unlock(&db->statement_mutex);
+        
+        pthread_mutex_lock(&worker->mutex);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    
+    return NULL;
+}
+
+int vacuum_start_worker(database_t *db, int interval_seconds) {
+    if (db->vacuum_worker || interval_seconds <= 0) return -1;
+    
+    struct vacuum_worker_s *worker = malloc(sizeof(struct vacuum_worker_s));
+    if (!worker) return -1;
+    
+    worker->interval_seconds = interval_seconds;
+    worker->stop = 0;
+    pthread_mutex_init(&worker->mutex, NULL);
+    pthread_cond_init(&worker->cond, NULL);
+    db->vacuum_worker = worker;
+    
+    if (pthread_create(&worker->thread, NULL, vacuum_worker_main, db) != 0) {
+        db->vacuum_worker = NULL;
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->mutex);
+        free(worker);
+        return -1;
+    }
+    
+    printf("vacuum: Background worker started (every %d seconds)\n", interval_seconds);
+    return 0;
+}
+
+void vacuum_stop_worker(database_t *db) {
+    struct vacuum_worker_s *worker = db->vacuum_worker;
+    if (!worker) return;
+    
+    pthread_mutex_lock(&worker->mutex);
+    worker->stop = 1;
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+    
+    pthread_join(worker->thread, NULL);
+    
+    db->vacuum_worker = NULL;
+    pthread_cond_destroy(&worker->cond);
+    pthread_mutex_destroy(&worker->mutex);
+    free(worker);
+    
+    printf("vacuum: Background worker stopped\n");
+}